@@ -0,0 +1,203 @@
+/**
+ * @file batch.c
+ * @brief batch planner, groups mixed jobs into buckets of one symbology and length
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbology.h"
+#include "trace.h"
+#include "batch.h"
+
+//bucket key: symbology << BATCH_LEN_BITS | input length, longer inputs share the last length
+#define BATCH_LEN_BITS		12
+#define BATCH_LEN_MAX		((1 << BATCH_LEN_BITS) - 1)
+#define BATCH_KEY_BITS		16
+//radix sort digit
+#define BATCH_RADIX_BITS	8
+#define BATCH_RADIX			(1 << BATCH_RADIX_BITS)
+
+//items encoded a time inside a bucket, a multiple of the lane kernel width
+#define BATCH_CHUNK			256
+//items planned together, small enough for their inputs and rows to stay in
+//cache while every bucket of the window walks over them
+#define BATCH_WINDOW		4096
+
+//buckets of the jobs that are not encoded, past every symbology
+#define BATCH_KEY_UNKNOWN	((u32)SYMBOLOGY_NUM << BATCH_LEN_BITS)
+#define BATCH_KEY_REFUSED	((u32)(SYMBOLOGY_NUM + 1) << BATCH_LEN_BITS)
+
+static u32 batch_key(s32 symbology, const s8 *input) {
+	size_t len;
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM || input == NULL) {
+		//unknown jobs get a bucket of their own and fail there
+		return BATCH_KEY_UNKNOWN;
+	}
+	//the encoders print what they refuse, such input never reaches them
+	if (symbology_check(symbology, input) <= 0) {
+		return BATCH_KEY_REFUSED;
+	}
+	len = strlen(input);
+	if (len > BATCH_LEN_MAX) {
+		len = BATCH_LEN_MAX;
+	}
+	return ((u32)symbology << BATCH_LEN_BITS) | (u32)len;
+}
+
+//stable LSD radix sort of item indexes by key, perm[] gets the order
+static void batch_sort(const u32 *key, s32 count, s32 *perm, s32 *tmp) {
+	s32 histogram[BATCH_RADIX];
+	s32 *from = perm;
+	s32 *to = tmp;
+	s32 *swap;
+	s32 shift, i, sum, digit;
+
+	for (i = 0; i < count; i++) {
+		perm[i] = i;
+	}
+	//BATCH_KEY_BITS / BATCH_RADIX_BITS is even, the last pass writes perm
+	for (shift = 0; shift < BATCH_KEY_BITS; shift += BATCH_RADIX_BITS) {
+		memset(histogram, 0, sizeof(histogram));
+		for (i = 0; i < count; i++) {
+			histogram[(key[from[i]] >> shift) & (BATCH_RADIX - 1)]++;
+		}
+		for (i = 0, sum = 0; i < BATCH_RADIX; i++) {
+			digit = histogram[i];
+			histogram[i] = sum;
+			sum += digit;
+		}
+		for (i = 0; i < count; i++) {
+			to[histogram[(key[from[i]] >> shift) & (BATCH_RADIX - 1)]++] = from[i];
+		}
+		swap = from;
+		from = to;
+		to = swap;
+	}
+}
+
+//plan and encode window items starting at first
+static s32 batch_encode_window(const s32 *symbology, const s8 *const *input, s32 first, s32 window,
+		u8 *output, s32 stride, s32 *bits, s32 *checksum, u32 *key, s32 *perm, s32 *tmp, u8 *chunk_output,
+		FILE *diag) {
+	const s8 *chunk_input[BATCH_CHUNK];
+	s32 chunk_bits[BATCH_CHUNK];
+	s32 chunk_checksum[BATCH_CHUNK];
+	s32 encoded = 0;
+	s32 begin, end, pos, num, sym, item, i;
+
+	//classify and group
+	for (i = 0; i < window; i++) {
+		key[i] = batch_key(symbology[first + i], input[first + i]);
+	}
+	batch_sort(key, window, perm, tmp);
+
+	for (begin = 0; begin < window; begin = end) {
+		for (end = begin + 1; end < window && key[perm[end]] == key[perm[begin]]; end++)
+			;
+		sym = key[perm[begin]] >> BATCH_LEN_BITS;
+		if (sym >= SYMBOLOGY_NUM) {
+			for (i = begin; i < end; i++) {
+				item = first + perm[i];
+				if (diag != NULL && sym == SYMBOLOGY_NUM) {
+					fprintf(diag, "%s %d item %d unknown symbology:%d\n",__func__,__LINE__,item,
+							symbology[item]);
+				} else if (diag != NULL) {
+					fprintf(diag, "%s %d item %d %s refused:%s\n",__func__,__LINE__,item,
+							symbology_name(symbology[item]), input[item]);
+				}
+				memset(output + (size_t)item * stride, 0, stride);
+				bits[item] = 0;
+				checksum[item] = -1;
+			}
+			continue;
+		}
+
+		for (pos = begin; pos < end; pos += num) {
+			num = (end - pos < BATCH_CHUNK) ? (end - pos) : BATCH_CHUNK;
+			//gather
+			for (i = 0; i < num; i++) {
+				chunk_input[i] = input[first + perm[pos + i]];
+			}
+			encoded += symbology_encode_batch(sym, chunk_input, num, chunk_output, stride,
+					chunk_bits, chunk_checksum);
+			//scatter back to the original order
+			for (i = 0; i < num; i++) {
+				item = first + perm[pos + i];
+				if (chunk_bits[i] > 0) {
+					memcpy(output + (size_t)item * stride, chunk_output + (size_t)i * stride, stride);
+				} else {
+					memset(output + (size_t)item * stride, 0, stride);
+				}
+				bits[item] = chunk_bits[i];
+				checksum[item] = chunk_checksum[i];
+			}
+		}
+	}
+	return encoded;
+}
+
+/**
+ * @brief encode a mixed batch, results come back in the original order
+ *
+ * items are planned in windows of BATCH_WINDOW: bucketed by symbology and
+ * input length, every bucket encoded in chunks by symbology_encode_batch()
+ * (lane kernels for EAN-13/UPC-A) and scattered back through the permutation
+ * index. The planner memory is fixed, any number of items can be streamed.
+ * Every item is checked by symbology_check() first, what an encoder would
+ * refuse is reported on diag and never encoded, so nothing goes to stdout.
+ *
+ * @param symbology: count SYMBOLOGY_XXX
+ * @param input: count input strings
+ * @param count: number of items
+ * @param output: count packed rows, stride bytes apart
+ * @param stride: bytes per row, a row that does not fit is an error
+ * @param bits: count lengths of coded data(modules), 0 on error
+ * @param checksum: count check digits, -1 when there is none
+ * @param diag: unknown symbologies and refused inputs, one line each; NULL for none
+ *
+ * @return number of items encoded, -1 on error
+ */
+s32 batch_encode(const s32 *symbology, const s8 *const *input, s32 count, u8 *output, s32 stride,
+		s32 *bits, s32 *checksum, FILE *diag) {
+	u8 *chunk_output = NULL;
+	u32 *key = NULL;
+	s32 *perm = NULL;
+	s32 *tmp = NULL;
+	s32 encoded = -1;
+	s32 first, window;
+
+	if (symbology == NULL || input == NULL || output == NULL || bits == NULL ||
+			checksum == NULL || count < 0 || stride <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	key = (u32*)malloc(sizeof(*key) * BATCH_WINDOW);
+	perm = (s32*)malloc(sizeof(*perm) * BATCH_WINDOW);
+	tmp = (s32*)malloc(sizeof(*tmp) * BATCH_WINDOW);
+	chunk_output = (u8*)malloc((size_t)stride * BATCH_CHUNK);
+	if (key == NULL || perm == NULL || tmp == NULL || chunk_output == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		goto end;
+	}
+
+	encoded = 0;
+	for (first = 0; first < count; first += window) {
+		window = (count - first < BATCH_WINDOW) ? (count - first) : BATCH_WINDOW;
+		encoded += batch_encode_window(symbology, input, first, window, output, stride,
+				bits, checksum, key, perm, tmp, chunk_output, diag);
+	}
+
+end:
+	free(key);
+	free(perm);
+	free(tmp);
+	free(chunk_output);
+	return encoded;
+}
@@ -0,0 +1,19 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+s32 batch_encode(const s32 *symbology, const s8 *const *input, s32 count, u8 *output, s32 stride,
+		s32 *bits, s32 *checksum, FILE *diag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,579 @@
+/**
+ * @file cache.c
+ * @brief printer resident graphics: download a raster once(ZPL ~DG, TSPL DOWNLOAD), then recall it by name
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pack.h"
+#include "zpl.h"
+#include "native.h"
+#include "symbology.h"
+#include "trace.h"
+#include "cache.h"
+
+#define CACHE_HASH_SEED		0x9E3779B97F4A7C15ULL
+#define CACHE_HASH_MUL		0xFF51AFD7ED558CCDULL
+
+//a command without its data at most
+#define CACHE_COMMAND_LEN	64
+#define CACHE_NAME_LEN		16
+
+//monochrome BMP: file header, info header and a 2 color palette
+#define BMP_HEADER_LEN		62
+
+static inline u64 cache_mix(u64 h, u64 w) {
+	h = (h ^ w) * CACHE_HASH_MUL;
+	return h ^ (h >> 29);
+}
+
+/**
+ * @brief hash of a packed bitmap, a word at a time
+ *
+ * the dots past width in the last byte of a row don't count
+ *
+ * @param bitmap: packed rows, first dot is the MSB
+ * @param width: dots per row
+ * @param rows: number of rows
+ * @param stride: bytes between rows, 0 repeats one row
+ *
+ * @return hash
+ */
+u64 cache_hash(const u8 *bitmap, s32 width, s32 rows, s32 stride) {
+	s32 bytes = pack_len(width);
+	u8 last = (width & 7) ? (u8)(0xFF << (8 - (width & 7))) : 0xFF;
+	u64 h = cache_mix(CACHE_HASH_SEED, ((u64)width << 32) | (u32)rows);
+	const u8 *row;
+	u64 w;
+	s32 r, k;
+
+	if (bitmap == NULL || bytes <= 0) {
+		return h;
+	}
+	for (r = 0; r < rows; r++) {
+		row = bitmap + (size_t)r * stride;
+		for (k = 0; k + 8 < bytes; k += 8) {
+			memcpy(&w, row + k, 8);
+			h = cache_mix(h, w);
+		}
+		//the last word holds the cut byte
+		w = 0;
+		memcpy(&w, row + k, bytes - k);
+		((u8*)&w)[bytes - k - 1] &= last;
+		h = cache_mix(h, w);
+	}
+	return h;
+}
+
+//printer memory a graphic takes: the bitmap for ZPL, the BMP file for TSPL
+static s32 cache_bytes(s32 dialect, s32 width, s32 rows) {
+	if (dialect == NATIVE_TSPL) {
+		return BMP_HEADER_LEN + ((width + 31) >> 5) * 4 * rows;
+	}
+	return pack_len(width) * rows;
+}
+
+/**
+ * @brief track the graphics of one printer
+ *
+ * @param dialect: NATIVE_ZPL or NATIVE_TSPL, ESC/POS has no named graphics
+ * @param budget: printer memory for graphics in bytes
+ * @param capacity: graphics at most
+ * @param fp: the printer, a file or pipe stands in for it; NULL when every label
+ * brings its own, see native_write_cached()
+ *
+ * @return 0, -1 on error
+ */
+s32 cache_init(struct cache *cache, s32 dialect, s64 budget, s32 capacity, FILE *fp) {
+	s32 slots = 1;
+
+	if (cache == NULL || (dialect != NATIVE_ZPL && dialect != NATIVE_TSPL) || budget <= 0 ||
+			capacity <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(cache, 0, sizeof(*cache));
+	//at most half full, probes stay short
+	while (slots < (capacity << 1)) {
+		slots <<= 1;
+	}
+	cache->entry = (struct cache_entry*)calloc(capacity, sizeof(struct cache_entry));
+	cache->slot = (s32*)malloc(slots * sizeof(s32));
+	if (cache->entry == NULL || cache->slot == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		cache_free(cache);
+		return -1;
+	}
+	cache->dialect = dialect;
+	cache->fp = fp;
+	cache->budget = budget;
+	cache->capacity = capacity;
+	cache->slot_mask = slots - 1;
+	cache->next_name = 1;
+	cache_forget(cache);
+	return 0;
+}
+
+void cache_free(struct cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	cache_forget(cache);
+	free(cache->entry);
+	free(cache->slot);
+	cache->entry = NULL;
+	cache->slot = NULL;
+}
+
+//the printer lost its graphics(power cycle, memory cleared), nothing is resident
+void cache_forget(struct cache *cache) {
+	s32 i;
+	if (cache == NULL || cache->entry == NULL) {
+		return;
+	}
+	for (i = 0; i < cache->capacity; i++) {
+		free(cache->entry[i].raster);
+		cache->entry[i].raster = NULL;
+		cache->entry[i].next = (i + 1 < cache->capacity) ? i + 1 : -1;
+	}
+	for (i = 0; cache->slot != NULL && i <= cache->slot_mask; i++) {
+		cache->slot[i] = -1;
+	}
+	cache->free = 0;
+	cache->count = 0;
+	cache->used = 0;
+	cache->head = -1;
+	cache->tail = -1;
+}
+
+//name of a graphic in the printer: "R:G0000001.GRF" or "G0000001.BMP"
+s32 cache_name(const struct cache *cache, u32 name, s8 *out, s32 out_size) {
+	if (cache == NULL || out == NULL) {
+		return -1;
+	}
+	if (cache->dialect == NATIVE_ZPL) {
+		return snprintf(out, out_size, "R:G%07X.GRF", name & 0xFFFFFFF);
+	}
+	return snprintf(out, out_size, "G%07X.BMP", name & 0xFFFFFFF);
+}
+
+static void cache_unlink(struct cache *cache, s32 i) {
+	struct cache_entry *e = &cache->entry[i];
+	if (e->prev >= 0) {
+		cache->entry[e->prev].next = e->next;
+	} else {
+		cache->head = e->next;
+	}
+	if (e->next >= 0) {
+		cache->entry[e->next].prev = e->prev;
+	} else {
+		cache->tail = e->prev;
+	}
+}
+
+static void cache_push(struct cache *cache, s32 i) {
+	struct cache_entry *e = &cache->entry[i];
+	e->prev = -1;
+	e->next = cache->head;
+	if (cache->head >= 0) {
+		cache->entry[cache->head].prev = i;
+	} else {
+		cache->tail = i;
+	}
+	cache->head = i;
+}
+
+//dot for dot the graphic of entry e, its hash and size already match
+static s32 cache_same(const struct cache_entry *e, const u8 *bitmap, s32 stride) {
+	s32 bytes = pack_len(e->width);
+	u8 last = (e->width & 7) ? (u8)(0xFF << (8 - (e->width & 7))) : 0xFF;
+	const u8 *row, *copy;
+	s32 r;
+
+	for (r = 0; r < e->rows; r++) {
+		row = bitmap + (size_t)r * stride;
+		copy = e->raster + (size_t)r * bytes;
+		if (memcmp(row, copy, bytes - 1) != 0 || (row[bytes - 1] & last) != copy[bytes - 1]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//slot of the graphic, or of the empty slot it would take
+static s32 cache_find(const struct cache *cache, u64 hash, const u8 *bitmap, s32 width, s32 rows, s32 stride) {
+	s32 s = (s32)(hash & cache->slot_mask);
+	const struct cache_entry *e;
+	while (cache->slot[s] >= 0) {
+		e = &cache->entry[cache->slot[s]];
+		if (e->hash == hash && e->width == width && e->rows == rows && cache_same(e, bitmap, stride)) {
+			break;
+		}
+		s = (s + 1) & cache->slot_mask;
+	}
+	return s;
+}
+
+//slot holding entry i
+static s32 cache_slot(const struct cache *cache, s32 i) {
+	s32 s = (s32)(cache->entry[i].hash & cache->slot_mask);
+	while (cache->slot[s] != i) {
+		s = (s + 1) & cache->slot_mask;
+	}
+	return s;
+}
+
+//keep the raster of entry e for cache_same()
+static s32 cache_keep(struct cache_entry *e, const u8 *bitmap, s32 stride) {
+	s32 bytes = pack_len(e->width);
+	u8 last = (e->width & 7) ? (u8)(0xFF << (8 - (e->width & 7))) : 0xFF;
+	s32 r;
+
+	e->raster = (u8*)malloc((size_t)bytes * e->rows);
+	if (e->raster == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (r = 0; r < e->rows; r++) {
+		memcpy(e->raster + (size_t)r * bytes, bitmap + (size_t)r * stride, bytes);
+		e->raster[(size_t)r * bytes + bytes - 1] &= last;
+	}
+	return 0;
+}
+
+//empty slot s, later entries of the probe run move back so lookups still find them
+static void cache_remove_slot(struct cache *cache, s32 s) {
+	s32 j = s;
+	s32 home;
+	cache->slot[s] = -1;
+	for (;;) {
+		j = (j + 1) & cache->slot_mask;
+		if (cache->slot[j] < 0) {
+			break;
+		}
+		home = (s32)(cache->entry[cache->slot[j]].hash & cache->slot_mask);
+		//move unless home lies cyclically in (s, j]
+		if ((s <= j) ? (home <= s || home > j) : (home <= s && home > j)) {
+			cache->slot[s] = cache->slot[j];
+			cache->slot[j] = -1;
+			s = j;
+		}
+	}
+}
+
+static s32 cache_write(struct cache *cache, const void *data, s32 len) {
+	if (len < 0 || fwrite(data, 1, len, cache->fp) != (size_t)len) {
+		printf("%s %d write err\n",__func__,__LINE__);
+		return -1;
+	}
+	cache->bytes_sent += len;
+	return len;
+}
+
+//delete the least recently used graphic from the printer
+static s32 cache_evict(struct cache *cache) {
+	s8 name[CACHE_NAME_LEN];
+	s8 command[CACHE_COMMAND_LEN];
+	s32 i = cache->tail;
+	s32 len;
+
+	cache_name(cache, cache->entry[i].name, name, sizeof(name));
+	if (cache->dialect == NATIVE_ZPL) {
+		len = snprintf(command, sizeof(command), "^ID%s^FS", name);
+	} else {
+		len = snprintf(command, sizeof(command), "KILL \"%s\"\r\n", name);
+	}
+	cache_remove_slot(cache, cache_slot(cache, i));
+	cache_unlink(cache, i);
+	free(cache->entry[i].raster);
+	cache->entry[i].raster = NULL;
+	cache->entry[i].next = cache->free;
+	cache->free = i;
+	cache->used -= cache->entry[i].bytes;
+	cache->count--;
+	cache->evictions++;
+	return cache_write(cache, command, len);
+}
+
+//ZPL ~DG with ACS data
+static s32 cache_download_zpl(struct cache *cache, const s8 *name, const u8 *bitmap, s32 width, s32 rows,
+		s32 stride) {
+	s32 bytes = pack_len(width);
+	s32 size = zpl_compress_len(bytes, rows) + CACHE_COMMAND_LEN;
+	s8 *text = (s8*)malloc(size);
+	s32 len, data;
+
+	if (text == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	len = snprintf(text, CACHE_COMMAND_LEN, "~DG%s,%d,%d,", name, bytes * rows, bytes);
+	data = zpl_compress(bitmap, bytes, rows, stride, text + len, size - len);
+	len = (data < 0) ? -1 : cache_write(cache, text, len + data);
+	free(text);
+	return len;
+}
+
+//TSPL DOWNLOAD of a monochrome BMP, bottom row first, palette 0 black
+static s32 cache_download_tspl(struct cache *cache, const s8 *name, const u8 *bitmap, s32 width, s32 rows,
+		s32 stride) {
+	s32 bytes = pack_len(width);
+	s32 bmp_row = ((width + 31) >> 5) * 4;
+	s32 size = BMP_HEADER_LEN + bmp_row * rows;
+	u8 last = (width & 7) ? (u8)(0xFF >> (width & 7)) : 0;
+	s8 command[CACHE_COMMAND_LEN];
+	u8 *bmp = (u8*)malloc(size);
+	u8 *p;
+	s32 r, i, len;
+
+	if (bmp == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(bmp, 0, BMP_HEADER_LEN);
+	bmp[0] = 'B'; bmp[1] = 'M';
+	for (i = 0; i < 4; i++) {
+		bmp[2 + i] = size >> (i << 3);
+		bmp[10 + i] = BMP_HEADER_LEN >> (i << 3);
+		bmp[14 + i] = 40 >> (i << 3);
+		bmp[18 + i] = width >> (i << 3);
+		bmp[22 + i] = rows >> (i << 3);
+		bmp[34 + i] = (bmp_row * rows) >> (i << 3);
+	}
+	bmp[26] = 1;	//planes
+	bmp[28] = 1;	//bits per pixel
+	bmp[58] = 0xFF; bmp[59] = 0xFF; bmp[60] = 0xFF;	//color 1 white
+	for (r = 0; r < rows; r++) {
+		p = bmp + BMP_HEADER_LEN + (size_t)(rows - 1 - r) * bmp_row;
+		for (i = 0; i < bytes; i++) {
+			p[i] = ~bitmap[(size_t)r * stride + i];
+		}
+		p[bytes - 1] |= last;
+		memset(p + bytes, 0xFF, bmp_row - bytes);
+	}
+	len = snprintf(command, sizeof(command), "DOWNLOAD \"%s\",%d,", name, size);
+	if (cache_write(cache, command, len) < 0 || cache_write(cache, bmp, size) < 0 ||
+			cache_write(cache, "\r\n", 2) < 0) {
+		len = -1;
+	} else {
+		len += size + 2;
+	}
+	free(bmp);
+	return len;
+}
+
+/**
+ * @brief place a graphic on the label: recall it when the printer holds it,
+ * otherwise download it first, deleting least recently used graphics until
+ * it fits the budget
+ *
+ * a graphic bigger than the whole budget goes out inline, see native_bitmap();
+ * the host keeps a copy of every resident raster, a hit compares it dot for dot
+ *
+ * @param bitmap: packed rows, first dot is the MSB
+ * @param width: dots per row
+ * @param rows: number of rows
+ * @param stride: bytes between rows, 0 repeats one row
+ * @param x: field origin
+ * @param y: field origin
+ *
+ * @return bytes written, -1 on error
+ */
+s32 cache_place(struct cache *cache, const u8 *bitmap, s32 width, s32 rows, s32 stride, s32 x, s32 y) {
+	s8 name[CACHE_NAME_LEN];
+	s8 command[CACHE_COMMAND_LEN];
+	struct cache_entry *e;
+	s32 bytes = pack_len(width);
+	s32 sent = 0;
+	s32 len, s, i;
+	u64 hash;
+
+	if (cache == NULL || cache->entry == NULL || cache->fp == NULL || bitmap == NULL || bytes <= 0 || rows <= 0 ||
+			stride < 0 || (stride > 0 && stride < bytes)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	hash = cache_hash(bitmap, width, rows, stride);
+	s = cache_find(cache, hash, bitmap, width, rows, stride);
+	i = cache->slot[s];
+	if (i >= 0) {
+		cache->hits++;
+		cache_unlink(cache, i);
+		cache_push(cache, i);
+	} else {
+		cache->misses++;
+		bytes = cache_bytes(cache->dialect, width, rows);
+		if (bytes > cache->budget) {
+			len = native_bitmap(cache->dialect, bitmap, width, rows, stride, x, y, cache->fp);
+			if (len > 0) {
+				cache->bytes_sent += len;
+			}
+			return len;
+		}
+		while (cache->count > 0 && (cache->used + bytes > cache->budget || cache->count == cache->capacity)) {
+			len = cache_evict(cache);
+			if (len < 0) {
+				return -1;
+			}
+			sent += len;
+		}
+		//eviction moved slots around
+		s = cache_find(cache, hash, bitmap, width, rows, stride);
+		i = cache->free;
+		e = &cache->entry[i];
+		cache->free = e->next;
+		e->hash = hash;
+		e->width = width;
+		e->rows = rows;
+		e->bytes = bytes;
+		e->name = cache->next_name++;
+		cache_name(cache, e->name, name, sizeof(name));
+		if (cache_keep(e, bitmap, stride) < 0) {
+			len = -1;
+		} else if (cache->dialect == NATIVE_ZPL) {
+			len = cache_download_zpl(cache, name, bitmap, width, rows, stride);
+		} else {
+			len = cache_download_tspl(cache, name, bitmap, width, rows, stride);
+		}
+		if (len < 0) {
+			free(e->raster);
+			e->raster = NULL;
+			e->next = cache->free;
+			cache->free = i;
+			return -1;
+		}
+		sent += len;
+		cache->slot[s] = i;
+		cache->used += bytes;
+		cache->count++;
+		cache_push(cache, i);
+	}
+	cache_name(cache, cache->entry[i].name, name, sizeof(name));
+	if (cache->dialect == NATIVE_ZPL) {
+		len = snprintf(command, sizeof(command), "^FO%d,%d^XG%s,1,1^FS", x, y, name);
+	} else {
+		len = snprintf(command, sizeof(command), "PUTBMP %d,%d,\"%s\"\r\n", x, y, name);
+	}
+	len = cache_write(cache, command, len);
+	return (len < 0) ? -1 : sent + len;
+}
+
+//cache_selftest(): graphics of CACHE_TEST_WIDTH x CACHE_TEST_ROWS dots, the budget holds two
+#define CACHE_TEST_WIDTH	100
+#define CACHE_TEST_BYTES	((CACHE_TEST_WIDTH + 7) / 8)
+#define CACHE_TEST_ROWS		20
+
+//len bytes at data hold text
+static s32 cache_selftest_has(const u8 *data, s32 len, const s8 *text) {
+	s32 n = strlen(text), i;
+	for (i = 0; i + n <= len; i++) {
+		if (memcmp(data + i, text, n) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//place graphic g(0-3, 3 is over the budget) and check it was a hit or not
+static s32 cache_selftest_place(struct cache *cache, const u8 *graphic, s32 g, s32 hit) {
+	u64 hits = cache->hits;
+	s32 rows = (g == 3) ? CACHE_TEST_ROWS * 4 : CACHE_TEST_ROWS;
+	s32 len = cache_place(cache, graphic + g * CACHE_TEST_BYTES, CACHE_TEST_WIDTH, rows,
+			(g == 3) ? 0 : 4 * CACHE_TEST_BYTES, 10, 10);
+	if (len <= 0 || (cache->hits > hits) != hit || cache->used > cache->budget) {
+		printf("%s %d %s graphic %d len:%d hit:%d used:%lld\n",__func__,__LINE__,native_name(cache->dialect),g,
+				len,(s32)(cache->hits - hits),(long long)cache->used);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief graphics into a spool file under a budget of two: hits only recall,
+ * misses download, the least recently used one is deleted to make room, one
+ * over the budget goes inline; a raster label through native_write_cached()
+ * is downloaded once
+ *
+ * @return 0 when both dialects behave, -1 otherwise
+ */
+s32 cache_selftest(void) {
+	static const s32 dialects[2] = {NATIVE_ZPL, NATIVE_TSPL};
+	struct native_field field = {0, 0, 20, 2, 0};
+	struct cache cache;
+	u8 graphic[4 * CACHE_TEST_BYTES * CACHE_TEST_ROWS];
+	u8 *spool = NULL;
+	s8 name[CACHE_NAME_LEN];
+	s8 command[CACHE_COMMAND_LEN];
+	FILE *fp = NULL;
+	s32 ret = 0;
+	s32 d, i, len, first;
+
+	//four graphics interleaved row by row, stride 4 rows
+	for (i = 0; i < (s32)sizeof(graphic); i++) {
+		graphic[i] = (u8)(i * 37 + (i / CACHE_TEST_BYTES) * 11);
+	}
+	for (d = 0; d < 2 && ret == 0; d++) {
+		fp = tmpfile();
+		if (fp == NULL || cache_init(&cache, dialects[d], 2 * cache_bytes(dialects[d], CACHE_TEST_WIDTH,
+				CACHE_TEST_ROWS) + 1, 8, fp) < 0) {
+			printf("%s %d err\n",__func__,__LINE__);
+			if (fp != NULL) {
+				fclose(fp);
+			}
+			return -1;
+		}
+		//miss, hit, miss, hit(0 is the newest now), miss evicting 1, hit 0,
+		//miss 1 evicting 2, over the budget: inline and never resident
+		if (cache_selftest_place(&cache, graphic, 0, 0) < 0 || cache_selftest_place(&cache, graphic, 0, 1) < 0 ||
+				cache_selftest_place(&cache, graphic, 1, 0) < 0 || cache_selftest_place(&cache, graphic, 0, 1) < 0 ||
+				cache_selftest_place(&cache, graphic, 2, 0) < 0 || cache_selftest_place(&cache, graphic, 0, 1) < 0 ||
+				cache_selftest_place(&cache, graphic, 1, 0) < 0 || cache_selftest_place(&cache, graphic, 3, 0) < 0 ||
+				cache_selftest_place(&cache, graphic, 3, 0) < 0) {
+			ret = -1;
+		}
+		if (ret == 0 && (cache.hits != 3 || cache.misses != 6 || cache.evictions != 2 || cache.count != 2)) {
+			printf("%s %d hits:%llu misses:%llu evictions:%llu\n",__func__,__LINE__,(unsigned long long)cache.hits,
+					(unsigned long long)cache.misses,(unsigned long long)cache.evictions);
+			ret = -1;
+		}
+		//a Code 11 label is a bitmap in both dialects, the second one only recalls it
+		first = native_write_cached(dialects[d], SYMBOLOGY_CODE11, "0123-4", &field, &cache, fp);
+		len = native_write_cached(dialects[d], SYMBOLOGY_CODE11, "0123-4", &field, &cache, fp);
+		if (ret == 0 && (first <= 0 || len <= 0 || len >= CACHE_COMMAND_LEN || len >= first)) {
+			printf("%s %d raster label:%d then %d bytes\n",__func__,__LINE__,first,len);
+			ret = -1;
+		}
+		//what the spool got: every byte counted, graphic 2 and then 1 deleted
+		fflush(fp);
+		len = ftell(fp);
+		spool = (u8*)malloc(len);
+		rewind(fp);
+		if (ret == 0 && (spool == NULL || len != (s32)cache.bytes_sent || fread(spool, 1, len, fp) != (size_t)len)) {
+			printf("%s %d spool:%d sent:%llu\n",__func__,__LINE__,len,(unsigned long long)cache.bytes_sent);
+			ret = -1;
+		}
+		for (i = 2; ret == 0 && i <= 3; i++) {
+			cache_name(&cache, i, name, sizeof(name));
+			snprintf(command, sizeof(command), (dialects[d] == NATIVE_ZPL) ? "^ID%s^FS" : "KILL \"%s\"", name);
+			if (!cache_selftest_has(spool, len, command)) {
+				printf("%s %d no %s\n",__func__,__LINE__,command);
+				ret = -1;
+			}
+		}
+		free(spool);
+		cache_free(&cache);
+		fclose(fp);
+	}
+	return ret;
+}
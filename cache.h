@@ -0,0 +1,65 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//one graphic resident in the printer
+struct cache_entry {
+	u64 hash;
+	s32 width;
+	s32 rows;
+	//printer memory it takes
+	s32 bytes;
+	//stored as G + 7 hex digits, see cache_name()
+	u32 name;
+	//packed rows without padding, the dots past width cleared; equal hashes
+	//only make a hit when the rasters match too
+	u8 *raster;
+	//LRU list, -1 ends it; next also links free entries
+	s32 prev;
+	s32 next;
+};
+
+//graphics one printer holds, rasters are sent once and recalled by name
+struct cache {
+	s32 dialect;
+	FILE *fp;
+	//printer memory for graphics and what the resident ones take
+	s64 budget;
+	s64 used;
+	struct cache_entry *entry;
+	s32 capacity;
+	s32 count;
+	s32 free;
+	//most and least recently used
+	s32 head;
+	s32 tail;
+	//open addressed hash -> entry, -1 is empty
+	s32 *slot;
+	s32 slot_mask;
+	u32 next_name;
+	u64 hits;
+	u64 misses;
+	u64 evictions;
+	u64 bytes_sent;
+};
+
+u64 cache_hash(const u8 *bitmap, s32 width, s32 rows, s32 stride);
+s32 cache_init(struct cache *cache, s32 dialect, s64 budget, s32 capacity, FILE *fp);
+void cache_free(struct cache *cache);
+s32 cache_name(const struct cache *cache, u32 name, s8 *out, s32 out_size);
+s32 cache_place(struct cache *cache, const u8 *bitmap, s32 width, s32 rows, s32 stride, s32 x, s32 y);
+void cache_forget(struct cache *cache);
+s32 cache_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * @file check.c
+ * @brief check digits shared by the symbologies, batch validation on the kernels
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "trace.h"
+#include "check.h"
+
+//steps of a scheme, each is one weighted sum
+enum {
+	CHECK_STEP_MOD10 = 0,
+	CHECK_STEP_LUHN,
+	CHECK_STEP_MOD11,
+	CHECK_STEP_NUM
+};
+
+//IBM mod 11 weights 2-7
+#define CHECK_MOD11_WEIGHT	7
+
+//inputs of check_batch() going through the kernel a time
+#define CHECK_CHUNK			256
+
+struct check_scheme {
+	s32 first;
+	//-1 when the scheme has one check character
+	s32 second;
+};
+
+static const struct check_scheme check_schemes[CHECK_NUM] = {
+	{CHECK_STEP_MOD10, -1},
+	{CHECK_STEP_LUHN, -1},
+	{CHECK_STEP_MOD11, -1},
+	{CHECK_STEP_LUHN, CHECK_STEP_LUHN},
+	{CHECK_STEP_MOD11, CHECK_STEP_LUHN}
+};
+
+//right aligned records, position 15 is the rightmost data digit
+static const struct kernel_check_weights check_weights[CHECK_STEP_NUM] = {
+	{{1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3}, {0}},
+	{{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+		{0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF}},
+	{{5, 4, 3, 2, 7, 6, 5, 4, 3, 2, 7, 6, 5, 4, 3, 2}, {0}}
+};
+
+//weighted sum of the digits of a then b, walking from the right; -1 on a non-digit
+static s32 check_sum(s32 step, const s8 *a, s32 a_len, const s8 *b, s32 b_len) {
+	s32 sum = 0;
+	s32 pos, v;
+	for (pos = 0; pos < a_len + b_len; pos++) {
+		v = (pos < b_len) ? b[b_len - 1 - pos] : a[a_len + b_len - 1 - pos];
+		v -= '0';
+		if (v < 0 || v > 9) {
+			return -1;
+		}
+		if (step == CHECK_STEP_MOD10) {
+			sum += v * ((pos & 1) ? 1 : 3);
+		} else if (step == CHECK_STEP_LUHN) {
+			sum += (pos & 1) ? v : ((v << 1) - ((v > 4) ? 9 : 0));
+		} else {
+			sum += v * (2 + pos % (CHECK_MOD11_WEIGHT - 1));
+		}
+	}
+	return sum;
+}
+
+static s32 check_finish(s32 step, s32 sum) {
+	if (sum < 0) {
+		return -1;
+	}
+	if (step == CHECK_STEP_MOD11) {
+		return (11 - sum % 11) % 11;
+	}
+	return (10 - sum % 10) % 10;
+}
+
+//check value as characters, 10 is written "10"
+static s32 check_put(s32 value, s8 *check) {
+	if (value > 9) {
+		check[0] = '0' + value / 10;
+		check[1] = '0' + value % 10;
+		return 2;
+	}
+	check[0] = '0' + value;
+	return 1;
+}
+
+//GS1 mod 10 check digit of len digits, -1 on a non-digit
+s32 check_mod10(const s8 *input, s32 len) {
+	return check_finish(CHECK_STEP_MOD10, check_sum(CHECK_STEP_MOD10, input, len, NULL, 0));
+}
+
+//Luhn(MSI mod 10) check digit of len digits, -1 on a non-digit
+s32 check_luhn(const s8 *input, s32 len) {
+	return check_finish(CHECK_STEP_LUHN, check_sum(CHECK_STEP_LUHN, input, len, NULL, 0));
+}
+
+/**
+ * @brief mod 11 check of len digits, weights 2 to max_weight from the right
+ *
+ * @param max_weight: 7 for IBM, 9 for NCR
+ *
+ * @return check value 0-10, -1 on a non-digit
+ */
+s32 check_mod11(const s8 *input, s32 len, s32 max_weight) {
+	s32 sum = 0;
+	s32 pos, v;
+	for (pos = 0; pos < len; pos++) {
+		v = input[len - 1 - pos] - '0';
+		if (v < 0 || v > 9) {
+			return -1;
+		}
+		sum += v * (2 + pos % (max_weight - 1));
+	}
+	return (11 - sum % 11) % 11;
+}
+
+/**
+ * @brief weighted sum of symbol values modulo modulus, weights 1 to max_weight from the right
+ *
+ * code93 C(20, 47) and K(15, 47), code11 C(10, 11) and K(9, 11)
+ *
+ * @param value: symbol values, not characters
+ *
+ * @return check value
+ */
+s32 check_weighted(const s8 *value, s32 len, s32 max_weight, s32 modulus) {
+	s32 sum = 0;
+	s32 pos;
+	for (pos = 0; pos < len; pos++) {
+		sum += value[len - 1 - pos] * (1 + pos % max_weight);
+	}
+	return sum % modulus;
+}
+
+/**
+ * @brief check characters of a scheme
+ *
+ * @param scheme: CHECK_XXX
+ * @param input: digits
+ * @param len: number of digits
+ * @param check: check characters, at least CHECK_MAX_LEN + 1
+ *
+ * @return number of check characters, -1 on error
+ */
+s32 check_append(s32 scheme, const s8 *input, s32 len, s8 *check) {
+	const struct check_scheme *s = NULL;
+	s32 value, n;
+
+	if (scheme < 0 || scheme >= CHECK_NUM || input == NULL || check == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	s = &check_schemes[scheme];
+	value = check_finish(s->first, check_sum(s->first, input, len, NULL, 0));
+	if (value < 0) {
+		return -1;
+	}
+	n = check_put(value, check);
+	if (s->second >= 0) {
+		value = check_finish(s->second, check_sum(s->second, input, len, check, n));
+		n += check_put(value, check + n);
+	}
+	check[n] = '\0';
+	return n;
+}
+
+//one input without the kernel, see check_batch()
+static s32 check_item(s32 scheme, s32 validate, const s8 *input) {
+	s8 check[CHECK_MAX_LEN + 1];
+	s32 len = strlen(input);
+	s32 n;
+
+	if (len == 0 || kernel_check_digits(input, len) != len) {
+		return -1;
+	}
+	if (!validate) {
+		return (check_append(scheme, input, len, check) > 0) ? atoi(check) : -1;
+	}
+	//mod 11 checks are one or two characters
+	for (n = 1; n <= CHECK_MAX_LEN && n < len; n++) {
+		if (check_append(scheme, input, len - n, check) == n && memcmp(check, input + len - n, n) == 0) {
+			return 1;
+		}
+	}
+	return (len > 1) ? 0 : -1;
+}
+
+//one step over the records, right aligned check values go back into them for the next step
+static void check_step(s32 step, u8 *record, s32 n, u32 *sum, s32 *value, s32 shift) {
+	u8 *rec;
+	s32 i, width;
+	kernel_check_sums(record, n, &check_weights[step], sum);
+	for (i = 0; i < n; i++) {
+		value[i] = check_finish(step, sum[i]);
+		if (shift) {
+			rec = record + i * KERNEL_CHECK_LEN;
+			width = (value[i] > 9) ? 2 : 1;
+			memmove(rec, rec + width, KERNEL_CHECK_LEN - width);
+			if (width == 2) {
+				rec[KERNEL_CHECK_LEN - 2] = value[i] / 10;
+			}
+			rec[KERNEL_CHECK_LEN - 1] = value[i] % 10;
+		}
+	}
+}
+
+/**
+ * @brief compute or validate the check characters of many inputs, nothing is encoded
+ *
+ * inputs of up to 14 data digits are zero padded into right aligned records
+ * and summed by the check kernel of this machine, a chunk at a time; longer
+ * inputs and mod 11 validation(one or two check characters) run scalar
+ *
+ * @param scheme: CHECK_XXX
+ * @param validate: 0: inputs are data, 1: inputs end with their check characters
+ * @param input: count digit strings
+ * @param count: number of inputs
+ * @param result: validate 1 valid, 0 wrong check; compute the check characters
+ *				read as a decimal number; -1 for an input that is not digits
+ *
+ * @return number of valid inputs(validate) or of computed checks, -1 on error
+ */
+s32 check_batch(s32 scheme, s32 validate, const s8 *const *input, s32 count, s32 *result) {
+	u8 record[CHECK_CHUNK * KERNEL_CHECK_LEN];
+	u32 sum[CHECK_CHUNK];
+	s32 first[CHECK_CHUNK];
+	s32 second[CHECK_CHUNK];
+	s32 item[CHECK_CHUNK];
+	s32 expect[CHECK_CHUNK];
+	const struct check_scheme *s = NULL;
+	const s8 *in = NULL;
+	s32 fixed, len, data_len, base, n, i, k, value;
+	s32 done = 0;
+
+	if (scheme < 0 || scheme >= CHECK_NUM || input == NULL || result == NULL || count < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	s = &check_schemes[scheme];
+	//check characters a validated input ends with, 0 when not known up front
+	fixed = (s->first == CHECK_STEP_MOD11 || !validate) ? 0 : ((s->second >= 0) ? 2 : 1);
+
+	for (base = 0; base < count; base += CHECK_CHUNK) {
+		n = 0;
+		for (i = base; i < count && i < base + CHECK_CHUNK; i++) {
+			in = input[i];
+			len = (in != NULL) ? strlen(in) : 0;
+			data_len = len - fixed;
+			//two more digits for the second step
+			if (in == NULL || (validate && fixed == 0) || data_len < 1 || data_len + 2 > KERNEL_CHECK_LEN ||
+					kernel_load_record(in, data_len, record + n * KERNEL_CHECK_LEN) < 0) {
+				result[i] = (in != NULL) ? check_item(scheme, validate, in) : -1;
+				done += (result[i] > (validate ? 0 : -1));
+				continue;
+			}
+			//the check characters to compare with, as a number
+			for (k = data_len, value = 0; k < len; k++) {
+				value = value * 10 + (in[k] - '0');
+				if (in[k] < '0' || in[k] > '9') {
+					value = -1;
+					break;
+				}
+			}
+			expect[n] = value;
+			item[n++] = i;
+		}
+
+		check_step(s->first, record, n, sum, first, s->second >= 0);
+		if (s->second >= 0) {
+			check_step(s->second, record, n, sum, second, 0);
+		}
+		//a mod 11 first value of 10 comes here too: check_step() shifted both of its digits
+		//in for the second step, and first * 10 + second still reads as the decimal "10x"
+		for (k = 0; k < n; k++) {
+			value = (s->second >= 0) ? (first[k] * 10 + second[k]) : first[k];
+			if (!validate) {
+				result[item[k]] = value;
+				done++;
+			} else {
+				result[item[k]] = (expect[k] < 0) ? -1 : (value == expect[k]);
+				done += (value == expect[k]);
+			}
+		}
+	}
+	return done;
+}
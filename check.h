@@ -0,0 +1,35 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//check digit schemes of check_append() and check_batch()
+enum {
+	CHECK_GS1 = 0,		//EAN/UPC/GTIN/SSCC mod 10, weights 3,1 from the right
+	CHECK_MSI_MOD10,	//Luhn
+	CHECK_MSI_MOD11,	//IBM weights 2-7 from the right, 10 is written "10"
+	CHECK_MSI_MOD1010,	//mod 10, then mod 10 over data and first check
+	CHECK_MSI_MOD1110,	//mod 11, then mod 10 over data and first check
+	CHECK_NUM
+};
+
+//check characters of a scheme at most
+#define CHECK_MAX_LEN		3
+
+s32 check_mod10(const s8 *input, s32 len);
+s32 check_luhn(const s8 *input, s32 len);
+s32 check_mod11(const s8 *input, s32 len, s32 max_weight);
+s32 check_weighted(const s8 *value, s32 len, s32 max_weight, s32 modulus);
+s32 check_append(s32 scheme, const s8 *input, s32 len, s8 *check);
+s32 check_batch(s32 scheme, s32 validate, const s8 *const *input, s32 count, s32 *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
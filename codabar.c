@@ -11,20 +11,10 @@
 #include <string.h>
 
 #include "codabar.h"
+#include "trace.h"
 
 //https://en.wikipedia.org/wiki/Codabar
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-//#define CODABAR_APPEND_BLANK
-
-#ifdef CODABAR_APPEND_BLANK
-#define CODABAR_BLANK_LEN			10
-#endif
-
 #define CODABAR_PATTERN_NUM			20
 #define CODABAR_PATTERN_LEN			9
 #define CODABAR_PATTERN_LEN_10		10
@@ -60,9 +50,6 @@ static const s32 codabar_pattern[] = {
 
 static s32 codabar_mapping_code(const s8 str) {
 	s32 i = CODABAR_PATTERN_NUM - 1;
-#ifdef DEBUG
-	printf("%c ",str);
-#endif
 	while(i > -1) {
 		if (str == codabar_table[i]) {
 			return i;
@@ -91,18 +78,10 @@ static s32 codabar_append_pattern(s32 index, s8 *out) {
 	} else {
 		pattern_len = CODABAR_PATTERN_LEN;
 	}
-#ifdef DEBUG
-	printf("index:%d->",index);
-#endif
+	TRACE_SYMBOL("codabar", index, pattern);
 	for (i = pattern_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return pattern_len;
 }
 
@@ -118,6 +97,37 @@ s32 codabar_max_len(const s8 *input) {
 	return len;
 }
 
+//exact length of the coded data, 0 when input can't be encoded
+s32 codabar_width(const s8 *input) {
+	s32 input_len, len, index, i;
+	if (input == NULL) {
+		return 0;
+	}
+	input_len = strlen(input);
+	if (input_len < 1 || *input < 'A' || *input > 'D' || *(input+input_len-1) < 'A' || *(input+input_len-1) > 'D') {
+		return 0;
+	}
+	//gap between characters
+	len = input_len - 1;
+	for (i = 0; i < input_len; i++) {
+		index = codabar_mapping_code(*(input+i));
+		if (index < 0) {
+			return 0;
+		}
+		if (index == CODABAR_PATTERN_NUM - 1) {
+			len += CODABAR_PATTERN_LEN_12;
+		} else if (index > 11) {
+			len += CODABAR_PATTERN_LEN_10;
+		} else {
+			len += CODABAR_PATTERN_LEN;
+		}
+	}
+#ifdef CODABAR_APPEND_BLANK
+	len += (CODABAR_BLANK_LEN << 1);
+#endif
+	return len;
+}
+
 s32 codabar_encode(const s8 *input, s8 *output) {
 
 	s32 barcode_len = 0;
@@ -128,13 +138,16 @@ s32 codabar_encode(const s8 *input, s8 *output) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("codabar", input);
 
 	if (*input < 'A' || *input > 'D' || *(input+input_len-1) < 'A' || *(input+input_len-1) > 'D') {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 
@@ -150,6 +163,7 @@ s32 codabar_encode(const s8 *input, s8 *output) {
 		index = codabar_mapping_code(*(input+i));
 		if (index < 0) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			barcode_len = 0;
 			goto end;
 		} else {
@@ -4,11 +4,26 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+//#define CODABAR_APPEND_BLANK
+
+#ifdef CODABAR_APPEND_BLANK
+#define CODABAR_BLANK_LEN			10
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef CODABAR_APPEND_BLANK
+#define CODABAR_QUIET_LEN		(CODABAR_BLANK_LEN << 1)
+#else
+#define CODABAR_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 codabar_max_len(const s8 *input);
+s32 codabar_width(const s8 *input);
 s32 codabar_encode(const s8 *input, s8 *output);
 
 #ifdef __cplusplus
@@ -11,20 +11,10 @@
 #include <string.h>
 
 #include "code11.h"
+#include "trace.h"
 
 //https://en.wikipedia.org/wiki/Code_11
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-//#define CODE11_APPEND_BLANK
-
-#ifdef CODE11_APPEND_BLANK
-#define CODE11_BLANK_LEN		10
-#endif
-
 #define CODE11_PATTERN_NUM		12
 #define CODE11_PATTERN_LEN		7
 #define CODE11_MARKER_INDEX		8
@@ -50,9 +40,6 @@ static const s32 code11_pattern[] = {
 
 static s32 code11_mapping_code(const s8 str) {
 	s32 i = CODE11_PATTERN_NUM - 1;
-#ifdef DEBUG
-	printf("%c ",str);
-#endif
 	while(i > -1) {
 		if (str == code11_table[i]) {
 			return i;
@@ -75,18 +62,10 @@ static s32 code11_append_pattern(s32 index, s8 *out) {
 	s32 pattern = code11_pattern[index];
 	if (index > CODE11_MARKER_INDEX)
 		pattern_len--;
-#ifdef DEBUG
-	printf("index:%d->",index);
-#endif
+	TRACE_SYMBOL("code11", index, pattern);
 	for (i = pattern_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return pattern_len;
 }
 
@@ -103,6 +82,28 @@ s32 code11_max_len(const s8 *input) {
 	return len;
 }
 
+//exact length of the coded data, 0 when input can't be encoded
+s32 code11_width(const s8 *input) {
+	s32 len = 0;
+	s32 index;
+	if (input == NULL) {
+		return 0;
+	}
+	//start, stop and the gap after each data
+	len = (CODE11_PATTERN_LEN << 1) + strlen(input) + 1;
+	for (; *input != '\0'; input++) {
+		index = code11_mapping_code(*input);
+		if (index < 0) {
+			return 0;
+		}
+		len += (index > CODE11_MARKER_INDEX) ? (CODE11_PATTERN_LEN - 1) : CODE11_PATTERN_LEN;
+	}
+#ifdef CODE11_APPEND_BLANK
+	len += (CODE11_BLANK_LEN << 1);
+#endif
+	return len;
+}
+
 s32 code11_encode(const s8 *input, s8 *output) {
 
 	s32 barcode_len = 0;
@@ -113,9 +114,11 @@ s32 code11_encode(const s8 *input, s8 *output) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("code11", input);
 
 #ifdef CODE11_APPEND_BLANK
 	//append left blank
@@ -124,9 +127,6 @@ s32 code11_encode(const s8 *input, s8 *output) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("* ");
-#endif
 	//append start code
 	append_len = code11_append_pattern(CODE11_MARKER_INDEX, output);
 	output += append_len;
@@ -140,6 +140,7 @@ s32 code11_encode(const s8 *input, s8 *output) {
 		index = code11_mapping_code(*(input+i));
 		if (index < 0) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			barcode_len = 0;
 			goto end;
 		} else {
@@ -152,9 +153,6 @@ s32 code11_encode(const s8 *input, s8 *output) {
 		}
 	}
 
-#ifdef DEBUG
-	printf("* ");
-#endif
 	//append stop code
 	append_len = code11_append_pattern(CODE11_MARKER_INDEX, output);
 	output += append_len;
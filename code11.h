@@ -4,11 +4,26 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+//#define CODE11_APPEND_BLANK
+
+#ifdef CODE11_APPEND_BLANK
+#define CODE11_BLANK_LEN		10
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef CODE11_APPEND_BLANK
+#define CODE11_QUIET_LEN		(CODE11_BLANK_LEN << 1)
+#else
+#define CODE11_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 code11_max_len(const s8 *input);
+s32 code11_width(const s8 *input);
 s32 code11_encode(const s8 *input, s8 *output);
 
 #ifdef __cplusplus
@@ -11,15 +11,11 @@
 #include <string.h>
 
 #include "code128.h"
+#include "trace.h"
 
 //https://en.wikipedia.org/wiki/Code_128
 
-#if 0
-#define DEBUG
-#endif
-
 //bits len
-#define CODE128_QUIET_ZONE_LEN	10
 #define CODE128_CODE_LEN		11
 #define CODE128_STOP_CODE_LEN	13
 
@@ -34,6 +30,11 @@
 
 #define CODE128_FNC1_CODE		"[FNC1]"
 
+//suffixes shorter than this are normalized on the stack, not malloc()
+#define CODE128_RESUME_STACK	256
+//prefix characters that decide the start code
+#define CODE128_PREFIX_START_LEN	5
+
 
 
 //FNC1-4 are not in ascii, defined here
@@ -263,6 +264,7 @@ static s32 code128_mapping_switch_code(s32 prev_mode, s32 next_mode) {
 static s32 code128_append_pattern(s32 index, s32 pattern_length, s8 *out) {
 	int i;
 	s32 pattern = code128_pattern[index];
+	TRACE_SYMBOL("code128", index, pattern);
 	for (i = pattern_length; i > 0; i--)
 		*out++ = (pattern & (1 << (i-1))) ? 1 : 0;
 	return pattern_length;
@@ -274,10 +276,12 @@ static s32 code128_append_quiet_zone(s8 *out) {
 }
 
 static s32 code128_append_check_code(s32 sum, s8 *out) {
+	TRACE_CHECKSUM("code128", sum % 103);
 	return code128_append_pattern((sum % 103), CODE128_CODE_LEN, out);
 }
 
 static s32 code128_append_start_code(s32 start_index, s8 *out) {
+	TRACE_CODE_SET(0, start_index - CODE128_START_A_INDEX + CODE128_MODE_A, start_index);
 	return code128_append_pattern(start_index, CODE128_CODE_LEN, out);
 }
 
@@ -294,7 +298,7 @@ s32 code128_max_len(const s8 *input) {
 	if (input != NULL) {
 		len = CODE128_QUIET_ZONE_LEN
 			+ CODE128_CODE_LEN //start code
-			+ CODE128_CODE_LEN * (strlen(input) * 11 / 10) // contents + 10% padding
+			+ CODE128_CODE_LEN * (strlen(input) << 1) // contents, a switch code per character at worst
 			+ CODE128_CODE_LEN //check code
 			+ CODE128_STOP_CODE_LEN
 			+ CODE128_QUIET_ZONE_LEN;
@@ -302,71 +306,97 @@ s32 code128_max_len(const s8 *input) {
 	return len;
 }
 
-/**
-* @brief encode input by code128
-*
-* @param input: input strings
-* @param output: coded data,format is binary array
-*
-* @return length of coded data
-*/
-s32 code128_encode(const s8 *input, s8 *output) {
+//running state of the encoder
+struct code128_state {
+	//NULL only counts the symbols, see code128_width()
+	s8 *output;
+	//current code set
+	s32 mode;
+	s32 checksum;
+	//weight of the next symbol in the checksum
+	s32 count;
+	//optional symbol log, source offsets are in the caller's input
+	struct code128_symbol *symbol;
+	s32 symbol_num;
+	s32 symbol_size;
+	const s8 *str;
+	const s32 *raw;
+	//only measuring, see code128_width(): a refused input is an answer, not an error
+	s32 quiet;
+};
 
-	s8 *p = NULL;
-	s8 *pos_i = NULL;
-	s8 *str = NULL;
-	s32 prev_mode = CODE128_MODE_C;
-	s32 next_mode  = CODE128_MODE_C;
-	s32 append_len = 0;
-	s32 barcode_len = 0;
-	s32 input_len = 0;
-	s32 str_len = 0;
-	s32 checksum = 0;
-	s32 count = 1;
-	s32 index = 0;
-	s32 switch_index = 0;
-	s32 digits = 0;
-	s32 i = 0;
+static void code128_log(struct code128_state *state, s32 index, const s8 *pos, s32 chars) {
+	struct code128_symbol *symbol;
+	if (state->symbol == NULL) {
+		return;
+	}
+	if (state->symbol_num < state->symbol_size) {
+		symbol = &state->symbol[state->symbol_num];
+		symbol->value = index;
+		symbol->source = (pos != NULL) ? state->raw[pos - state->str] : -1;
+		symbol->chars = chars;
+	}
+	state->symbol_num++;
+}
 
-	if (input == NULL || output == NULL) {
-		printf("%s %d err\n",__func__,__LINE__);
-		goto end;
+static void code128_emit_start(struct code128_state *state, s32 start_index) {
+	if (state->output != NULL) {
+		state->output += code128_append_start_code(start_index, state->output);
 	}
-	input_len = strlen(input);
-	str = (s8*)malloc(input_len + 1);
-	if (str == NULL) {
-		printf("%s %d err\n",__func__,__LINE__);
-		goto end;
+	state->checksum += start_index;
+	code128_log(state, start_index, NULL, 0);
+}
+
+//data or switch code, chars input characters from pos(NULL for a switch code)
+static void code128_emit(struct code128_state *state, s32 index, const s8 *pos, s32 chars) {
+	if (state->output != NULL) {
+		state->output += code128_append_data_code(index, state->output);
 	}
-	//GS1-128 compatible and removes spaces
-	if (strncmp(input, CODE128_FNC1_CODE, 6) == 0) {
-#ifdef DEBUG
-		printf("GS1-128\n");
-#endif
-		p = str;
-		*p++ = CODE128_FNC1;
-		input += 6;
-		while (*input != '\0') {
-			if (*input != ' ') {
-				*p++ = *input++;
-			} else {
-				input++;
-			}
+	state->checksum += (index * (state->count++));
+	code128_log(state, index, pos, chars);
+}
+
+/**
+ * @brief copy input to str, raw[] gets the input offset of every character
+ *
+ * GS1-128 compatible: a leading "[FNC1]" makes the input GS1-128, where every
+ * "[FNC1]" becomes FNC1(a field separator after the first one) and spaces
+ * are removed
+ *
+ * @param gs1: in: remove spaces anyway, out: set for GS1-128 input
+ *
+ * @return length of str
+ */
+static s32 code128_normalize(const s8 *input, s8 *str, s32 *raw, s32 *gs1) {
+	s8 *p = str;
+	s32 i = 0;
+	while (input[i] != '\0') {
+		if ((i == 0 || *gs1) && strncmp(input + i, CODE128_FNC1_CODE, 6) == 0) {
+			*gs1 = 1;
+			raw[p - str] = i;
+			*p++ = CODE128_FNC1;
+			i += 6;
+			continue;
 		}
-		*p = '\0';
-	} else {
-		memcpy(str, input, input_len);
-		*(str+input_len) = '\0';
+		if (!*gs1 || input[i] != ' ') {
+			raw[p - str] = i;
+			*p++ = input[i];
+		}
+		i++;
 	}
-	str_len = strlen(str);
-	pos_i = str;
-#ifdef DEBUG
-	printf("str(%d):%s\n",str_len,str);
-#endif
+	*p = '\0';
+	return p - str;
+}
+
+//quiet zone, start code and the first data character, returns the next character
+static s8 *code128_encode_start(struct code128_state *state, s8 *pos_i, s32 input_len) {
+	s8 *p = pos_i;
+	s32 index = 0;
 
 	//append quiet zone
-	append_len = code128_append_quiet_zone(output);
-	output += append_len;
+	if (state->output != NULL) {
+		state->output += code128_append_quiet_zone(state->output);
+	}
 
 	//append start character
 	if (input_len == 2 || (input_len > 3 && code128_check_digit(pos_i, 4) > 3)) {
@@ -376,113 +406,78 @@ s32 code128_encode(const s8 *input, s8 *output) {
 	}
 	if (index > -1) {
 		//start C
+		state->mode = CODE128_MODE_C;
+		code128_emit_start(state, CODE128_START_C_INDEX);
 		if (index == 102) {
-#ifdef DEBUG
-			printf("start C with FNC1\n");
-			printf("code C:%c idx:%d\n",*(pos_i),index);
-#endif
 			//start with [FNC1]
-			prev_mode = CODE128_MODE_C;
-			append_len = code128_append_start_code(CODE128_START_C_INDEX, output);
-			output += append_len;
-			checksum += CODE128_START_C_INDEX;
-			//append FNC1
-			append_len = code128_append_data_code(index, output);
-			output += append_len;
-			checksum += (index * (count++));
+			code128_emit(state, index, pos_i, 1);
 			pos_i += 1;
 			index = code128_mapping_c(pos_i);
-#ifdef DEBUG
-			printf("code C:%c%c idx:%d\n",*(pos_i),*(pos_i+1),index);
-#endif
-			pos_i += 2;
-		} else {
-#ifdef DEBUG
-			printf("start C\n");
-			printf("code C:%c%c idx:%d\n",*(pos_i),*(pos_i+1),index);
-#endif
-			pos_i += 2;
-
-			prev_mode = CODE128_MODE_C;
-			append_len = code128_append_start_code(CODE128_START_C_INDEX, output);
-			output += append_len;
-			checksum += CODE128_START_C_INDEX;
 		}
+		p = pos_i;
+		pos_i += 2;
 	} else {
 		index = code128_mapping_b(pos_i);
 		if (index > -1) {
-#ifdef DEBUG
-			printf("start B\n");
-			printf("code B:%c idx:%d\n",*(pos_i),index);
-#endif
 			//start B
 			pos_i += 1;
-			prev_mode = CODE128_MODE_B;
-			append_len = code128_append_start_code(CODE128_START_B_INDEX, output);
-			output += append_len;
-			checksum += CODE128_START_B_INDEX;
+			state->mode = CODE128_MODE_B;
+			code128_emit_start(state, CODE128_START_B_INDEX);
 		} else {
 			index = code128_mapping_a(pos_i);
 			if (index > -1) {
-#ifdef DEBUG
-			printf("start A\n");
-			printf("code A:%c idx:%d\n",*(pos_i),index);
-#endif
 				//start A
 				pos_i += 1;
-				prev_mode = CODE128_MODE_A;
-				append_len = code128_append_start_code(CODE128_START_A_INDEX, output);
-				output += append_len;
-				checksum += CODE128_START_A_INDEX;
+				state->mode = CODE128_MODE_A;
+				code128_emit_start(state, CODE128_START_A_INDEX);
 			} else {
-				printf("%s %d err\n",__func__,__LINE__);
-				barcode_len = 0;
-				goto end;
+				if (!state->quiet) {
+					printf("%s %d err\n",__func__,__LINE__);
+					TRACE_ERROR();
+				}
+				return NULL;
 			}
 		}
 	}
 
 	//append first data character
-	append_len = code128_append_data_code(index, output);
-	output += append_len;
-	checksum += (index * (count++));
-	next_mode = prev_mode;
+	code128_emit(state, index, p, pos_i - p);
+	return pos_i;
+}
+
+//data characters from pos_i on, str_len is the length of the whole data
+static s32 code128_encode_data(struct code128_state *state, s8 *pos_i, s32 str_len) {
+	s8 *p = NULL;
+	s32 prev_mode = state->mode;
+	s32 next_mode = state->mode;
+	s32 index = 0;
+	s32 switch_index = 0;
+	s32 digits = 0;
+	s32 i = 0;
 
 	//continues append data character
 	while(*pos_i != '\0') {
 		if (prev_mode < CODE128_MODE_C) {
 			//middle of data (surrounded by characters from code set A or B). need digits >= 6
 			digits = code128_check_digit(pos_i, 6);
-			//printf("pos:%c pos-1:%c pos+1(digits):%d pos-1(digits):%d\n",*pos_i,*(pos_i-1),code128_check_digit(pos_i+1, 6),code128_check_digit(pos_i-1,1));
 			//such as 'abc000000', split to 'abc'+'000000'
-			if (digits > 3 && (code128_check_digit(pos_i+1,(str_len-count-2)%2)) != 0 /*&& code128_check_digit(pos_i-1,1) == 0*/) {
+			if (digits > 3 && (code128_check_digit(pos_i+1,(str_len-state->count-2)%2)) != 0) {
 				next_mode = CODE128_MODE_C;
-#ifdef DEBUG
-				printf("next digits:");
-				for(i=0;i<digits;i++)
-					printf("%c",*(pos_i+i));
-				printf("\n");
-#endif
 				switch_index = code128_mapping_switch_code(prev_mode, next_mode);
-#ifdef DEBUG
-				printf("code %c to %c idx:%d pattern:%x\n",(prev_mode==1)?('A'):((prev_mode==2)?('B'):('C')),
-						(next_mode==1)?('A'):((next_mode==2)?('B'):('C')),switch_index,code128_pattern[switch_index]);
-#endif
-				append_len = code128_append_data_code(switch_index, output);
-				output += append_len;
+				TRACE_CODE_SET(prev_mode, next_mode, switch_index);
+				code128_emit(state, switch_index, NULL, 0);
 				prev_mode = next_mode;
-				checksum += (switch_index * (count++));
 
+				//FNC1 in front of the digits is a symbol of its own
+				if (*pos_i == CODE128_FNC1) {
+					code128_emit(state, 102, pos_i, 1);
+					pos_i += 1;
+				}
 				for(i=0; i<(digits>>1); i++) {
 					index = code128_mapping_c(pos_i);
-#ifdef DEBUG
-					printf("code-C:%c%c idx:%d\n",*pos_i,*(pos_i+1),index);
-#endif
 					//code C
+					code128_emit(state, index, pos_i, 2);
 					pos_i += 2;
-					append_len = code128_append_data_code(index, output);
-					output += append_len;
-					checksum += (index * (count++));
 				}
 				continue;
 			} else {
@@ -492,78 +487,340 @@ s32 code128_encode(const s8 *input, s8 *output) {
 		} else {
 			index = code128_mapping_c(pos_i);
 		}
+		p = pos_i;
 		if (index > -1) {
-#ifdef DEBUG
-			printf("code C:%c%c idx:%d\n",*pos_i,*(pos_i+1),index);
-#endif
-			//code C
-			pos_i += 2;
+			//code C, digit pair or FNC1
+			pos_i += (index == 102) ? 1 : 2;
 			next_mode = CODE128_MODE_C;
 		} else {
 			index = code128_mapping_b(pos_i);
 			if (index > -1) {
-#ifdef DEBUG
-				printf("code B:%c idx:%d\n",*pos_i,index);
-#endif
 				//code B
 				pos_i += 1;
 				next_mode = CODE128_MODE_B;
 			} else {
 				index = code128_mapping_a(pos_i);
 				if (index > -1) {
-#ifdef DEBUG
-					printf("code A:%c idx:%d\n",*pos_i,index);
-#endif
 					//code A
 					pos_i += 1;
 					next_mode = CODE128_MODE_A;
 				} else {
-					printf("%s %d err\n",__func__,__LINE__);
-					barcode_len = 0;
-					goto end;
+					if (!state->quiet) {
+						printf("%s %d err\n",__func__,__LINE__);
+						TRACE_ERROR();
+					}
+					return -1;
 				}
 			}
 		}
 		//will change code set, append switch code
 		if (prev_mode != next_mode) {
 			switch_index = code128_mapping_switch_code(prev_mode, next_mode);
-#ifdef DEBUG
-			printf("code %c to %c idx:%d pattern:%x\n",(prev_mode==1)?('A'):((prev_mode==2)?('B'):('C')),
-					(next_mode==1)?('A'):((next_mode==2)?('B'):('C')),switch_index,code128_pattern[switch_index]);
-#endif
-			append_len = code128_append_data_code(switch_index, output);
-			output += append_len;
+			TRACE_CODE_SET(prev_mode, next_mode, switch_index);
+			code128_emit(state, switch_index, NULL, 0);
 			prev_mode = next_mode;
-			checksum += (switch_index * (count++));
 		}
 
-		append_len = code128_append_data_code(index, output);
-		output += append_len;
-		checksum += (index * (count++));
+		code128_emit(state, index, p, pos_i - p);
 	}
+	state->mode = prev_mode;
+	return 0;
+}
 
-	//append check character
-	append_len = code128_append_check_code(checksum, output);
-	output += append_len;
-	count++;
+//check character, stop character and quiet zone, returns length of coded data
+static s32 code128_encode_stop(struct code128_state *state) {
+	if (state->output != NULL) {
+		//append check character
+		state->output += code128_append_check_code(state->checksum, state->output);
 
-	//append stop character
-	append_len = code128_append_stop_code(output);
-	output += append_len;
+		//append stop character
+		state->output += code128_append_stop_code(state->output);
 
-	//append quiet zone
-	append_len = code128_append_quiet_zone(output);
-	output += append_len;
+		//append quiet zone
+		state->output += code128_append_quiet_zone(state->output);
+	}
+	state->count++;
 
 	//count = start code + data code + check code
-	barcode_len = count*CODE128_CODE_LEN + CODE128_STOP_CODE_LEN + (CODE128_QUIET_ZONE_LEN << 1);
-#ifdef DEBUG
-	printf("barcode len:%d\n",barcode_len);
-#endif
+	return state->count*CODE128_CODE_LEN + CODE128_STOP_CODE_LEN + (CODE128_QUIET_ZONE_LEN << 1);
+}
+
+/**
+* @brief encode input by code128
+*
+* @param input: input strings
+* @param output: coded data,format is binary array
+*
+* @return length of coded data
+*/
+s32 code128_encode(const s8 *input, s8 *output) {
+	return code128_encode_symbols(input, output, NULL, NULL, 0);
+}
+
+//symbols into output(NULL: none written), returns length of coded data
+static s32 code128_run(const s8 *input, s8 *output, struct code128_symbol *symbol, s32 *symbol_num, s32 symbol_size) {
+
+	struct code128_state state;
+	s8 *pos_i = NULL;
+	s8 *str = NULL;
+	s32 *raw = NULL;
+	s32 barcode_len = 0;
+	s32 input_len = 0;
+	s32 str_len = 0;
+	s32 gs1 = 0;
+
+	input_len = strlen(input);
+	if (input_len == 0) {
+		//the start character would take the NUL as data
+		if (output != NULL || symbol != NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+		}
+		return 0;
+	}
+	str = (s8*)malloc(input_len + 1);
+	raw = (s32*)malloc((input_len + 1) * sizeof(s32));
+	if (str == NULL || raw == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		goto end;
+	}
+	str_len = code128_normalize(input, str, raw, &gs1);
+	if (output != NULL) {
+		TRACE_SYMBOL_START("code128", str);
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.output = output;
+	state.count = 1;
+	state.symbol = symbol;
+	state.symbol_size = symbol_size;
+	state.str = str;
+	state.raw = raw;
+	state.quiet = (output == NULL && symbol == NULL);
+
+	pos_i = code128_encode_start(&state, str, input_len);
+	if (pos_i == NULL || code128_encode_data(&state, pos_i, str_len) < 0) {
+		barcode_len = 0;
+		goto end;
+	}
+	barcode_len = code128_encode_stop(&state);
+
+	if (symbol_num != NULL) {
+		*symbol_num = state.symbol_num;
+	}
 end:
 	if (str != NULL) {
 		free(str);
 		str = NULL;
 	}
+	if (raw != NULL) {
+		free(raw);
+		raw = NULL;
+	}
 	return barcode_len;
 }
+
+/**
+* @brief encode input by code128, and log the symbols
+*
+* symbol i(start code is 0) is at modules code128_symbol_offset(i), the check
+* character follows the last one
+*
+* @param input: input strings
+* @param output: coded data,format is binary array
+* @param symbol: symbol log without check and stop character, may be NULL
+* @param symbol_num: number of symbols, may be more than symbol_size
+* @param symbol_size: size of symbol
+*
+* @return length of coded data
+*/
+s32 code128_encode_symbols(const s8 *input, s8 *output, struct code128_symbol *symbol, s32 *symbol_num, s32 symbol_size) {
+	if (input == NULL || output == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	return code128_run(input, output, symbol, symbol_num, symbol_size);
+}
+
+/**
+* @brief exact length of the coded data, the code sets are chosen as by
+* code128_encode() but no module is written
+*
+* @param input: input strings
+*
+* @return length of coded data, 0 when input can't be encoded
+*/
+s32 code128_width(const s8 *input) {
+	if (input == NULL) {
+		return 0;
+	}
+	return code128_run(input, NULL, NULL, NULL, 0);
+}
+
+/**
+* @brief symbols as code128_encode_symbols() chooses them, no module is
+* written; printers that draw code128 themselves take these code sets
+*
+* @param input: input strings
+* @param symbol: symbol log without check and stop character
+* @param symbol_num: number of symbols, may be more than symbol_size
+* @param symbol_size: size of symbol
+*
+* @return length of coded data, 0 when input can't be encoded
+*/
+s32 code128_symbols(const s8 *input, struct code128_symbol *symbol, s32 *symbol_num, s32 symbol_size) {
+	if (input == NULL || symbol == NULL || symbol_num == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	return code128_run(input, NULL, symbol, symbol_num, symbol_size);
+}
+
+/**
+* @brief encode the constant leading part of labels, see code128_encode_resume()
+*
+* @param prefix: leading input strings, may start with "[FNC1]"
+* @param output: coded data,format is binary array, keeps the prefix modules
+* @param snapshot: encoder state after the prefix
+*
+* @return modules of the prefix, 0 on error
+*/
+s32 code128_encode_prefix(const s8 *prefix, s8 *output, struct code128_prefix *snapshot) {
+	struct code128_state state;
+	s8 *pos_i = NULL;
+	s8 *str = NULL;
+	s32 *raw = NULL;
+	s32 input_len = 0;
+	s32 run = 0;
+	s32 pending = 0;
+	s32 gs1 = 0;
+
+	if (prefix == NULL || output == NULL || snapshot == NULL || *prefix == '\0') {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	memset(snapshot, 0, sizeof(*snapshot));
+	input_len = strlen(prefix);
+	str = (s8*)malloc(input_len + 1);
+	raw = (s32*)malloc((input_len + 1) * sizeof(s32));
+	if (str == NULL || raw == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		goto end;
+	}
+	snapshot->length = code128_normalize(prefix, str, raw, &gs1);
+	TRACE_SYMBOL_START("code128", str);
+
+	//trailing digits are held back and encoded with the suffix, the join then
+	//needs no code set switch: the whole run after the start characters, or
+	//the odd digit of an all digit prefix that code set C can not pair
+	while (run < snapshot->length && str[snapshot->length - run - 1] > 47 && str[snapshot->length - run - 1] < 58) {
+		run++;
+	}
+	if (snapshot->length - run >= CODE128_PREFIX_START_LEN) {
+		pending = (run < CODE128_PENDING_MAX) ? run : CODE128_PENDING_MAX;
+	} else if ((run & 1) && run > 4) {
+		pending = 1;
+	}
+	memcpy(snapshot->pending, str + snapshot->length - pending, pending);
+	str[snapshot->length - pending] = '\0';
+
+	memset(&state, 0, sizeof(state));
+	state.output = output;
+	state.count = 1;
+	pos_i = code128_encode_start(&state, str, input_len);
+	if (pos_i == NULL || code128_encode_data(&state, pos_i, snapshot->length) < 0) {
+		goto end;
+	}
+	snapshot->offset = state.output - output;
+	snapshot->mode = state.mode;
+	snapshot->checksum = state.checksum;
+	snapshot->count = state.count;
+	snapshot->gs1 = gs1;
+end:
+	free(str);
+	free(raw);
+	return snapshot->offset;
+}
+
+/**
+* @brief encode prefix + suffix, only the suffix, check and stop character are generated
+*
+* the prefix symbols are kept as they are, so the code sets may differ from a
+* one-shot code128_encode(), the symbol carries the same data
+*
+* @param snapshot: from code128_encode_prefix()
+* @param suffix: trailing input strings
+* @param output: coded data holding the prefix modules, they are not touched
+*
+* @return length of coded data, 0 on error
+*/
+s32 code128_encode_resume(const struct code128_prefix *snapshot, const s8 *suffix, s8 *output) {
+	struct code128_state state;
+	s8 str_stack[CODE128_RESUME_STACK];
+	s32 raw_stack[CODE128_RESUME_STACK];
+	s8 *str = str_stack;
+	s32 *raw = raw_stack;
+	s32 input_len = 0;
+	s32 str_len = 0;
+	s32 pending = 0;
+	s32 gs1 = 0;
+	s32 barcode_len = 0;
+
+	if (snapshot == NULL || suffix == NULL || output == NULL || snapshot->offset <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	input_len = strlen(suffix) + CODE128_PENDING_MAX;
+	if (input_len >= CODE128_RESUME_STACK) {
+		str = (s8*)malloc(input_len + 1);
+		raw = (s32*)malloc((input_len + 1) * sizeof(s32));
+		if (str == NULL || raw == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			goto end;
+		}
+	}
+	//held back digits of the prefix go first, "[FNC1]" of a GS1-128 suffix
+	//is a field separator
+	pending = strlen(snapshot->pending);
+	memcpy(str, snapshot->pending, pending);
+	gs1 = snapshot->gs1;
+	str_len = code128_normalize(suffix, str + pending, raw, &gs1);
+
+	memset(&state, 0, sizeof(state));
+	state.output = output + snapshot->offset;
+	state.mode = snapshot->mode;
+	state.checksum = snapshot->checksum;
+	state.count = snapshot->count;
+	if (code128_encode_data(&state, str, snapshot->length + str_len) < 0) {
+		goto end;
+	}
+	barcode_len = code128_encode_stop(&state);
+end:
+	if (str != str_stack) {
+		free(str);
+	}
+	if (raw != raw_stack) {
+		free(raw);
+	}
+	return barcode_len;
+}
+
+//first module of symbol index(start code is 0)
+s32 code128_symbol_offset(s32 index) {
+	return CODE128_QUIET_ZONE_LEN + index * CODE128_CODE_LEN;
+}
+
+//write the modules of symbol value, returns their length
+s32 code128_symbol_pattern(s32 value, s8 *output) {
+	if (value < 0 || value >= CODE128_STOP_INDEX) {
+		return 0;
+	}
+	return code128_append_pattern(value, CODE128_CODE_LEN, output);
+}
@@ -4,12 +4,52 @@
 #include <stddef.h>
 #include "platform.h"
 
+//blank modules on each side, always written
+#define CODE128_QUIET_ZONE_LEN	10
+//both sides, in every length the encoders return
+#define CODE128_QUIET_LEN		(CODE128_QUIET_ZONE_LEN << 1)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+//one symbol of an encoded code128
+struct code128_symbol {
+	s32 value;
+	//offset of its first input character, -1 for start and switch codes
+	s32 source;
+	//input characters it encodes
+	s32 chars;
+};
+
+//trailing prefix digits held back by a snapshot
+#define CODE128_PENDING_MAX		16
+
+//encoder state after a constant prefix, see code128_encode_prefix()
+struct code128_prefix {
+	//modules written so far
+	s32 offset;
+	//code set
+	s32 mode;
+	//checksum accumulator and weight of the next symbol
+	s32 checksum;
+	s32 count;
+	//prefix characters after normalizing, and set for GS1-128
+	s32 length;
+	s32 gs1;
+	//trailing digits of the prefix, encoded with the suffix
+	s8 pending[CODE128_PENDING_MAX + 1];
+};
+
 s32 code128_max_len(const s8 *input);
 s32 code128_encode(const s8 *input, s8 *output);
+s32 code128_encode_symbols(const s8 *input, s8 *output, struct code128_symbol *symbol, s32 *symbol_num, s32 symbol_size);
+s32 code128_width(const s8 *input);
+s32 code128_symbols(const s8 *input, struct code128_symbol *symbol, s32 *symbol_num, s32 symbol_size);
+s32 code128_encode_prefix(const s8 *prefix, s8 *output, struct code128_prefix *snapshot);
+s32 code128_encode_resume(const struct code128_prefix *snapshot, const s8 *suffix, s8 *output);
+s32 code128_symbol_offset(s32 index);
+s32 code128_symbol_pattern(s32 value, s8 *output);
 
 #ifdef __cplusplus
 }
@@ -11,20 +11,10 @@
 #include <string.h>
 
 #include "code39.h"
+#include "trace.h"
 
 //https://en.wikipedia.org/wiki/Code_39
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-//#define CODE39_APPEND_BLANK
-
-#ifdef CODE39_APPEND_BLANK
-#define CODE39_BLANK_LEN		10
-#endif
-
 #define CODE39_PATTERN_NUM		43
 //one pattern have 12 bits
 #define CODE39_PATTERN_LEN		12
@@ -83,9 +73,6 @@ static const s32 code39_pattern[] = {
 
 static s32 code39_mapping_code(const s8 str) {
 	s32 i = CODE39_PATTERN_NUM - 1;
-#ifdef DEBUG
-	printf("%c ",str);
-#endif
 	while(i > -1) {
 		if (str == code39_table[i]) {
 			return i;
@@ -105,18 +92,10 @@ static s32 code39_append_blank(s8 *out) {
 static s32 code39_append_pattern(s32 index, s8 *out) {
 	s32 i;
 	s32 pattern = code39_pattern[index];
-#ifdef DEBUG
-	printf("index:%d->",index);
-#endif
+	TRACE_SYMBOL("code39", index, pattern);
 	for (i = CODE39_PATTERN_LEN; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return CODE39_PATTERN_LEN;
 }
 
@@ -142,9 +121,11 @@ s32 code39_encode(const s8 *input, s8 *output) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("code39", input);
 
 #ifdef CODE39_APPEND_BLANK
 	//append left blank
@@ -165,6 +146,7 @@ s32 code39_encode(const s8 *input, s8 *output) {
 		index = code39_mapping_code(*(input+i));
 		if (index < 0) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			barcode_len = 0;
 			goto end;
 		} else {
@@ -4,6 +4,20 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+//#define CODE39_APPEND_BLANK
+
+#ifdef CODE39_APPEND_BLANK
+#define CODE39_BLANK_LEN		10
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef CODE39_APPEND_BLANK
+#define CODE39_QUIET_LEN		(CODE39_BLANK_LEN << 1)
+#else
+#define CODE39_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
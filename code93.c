@@ -11,24 +11,19 @@
 #include <string.h>
 
 #include "code93.h"
+#include "trace.h"
+#include "check.h"
 
 //https://en.wikipedia.org/wiki/Code_93
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-//#define CODE93_APPEND_BLANK
-
-#ifdef CODE93_APPEND_BLANK
-#define CODE93_BLANK_LEN		10
-#endif
-
-
 #define CODE93_PATTERN_NUM		43
 #define CODE93_PATTERN_LEN		9
 
+//check C and K: weights 1-20 and 1-15 from the right, modulo 47
+#define CODE93_CHECK_C_WEIGHT	20
+#define CODE93_CHECK_K_WEIGHT	15
+#define CODE93_CHECK_MOD		47
+
 //Code 93 is restricted to 43 characters
 static const s8 code93_table[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. $/+%";
 
@@ -86,9 +81,6 @@ static const s32 code93_pattern[] = {
 
 static s32 code93_mapping_code(const s8 str) {
 	s32 i = CODE93_PATTERN_NUM - 1;
-#ifdef DEBUG
-	printf("%c ",str);
-#endif
 	while(i > -1) {
 		if (str == code93_table[i]) {
 			return i;
@@ -109,53 +101,13 @@ static s32 code93_append_blank(s8 *out) {
 static s32 code93_append_pattern(s32 index, s8 *out) {
 	int i;
 	s32 pattern = code93_pattern[index];
-#ifdef DEBUG
-	printf("index:%d->",index);
-#endif
+	TRACE_SYMBOL("code93", index, pattern);
 	for (i = CODE93_PATTERN_LEN; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return CODE93_PATTERN_LEN;
 }
 
-static s32 code93_checksum_c(const s8 *buf, s32 len) {
-	s32 sum = 0;
-	s32 i = len - 1;
-	s32 weight = 1;
-
-	while(i > -1) {
-		if (weight > 20) {
-			weight = 1;
-		}
-		sum += *(buf+i) * weight++;
-		i--;
-	}
-
-	return (sum % 47);
-}
-
-static s32 code93_checksum_k(const s8 *buf, s32 len) {
-	s32 sum = 0;
-	s32 i = len - 1;
-	s32 weight = 1;
-
-	while(i > -1) {
-		if (weight > 15) {
-			weight = 1;
-		}
-		sum += *(buf+i) * weight++;
-		i--;
-	}
-
-	return (sum % 47);
-}
-
 //len = start + data + check C + check K + stop + termination
 s32 code93_max_len(const s8 *input) {
 	s32 len = 0;
@@ -179,12 +131,15 @@ s32 code93_encode(const s8 *input, s8 *output) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("code93", input);
 	index_array = (s8*)malloc(input_len + 1);//data + check C
 	if (index_array == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	memset(index_array, 0, input_len + 1);
@@ -196,9 +151,6 @@ s32 code93_encode(const s8 *input, s8 *output) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("* ");
-#endif
 	//append start code
 	append_len = code93_append_pattern(CODE93_MARKER_INDEX, output);
 	output += append_len;
@@ -209,6 +161,7 @@ s32 code93_encode(const s8 *input, s8 *output) {
 		index = code93_mapping_code(*(input+i));
 		if (index < 0) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			barcode_len = 0;
 			goto end;
 		} else {
@@ -219,27 +172,20 @@ s32 code93_encode(const s8 *input, s8 *output) {
 		}
 	}
 	//append check C
-	index = code93_checksum_c(index_array, input_len);
-#ifdef DEBUG
-	printf("check C:\n ");
-#endif
+	index = check_weighted(index_array, input_len, CODE93_CHECK_C_WEIGHT, CODE93_CHECK_MOD);
+	TRACE_CHECKSUM("code93", index);
 	*(index_array + input_len) = index;
 	append_len = code93_append_pattern(index, output);
 	output += append_len;
 	barcode_len += append_len;
 
 	//append check K
-	index = code93_checksum_k(index_array, input_len + 1);//data + check C
-#ifdef DEBUG
-	printf("check K:\n ");
-#endif
+	index = check_weighted(index_array, input_len + 1, CODE93_CHECK_K_WEIGHT, CODE93_CHECK_MOD);//data + check C
+	TRACE_CHECKSUM("code93", index);
 	append_len = code93_append_pattern(index, output);
 	output += append_len;
 	barcode_len += append_len;
 
-#ifdef DEBUG
-	printf("* ");
-#endif
 	//append stop code
 	append_len = code93_append_pattern(CODE93_MARKER_INDEX, output);
 	output += append_len;
@@ -4,6 +4,20 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+//#define CODE93_APPEND_BLANK
+
+#ifdef CODE93_APPEND_BLANK
+#define CODE93_BLANK_LEN		10
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef CODE93_APPEND_BLANK
+#define CODE93_QUIET_LEN		(CODE93_BLANK_LEN << 1)
+#else
+#define CODE93_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
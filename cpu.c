@@ -0,0 +1,153 @@
+/**
+ * @file cpu.c
+ * @brief detect cpu features once for kernel dispatch
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define CPU_X86
+#endif
+
+//BARCODE_CPU=scalar|sse4.2|avx2|avx512 caps the detected level
+#define CPU_LEVEL_ENV	"BARCODE_CPU"
+
+//XCR0: SSE | AVX | opmask | ZMM0-15 upper | ZMM16-31
+#define CPU_XCR0_AVX	0x06
+#define CPU_XCR0_AVX512	0xE6
+
+static const s8 *cpu_level_names[CPU_LEVEL_NUM] = {
+	"scalar",
+	"sse4.2",
+	"avx2",
+	"avx512"
+};
+
+static u32 cpu_feature_bits = 0;
+static s32 cpu_detected_level = -1;
+
+#ifdef CPU_X86
+static u64 cpu_xgetbv(void) {
+	u32 eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((u64)edx << 32) | eax;
+}
+#endif
+
+static u32 cpu_detect(void) {
+	u32 features = 0;
+#ifdef CPU_X86
+	u32 eax, ebx, ecx, edx;
+	u32 max_leaf;
+	u64 xcr0 = 0;
+
+	max_leaf = __get_cpuid_max(0, NULL);
+	if (max_leaf < 1 || !__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return 0;
+	}
+	if (ecx & bit_SSSE3)
+		features |= CPU_FEATURE_SSSE3;
+	if (ecx & bit_SSE4_2)
+		features |= CPU_FEATURE_SSE42;
+	if (ecx & bit_POPCNT)
+		features |= CPU_FEATURE_POPCNT;
+	//AVX registers are only usable when the OS saves them
+	if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+		xcr0 = cpu_xgetbv();
+	}
+	if (max_leaf >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if (ebx & bit_BMI2)
+			features |= CPU_FEATURE_BMI2;
+		if ((xcr0 & CPU_XCR0_AVX) == CPU_XCR0_AVX) {
+			if (ebx & bit_AVX2)
+				features |= CPU_FEATURE_AVX2;
+			if ((xcr0 & CPU_XCR0_AVX512) == CPU_XCR0_AVX512) {
+				if (ebx & bit_AVX512F)
+					features |= CPU_FEATURE_AVX512F;
+				if (ebx & bit_AVX512BW)
+					features |= CPU_FEATURE_AVX512BW;
+				if (ebx & bit_AVX512VL)
+					features |= CPU_FEATURE_AVX512VL;
+			}
+		}
+	}
+#endif
+	return features;
+}
+
+static s32 cpu_detect_level(u32 features) {
+	s32 level = CPU_LEVEL_SCALAR;
+	const u32 sse42 = CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE42 | CPU_FEATURE_POPCNT;
+	const u32 avx2 = sse42 | CPU_FEATURE_AVX2 | CPU_FEATURE_BMI2;
+	const u32 avx512 = avx2 | CPU_FEATURE_AVX512F | CPU_FEATURE_AVX512BW | CPU_FEATURE_AVX512VL;
+	const s8 *env = NULL;
+	s32 cap;
+
+	if ((features & avx512) == avx512)
+		level = CPU_LEVEL_AVX512;
+	else if ((features & avx2) == avx2)
+		level = CPU_LEVEL_AVX2;
+	else if ((features & sse42) == sse42)
+		level = CPU_LEVEL_SSE42;
+
+	env = getenv(CPU_LEVEL_ENV);
+	if (env != NULL) {
+		cap = cpu_level_lookup(env);
+		if (cap < 0) {
+			printf("%s %d unknown %s=%s\n",__func__,__LINE__,CPU_LEVEL_ENV,env);
+		} else if (cap < level) {
+			level = cap;
+		}
+	}
+	return level;
+}
+
+u32 cpu_features(void) {
+	if (cpu_detected_level < 0) {
+		cpu_level();
+	}
+	return cpu_feature_bits;
+}
+
+//best kernel level of this machine, detected on the first call
+s32 cpu_level(void) {
+	s32 level = __atomic_load_n(&cpu_detected_level, __ATOMIC_ACQUIRE);
+	u32 features;
+	if (level < 0) {
+		//racing threads compute the same result
+		features = cpu_detect();
+		level = cpu_detect_level(features);
+		__atomic_store_n(&cpu_feature_bits, features, __ATOMIC_RELAXED);
+		__atomic_store_n(&cpu_detected_level, level, __ATOMIC_RELEASE);
+	}
+	return level;
+}
+
+s32 cpu_level_lookup(const s8 *name) {
+	s32 i;
+	if (name == NULL) {
+		return -1;
+	}
+	for (i = 0; i < CPU_LEVEL_NUM; i++) {
+		if (strcmp(cpu_level_names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const s8 *cpu_level_name(s32 level) {
+	if (level < 0 || level >= CPU_LEVEL_NUM) {
+		return "unknown";
+	}
+	return cpu_level_names[level];
+}
@@ -0,0 +1,38 @@
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//kernel levels, each one implies the previous
+enum {
+	CPU_LEVEL_SCALAR = 0,
+	CPU_LEVEL_SSE42,	//SSE4.2 + SSSE3 + POPCNT
+	CPU_LEVEL_AVX2,		//AVX2 + BMI2
+	CPU_LEVEL_AVX512,	//AVX-512 F/BW/VL
+	CPU_LEVEL_NUM
+};
+
+#define CPU_FEATURE_SSSE3		0x01
+#define CPU_FEATURE_SSE42		0x02
+#define CPU_FEATURE_POPCNT		0x04
+#define CPU_FEATURE_AVX2		0x08
+#define CPU_FEATURE_BMI2		0x10
+#define CPU_FEATURE_AVX512F		0x20
+#define CPU_FEATURE_AVX512BW	0x40
+#define CPU_FEATURE_AVX512VL	0x80
+
+u32 cpu_features(void);
+s32 cpu_level(void);
+s32 cpu_level_lookup(const s8 *name);
+const s8 *cpu_level_name(s32 level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,546 @@
+/**
+ * @file dispatch.c
+ * @brief label scheduling for a printer: priority classes, earliest deadline first within a class
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "native.h"
+#include "symbology.h"
+#include "stats.h"
+#include "trace.h"
+#include "dispatch.h"
+
+#define DISPATCH_NO_DEADLINE		(~0ULL)
+#define DISPATCH_HEAP_SIZE			16
+#define DISPATCH_TEXT_SIZE			128
+#define DISPATCH_BUFFER_SIZE		4096
+//a label bigger than this is refused, not grown for
+#define DISPATCH_BUFFER_MAX		(16 << 20)
+#define DISPATCH_WIDTH_MAX			19
+
+static const s8 *dispatch_names[DISPATCH_CLASS_NUM] = {
+	"urgent", "normal", "bulk"
+};
+
+//earlier deadline first, the older job when they are due together
+static inline s32 dispatch_before(const struct dispatch_job *a, const struct dispatch_job *b) {
+	return (a->deadline != b->deadline) ? (a->deadline < b->deadline) : (a->seq < b->seq);
+}
+
+static s32 dispatch_push(struct dispatch_class *priority, struct dispatch_job *job) {
+	struct dispatch_job **heap;
+	s32 i, parent;
+
+	if (priority->jobs == priority->capacity) {
+		heap = (struct dispatch_job**)realloc(priority->heap, priority->capacity * 2 * sizeof(struct dispatch_job*));
+		if (heap == NULL) {
+			return -1;
+		}
+		priority->heap = heap;
+		priority->capacity *= 2;
+	}
+	for (i = priority->jobs++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (!dispatch_before(job, priority->heap[parent])) {
+			break;
+		}
+		priority->heap[i] = priority->heap[parent];
+	}
+	priority->heap[i] = job;
+	return 0;
+}
+
+static void dispatch_pop(struct dispatch_class *priority) {
+	struct dispatch_job *last = priority->heap[--priority->jobs];
+	s32 i = 0, child;
+
+	while ((child = 2 * i + 1) < priority->jobs) {
+		if (child + 1 < priority->jobs && dispatch_before(priority->heap[child + 1], priority->heap[child])) {
+			child++;
+		}
+		if (!dispatch_before(priority->heap[child], last)) {
+			break;
+		}
+		priority->heap[i] = priority->heap[child];
+		i = child;
+	}
+	priority->heap[i] = last;
+}
+
+//text of label number into dispatch->text, the counter run replaced
+static s32 dispatch_text(struct dispatch *dispatch, const struct dispatch_job *job, u64 number) {
+	s32 len = strlen(job->input), i;
+	s8 *text;
+
+	if (len + 1 > dispatch->text_size) {
+		text = (s8*)realloc(dispatch->text, len + 1);
+		if (text == NULL) {
+			return -1;
+		}
+		dispatch->text = text;
+		dispatch->text_size = len + 1;
+	}
+	memcpy(dispatch->text, job->input, len + 1);
+	for (i = job->width - 1; job->field >= 0 && i >= 0; i--) {
+		dispatch->text[job->field + i] = '0' + number % 10;
+		number /= 10;
+	}
+	return len;
+}
+
+static s32 dispatch_write(s32 fd, const u8 *data, s32 len) {
+	ssize_t n;
+	while (len > 0) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+s32 dispatch_init(struct dispatch *dispatch) {
+	s32 i;
+	if (dispatch == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(dispatch, 0, sizeof(*dispatch));
+	for (i = 0; i < DISPATCH_CLASS_NUM; i++) {
+		dispatch->priority[i].capacity = DISPATCH_HEAP_SIZE;
+		dispatch->priority[i].heap = (struct dispatch_job**)malloc(DISPATCH_HEAP_SIZE * sizeof(struct dispatch_job*));
+	}
+	dispatch->text_size = DISPATCH_TEXT_SIZE;
+	dispatch->text = (s8*)malloc(dispatch->text_size);
+	dispatch->buffer_size = DISPATCH_BUFFER_SIZE;
+	dispatch->buffer = (u8*)malloc(dispatch->buffer_size);
+	for (i = 0; i < DISPATCH_CLASS_NUM && dispatch->priority[i].heap != NULL; i++);
+	if (i < DISPATCH_CLASS_NUM || dispatch->text == NULL || dispatch->buffer == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		for (i = 0; i < DISPATCH_CLASS_NUM; i++) {
+			free(dispatch->priority[i].heap);
+		}
+		free(dispatch->text);
+		free(dispatch->buffer);
+		return -1;
+	}
+	pthread_mutex_init(&dispatch->lock, NULL);
+	pthread_cond_init(&dispatch->work, NULL);
+	return 0;
+}
+
+//drops the jobs still queued
+void dispatch_free(struct dispatch *dispatch) {
+	s32 i, j;
+	if (dispatch == NULL || dispatch->text == NULL) {
+		return;
+	}
+	for (i = 0; i < DISPATCH_CLASS_NUM; i++) {
+		for (j = 0; j < dispatch->priority[i].jobs; j++) {
+			free(dispatch->priority[i].heap[j]->input);
+			free(dispatch->priority[i].heap[j]);
+		}
+		free(dispatch->priority[i].heap);
+		dispatch->priority[i].heap = NULL;
+	}
+	free(dispatch->text);
+	free(dispatch->buffer);
+	dispatch->text = NULL;
+	dispatch->buffer = NULL;
+	pthread_mutex_destroy(&dispatch->lock);
+	pthread_cond_destroy(&dispatch->work);
+}
+
+/**
+ * @brief queue count labels of input, from any thread
+ *
+ * @param priority: DISPATCH_XXX
+ * @param deadline_ms: the last label is due this long from now, 0 for none
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings, copied; a run of DISPATCH_COUNTER_CHAR is numbered
+ * from first, every label is the same without one
+ * @param count: labels, only their text is kept until each is about to print
+ *
+ * @return job id, -1 on error
+ */
+s32 dispatch_submit(struct dispatch *dispatch, s32 priority, u32 deadline_ms, s32 symbology, const s8 *input, u64 first,
+		u64 count) {
+	struct dispatch_job *job;
+	const s8 *field;
+	u64 limit = 1;
+	s32 i, id;
+
+	if (dispatch == NULL || dispatch->text == NULL || priority < 0 || priority >= DISPATCH_CLASS_NUM || input == NULL ||
+			count == 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	job = (struct dispatch_job*)calloc(1, sizeof(struct dispatch_job));
+	if (job == NULL || (job->input = strdup(input)) == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		free(job);
+		return -1;
+	}
+	job->field = -1;
+	field = strchr(input, DISPATCH_COUNTER_CHAR);
+	if (field != NULL) {
+		job->field = field - input;
+		for (i = job->field; input[i] == DISPATCH_COUNTER_CHAR; i++) {
+			job->width++;
+		}
+		for (i = 0; i < job->width && limit <= first + count - 1; i++) {
+			limit *= 10;
+		}
+		if (job->width > DISPATCH_WIDTH_MAX || limit <= first + count - 1) {
+			printf("%s %d last:%llu does not fit %d digits\n",__func__,__LINE__,
+					(unsigned long long)(first + count - 1),job->width);
+			TRACE_ERROR();
+			free(job->input);
+			free(job);
+			return -1;
+		}
+	}
+	job->priority = priority;
+	job->symbology = symbology;
+	job->first = first;
+	job->count = count;
+	job->submitted = stats_now();
+	job->deadline = (deadline_ms > 0) ? job->submitted + (u64)deadline_ms * 1000000ULL : DISPATCH_NO_DEADLINE;
+
+	pthread_mutex_lock(&dispatch->lock);
+	if (dispatch->closed) {
+		pthread_mutex_unlock(&dispatch->lock);
+		printf("%s %d closed\n",__func__,__LINE__);
+		free(job->input);
+		free(job);
+		return -1;
+	}
+	job->seq = dispatch->seq++;
+	job->id = dispatch->next_id++;
+	if (dispatch_push(&dispatch->priority[priority], job) < 0) {
+		pthread_mutex_unlock(&dispatch->lock);
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		free(job->input);
+		free(job);
+		return -1;
+	}
+	dispatch->priority[priority].labels += count;
+	if (dispatch->priority[priority].labels > dispatch->priority[priority].labels_max) {
+		dispatch->priority[priority].labels_max = dispatch->priority[priority].labels;
+	}
+	id = job->id & 0x7fffffff;
+	pthread_cond_signal(&dispatch->work);
+	pthread_mutex_unlock(&dispatch->lock);
+	return id;
+}
+
+//no more jobs, dispatch_next() returns 0 once the queued ones are handed out
+s32 dispatch_close(struct dispatch *dispatch) {
+	if (dispatch == NULL || dispatch->text == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&dispatch->lock);
+	dispatch->closed = 1;
+	pthread_cond_broadcast(&dispatch->work);
+	pthread_mutex_unlock(&dispatch->lock);
+	return 0;
+}
+
+/**
+ * @brief hand out the label to print now, from one printer thread only; a job
+ * is only left for a more urgent one between two of its labels
+ *
+ * @param wait: sleep until there is a label or the scheduler is closed
+ *
+ * @return 1 with label set, 0 when there is none, -1 on error
+ */
+s32 dispatch_next(struct dispatch *dispatch, struct dispatch_label *label, s32 wait) {
+	struct dispatch_class *priority = NULL;
+	struct dispatch_job *job;
+	s32 i;
+
+	if (dispatch == NULL || dispatch->text == NULL || label == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	pthread_mutex_lock(&dispatch->lock);
+	for (;;) {
+		for (i = 0; i < DISPATCH_CLASS_NUM && dispatch->priority[i].jobs == 0; i++);
+		if (i < DISPATCH_CLASS_NUM) {
+			priority = &dispatch->priority[i];
+			break;
+		}
+		if (!wait || dispatch->closed) {
+			pthread_mutex_unlock(&dispatch->lock);
+			return 0;
+		}
+		pthread_cond_wait(&dispatch->work, &dispatch->lock);
+	}
+	job = priority->heap[0];
+	if (dispatch->last_open && dispatch->last_id != job->id) {
+		dispatch->preemptions++;
+	}
+	label->job = job;
+	label->number = job->first + job->next++;
+	priority->labels--;
+	//handed out in full, it leaves the heap and lives on until its last label is done
+	if (job->next == job->count) {
+		dispatch_pop(priority);
+	}
+	dispatch->last_id = job->id;
+	dispatch->last_open = job->next < job->count;
+	pthread_mutex_unlock(&dispatch->lock);
+
+	if (dispatch_text(dispatch, job, label->number) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		label->text = NULL;
+		return 1;
+	}
+	label->text = dispatch->text;
+	return 1;
+}
+
+/**
+ * @brief the label handed out as a printer command into dispatch->buffer, which
+ * grows until it fits
+ *
+ * @return bytes, -1 on error
+ */
+s32 dispatch_encode(struct dispatch *dispatch, const struct dispatch_label *label, s32 dialect, const struct native_field *field) {
+	FILE *fp = NULL;
+	u8 *grow;
+	s32 len;
+
+	if (dispatch == NULL || dispatch->buffer == NULL || label == NULL || label->job == NULL || label->text == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (;;) {
+		fp = fmemopen(dispatch->buffer, dispatch->buffer_size, "w");
+		if (fp == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return -1;
+		}
+		setvbuf(fp, NULL, _IONBF, 0);
+		len = -1;
+		if (native_begin(dialect, fp) >= 0 &&
+				native_write(dialect, label->job->symbology, label->text, field, fp) > 0 &&
+				native_end(dialect, fp) >= 0) {
+			len = ftell(fp);
+		} else if (!ferror(fp)) {
+			//the label itself is bad, not the buffer
+			fclose(fp);
+			return -1;
+		}
+		fclose(fp);
+		if (len >= 0 && len < dispatch->buffer_size) {
+			return len;
+		}
+		if (dispatch->buffer_size >= DISPATCH_BUFFER_MAX) {
+			printf("%s %d label over %d bytes\n",__func__,__LINE__,DISPATCH_BUFFER_MAX);
+			return -1;
+		}
+		grow = (u8*)realloc(dispatch->buffer, dispatch->buffer_size << 1);
+		if (grow == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return -1;
+		}
+		dispatch->buffer = grow;
+		dispatch->buffer_size <<= 1;
+	}
+}
+
+//the label handed out was printed, or failed; a job is finished with its last label
+s32 dispatch_done(struct dispatch *dispatch, struct dispatch_label *label, s32 ok) {
+	struct dispatch_job *job;
+	struct dispatch_class *priority;
+	u64 now, latency;
+
+	if (dispatch == NULL || label == NULL || label->job == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	job = label->job;
+	label->job = NULL;
+	priority = &dispatch->priority[job->priority];
+	pthread_mutex_lock(&dispatch->lock);
+	priority->printed += (ok != 0);
+	priority->errors += (ok == 0);
+	if (++job->done < job->count) {
+		pthread_mutex_unlock(&dispatch->lock);
+		return 0;
+	}
+	now = stats_now();
+	latency = now - job->submitted;
+	priority->finished++;
+	priority->misses += (now > job->deadline);
+	priority->latency_sum += latency;
+	if (latency > priority->latency_max) {
+		priority->latency_max = latency;
+	}
+	pthread_mutex_unlock(&dispatch->lock);
+	free(job->input);
+	free(job);
+	return 1;
+}
+
+/**
+ * @brief print labels to fd as they are handed out, each encoded just before
+ * it is written and paced by dispatch->pace, until the scheduler is closed and empty
+ *
+ * @return 0, -1 when a write failed
+ */
+s32 dispatch_run(struct dispatch *dispatch, s32 fd, s32 dialect, const struct native_field *field) {
+	struct dispatch_label label;
+	struct pace_estimate estimate;
+	s32 len, ret;
+
+	while ((ret = dispatch_next(dispatch, &label, 1)) > 0) {
+		len = (label.text != NULL) ? dispatch_encode(dispatch, &label, dialect, field) : -1;
+		//native fields print bars across the feed
+		if (len > 0 && dispatch->pace != NULL && pace_estimate(&dispatch->pace->printer,
+				symbology_width(label.job->symbology, label.text), field->module, field->height, 0,
+				&estimate) == 0) {
+			pace_wait(dispatch->pace, estimate.ns, len);
+		}
+		if (len > 0 && dispatch_write(fd, dispatch->buffer, len) < 0) {
+			printf("%s %d fd %d write err:%s\n",__func__,__LINE__,fd,strerror(errno));
+			dispatch_done(dispatch, &label, 0);
+			return -1;
+		}
+		dispatch_done(dispatch, &label, len > 0);
+	}
+	return ret;
+}
+
+//one line per class: queue depth, labels, finished jobs, deadline misses and latency
+s32 dispatch_dump(struct dispatch *dispatch, FILE *fp) {
+	const struct dispatch_class *priority;
+	s32 i;
+
+	if (dispatch == NULL || dispatch->text == NULL || fp == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&dispatch->lock);
+	for (i = 0; i < DISPATCH_CLASS_NUM; i++) {
+		priority = &dispatch->priority[i];
+		fprintf(fp, "%s jobs:%d labels:%llu(max %llu) printed:%llu errors:%llu finished:%llu misses:%llu "
+				"latency(us) avg:%llu max:%llu\n", dispatch_names[i], priority->jobs,
+				(unsigned long long)priority->labels, (unsigned long long)priority->labels_max,
+				(unsigned long long)priority->printed, (unsigned long long)priority->errors,
+				(unsigned long long)priority->finished, (unsigned long long)priority->misses,
+				(unsigned long long)(priority->finished ? priority->latency_sum / priority->finished / 1000 : 0),
+				(unsigned long long)(priority->latency_max / 1000));
+	}
+	fprintf(fp, "preemptions:%llu\n", (unsigned long long)dispatch->preemptions);
+	pthread_mutex_unlock(&dispatch->lock);
+	return 0;
+}
+
+#define DISPATCH_TEST_BULK			50
+#define DISPATCH_TEST_BEFORE		6
+
+//takes the next label, which has to read expect, and prints it to nowhere
+static s32 dispatch_selftest_take(struct dispatch *dispatch, struct dispatch_label *label, const s8 *expect, s32 done) {
+	struct native_field field = {0, 0, 8, 2, 0};
+
+	if (dispatch_next(dispatch, label, 0) != 1 || label->text == NULL || strcmp(label->text, expect) != 0 ||
+			dispatch_encode(dispatch, label, NATIVE_ZPL, &field) <= 0) {
+		printf("%s %d expected %s got %s\n",__func__,__LINE__,expect,
+				(label->job != NULL && label->text != NULL) ? label->text : "none");
+		return -1;
+	}
+	return (done && dispatch_done(dispatch, label, 1) < 0) ? -1 : 0;
+}
+
+/**
+ * @brief an urgent job submitted while a bulk label is out takes the printer at
+ * the next label boundary, the bulk numbers go on where they stopped, and the
+ * normal jobs come out earliest deadline first, the one without last
+ *
+ * @return 0 on pass, -1 on fail
+ */
+s32 dispatch_selftest(void) {
+	static const s8 *normal[] = {"N300", "N100", "NONE", "N200"};
+	static const u32 deadline[] = {300, 100, 0, 200};
+	static const s8 *order[] = {"N100", "N200", "N300", "NONE"};
+	struct dispatch dispatch;
+	struct dispatch_label label;
+	s8 expect[16];
+	s32 i, ret = 0;
+
+	memset(&label, 0, sizeof(label));
+	if (dispatch_init(&dispatch) < 0 ||
+			dispatch_submit(&dispatch, DISPATCH_BULK, 0, SYMBOLOGY_CODE128, "BULK####", 0, DISPATCH_TEST_BULK) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		dispatch_free(&dispatch);
+		return -1;
+	}
+	for (i = 0; i < DISPATCH_TEST_BEFORE && ret == 0; i++) {
+		snprintf(expect, sizeof(expect), "BULK%04d", i);
+		ret = dispatch_selftest_take(&dispatch, &label, expect, i + 1 < DISPATCH_TEST_BEFORE);
+	}
+	//the urgent and normal jobs arrive while the last bulk label is printing
+	if (ret == 0 && dispatch_submit(&dispatch, DISPATCH_URGENT, 0, SYMBOLOGY_CODE128, "URGENT", 0, 2) < 0) {
+		ret = -1;
+	}
+	for (i = 0; i < 4 && ret == 0; i++) {
+		if (dispatch_submit(&dispatch, DISPATCH_NORMAL, deadline[i], SYMBOLOGY_CODE128, normal[i], 0, 2) < 0) {
+			ret = -1;
+		}
+	}
+	if (ret == 0) {
+		dispatch_done(&dispatch, &label, 1);
+		ret = dispatch_selftest_take(&dispatch, &label, "URGENT", 1);
+	}
+	if (ret == 0 && dispatch.preemptions != 1) {
+		printf("%s %d preemptions:%llu\n",__func__,__LINE__,(unsigned long long)dispatch.preemptions);
+		ret = -1;
+	}
+	if (ret == 0) {
+		ret = dispatch_selftest_take(&dispatch, &label, "URGENT", 1);
+	}
+	//both labels of a job before the next one
+	for (i = 0; i < 8 && ret == 0; i++) {
+		ret = dispatch_selftest_take(&dispatch, &label, order[i / 2], 1);
+	}
+	for (i = DISPATCH_TEST_BEFORE; i < DISPATCH_TEST_BULK && ret == 0; i++) {
+		snprintf(expect, sizeof(expect), "BULK%04d", i);
+		ret = dispatch_selftest_take(&dispatch, &label, expect, 1);
+	}
+	dispatch_close(&dispatch);
+	if (ret == 0 && (dispatch_next(&dispatch, &label, 1) != 0 || dispatch.preemptions != 1 ||
+			dispatch.priority[DISPATCH_URGENT].finished != 1 || dispatch.priority[DISPATCH_NORMAL].finished != 4 ||
+			dispatch.priority[DISPATCH_BULK].finished != 1 ||
+			dispatch.priority[DISPATCH_BULK].printed != DISPATCH_TEST_BULK)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		dispatch_dump(&dispatch, stdout);
+		ret = -1;
+	}
+	dispatch_free(&dispatch);
+	return ret;
+}
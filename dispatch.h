@@ -0,0 +1,107 @@
+#ifndef __DISPATCH_H__
+#define __DISPATCH_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "platform.h"
+#include "native.h"
+#include "pace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//priority classes, a label of a higher class always prints first
+enum {
+	DISPATCH_URGENT = 0,	//conveyor side, a carton is waiting
+	DISPATCH_NORMAL,
+	DISPATCH_BULK,			//reprint batches
+	DISPATCH_CLASS_NUM
+};
+
+//the run of it in a job input is the label number, zero padded to its width
+#define DISPATCH_COUNTER_CHAR		'#'
+
+//count labels of one input, the job stays queued until its last label printed
+struct dispatch_job {
+	u32 id;
+	s32 priority;
+	//stats_now() time it is due, ~0 for none, earliest first within a class
+	u64 deadline;
+	u64 seq;
+	s32 symbology;
+	s8 *input;
+	//counter run in input, -1 for none, and the number of the first label
+	s32 field;
+	s32 width;
+	u64 first;
+	//labels of the job, handed out, printed
+	u64 count;
+	u64 next;
+	u64 done;
+	u64 submitted;
+};
+
+//jobs of a class in a min heap on (deadline, seq)
+struct dispatch_class {
+	struct dispatch_job **heap;
+	s32 jobs;
+	s32 capacity;
+	//labels queued and not handed out yet, the most there were
+	u64 labels;
+	u64 labels_max;
+	u64 printed;
+	u64 errors;
+	//finished jobs, those past their deadline, submit to last label written
+	u64 finished;
+	u64 misses;
+	u64 latency_sum;
+	u64 latency_max;
+};
+
+//the label handed out by dispatch_next(), valid until dispatch_done()
+struct dispatch_label {
+	struct dispatch_job *job;
+	u64 number;
+	const s8 *text;
+};
+
+//orders labels for one printer, jobs are submitted from any thread
+struct dispatch {
+	struct dispatch_class priority[DISPATCH_CLASS_NUM];
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	u64 seq;
+	u32 next_id;
+	s32 closed;
+	//text and printer command of the label handed out
+	s8 *text;
+	s32 text_size;
+	u8 *buffer;
+	s32 buffer_size;
+	//job of the last label, and labels taken from another job before it finished
+	u32 last_id;
+	s32 last_open;
+	u64 preemptions;
+	//dispatch_run() output paced to the printer, NULL for as fast as it takes it
+	struct pace *pace;
+};
+
+s32 dispatch_init(struct dispatch *dispatch);
+void dispatch_free(struct dispatch *dispatch);
+s32 dispatch_submit(struct dispatch *dispatch, s32 priority, u32 deadline_ms, s32 symbology, const s8 *input, u64 first,
+		u64 count);
+s32 dispatch_close(struct dispatch *dispatch);
+s32 dispatch_next(struct dispatch *dispatch, struct dispatch_label *label, s32 wait);
+s32 dispatch_encode(struct dispatch *dispatch, const struct dispatch_label *label, s32 dialect, const struct native_field *field);
+s32 dispatch_done(struct dispatch *dispatch, struct dispatch_label *label, s32 ok);
+s32 dispatch_run(struct dispatch *dispatch, s32 fd, s32 dialect, const struct native_field *field);
+s32 dispatch_dump(struct dispatch *dispatch, FILE *fp);
+s32 dispatch_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,22 +11,12 @@
 #include <string.h>
 
 #include "ean13.h"
+#include "trace.h"
+#include "check.h"
+#include "kernel.h"
 
 //https://en.wikipedia.org/wiki/International_Article_Number
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-#define EAN13_APPEND_BLANK
-
-//add left blank to display human readable string(first digit)
-#ifdef EAN13_APPEND_BLANK
-#define EAN13_BLANK_LEN				8
-#endif
-
-
 #define EAN13_INPUT_LEN				12
 #define EAN13_PATTERN_LEN			7
 //start/stop
@@ -109,21 +99,14 @@ static s32 ean13_append_marker(s32 index, s8 *out) {
 	s32 marker = ean13_marker_pattern[index];
 	s32 marker_len = index ? EAN13_CENTER_PATTERN_LEN : EAN13_MARKER_PATTERN_LEN;
 	for (i = marker_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(marker & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (marker & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return marker_len;
 }
 
 static s32 ean13_append_data(const s8 *input, s8 *out, s32 *checksum) {
 	s32 i,j;
 	s32 sum = 0;
-	s32 weight = 0;
 	s32 index = 0;
 	s32 append_len = 0;
 	s32 total_len = 0;
@@ -134,33 +117,21 @@ static s32 ean13_append_data(const s8 *input, s8 *out, s32 *checksum) {
 		index = *(input+i) - '0';
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto err;
 		}
-#ifdef DEBUG
-		printf("%c index:%d->", *(input+i), index);
-#endif
-		weight = ((i%2) == 0) ? 1 : 3;
-		sum += index * weight;
 		//skip first digit
 		if (i > 0) {
 			pattern = (ean13_left_parity_table[first_index] & (1 << (6-i))) ? ean13_left_odd_pattern[index] : ean13_left_even_pattern[index];
+			TRACE_SYMBOL("ean13", index, pattern);
 			for (j = EAN13_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-				printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 				*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 			}
 			total_len += EAN13_PATTERN_LEN;
 		}
-#ifdef DEBUG
-		printf("\n");
-#endif
 	}
 
 	//append center marker
-#ifdef DEBUG
-	printf("center->");
-#endif
 	append_len = ean13_append_marker(EAN13_CENTER_MARKER_INDEX, out);
 	total_len += append_len;
 	out += append_len;
@@ -170,41 +141,25 @@ static s32 ean13_append_data(const s8 *input, s8 *out, s32 *checksum) {
 		index = *(input+i) - '0';
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto err;
 		}
-#ifdef DEBUG
-		printf("%c index:%d->", *(input+i), index);
-#endif
 		pattern = ean13_right_pattern[index];
-		weight = ((i%2) == 0) ? 1 : 3;
-		sum += index * weight;
+		TRACE_SYMBOL("ean13", index, pattern);
 		for (j = EAN13_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-			printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 			*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 		}
-#ifdef DEBUG
-		printf("\n");
-#endif
 		total_len += EAN13_PATTERN_LEN;
 	}
 	//append checksum(modulo 10)
-	sum = (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
+	sum = check_mod10(input, EAN13_INPUT_LEN);
 	*checksum = sum;
-#ifdef DEBUG
-	printf("check:%d->",sum);
-#endif
+	TRACE_CHECKSUM("ean13", sum);
 	pattern = ean13_right_pattern[sum];
+	TRACE_SYMBOL("ean13", sum, pattern);
 	for (j = EAN13_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	total_len += EAN13_PATTERN_LEN;
 
 	return total_len;
@@ -232,11 +187,14 @@ s32 ean13_encode(const s8 *input, s8 *output, s32 *checksum) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("ean13", input);
 	if (input_len != EAN13_INPUT_LEN) {
 		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 
@@ -247,9 +205,6 @@ s32 ean13_encode(const s8 *input, s8 *output, s32 *checksum) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("start->");
-#endif
 	//append start code
 	append_len = ean13_append_marker(EAN13_MARKER_INDEX, output);
 	output += append_len;
@@ -259,14 +214,12 @@ s32 ean13_encode(const s8 *input, s8 *output, s32 *checksum) {
 	append_len = ean13_append_data(input, output, checksum);
 	if (append_len < 0) {
 		printf("%s %d end\n",__func__,__LINE__);
+		barcode_len = 0;
 		goto end;
 	}
 	output += append_len;
 	barcode_len += append_len;
 
-#ifdef DEBUG
-	printf("stop->");
-#endif
 	//append stop code
 	append_len = ean13_append_marker(EAN13_MARKER_INDEX, output);
 	output += append_len;
@@ -282,3 +235,190 @@ s32 ean13_encode(const s8 *input, s8 *output, s32 *checksum) {
 end:
 	return barcode_len;
 }
+
+#ifdef EAN13_APPEND_BLANK
+#define EAN13_ROW_BLANK_LEN		EAN13_BLANK_LEN
+#else
+#define EAN13_ROW_BLANK_LEN		0
+#endif
+//row = blank + start + 6 left + center | 6 right + stop + blank
+#define EAN13_ROW_LEFT_LEN		(EAN13_ROW_BLANK_LEN + EAN13_MARKER_PATTERN_LEN + 6 * EAN13_PATTERN_LEN + EAN13_CENTER_PATTERN_LEN)
+#define EAN13_ROW_RIGHT_LEN		(6 * EAN13_PATTERN_LEN + EAN13_MARKER_PATTERN_LEN + EAN13_ROW_BLANK_LEN)
+#define EAN13_ROW_BYTES			((EAN13_ROW_LEFT_LEN + EAN13_ROW_RIGHT_LEN + 7) >> 3)
+
+//[parity][digit], parity 1:odd 0:even
+static const s32 *const ean13_left_pattern[] = {
+	ean13_left_even_pattern,
+	ean13_left_odd_pattern
+};
+
+#define EAN13_LEFT(parity, bit, digit) \
+	ean13_left_pattern[((parity) >> (bit)) & 1][digit]
+
+//pattern: digits 1-11 then the check digit, left-hand parity already applied
+static s32 ean13_store_row(const u8 *pattern, u8 *output) {
+	u64 left, right;
+	left = ean13_marker_pattern[EAN13_MARKER_INDEX];
+	left = (left << EAN13_PATTERN_LEN) | pattern[0];
+	left = (left << EAN13_PATTERN_LEN) | pattern[1];
+	left = (left << EAN13_PATTERN_LEN) | pattern[2];
+	left = (left << EAN13_PATTERN_LEN) | pattern[3];
+	left = (left << EAN13_PATTERN_LEN) | pattern[4];
+	left = (left << EAN13_PATTERN_LEN) | pattern[5];
+	left = (left << EAN13_CENTER_PATTERN_LEN) | ean13_marker_pattern[EAN13_CENTER_MARKER_INDEX];
+
+	right = pattern[6];
+	right = (right << EAN13_PATTERN_LEN) | pattern[7];
+	right = (right << EAN13_PATTERN_LEN) | pattern[8];
+	right = (right << EAN13_PATTERN_LEN) | pattern[9];
+	right = (right << EAN13_PATTERN_LEN) | pattern[10];
+	right = (right << EAN13_PATTERN_LEN) | pattern[11];
+	right = (right << EAN13_MARKER_PATTERN_LEN) | ean13_marker_pattern[EAN13_MARKER_INDEX];
+	right <<= EAN13_ROW_BLANK_LEN;
+
+	return kernel_store_row(output, left, EAN13_ROW_LEFT_LEN, right, EAN13_ROW_RIGHT_LEN);
+}
+
+/**
+ * @brief encode input by ean13 straight into a packed row
+ *
+ * fixed geometry: the digits are checked with one vector compare and the
+ * whole row is assembled in two registers, no per-module loop
+ *
+ * @param input: 12 digits
+ * @param output: packed data, first module is the MSB, at least (ean13_max_len() + 7) / 8 bytes
+ * @param checksum: check digit
+ *
+ * @return length of coded data(modules), 0 on error
+ */
+s32 ean13_encode_packed(const s8 *input, u8 *output, s32 *checksum) {
+	u8 digits[16];
+	u8 pattern[12];
+	s32 parity, check;
+
+	if (input == NULL || output == NULL || checksum == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	if (strlen(input) != EAN13_INPUT_LEN || kernel_load_digits(input, EAN13_INPUT_LEN, digits) < 0) {
+		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	TRACE_SYMBOL_START("ean13", input);
+	check = kernel_mod10(digits, 1);
+	*checksum = check;
+	TRACE_CHECKSUM("ean13", check);
+
+	//first digit selects the parity of the left-hand digits
+	parity = ean13_left_parity_table[digits[0]];
+	pattern[0] = EAN13_LEFT(parity, 5, digits[1]);
+	pattern[1] = EAN13_LEFT(parity, 4, digits[2]);
+	pattern[2] = EAN13_LEFT(parity, 3, digits[3]);
+	pattern[3] = EAN13_LEFT(parity, 2, digits[4]);
+	pattern[4] = EAN13_LEFT(parity, 1, digits[5]);
+	pattern[5] = EAN13_LEFT(parity, 0, digits[6]);
+	pattern[6] = ean13_right_pattern[digits[7]];
+	pattern[7] = ean13_right_pattern[digits[8]];
+	pattern[8] = ean13_right_pattern[digits[9]];
+	pattern[9] = ean13_right_pattern[digits[10]];
+	pattern[10] = ean13_right_pattern[digits[11]];
+	pattern[11] = ean13_right_pattern[check];
+
+	return ean13_store_row(pattern, output);
+}
+
+//build the lane kernel tables from the pattern tables
+static void ean13_lane_tables(struct kernel_ean_tables *tables) {
+	s32 i;
+	memset(tables, 0, sizeof(*tables));
+	for (i = 0; i < 10; i++) {
+		tables->left_odd[i] = ean13_left_odd_pattern[i];
+		tables->left_even[i] = ean13_left_even_pattern[i];
+		tables->right[i] = ean13_right_pattern[i];
+		tables->parity[i] = ean13_left_parity_table[i];
+	}
+}
+
+//input_len 12 for EAN-13, 11 for UPC-A which is EAN-13 with a leading 0
+static s32 ean13_encode_lanes(const s8 *const *input, s32 count, s32 input_len,
+		u8 *output, s32 stride, s32 *checksum) {
+	struct kernel_ean_tables tables;
+	struct kernel_ean_lanes lanes;
+	//one label per row, characters in, patterns out
+	u8 record[KERNEL_LANES][16];
+	s32 base, lane_num, i, j;
+	s32 encoded = 0;
+
+	if (input == NULL || output == NULL || checksum == NULL || count < 0 ||
+			stride < EAN13_ROW_BYTES) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	ean13_lane_tables(&tables);
+	memset(&lanes, '0', sizeof(lanes));
+
+	for (base = 0; base < count; base += KERNEL_LANES) {
+		lane_num = (count - base < KERNEL_LANES) ? (count - base) : KERNEL_LANES;
+		memset(record, '0', sizeof(record));
+		for (j = 0; j < lane_num; j++) {
+			if (input[base + j] == NULL || strnlen(input[base + j], EAN13_INPUT_LEN + 1) != (size_t)input_len) {
+				//not a digit, the lane comes back invalid
+				record[j][EAN13_INPUT_LEN - 1] = 'x';
+			} else {
+				memcpy(record[j] + EAN13_INPUT_LEN - input_len, input[base + j], input_len);
+			}
+		}
+		//transpose in: lanes.digit[i][j] is character i of label j
+		for (j = 0; j < lane_num; j += 16) {
+			kernel_transpose16(record[j], sizeof(record[0]), &lanes.digit[0][j], KERNEL_LANES);
+		}
+		kernel_ean13_lanes(&tables, &lanes, lane_num);
+		//transpose out: record[j] holds the patterns of label j
+		for (j = 0; j < lane_num; j += 16) {
+			kernel_transpose16(&lanes.pattern[0][j], KERNEL_LANES, record[j], sizeof(record[0]));
+		}
+
+		for (j = 0, i = base; j < lane_num; j++, i++) {
+			if (record[j][KERNEL_EAN_VALID] == 0) {
+				printf("%s %d input err:%d\n",__func__,__LINE__,i);
+				TRACE_ERROR();
+				memset(output + i * stride, 0, EAN13_ROW_BYTES);
+				checksum[i] = -1;
+				continue;
+			}
+			ean13_store_row(record[j], output + i * stride);
+			checksum[i] = record[j][KERNEL_EAN_CHECK];
+			encoded++;
+		}
+	}
+	return encoded;
+}
+
+/**
+ * @brief encode a batch of ean13 labels side by side, one SIMD byte lane per label
+ *
+ * the labels are transposed into lanes, validated, check digited and looked
+ * up together, then transposed back into one packed row per label
+ *
+ * @param input: count strings of 12 digits
+ * @param count: number of labels
+ * @param output: count packed rows, stride bytes apart
+ * @param stride: at least (ean13_max_len() + 7) / 8
+ * @param checksum: count check digits, -1 for a refused label(its row is zeroed)
+ *
+ * @return number of labels encoded
+ */
+s32 ean13_encode_batch(const s8 *const *input, s32 count, u8 *output, s32 stride, s32 *checksum) {
+	return ean13_encode_lanes(input, count, EAN13_INPUT_LEN, output, stride, checksum);
+}
+
+/**
+ * @brief same as ean13_encode_batch() for 11 digit UPC-A, a UPC-A row is the
+ * EAN-13 row of '0' + input
+ */
+s32 ean13_encode_upca_batch(const s8 *const *input, s32 count, u8 *output, s32 stride, s32 *checksum) {
+	return ean13_encode_lanes(input, count, EAN13_INPUT_LEN - 1, output, stride, checksum);
+}
@@ -4,12 +4,30 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+#define EAN13_APPEND_BLANK
+
+//add left blank to display human readable string(first digit)
+#ifdef EAN13_APPEND_BLANK
+#define EAN13_BLANK_LEN				8
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef EAN13_APPEND_BLANK
+#define EAN13_QUIET_LEN		(EAN13_BLANK_LEN << 1)
+#else
+#define EAN13_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 ean13_max_len(const s8 *input);
 s32 ean13_encode(const s8 *input, s8 *output, s32 *checksum);
+s32 ean13_encode_packed(const s8 *input, u8 *output, s32 *checksum);
+s32 ean13_encode_batch(const s8 *const *input, s32 count, u8 *output, s32 stride, s32 *checksum);
+s32 ean13_encode_upca_batch(const s8 *const *input, s32 count, u8 *output, s32 stride, s32 *checksum);
 
 #ifdef __cplusplus
 }
@@ -11,22 +11,12 @@
 #include <string.h>
 
 #include "ean8.h"
+#include "trace.h"
+#include "check.h"
+#include "kernel.h"
 
 //https://en.wikipedia.org/wiki/International_Article_Number
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-#define EAN8_APPEND_BLANK
-
-//add left blank to display human readable string(first digit)
-#ifdef EAN8_APPEND_BLANK
-#define EAN8_BLANK_LEN				8
-#endif
-
-
 #define EAN8_INPUT_LEN				7
 #define EAN8_PATTERN_LEN			7
 //start/stop
@@ -81,21 +71,14 @@ static s32 ean8_append_marker(s32 index, s8 *out) {
 	s32 marker = ean8_marker_pattern[index];
 	s32 marker_len = index ? EAN8_CENTER_PATTERN_LEN : EAN8_MARKER_PATTERN_LEN;
 	for (i = marker_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(marker & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (marker & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return marker_len;
 }
 
 static s32 ean8_append_data(const s8 *input, s8 *out, s32 *checksum) {
 	s32 i,j;
 	s32 sum = 0;
-	s32 weight = 0;
 	s32 index = 0;
 	s32 append_len = 0;
 	s32 total_len = 0;
@@ -105,30 +88,18 @@ static s32 ean8_append_data(const s8 *input, s8 *out, s32 *checksum) {
 		index = *(input+i) - '0';
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto err;
 		}
-#ifdef DEBUG
-		printf("%c index:%d->", *(input+i), index);
-#endif
-		weight = ((i%2) == 0) ? 3 : 1;
-		sum += index * weight;
 		pattern = ean8_left_pattern[index];
+		TRACE_SYMBOL("ean8", index, pattern);
 		for (j = EAN8_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-			printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 			*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 		}
 		total_len += EAN8_PATTERN_LEN;
-#ifdef DEBUG
-		printf("\n");
-#endif
 	}
 
 	//append center marker
-#ifdef DEBUG
-	printf("center->");
-#endif
 	append_len = ean8_append_marker(EAN8_CENTER_MARKER_INDEX, out);
 	total_len += append_len;
 	out += append_len;
@@ -138,41 +109,25 @@ static s32 ean8_append_data(const s8 *input, s8 *out, s32 *checksum) {
 		index = *(input+i) - '0';
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto err;
 		}
-#ifdef DEBUG
-		printf("%c index:%d->", *(input+i), index);
-#endif
 		pattern = ean8_right_pattern[index];
-		weight = ((i%2) == 0) ? 3 : 1;
-		sum += index * weight;
+		TRACE_SYMBOL("ean8", index, pattern);
 		for (j = EAN8_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-			printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 			*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 		}
-#ifdef DEBUG
-		printf("\n");
-#endif
 		total_len += EAN8_PATTERN_LEN;
 	}
 	//append checksum(modulo 10)
-	sum = (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
+	sum = check_mod10(input, EAN8_INPUT_LEN);
 	*checksum = sum;
-#ifdef DEBUG
-	printf("check:%d->",sum);
-#endif
+	TRACE_CHECKSUM("ean8", sum);
 	pattern = ean8_right_pattern[sum];
+	TRACE_SYMBOL("ean8", sum, pattern);
 	for (j = EAN8_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	total_len += EAN8_PATTERN_LEN;
 
 	return total_len;
@@ -201,11 +156,14 @@ s32 ean8_encode(const s8 *input, s8 *output, s32 *checksum) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("ean8", input);
 	if (input_len != EAN8_INPUT_LEN) {
 		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 
@@ -216,9 +174,6 @@ s32 ean8_encode(const s8 *input, s8 *output, s32 *checksum) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("start->");
-#endif
 	//append start code
 	append_len = ean8_append_marker(EAN8_MARKER_INDEX, output);
 	output += append_len;
@@ -228,14 +183,12 @@ s32 ean8_encode(const s8 *input, s8 *output, s32 *checksum) {
 	append_len = ean8_append_data(input, output, checksum);
 	if (append_len < 0) {
 		printf("%s %d end\n",__func__,__LINE__);
+		barcode_len = 0;
 		goto end;
 	}
 	output += append_len;
 	barcode_len += append_len;
 
-#ifdef DEBUG
-	printf("stop->");
-#endif
 	//append stop code
 	append_len = ean8_append_marker(EAN8_MARKER_INDEX, output);
 	output += append_len;
@@ -251,3 +204,58 @@ s32 ean8_encode(const s8 *input, s8 *output, s32 *checksum) {
 end:
 	return barcode_len;
 }
+
+#ifdef EAN8_APPEND_BLANK
+#define EAN8_ROW_BLANK_LEN		EAN8_BLANK_LEN
+#else
+#define EAN8_ROW_BLANK_LEN		0
+#endif
+//row = blank + start + 4 left + center | 4 right + stop + blank
+#define EAN8_ROW_LEFT_LEN		(EAN8_ROW_BLANK_LEN + EAN8_MARKER_PATTERN_LEN + 4 * EAN8_PATTERN_LEN + EAN8_CENTER_PATTERN_LEN)
+#define EAN8_ROW_RIGHT_LEN		(4 * EAN8_PATTERN_LEN + EAN8_MARKER_PATTERN_LEN + EAN8_ROW_BLANK_LEN)
+
+/**
+ * @brief encode input by ean8 straight into a packed row
+ *
+ * @param input: 7 digits
+ * @param output: packed data, first module is the MSB, at least (ean8_max_len() + 7) / 8 bytes
+ * @param checksum: check digit
+ *
+ * @return length of coded data(modules), 0 on error
+ */
+s32 ean8_encode_packed(const s8 *input, u8 *output, s32 *checksum) {
+	u8 digits[16];
+	u64 left, right;
+	s32 check;
+
+	if (input == NULL || output == NULL || checksum == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	if (strlen(input) != EAN8_INPUT_LEN || kernel_load_digits(input, EAN8_INPUT_LEN, digits) < 0) {
+		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	TRACE_SYMBOL_START("ean8", input);
+	check = kernel_mod10(digits, 0);
+	*checksum = check;
+	TRACE_CHECKSUM("ean8", check);
+
+	left = ean8_marker_pattern[EAN8_MARKER_INDEX];
+	left = (left << EAN8_PATTERN_LEN) | ean8_left_pattern[digits[0]];
+	left = (left << EAN8_PATTERN_LEN) | ean8_left_pattern[digits[1]];
+	left = (left << EAN8_PATTERN_LEN) | ean8_left_pattern[digits[2]];
+	left = (left << EAN8_PATTERN_LEN) | ean8_left_pattern[digits[3]];
+	left = (left << EAN8_CENTER_PATTERN_LEN) | ean8_marker_pattern[EAN8_CENTER_MARKER_INDEX];
+
+	right = ean8_right_pattern[digits[4]];
+	right = (right << EAN8_PATTERN_LEN) | ean8_right_pattern[digits[5]];
+	right = (right << EAN8_PATTERN_LEN) | ean8_right_pattern[digits[6]];
+	right = (right << EAN8_PATTERN_LEN) | ean8_right_pattern[check];
+	right = (right << EAN8_MARKER_PATTERN_LEN) | ean8_marker_pattern[EAN8_MARKER_INDEX];
+	right <<= EAN8_ROW_BLANK_LEN;
+
+	return kernel_store_row(output, left, EAN8_ROW_LEFT_LEN, right, EAN8_ROW_RIGHT_LEN);
+}
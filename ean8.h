@@ -4,12 +4,28 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+#define EAN8_APPEND_BLANK
+
+//add left blank to display human readable string(first digit)
+#ifdef EAN8_APPEND_BLANK
+#define EAN8_BLANK_LEN				8
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef EAN8_APPEND_BLANK
+#define EAN8_QUIET_LEN		(EAN8_BLANK_LEN << 1)
+#else
+#define EAN8_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 ean8_max_len(const s8 *input);
 s32 ean8_encode(const s8 *input, s8 *output, s32 *checksum);
+s32 ean8_encode_packed(const s8 *input, u8 *output, s32 *checksum);
 
 #ifdef __cplusplus
 }
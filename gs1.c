@@ -0,0 +1,334 @@
+/**
+ * @file gs1.c
+ * @brief GS1-128 element strings, application identifiers to code128 input
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "code128.h"
+#include "trace.h"
+#include "check.h"
+#include "gs1.h"
+
+//data character sets
+enum {
+	GS1_N = 0,	//digits
+	GS1_X		//GS1 AI encodable character set 82
+};
+
+//AI digits
+#define GS1_AI_MIN		2
+#define GS1_AI_MAX		4
+
+//element strings shorter than this are parsed on the stack, not malloc()
+#define GS1_STACK		256
+
+#define GS1_IS_DIGIT(c)	((c) >= '0' && (c) <= '9')
+
+static const s8 GS1_CSET82[] = "!\"%&'()*+,-./0123456789:;<=>?ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+
+struct gs1_ai {
+	//AI digits, '#' matches any digit(decimal point position or a range)
+	const s8 *ai;
+	s32 charset;
+	s32 min;
+	s32 max;
+	//last data digit is a mod 10 check digit
+	s32 check;
+};
+
+static const struct gs1_ai gs1_ai_table[] = {
+	{"00", GS1_N, 18, 18, 1},		//SSCC
+	{"01", GS1_N, 14, 14, 1},		//GTIN
+	{"02", GS1_N, 14, 14, 1},		//GTIN of contained trade items
+	{"10", GS1_X, 1, 20, 0},		//batch or lot
+	{"11", GS1_N, 6, 6, 0},			//production date
+	{"12", GS1_N, 6, 6, 0},			//due date
+	{"13", GS1_N, 6, 6, 0},			//packaging date
+	{"15", GS1_N, 6, 6, 0},			//best before date
+	{"16", GS1_N, 6, 6, 0},			//sell by date
+	{"17", GS1_N, 6, 6, 0},			//expiration date
+	{"20", GS1_N, 2, 2, 0},			//internal product variant
+	{"21", GS1_X, 1, 20, 0},		//serial number
+	{"22", GS1_X, 1, 20, 0},		//consumer product variant
+	{"235", GS1_X, 1, 28, 0},		//third party controlled serial
+	{"240", GS1_X, 1, 30, 0},		//additional product id
+	{"241", GS1_X, 1, 30, 0},		//customer part number
+	{"242", GS1_N, 1, 6, 0},		//made-to-order variation
+	{"243", GS1_X, 1, 20, 0},		//packaging component number
+	{"250", GS1_X, 1, 30, 0},		//secondary serial number
+	{"251", GS1_X, 1, 30, 0},		//reference to source entity
+	{"253", GS1_X, 13, 30, 0},		//GDTI
+	{"254", GS1_X, 1, 20, 0},		//GLN extension
+	{"255", GS1_N, 13, 25, 0},		//GCN
+	{"30", GS1_N, 1, 8, 0},			//variable count
+	{"31##", GS1_N, 6, 6, 0},		//trade measures
+	{"32##", GS1_N, 6, 6, 0},
+	{"33##", GS1_N, 6, 6, 0},		//logistic measures
+	{"34##", GS1_N, 6, 6, 0},
+	{"35##", GS1_N, 6, 6, 0},
+	{"36##", GS1_N, 6, 6, 0},
+	{"37", GS1_N, 1, 8, 0},			//count of trade items
+	{"390#", GS1_N, 1, 15, 0},		//amount payable
+	{"391#", GS1_N, 4, 18, 0},		//amount payable with currency
+	{"392#", GS1_N, 1, 15, 0},
+	{"393#", GS1_N, 4, 18, 0},
+	{"394#", GS1_N, 4, 4, 0},		//coupon discount
+	{"395#", GS1_N, 6, 6, 0},		//amount payable per unit
+	{"400", GS1_X, 1, 30, 0},		//customer purchase order
+	{"401", GS1_X, 1, 30, 0},		//GINC
+	{"402", GS1_N, 17, 17, 1},		//GSIN
+	{"403", GS1_X, 1, 30, 0},		//routing code
+	{"41#", GS1_N, 13, 13, 1},		//GLN ship to, bill to, ...
+	{"420", GS1_X, 1, 20, 0},		//ship to postal code
+	{"421", GS1_X, 4, 12, 0},		//ship to postal code with country
+	{"422", GS1_N, 3, 3, 0},		//country of origin
+	{"423", GS1_N, 3, 15, 0},		//country of initial processing
+	{"424", GS1_N, 3, 3, 0},
+	{"425", GS1_N, 3, 15, 0},
+	{"426", GS1_N, 3, 3, 0},
+	{"427", GS1_X, 1, 3, 0},
+	{"7001", GS1_N, 13, 13, 0},		//NATO stock number
+	{"7002", GS1_X, 1, 30, 0},
+	{"7003", GS1_N, 10, 10, 0},		//expiration date and time
+	{"7004", GS1_N, 1, 4, 0},
+	{"7005", GS1_X, 1, 12, 0},
+	{"7006", GS1_N, 6, 6, 0},
+	{"7007", GS1_N, 6, 12, 0},
+	{"7008", GS1_X, 1, 3, 0},
+	{"7009", GS1_X, 1, 10, 0},
+	{"7010", GS1_X, 1, 2, 0},
+	{"7020", GS1_X, 1, 20, 0},
+	{"7021", GS1_X, 1, 20, 0},
+	{"7022", GS1_X, 1, 20, 0},
+	{"7023", GS1_X, 1, 30, 0},
+	{"703#", GS1_X, 4, 30, 0},		//processor with country
+	{"71#", GS1_X, 1, 20, 0},		//national healthcare reimbursement number
+	{"8001", GS1_N, 14, 14, 0},		//roll products
+	{"8002", GS1_X, 1, 20, 0},
+	{"8003", GS1_X, 14, 30, 0},		//GRAI
+	{"8004", GS1_X, 1, 30, 0},		//GIAI
+	{"8005", GS1_N, 6, 6, 0},
+	{"8006", GS1_N, 18, 18, 0},
+	{"8007", GS1_X, 1, 34, 0},		//IBAN
+	{"8008", GS1_N, 8, 12, 0},
+	{"8009", GS1_X, 1, 50, 0},
+	{"8010", GS1_X, 1, 30, 0},
+	{"8011", GS1_N, 1, 12, 0},
+	{"8012", GS1_X, 1, 20, 0},
+	{"8013", GS1_X, 1, 25, 0},
+	{"8017", GS1_N, 18, 18, 1},		//GSRN provider
+	{"8018", GS1_N, 18, 18, 1},		//GSRN recipient
+	{"8019", GS1_N, 1, 10, 0},
+	{"8020", GS1_X, 1, 25, 0},
+	{"8026", GS1_N, 18, 18, 0},
+	{"8110", GS1_X, 1, 70, 0},		//coupon code
+	{"8111", GS1_N, 4, 4, 0},
+	{"8112", GS1_X, 1, 70, 0},
+	{"8200", GS1_X, 1, 70, 0},		//extended packaging URL
+	{"90", GS1_X, 1, 30, 0},		//mutually agreed
+	{"9#", GS1_X, 1, 90, 0}			//company internal
+};
+
+//AIs whose first two digits give a predefined length(AI + data), they are
+//never followed by FNC1; every other AI is, unless it ends the symbol
+static const s8 gs1_predefined[][3] = {
+	"00", "01", "02", "03", "04", "11", "12", "13", "14", "15", "16", "17",
+	"18", "19", "20", "31", "32", "33", "34", "35", "36", "41"
+};
+
+static const struct gs1_ai *gs1_ai_lookup(const s8 *ai, s32 ai_len) {
+	const struct gs1_ai *entry;
+	s32 i, k;
+	for (i = 0; i < (s32)(sizeof(gs1_ai_table) / sizeof(gs1_ai_table[0])); i++) {
+		entry = &gs1_ai_table[i];
+		if ((s32)strlen(entry->ai) != ai_len) {
+			continue;
+		}
+		for (k = 0; k < ai_len && (entry->ai[k] == '#' || entry->ai[k] == ai[k]); k++)
+			;
+		if (k == ai_len) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static s32 gs1_is_predefined(const s8 *ai) {
+	s32 i;
+	for (i = 0; i < (s32)(sizeof(gs1_predefined) / sizeof(gs1_predefined[0])); i++) {
+		if (ai[0] == gs1_predefined[i][0] && ai[1] == gs1_predefined[i][1]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static s32 gs1_check_data(const struct gs1_ai *entry, const s8 *data, s32 len) {
+	s32 i;
+	if (len < entry->min || len > entry->max) {
+		return -1;
+	}
+	for (i = 0; i < len; i++) {
+		if (entry->charset == GS1_N ? !GS1_IS_DIGIT(data[i]) :
+				(data[i] == '\0' || strchr(GS1_CSET82, data[i]) == NULL)) {
+			return -1;
+		}
+	}
+	if (entry->check && check_mod10(data, len - 1) != data[len - 1] - '0') {
+		return -1;
+	}
+	return 0;
+}
+
+//gs1_parse(), quiet when only measuring: a refused input is not an error there
+static s32 gs1_convert(const s8 *input, s8 *output, s32 output_size, s32 quiet) {
+	const struct gs1_ai *entry = NULL;
+	const s8 *ai = NULL;
+	const s8 *data = NULL;
+	s32 ai_len = 0;
+	s32 data_len = 0;
+	s32 separator = 0;
+	s32 len = 0;
+
+	if (input == NULL || output == NULL || *input != '(') {
+		if (!quiet) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+		}
+		return 0;
+	}
+	if (output_size <= GS1_FNC1_CODE_LEN) {
+		if (!quiet) {
+			printf("%s %d buffer too small\n",__func__,__LINE__);
+		}
+		return 0;
+	}
+	memcpy(output, GS1_FNC1_CODE, GS1_FNC1_CODE_LEN);
+	len = GS1_FNC1_CODE_LEN;
+
+	while (*input == '(') {
+		ai = input + 1;
+		for (ai_len = 0; GS1_IS_DIGIT(ai[ai_len]); ai_len++)
+			;
+		if (ai[ai_len] != ')' || ai_len < GS1_AI_MIN || ai_len > GS1_AI_MAX) {
+			if (!quiet) {
+				printf("%s %d bad AI at:%s\n",__func__,__LINE__,input);
+				TRACE_ERROR();
+			}
+			return 0;
+		}
+		data = ai + ai_len + 1;
+		for (data_len = 0; data[data_len] != '\0' && data[data_len] != '('; data_len++)
+			;
+		entry = gs1_ai_lookup(ai, ai_len);
+		if (entry == NULL || gs1_check_data(entry, data, data_len) < 0) {
+			if (!quiet) {
+				printf("%s %d bad element:%.*s\n",__func__,__LINE__,ai_len + data_len + 2,input);
+				TRACE_ERROR();
+			}
+			return 0;
+		}
+
+		if (len + separator + ai_len + data_len >= output_size) {
+			if (!quiet) {
+				printf("%s %d buffer too small\n",__func__,__LINE__);
+			}
+			return 0;
+		}
+		//the separator of the previous element, only written when one follows
+		if (separator) {
+			memcpy(output + len, GS1_FNC1_CODE, GS1_FNC1_CODE_LEN);
+			len += GS1_FNC1_CODE_LEN;
+		}
+		memcpy(output + len, ai, ai_len);
+		len += ai_len;
+		memcpy(output + len, data, data_len);
+		len += data_len;
+		separator = gs1_is_predefined(ai) ? 0 : GS1_FNC1_CODE_LEN;
+
+		input = data + data_len;
+	}
+	output[len] = '\0';
+	return len;
+}
+
+/**
+ * @brief convert a GS1 element string to code128 input
+ *
+ * "(01)09501101530003(17)250101(10)ABC123(21)42" becomes
+ * "[FNC1]01095011015300031725010110ABC123[FNC1]2142": elements keep their
+ * order, FNC1 follows an element only where the AI length is not predefined
+ * and another element comes after it. Data may not contain '('.
+ *
+ * @param input: element string, every AI in parentheses
+ * @param output: code128 input, see code128_encode()
+ * @param output_size: size of output
+ *
+ * @return length of output, 0 on error
+ */
+s32 gs1_parse(const s8 *input, s8 *output, s32 output_size) {
+	return gs1_convert(input, output, output_size, 0);
+}
+
+//the FNC1 of an element takes no more symbols than its parentheses
+s32 gs1_max_len(const s8 *input) {
+	return code128_max_len(input);
+}
+
+//encoded into output, or only measured when output is NULL
+static s32 gs1_run(const s8 *input, s8 *output) {
+	s8 str_stack[GS1_STACK];
+	s8 *str = str_stack;
+	s32 str_size = 0;
+	s32 barcode_len = 0;
+
+	//a separator in place of the parentheses adds 4 characters to an element
+	//of at least 5
+	str_size = (strlen(input) << 1) + GS1_FNC1_CODE_LEN + 1;
+	if (str_size > GS1_STACK) {
+		str = (s8*)malloc(str_size);
+		if (str == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return 0;
+		}
+	}
+	if (gs1_convert(input, str, str_size, output == NULL) > 0) {
+		barcode_len = (output != NULL) ? code128_encode(str, output) : code128_width(str);
+	}
+	if (str != str_stack) {
+		free(str);
+	}
+	return barcode_len;
+}
+
+/**
+ * @brief encode a GS1 element string as GS1-128
+ *
+ * @param input: element string, such as "(00)095011015300000010(21)A1"
+ * @param output: coded data,format is binary array, at least gs1_max_len()
+ *
+ * @return length of coded data, 0 on error
+ */
+s32 gs1_encode(const s8 *input, s8 *output) {
+	if (input == NULL || output == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	return gs1_run(input, output);
+}
+
+//exact length of the coded data without encoding, 0 when input is refused
+s32 gs1_width(const s8 *input) {
+	if (input == NULL) {
+		return 0;
+	}
+	return gs1_run(input, NULL);
+}
@@ -0,0 +1,24 @@
+#ifndef __GS1_H__
+#define __GS1_H__
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//field separator in the code128 input written by gs1_parse()
+#define GS1_FNC1_CODE		"[FNC1]"
+#define GS1_FNC1_CODE_LEN	6
+
+s32 gs1_parse(const s8 *input, s8 *output, s32 output_size);
+s32 gs1_max_len(const s8 *input);
+s32 gs1_encode(const s8 *input, s8 *output);
+s32 gs1_width(const s8 *input);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * @file gtin.c
+ * @brief UPC-E, EAN-8, UPC-A, EAN-13 and GTIN-14 conversion by lookup tables
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "trace.h"
+#include "gtin.h"
+
+//https://www.gs1.org/standards/id-keys/gtin
+//http://www.barcodeisland.com/upce.phtml#Conversion
+
+//every code is a record of 16 digit values, right aligned like its GTIN-14
+//form: UPC-A number system at 4, the 10 digits after it at 5-14, check at 15
+#define GTIN_RECORD_LEN		16
+#define GTIN_SYSTEM_POS		4
+#define GTIN_BODY_POS		5
+#define GTIN_CHECK_POS		15
+//record positions in front of a UPC-A
+#define GTIN_UPCA_LEAD		0x000F
+
+#define GTIN_UPCE_DIGITS	6
+#define GTIN_UPCA_DIGITS	11
+//UPC-E digit that is not taken from the record
+#define GTIN_LITERAL		16
+
+static const s8 *gtin_names[GTIN_NUM] = {"upce", "ean8", "upca", "ean13", "gtin14"};
+static const s32 gtin_lens[GTIN_NUM] = {8, 8, 12, 13, 14};
+
+//format by length, 8 digits are EAN-8: UPC-E has to be asked for
+static const s8 gtin_by_len[GTIN_LEN_MAX + 1] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, GTIN_EAN8, -1, -1, -1, GTIN_UPCA, GTIN_EAN13, GTIN_14
+};
+
+//UPC-E to UPC-A by the last UPC-E digit: the 10 digits after the number
+//system, index of the UPC-E digit or -1 for a 0
+#define GTIN_EXPAND_012		{0, 1, 5, -1, -1, -1, -1, 2, 3, 4}	//ab?00 00cde
+#define GTIN_EXPAND_3		{0, 1, 2, -1, -1, -1, -1, -1, 3, 4}	//abc00 000de
+#define GTIN_EXPAND_4		{0, 1, 2, 3, -1, -1, -1, -1, -1, 4}	//abcd0 0000e
+#define GTIN_EXPAND_5_9		{0, 1, 2, 3, 4, -1, -1, -1, -1, 5}	//abcde 0000?
+
+static const s8 gtin_upce_expand[10][10] = {
+	GTIN_EXPAND_012, GTIN_EXPAND_012, GTIN_EXPAND_012, GTIN_EXPAND_3, GTIN_EXPAND_4,
+	GTIN_EXPAND_5_9, GTIN_EXPAND_5_9, GTIN_EXPAND_5_9, GTIN_EXPAND_5_9, GTIN_EXPAND_5_9
+};
+
+//UPC-A to UPC-E, the first rule whose zeros are there and whose limited
+//digit is in range wins; the same tables run backwards
+struct gtin_upce_rule {
+	//record positions that must be 0, bit i is position i
+	u16 zeros;
+	//record position of the limited digit and its range
+	s8 pos;
+	s8 min;
+	s8 max;
+	//UPC-E digits: record position, or GTIN_LITERAL + digit
+	s8 digit[GTIN_UPCE_DIGITS];
+};
+
+static const struct gtin_upce_rule gtin_upce_rules[] = {
+	{0x0F00, 7, 0, 2, {5, 6, 12, 13, 14, 7}},
+	{0x1F00, 5, 0, 9, {5, 6, 7, 13, 14, GTIN_LITERAL + 3}},
+	{0x3E00, 5, 0, 9, {5, 6, 7, 8, 14, GTIN_LITERAL + 4}},
+	{0x3C00, 14, 5, 9, {5, 6, 7, 8, 9, 14}}
+};
+
+//bit i set when record position i is 0
+static inline u32 gtin_zeros(const u8 *record) {
+#ifdef __SSE2__
+	__m128i value = _mm_loadu_si128((const __m128i*)record);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(value, _mm_setzero_si128()));
+#else
+	u32 zeros = 0;
+	s32 i;
+	for (i = 0; i < GTIN_RECORD_LEN; i++) {
+		zeros |= (record[i] == 0) << i;
+	}
+	return zeros;
+#endif
+}
+
+//UPC-E system, 6 digits and check at record positions 8-15 become a UPC-A record
+static inline s32 gtin_expand(u8 *record) {
+	u8 upca[GTIN_RECORD_LEN] = {0};
+	const s8 *expand = gtin_upce_expand[record[14]];
+	s32 i;
+	if (record[8] > 1) {
+		return -1;
+	}
+	upca[GTIN_SYSTEM_POS] = record[8];
+	for (i = 0; i < 10; i++) {
+		upca[GTIN_BODY_POS + i] = (expand[i] < 0) ? 0 : record[9 + expand[i]];
+	}
+	upca[GTIN_CHECK_POS] = record[15];
+	memcpy(record, upca, GTIN_RECORD_LEN);
+	return 0;
+}
+
+//6 UPC-E digit values of a UPC-A record, -1 when it has no UPC-E form
+static inline s32 gtin_compress(const u8 *record, u32 zeros, u8 *upce) {
+	const struct gtin_upce_rule *rule;
+	s32 i, j;
+	if ((zeros & GTIN_UPCA_LEAD) != GTIN_UPCA_LEAD || record[GTIN_SYSTEM_POS] > 1) {
+		return -1;
+	}
+	for (i = 0; i < (s32)(sizeof(gtin_upce_rules) / sizeof(gtin_upce_rules[0])); i++) {
+		rule = &gtin_upce_rules[i];
+		if ((zeros & rule->zeros) == rule->zeros && record[(s32)rule->pos] >= rule->min &&
+				record[(s32)rule->pos] <= rule->max) {
+			for (j = 0; j < GTIN_UPCE_DIGITS; j++) {
+				upce[j] = (rule->digit[j] >= GTIN_LITERAL) ? (rule->digit[j] - GTIN_LITERAL) : record[(s32)rule->digit[j]];
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
+
+//code of format from(-1: by length) to a record with a valid check digit
+static inline s32 gtin_load(const s8 *input, s32 len, s32 from, u8 *record) {
+	if (from < 0) {
+		from = (len <= GTIN_LEN_MAX) ? gtin_by_len[len] : -1;
+	}
+	if (from < 0 || from >= GTIN_NUM || len != gtin_lens[from] || kernel_load_record(input, len, record) < 0) {
+		return -1;
+	}
+	if (from == GTIN_UPCE && gtin_expand(record) < 0) {
+		return -1;
+	}
+	//weights 3,1 from the left of 16 positions end with weight 1 on the check digit
+	return (kernel_mod10(record, 0) == 0) ? 0 : -1;
+}
+
+//record to code of format to, returns its length, -1 when it has no such form
+static inline s32 gtin_store(const u8 *record, s32 to, s8 *output) {
+	u8 upce[GTIN_UPCE_DIGITS];
+	s8 text[GTIN_RECORD_LEN];
+	u32 zeros = gtin_zeros(record);
+	u32 lead;
+	s32 len, i;
+
+	if (to == GTIN_UPCE) {
+		if (gtin_compress(record, zeros, upce) < 0) {
+			return -1;
+		}
+		output[0] = '0' + record[GTIN_SYSTEM_POS];
+		for (i = 0; i < GTIN_UPCE_DIGITS; i++) {
+			output[1 + i] = '0' + upce[i];
+		}
+		output[1 + GTIN_UPCE_DIGITS] = '0' + record[GTIN_CHECK_POS];
+		output[2 + GTIN_UPCE_DIGITS] = '\0';
+		return 2 + GTIN_UPCE_DIGITS;
+	}
+	//positions in front of the code must be 0
+	len = gtin_lens[to];
+	lead = (1u << (GTIN_RECORD_LEN - len)) - 1;
+	if ((zeros & lead) != lead) {
+		return -1;
+	}
+#ifdef __SSE2__
+	_mm_storeu_si128((__m128i*)text, _mm_add_epi8(_mm_loadu_si128((const __m128i*)record), _mm_set1_epi8('0')));
+#else
+	for (i = 0; i < GTIN_RECORD_LEN; i++) {
+		text[i] = '0' + record[i];
+	}
+#endif
+	//every code is 8 digits or more: two overlapping fixed size copies
+	memcpy(output, text + GTIN_RECORD_LEN - len, 8);
+	memcpy(output + len - 8, text + GTIN_RECORD_LEN - 8, 8);
+	output[len] = '\0';
+	return len;
+}
+
+s32 gtin_lookup(const s8 *name) {
+	s32 i;
+	if (name == NULL) {
+		return -1;
+	}
+	for (i = 0; i < GTIN_NUM; i++) {
+		if (strcmp(gtin_names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+s32 gtin_len(s32 format) {
+	if (format < 0 || format >= GTIN_NUM) {
+		return 0;
+	}
+	return gtin_lens[format];
+}
+
+/**
+ * @brief expand 6 UPC-E digits to the 11 UPC-A digits without check digit
+ *
+ * @param upce: 6 digits
+ * @param system: number system '0' or '1'
+ * @param upca: 11 digits, not terminated
+ *
+ * @return 0, -1 on error
+ */
+s32 gtin_upce_to_upca(const s8 *upce, s8 system, s8 *upca) {
+	const s8 *expand = NULL;
+	s32 i;
+	if (upce == NULL || upca == NULL || (system != '0' && system != '1') ||
+			kernel_check_digits(upce, GTIN_UPCE_DIGITS) != GTIN_UPCE_DIGITS) {
+		return -1;
+	}
+	expand = gtin_upce_expand[upce[GTIN_UPCE_DIGITS - 1] - '0'];
+	upca[0] = system;
+	for (i = 0; i < 10; i++) {
+		upca[1 + i] = (expand[i] < 0) ? '0' : upce[(s32)expand[i]];
+	}
+	return 0;
+}
+
+/**
+ * @brief compress 11 UPC-A digits(without check digit) to 6 UPC-E digits
+ *
+ * @param upca: 11 digits, number system '0' or '1' first
+ * @param upce: 6 digits, not terminated
+ *
+ * @return 0, -1 when there is no UPC-E form
+ */
+s32 gtin_upca_to_upce(const s8 *upca, s8 *upce) {
+	s8 code[GTIN_UPCA_DIGITS + 1];
+	u8 record[GTIN_RECORD_LEN];
+	u8 digit[GTIN_UPCE_DIGITS];
+	s32 i;
+	if (upca == NULL || upce == NULL) {
+		return -1;
+	}
+	//a check digit place keeps the record layout
+	memcpy(code, upca, GTIN_UPCA_DIGITS);
+	code[GTIN_UPCA_DIGITS] = '0';
+	if (kernel_load_record(code, GTIN_UPCA_DIGITS + 1, record) < 0 ||
+			gtin_compress(record, gtin_zeros(record), digit) < 0) {
+		return -1;
+	}
+	for (i = 0; i < GTIN_UPCE_DIGITS; i++) {
+		upce[i] = '0' + digit[i];
+	}
+	return 0;
+}
+
+/**
+ * @brief convert a code between UPC-E, EAN-8, UPC-A, EAN-13 and GTIN-14
+ *
+ * the check digit is verified and carried over, all forms of a code share
+ * the GTIN-14 check digit. Widening always works, narrowing needs the
+ * dropped leading digits to be 0(and a UPC-E form for UPC-E).
+ *
+ * @param input: code with its check digit
+ * @param from: GTIN_XXX, -1 tells by the length(8 digits are EAN-8)
+ * @param to: GTIN_XXX
+ * @param output: code, at least GTIN_LEN_MAX + 1 bytes
+ *
+ * @return length of output, -1 on error
+ */
+s32 gtin_normalize(const s8 *input, s32 from, s32 to, s8 *output) {
+	u8 record[GTIN_RECORD_LEN];
+	s32 len;
+
+	if (input == NULL || output == NULL || to < 0 || to >= GTIN_NUM) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (gtin_load(input, strlen(input), from, record) < 0) {
+		printf("%s %d input err:%s\n",__func__,__LINE__,input);
+		TRACE_ERROR();
+		return -1;
+	}
+	len = gtin_store(record, to, output);
+	if (len < 0) {
+		printf("%s %d no %s form:%s\n",__func__,__LINE__,gtin_names[to],input);
+	}
+	return len;
+}
+
+/**
+ * @brief normalize a column of codes, nothing is printed for refused codes
+ *
+ * @param input: count codes with their check digits
+ * @param from: count GTIN_XXX, NULL tells every code by its length
+ * @param count: number of codes
+ * @param to: GTIN_XXX
+ * @param output: count codes, stride bytes apart, empty on error
+ * @param stride: at least GTIN_LEN_MAX + 1
+ * @param result: count lengths of output, -1 for a refused code
+ *
+ * @return number of codes converted, -1 on error
+ */
+s32 gtin_normalize_batch(const s8 *const *input, const s32 *from, s32 count, s32 to, s8 *output, s32 stride,
+		s32 *result) {
+	u8 record[GTIN_RECORD_LEN];
+	s8 *out = NULL;
+	s32 converted = 0;
+	s32 i;
+
+	if (input == NULL || output == NULL || result == NULL || count < 0 || to < 0 || to >= GTIN_NUM ||
+			stride <= GTIN_LEN_MAX) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		out = output + (size_t)i * stride;
+		result[i] = -1;
+		if (input[i] != NULL && gtin_load(input[i], strlen(input[i]), (from != NULL) ? from[i] : -1, record) == 0) {
+			result[i] = gtin_store(record, to, out);
+		}
+		if (result[i] < 0) {
+			*out = '\0';
+		} else {
+			converted++;
+		}
+	}
+	return converted;
+}
@@ -0,0 +1,36 @@
+#ifndef __GTIN_H__
+#define __GTIN_H__
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//code formats, digit strings ending with their check digit
+enum {
+	GTIN_UPCE = 0,	//8 digits: number system 0 or 1, 6 digits, check digit
+	GTIN_EAN8,		//8 digits
+	GTIN_UPCA,		//12 digits
+	GTIN_EAN13,		//13 digits
+	GTIN_14,		//14 digits
+	GTIN_NUM
+};
+
+//longest code, an output row takes one more byte
+#define GTIN_LEN_MAX		14
+
+s32 gtin_lookup(const s8 *name);
+s32 gtin_len(s32 format);
+s32 gtin_upce_to_upca(const s8 *upce, s8 system, s8 *upca);
+s32 gtin_upca_to_upce(const s8 *upca, s8 *upce);
+s32 gtin_normalize(const s8 *input, s32 from, s32 to, s8 *output);
+s32 gtin_normalize_batch(const s8 *const *input, const s32 *from, s32 count, s32 to, s8 *output, s32 stride,
+		s32 *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
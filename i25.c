@@ -11,26 +11,18 @@
 #include <string.h>
 
 #include "i25.h"
+#include "trace.h"
+#include "kernel.h"
 
 //https://en.wikipedia.org/wiki/Interleaved_2_of_5
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-//#define I25_APPEND_BLANK
-
-#ifdef I25_APPEND_BLANK
-#define I25_BLANK_LEN		10
-#endif
-
-
 #define I25_START			0xA	//1010
 #define I25_STOP			0xD	//1101
 #define I25_START_STOP_LEN	4
 #define I25_PATTERN_NUM		10
 #define I25_PATTERN_LEN		5
+//2 wide + 3 narrow bars, 2 wide + 3 narrow spaces
+#define I25_PAIR_LEN		14
 
 
 static s8 *i25_pattern[] = {
@@ -56,56 +48,46 @@ static s32 i25_append_blank(s8 *out) {
 static s32 i25_append_marker(s32 code, s8 *out) {
 	s32 i;
 	for (i = 4; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(code & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (code & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return I25_START_STOP_LEN;
 }
 
-static s32 i25_append_data(const s32 input_len, const s8 *input, s8 *output) {
-	s32 i,j,k;
+//interleave the digit pair at input(bars: 1st digit, spaces: 2nd digit)
+static s32 i25_append_pair(const s8 *input, s8 *output) {
+	s32 j,k;
 	s8 *high;
 	s8 *low;
 	s8 sum[I25_PATTERN_LEN<<1];
 	s32 bit = 0;
-	s32 len = 0;
 
-	for(i=0; i<input_len; i+=2) {
-#ifdef DEBUG
-		printf("%c+%c->",*(input+i),*(input+i+1));
-#endif
-		//mapping 1st digit and 2st digit
-		high = i25_pattern[*(input+i) - '0']; 
-		low = i25_pattern[*(input+i+1) - '0']; 
-
-		//interleaved merge 1st and 2st digit
-		for(j=0; j<(I25_PATTERN_LEN<<1); j+=2) {
-			sum[j] = *high++;
-			sum[j+1] = *low++;
-		}
-		//convet to binary
-		for(k=0; k<(I25_PATTERN_LEN<<1); k++) {
-			bit = (k%2) ? 0 : 1;
-#ifdef DEBUG
-			printf("%d",bit);
-#endif
-			if (sum[k] == 'W') {
-				*output++ = bit;
-#ifdef DEBUG
-			printf("%d",bit);
-#endif
-			}
+	//mapping 1st digit and 2st digit
+	high = i25_pattern[*input - '0'];
+	low = i25_pattern[*(input+1) - '0'];
+	TRACE_SYMBOL("i25", (*input - '0') * 10 + (*(input+1) - '0'), -1);
+
+	//interleaved merge 1st and 2st digit
+	for(j=0; j<(I25_PATTERN_LEN<<1); j+=2) {
+		sum[j] = *high++;
+		sum[j+1] = *low++;
+	}
+	//convet to binary
+	for(k=0; k<(I25_PATTERN_LEN<<1); k++) {
+		bit = (k%2) ? 0 : 1;
+		if (sum[k] == 'W') {
 			*output++ = bit;
 		}
-#ifdef DEBUG
-		printf("\n");
-#endif
-		len += 14;
+		*output++ = bit;
+	}
+	return I25_PAIR_LEN;
+}
+
+static s32 i25_append_data(const s32 input_len, const s8 *input, s8 *output) {
+	s32 i;
+	s32 len = 0;
+
+	for(i=0; i<input_len; i+=2) {
+		len += i25_append_pair(input + i, output + len);
 	}
 	return len;
 }
@@ -114,7 +96,7 @@ static s32 i25_append_data(const s32 input_len, const s8 *input, s8 *output) {
 s32 i25_max_len(const s8 *input) {
 	s32 len = 0;
 	if (input != NULL) {
-		len = (strlen(input) >> 1) * 14 + 4 + 4;
+		len = (strlen(input) >> 1) * I25_PAIR_LEN + 4 + 4;
 #ifdef I25_APPEND_BLANK
 		len += (I25_BLANK_LEN << 1);
 #endif
@@ -130,11 +112,15 @@ s32 i25_encode(const s8 *input, s8 *output) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
-	if (input_len % 2 != 0) {
+	TRACE_SYMBOL_START("i25", input);
+	//odd lengths and non-digits would index the pattern table out of bounds
+	if (input_len % 2 != 0 || kernel_check_digits(input, input_len) != input_len) {
 		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 
@@ -145,9 +131,6 @@ s32 i25_encode(const s8 *input, s8 *output) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("start->");
-#endif
 	//append start
 	append_len = i25_append_marker(I25_START, output);
 	output += append_len;
@@ -158,9 +141,6 @@ s32 i25_encode(const s8 *input, s8 *output) {
 	output += append_len;
 	barcode_len += append_len;
 
-#ifdef DEBUG
-	printf("stop->");
-#endif
 	//append stop
 	append_len = i25_append_marker(I25_STOP, output);
 	output += append_len;
@@ -178,3 +158,19 @@ end:
 
 }
 
+//first module of digit pair index
+s32 i25_pair_offset(s32 index) {
+	s32 offset = I25_START_STOP_LEN + index * I25_PAIR_LEN;
+#ifdef I25_APPEND_BLANK
+	offset += I25_BLANK_LEN;
+#endif
+	return offset;
+}
+
+//write the modules of the digit pair at input, returns their length
+s32 i25_pair_pattern(const s8 *input, s8 *output) {
+	if (input[0] < '0' || input[0] > '9' || input[1] < '0' || input[1] > '9') {
+		return 0;
+	}
+	return i25_append_pair(input, output);
+}
@@ -4,12 +4,28 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+//#define I25_APPEND_BLANK
+
+#ifdef I25_APPEND_BLANK
+#define I25_BLANK_LEN		10
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef I25_APPEND_BLANK
+#define I25_QUIET_LEN		(I25_BLANK_LEN << 1)
+#else
+#define I25_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 i25_max_len(const s8 *input);
 s32 i25_encode(const s8 *input, s8 *output);
+s32 i25_pair_offset(s32 index);
+s32 i25_pair_pattern(const s8 *input, s8 *output);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,863 @@
+/**
+ * @file kernel.c
+ * @brief runtime dispatch of the packing, scaling, digit validation and EAN lane kernels
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86
+#define KERNEL_SSE42	__attribute__((target("sse4.2,ssse3,popcnt")))
+#define KERNEL_AVX2		__attribute__((target("avx2,bmi2,popcnt")))
+#define KERNEL_AVX512	__attribute__((target("avx512f,avx512bw,avx512vl,avx2,bmi2,popcnt")))
+#endif
+
+//selftest input sizes
+#define KERNEL_TEST_LEN		300
+#define KERNEL_TEST_ROUNDS	20
+//row bytes of the transpose test block, wider than the 8 bytes of a block
+#define KERNEL_TRANSPOSE_TEST	24
+
+struct kernel_variant {
+	s32 (*pack_bits)(const s8 *bin, s32 len, u8 *out);
+	s32 (*scale_modules)(const u8 *row, s32 bits, s32 scale, u8 *out);
+	s32 (*check_digits)(const s8 *buf, s32 len);
+	void (*ean13_lanes)(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count);
+	void (*check_sums)(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum);
+	void (*transpose64)(const u8 *in, s32 in_stride, u8 *out, s32 out_stride);
+};
+
+static s32 kernel_bound_level = -1;
+
+/*
+ * scalar reference, every other variant must give the same result
+ */
+static s32 kernel_pack_bits_scalar(const s8 *bin, s32 len, u8 *out) {
+	s32 i;
+	s32 bytes = (len + 7) >> 3;
+	memset(out, 0, bytes);
+	for (i = 0; i < len; i++) {
+		if (bin[i]) {
+			out[i >> 3] |= 0x80 >> (i & 7);
+		}
+	}
+	return bytes;
+}
+
+static s32 kernel_scale_modules_scalar(const u8 *row, s32 bits, s32 scale, u8 *out) {
+	s32 i, j;
+	s32 pos = 0;
+	s32 bytes = (bits * scale + 7) >> 3;
+	memset(out, 0, bytes);
+	for (i = 0; i < bits; i++) {
+		if (row[i >> 3] & (0x80 >> (i & 7))) {
+			for (j = pos; j < pos + scale; j++) {
+				out[j >> 3] |= 0x80 >> (j & 7);
+			}
+		}
+		pos += scale;
+	}
+	return bytes;
+}
+
+static s32 kernel_check_digits_scalar(const s8 *buf, s32 len) {
+	s32 i;
+	for (i = 0; i < len; i++) {
+		if (buf[i] < '0' || buf[i] > '9') {
+			break;
+		}
+	}
+	return i;
+}
+
+static void kernel_ean13_lanes_scalar(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count) {
+	u8 digit[12];
+	s32 i, j, sum, check, valid;
+	for (j = 0; j < count; j++) {
+		sum = 0;
+		valid = 0xFF;
+		for (i = 0; i < 12; i++) {
+			digit[i] = lanes->digit[i][j] - '0';
+			if (digit[i] > 9) {
+				valid = 0;
+			}
+			sum += digit[i] * ((i & 1) ? 3 : 1);
+			digit[i] &= 0x0F;
+		}
+		check = (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
+		for (i = 1; i <= 6; i++) {
+			lanes->pattern[i - 1][j] = (tables->parity[digit[0]] & (1 << (6 - i))) ?
+				tables->left_odd[digit[i]] : tables->left_even[digit[i]];
+		}
+		for (; i < 12; i++) {
+			lanes->pattern[i - 1][j] = tables->right[digit[i]];
+		}
+		lanes->pattern[11][j] = tables->right[check];
+		lanes->pattern[KERNEL_EAN_CHECK][j] = check;
+		lanes->pattern[KERNEL_EAN_VALID][j] = valid;
+	}
+}
+
+static void kernel_check_sums_scalar(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum) {
+	s32 i, j, v;
+	for (j = 0; j < count; j++) {
+		sum[j] = 0;
+		for (i = 0; i < KERNEL_CHECK_LEN; i++) {
+			v = value[j * KERNEL_CHECK_LEN + i];
+			if (weights->luhn[i]) {
+				v = (v << 1) - ((v > 4) ? 9 : 0);
+			}
+			sum[j] += v * weights->weight[i];
+		}
+	}
+}
+
+//flip an 8x8 bit block about its anti-diagonal: byte k is row k with column
+//c at bit 7 - c, the result has column c in byte c with row k at bit 7 - k
+static inline u64 kernel_flip8(u64 x) {
+	u64 t;
+	t = x ^ (x << 36);
+	x ^= 0xF0F0F0F00F0F0F0FULL & (t ^ (x >> 36));
+	t = 0xCCCC0000CCCC0000ULL & (x ^ (x << 18));
+	x ^= t ^ (t >> 18);
+	t = 0xAA00AA00AA00AA00ULL & (x ^ (x << 9));
+	x ^= t ^ (t >> 9);
+	return x;
+}
+
+//gather an 8x8 block a byte per row, flip it, scatter a byte per row
+static void kernel_transpose64_scalar(const u8 *in, s32 in_stride, u8 *out, s32 out_stride) {
+	u64 x;
+	s32 bi, bj, k;
+	for (bi = 0; bi < 8; bi++) {
+		for (bj = 0; bj < 8; bj++) {
+			x = 0;
+			for (k = 0; k < 8; k++) {
+				x |= (u64)in[(bi * 8 + k) * in_stride + bj] << (k << 3);
+			}
+			x = kernel_flip8(x);
+			for (k = 0; k < 8; k++) {
+				out[(bj * 8 + k) * out_stride + bi] = x >> (k << 3);
+			}
+		}
+	}
+}
+
+#ifdef KERNEL_X86
+//reverse each group of 8 modules so movemask puts the first module in the MSB
+#define KERNEL_PACK_SHUFFLE	7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+
+//8x8 byte transpose in every 128-bit lane of r[0-7](low 8 bytes used): word j
+//of the result has byte j of every row, row k in byte k; w[m] holds words 2m, 2m+1
+#define KERNEL_BYTE_T8(P, T, r, w) do { \
+	T u0 = P##unpacklo_epi8(r[0], r[1]); \
+	T u1 = P##unpacklo_epi8(r[2], r[3]); \
+	T u2 = P##unpacklo_epi8(r[4], r[5]); \
+	T u3 = P##unpacklo_epi8(r[6], r[7]); \
+	T v0 = P##unpacklo_epi16(u0, u1); \
+	T v1 = P##unpackhi_epi16(u0, u1); \
+	T v2 = P##unpacklo_epi16(u2, u3); \
+	T v3 = P##unpackhi_epi16(u2, u3); \
+	w[0] = P##unpacklo_epi32(v0, v2); \
+	w[1] = P##unpackhi_epi32(v0, v2); \
+	w[2] = P##unpacklo_epi32(v1, v3); \
+	w[3] = P##unpackhi_epi32(v1, v3); \
+} while (0)
+
+//kernel_flip8() on every 64-bit word of x
+#define KERNEL_FLIP8(P, S, T, x) do { \
+	T t = P##xor_##S(x, P##slli_epi64(x, 36)); \
+	x = P##xor_##S(x, P##and_##S(P##set1_epi64x((s64)0xF0F0F0F00F0F0F0FULL), P##xor_##S(t, P##srli_epi64(x, 36)))); \
+	t = P##and_##S(P##set1_epi64x((s64)0xCCCC0000CCCC0000ULL), P##xor_##S(x, P##slli_epi64(x, 18))); \
+	x = P##xor_##S(x, P##xor_##S(t, P##srli_epi64(t, 18))); \
+	t = P##and_##S(P##set1_epi64x((s64)0xAA00AA00AA00AA00ULL), P##xor_##S(x, P##slli_epi64(x, 9))); \
+	x = P##xor_##S(x, P##xor_##S(t, P##srli_epi64(t, 9))); \
+} while (0)
+
+/*
+ * SSE4.2: pshufb + pmovmskb packing, pcmpestri range compare, 16 characters a time
+ */
+KERNEL_SSE42
+static s32 kernel_pack_bits_sse42(const s8 *bin, s32 len, u8 *out) {
+	const __m128i shuffle = _mm_setr_epi8(KERNEL_PACK_SHUFFLE);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i data;
+	u32 mask;
+	s32 i = 0;
+	for (; i + 16 <= len; i += 16) {
+		data = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(bin + i)), shuffle);
+		mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(data, zero));
+		out[i >> 3] = mask;
+		out[(i >> 3) + 1] = mask >> 8;
+	}
+	kernel_pack_bits_scalar(bin + i, len - i, out + (i >> 3));
+	return (len + 7) >> 3;
+}
+
+KERNEL_SSE42
+static s32 kernel_check_digits_sse42(const s8 *buf, s32 len) {
+	const __m128i range = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i data;
+	s32 i = 0;
+	s32 index;
+	for (; i + 16 <= len; i += 16) {
+		data = _mm_loadu_si128((const __m128i*)(buf + i));
+		index = _mm_cmpestri(range, 2, data, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+				_SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+		if (index < 16) {
+			return i + index;
+		}
+	}
+	return i + kernel_check_digits_scalar(buf + i, len - i);
+}
+
+//EAN-13 sum is at most 216 for valid lanes, reduce it modulo 10 by
+//conditional subtraction: min(s, s - k) keeps s when s - k wraps around
+#define KERNEL_MOD10_STEPS	160, 80, 40, 20, 10
+
+KERNEL_SSE42
+static void kernel_ean13_lanes_sse42(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count) {
+	static const u8 steps[] = {KERNEL_MOD10_STEPS};
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i ten = _mm_set1_epi8(10);
+	const __m128i left_odd = _mm_loadu_si128((const __m128i*)tables->left_odd);
+	const __m128i left_even = _mm_loadu_si128((const __m128i*)tables->left_even);
+	const __m128i right = _mm_loadu_si128((const __m128i*)tables->right);
+	const __m128i parity_table = _mm_loadu_si128((const __m128i*)tables->parity);
+	__m128i digit[12];
+	__m128i valid, sum, check, parity, bit;
+	s32 i, j;
+	for (j = 0; j < count; j += 16) {
+		valid = _mm_set1_epi8(-1);
+		sum = _mm_setzero_si128();
+		for (i = 0; i < 12; i++) {
+			digit[i] = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)&lanes->digit[i][j]), zero);
+			valid = _mm_and_si128(valid, _mm_cmpeq_epi8(_mm_min_epu8(digit[i], nine), digit[i]));
+			sum = _mm_add_epi8(sum, digit[i]);
+			if (i & 1) {
+				sum = _mm_add_epi8(sum, _mm_add_epi8(digit[i], digit[i]));
+			}
+		}
+		for (i = 0; i < (s32)sizeof(steps); i++) {
+			sum = _mm_min_epu8(sum, _mm_sub_epi8(sum, _mm_set1_epi8(steps[i])));
+		}
+		check = _mm_sub_epi8(ten, sum);
+		check = _mm_min_epu8(check, _mm_sub_epi8(check, ten));
+
+		parity = _mm_shuffle_epi8(parity_table, digit[0]);
+		for (i = 1; i <= 6; i++) {
+			bit = _mm_set1_epi8(1 << (6 - i));
+			_mm_storeu_si128((__m128i*)&lanes->pattern[i - 1][j], _mm_blendv_epi8(
+					_mm_shuffle_epi8(left_even, digit[i]), _mm_shuffle_epi8(left_odd, digit[i]),
+					_mm_cmpeq_epi8(_mm_and_si128(parity, bit), bit)));
+		}
+		for (; i < 12; i++) {
+			_mm_storeu_si128((__m128i*)&lanes->pattern[i - 1][j], _mm_shuffle_epi8(right, digit[i]));
+		}
+		_mm_storeu_si128((__m128i*)&lanes->pattern[11][j], _mm_shuffle_epi8(right, check));
+		_mm_storeu_si128((__m128i*)&lanes->pattern[KERNEL_EAN_CHECK][j], check);
+		_mm_storeu_si128((__m128i*)&lanes->pattern[KERNEL_EAN_VALID][j], valid);
+	}
+}
+
+//a record per register: pmaddubsw and pmaddwd leave 4 partial sums, two
+//rounds of phaddd reduce 4 records to one register
+KERNEL_SSE42
+static void kernel_check_sums_sse42(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum) {
+	const __m128i weight = _mm_loadu_si128((const __m128i*)weights->weight);
+	const __m128i luhn = _mm_loadu_si128((const __m128i*)weights->luhn);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i four = _mm_set1_epi8(4);
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i v, part[4];
+	s32 i, j;
+	for (j = 0; j + 4 <= count; j += 4) {
+		for (i = 0; i < 4; i++) {
+			v = _mm_loadu_si128((const __m128i*)(value + (j + i) * KERNEL_CHECK_LEN));
+			v = _mm_blendv_epi8(v, _mm_sub_epi8(_mm_add_epi8(v, v), _mm_and_si128(_mm_cmpgt_epi8(v, four), nine)), luhn);
+			part[i] = _mm_madd_epi16(_mm_maddubs_epi16(v, weight), one);
+		}
+		v = _mm_hadd_epi32(_mm_hadd_epi32(part[0], part[1]), _mm_hadd_epi32(part[2], part[3]));
+		_mm_storeu_si128((__m128i*)(sum + j), v);
+	}
+	kernel_check_sums_scalar(value + j * KERNEL_CHECK_LEN, count - j, weights, sum + j);
+}
+
+//byte transpose 8 rows into column words, flip them, byte transpose the
+//flipped words back into output rows; 2 words a vector
+KERNEL_SSE42
+static void kernel_transpose64_sse42(const u8 *in, s32 in_stride, u8 *out, s32 out_stride) {
+	u64 y[8][8];
+	__m128i r[8];
+	__m128i w[4];
+	s32 b, k, m;
+	for (b = 0; b < 8; b++) {
+		for (k = 0; k < 8; k++) {
+			r[k] = _mm_loadl_epi64((const __m128i*)(in + (b * 8 + k) * in_stride));
+		}
+		KERNEL_BYTE_T8(_mm_, __m128i, r, w);
+		for (m = 0; m < 4; m++) {
+			KERNEL_FLIP8(_mm_, si128, __m128i, w[m]);
+			_mm_storeu_si128((__m128i*)&y[b][m * 2], w[m]);
+		}
+	}
+	//y[bi][bj] byte k is byte bi of output row bj * 8 + k
+	for (b = 0; b < 8; b++) {
+		for (k = 0; k < 8; k++) {
+			r[k] = _mm_loadl_epi64((const __m128i*)&y[k][b]);
+		}
+		KERNEL_BYTE_T8(_mm_, __m128i, r, w);
+		for (m = 0; m < 4; m++) {
+			_mm_storel_epi64((__m128i*)(out + (b * 8 + m * 2) * out_stride), w[m]);
+			_mm_storel_epi64((__m128i*)(out + (b * 8 + m * 2 + 1) * out_stride), _mm_unpackhi_epi64(w[m], w[m]));
+		}
+	}
+}
+
+/*
+ * AVX2: 32 modules or characters a time, BMI2 pdep for scaling
+ */
+KERNEL_AVX2
+static s32 kernel_pack_bits_avx2(const s8 *bin, s32 len, u8 *out) {
+	const __m256i shuffle = _mm256_setr_epi8(KERNEL_PACK_SHUFFLE, KERNEL_PACK_SHUFFLE);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i data;
+	u32 mask;
+	s32 i = 0;
+	for (; i + 32 <= len; i += 32) {
+		data = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(bin + i)), shuffle);
+		mask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, zero));
+		//little endian: mask byte 0 holds modules 0-7
+		memcpy(out + (i >> 3), &mask, sizeof(mask));
+	}
+	kernel_pack_bits_scalar(bin + i, len - i, out + (i >> 3));
+	return (len + 7) >> 3;
+}
+
+KERNEL_AVX2
+static s32 kernel_check_digits_avx2(const s8 *buf, s32 len) {
+	const __m256i zero = _mm256_set1_epi8('0');
+	const __m256i nine = _mm256_set1_epi8(9);
+	__m256i value;
+	u32 mask;
+	s32 i = 0;
+	for (; i + 32 <= len; i += 32) {
+		//c - '0' <= 9 unsigned
+		value = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(buf + i)), zero);
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(value, nine), value));
+		if (mask != 0xFFFFFFFF) {
+			return i + __builtin_ctz(~mask);
+		}
+	}
+	return i + kernel_check_digits_scalar(buf + i, len - i);
+}
+
+//one input byte becomes scale output bytes: deposit the 8 bits scale apart
+//then multiply to smear each bit over its scale positions
+KERNEL_AVX2
+static s32 kernel_scale_modules_bmi2(const u8 *row, s32 bits, s32 scale, u8 *out) {
+	u64 deposit = 0;
+	u64 value;
+	s32 bytes = (bits * scale + 7) >> 3;
+	s32 full = bits >> 3;
+	s32 rest = bits & 7;
+	s32 i, j, k;
+	if (scale < 1 || scale > 8) {
+		return kernel_scale_modules_scalar(row, bits, scale, out);
+	}
+	for (k = 0; k < 8; k++) {
+		deposit |= 1UL << (k * scale);
+	}
+	for (i = 0, j = 0; i < full; i++) {
+		value = _pdep_u64(row[i], deposit) * ((1UL << scale) - 1);
+		for (k = scale - 1; k >= 0; k--) {
+			out[j++] = value >> (k << 3);
+		}
+	}
+	if (rest) {
+		value = _pdep_u64(row[full] & (0xFF << (8 - rest)), deposit) * ((1UL << scale) - 1);
+		for (k = scale - 1; j < bytes; k--) {
+			out[j++] = value >> (k << 3);
+		}
+	}
+	return bytes;
+}
+
+//pshufb looks up within each 128-bit lane, so the tables are broadcast
+KERNEL_AVX2
+static void kernel_ean13_lanes_avx2(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count) {
+	static const u8 steps[] = {KERNEL_MOD10_STEPS};
+	const __m256i zero = _mm256_set1_epi8('0');
+	const __m256i nine = _mm256_set1_epi8(9);
+	const __m256i ten = _mm256_set1_epi8(10);
+	const __m256i left_odd = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->left_odd));
+	const __m256i left_even = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->left_even));
+	const __m256i right = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->right));
+	const __m256i parity_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->parity));
+	__m256i digit[12];
+	__m256i valid, sum, check, parity, bit;
+	s32 i, j;
+	for (j = 0; j < count; j += 32) {
+		valid = _mm256_set1_epi8(-1);
+		sum = _mm256_setzero_si256();
+		for (i = 0; i < 12; i++) {
+			digit[i] = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)&lanes->digit[i][j]), zero);
+			valid = _mm256_and_si256(valid, _mm256_cmpeq_epi8(_mm256_min_epu8(digit[i], nine), digit[i]));
+			sum = _mm256_add_epi8(sum, digit[i]);
+			if (i & 1) {
+				sum = _mm256_add_epi8(sum, _mm256_add_epi8(digit[i], digit[i]));
+			}
+		}
+		for (i = 0; i < (s32)sizeof(steps); i++) {
+			sum = _mm256_min_epu8(sum, _mm256_sub_epi8(sum, _mm256_set1_epi8(steps[i])));
+		}
+		check = _mm256_sub_epi8(ten, sum);
+		check = _mm256_min_epu8(check, _mm256_sub_epi8(check, ten));
+
+		parity = _mm256_shuffle_epi8(parity_table, digit[0]);
+		for (i = 1; i <= 6; i++) {
+			bit = _mm256_set1_epi8(1 << (6 - i));
+			_mm256_storeu_si256((__m256i*)&lanes->pattern[i - 1][j], _mm256_blendv_epi8(
+					_mm256_shuffle_epi8(left_even, digit[i]), _mm256_shuffle_epi8(left_odd, digit[i]),
+					_mm256_cmpeq_epi8(_mm256_and_si256(parity, bit), bit)));
+		}
+		for (; i < 12; i++) {
+			_mm256_storeu_si256((__m256i*)&lanes->pattern[i - 1][j], _mm256_shuffle_epi8(right, digit[i]));
+		}
+		_mm256_storeu_si256((__m256i*)&lanes->pattern[11][j], _mm256_shuffle_epi8(right, check));
+		_mm256_storeu_si256((__m256i*)&lanes->pattern[KERNEL_EAN_CHECK][j], check);
+		_mm256_storeu_si256((__m256i*)&lanes->pattern[KERNEL_EAN_VALID][j], valid);
+	}
+}
+
+//two records per register, vphaddd works per 128-bit lane so the sums come
+//out as records 0,2,4,6 | 1,3,5,7 and are put back in order
+KERNEL_AVX2
+static void kernel_check_sums_avx2(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum) {
+	const __m256i weight = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)weights->weight));
+	const __m256i luhn = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)weights->luhn));
+	const __m256i nine = _mm256_set1_epi8(9);
+	const __m256i four = _mm256_set1_epi8(4);
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256i v, part[4];
+	s32 i, j;
+	for (j = 0; j + 8 <= count; j += 8) {
+		for (i = 0; i < 4; i++) {
+			v = _mm256_loadu_si256((const __m256i*)(value + (j + 2 * i) * KERNEL_CHECK_LEN));
+			v = _mm256_blendv_epi8(v, _mm256_sub_epi8(_mm256_add_epi8(v, v), _mm256_and_si256(_mm256_cmpgt_epi8(v, four), nine)), luhn);
+			part[i] = _mm256_madd_epi16(_mm256_maddubs_epi16(v, weight), one);
+		}
+		v = _mm256_hadd_epi32(_mm256_hadd_epi32(part[0], part[1]), _mm256_hadd_epi32(part[2], part[3]));
+		_mm256_storeu_si256((__m256i*)(sum + j), _mm256_permutevar8x32_epi32(v, order));
+	}
+	kernel_check_sums_scalar(value + j * KERNEL_CHECK_LEN, count - j, weights, sum + j);
+}
+
+//kernel_transpose64_sse42() with two 8-row groups in the two lanes
+KERNEL_AVX2
+static void kernel_transpose64_avx2(const u8 *in, s32 in_stride, u8 *out, s32 out_stride) {
+	u64 y[8][8];
+	__m256i r[8];
+	__m256i w[4];
+	__m128i lo, hi;
+	s32 b, k, m;
+	for (b = 0; b < 8; b += 2) {
+		for (k = 0; k < 8; k++) {
+			lo = _mm_loadl_epi64((const __m128i*)(in + (b * 8 + k) * in_stride));
+			hi = _mm_loadl_epi64((const __m128i*)(in + (b * 8 + 8 + k) * in_stride));
+			r[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		}
+		KERNEL_BYTE_T8(_mm256_, __m256i, r, w);
+		for (m = 0; m < 4; m++) {
+			KERNEL_FLIP8(_mm256_, si256, __m256i, w[m]);
+			_mm_storeu_si128((__m128i*)&y[b][m * 2], _mm256_castsi256_si128(w[m]));
+			_mm_storeu_si128((__m128i*)&y[b + 1][m * 2], _mm256_extracti128_si256(w[m], 1));
+		}
+	}
+	for (b = 0; b < 8; b += 2) {
+		for (k = 0; k < 8; k++) {
+			r[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)&y[k][b])),
+					_mm_loadl_epi64((const __m128i*)&y[k][b + 1]), 1);
+		}
+		KERNEL_BYTE_T8(_mm256_, __m256i, r, w);
+		for (m = 0; m < 4; m++) {
+			lo = _mm256_castsi256_si128(w[m]);
+			hi = _mm256_extracti128_si256(w[m], 1);
+			_mm_storel_epi64((__m128i*)(out + (b * 8 + m * 2) * out_stride), lo);
+			_mm_storel_epi64((__m128i*)(out + (b * 8 + m * 2 + 1) * out_stride), _mm_unpackhi_epi64(lo, lo));
+			_mm_storel_epi64((__m128i*)(out + (b * 8 + 8 + m * 2) * out_stride), hi);
+			_mm_storel_epi64((__m128i*)(out + (b * 8 + 8 + m * 2 + 1) * out_stride), _mm_unpackhi_epi64(hi, hi));
+		}
+	}
+}
+
+/*
+ * AVX-512: 64 modules or characters a time, masked load for the tail
+ */
+KERNEL_AVX512
+static s32 kernel_pack_bits_avx512(const s8 *bin, s32 len, u8 *out) {
+	const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(KERNEL_PACK_SHUFFLE));
+	__mmask64 load;
+	__m512i data;
+	u64 mask;
+	s32 i;
+	for (i = 0; i < len; i += 64) {
+		load = (len - i >= 64) ? ~0ULL : ((1ULL << (len - i)) - 1);
+		data = _mm512_shuffle_epi8(_mm512_maskz_loadu_epi8(load, bin + i), shuffle);
+		mask = _mm512_test_epi8_mask(data, data);
+		memcpy(out + (i >> 3), &mask, (len - i >= 64) ? 8 : ((len - i + 7) >> 3));
+	}
+	return (len + 7) >> 3;
+}
+
+KERNEL_AVX512
+static s32 kernel_check_digits_avx512(const s8 *buf, s32 len) {
+	const __m512i zero = _mm512_set1_epi8('0');
+	const __m512i nine = _mm512_set1_epi8(9);
+	__mmask64 load;
+	__mmask64 bad;
+	s32 i;
+	for (i = 0; i < len; i += 64) {
+		load = (len - i >= 64) ? ~0ULL : ((1ULL << (len - i)) - 1);
+		bad = load & ~_mm512_cmple_epu8_mask(
+				_mm512_sub_epi8(_mm512_maskz_loadu_epi8(load, buf + i), zero), nine);
+		if (bad) {
+			return i + __builtin_ctzll(bad);
+		}
+	}
+	return len;
+}
+
+//all KERNEL_LANES lanes in one register, mask registers for validity and parity
+KERNEL_AVX512
+static void kernel_ean13_lanes_avx512(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count) {
+	static const u8 steps[] = {KERNEL_MOD10_STEPS};
+	const __m512i zero = _mm512_set1_epi8('0');
+	const __m512i nine = _mm512_set1_epi8(9);
+	const __m512i ten = _mm512_set1_epi8(10);
+	const __m512i left_odd = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables->left_odd));
+	const __m512i left_even = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables->left_even));
+	const __m512i right = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables->right));
+	const __m512i parity_table = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables->parity));
+	__m512i digit[12];
+	__m512i sum, check, parity;
+	__mmask64 valid = ~0ULL;
+	s32 i;
+	(void)count;
+	sum = _mm512_setzero_si512();
+	for (i = 0; i < 12; i++) {
+		digit[i] = _mm512_sub_epi8(_mm512_loadu_si512(lanes->digit[i]), zero);
+		valid &= _mm512_cmple_epu8_mask(digit[i], nine);
+		sum = _mm512_add_epi8(sum, digit[i]);
+		if (i & 1) {
+			sum = _mm512_add_epi8(sum, _mm512_add_epi8(digit[i], digit[i]));
+		}
+	}
+	for (i = 0; i < (s32)sizeof(steps); i++) {
+		sum = _mm512_min_epu8(sum, _mm512_sub_epi8(sum, _mm512_set1_epi8(steps[i])));
+	}
+	check = _mm512_sub_epi8(ten, sum);
+	check = _mm512_min_epu8(check, _mm512_sub_epi8(check, ten));
+
+	parity = _mm512_shuffle_epi8(parity_table, digit[0]);
+	for (i = 1; i <= 6; i++) {
+		_mm512_storeu_si512(lanes->pattern[i - 1], _mm512_mask_blend_epi8(
+				_mm512_test_epi8_mask(parity, _mm512_set1_epi8(1 << (6 - i))),
+				_mm512_shuffle_epi8(left_even, digit[i]), _mm512_shuffle_epi8(left_odd, digit[i])));
+	}
+	for (; i < 12; i++) {
+		_mm512_storeu_si512(lanes->pattern[i - 1], _mm512_shuffle_epi8(right, digit[i]));
+	}
+	_mm512_storeu_si512(lanes->pattern[11], _mm512_shuffle_epi8(right, check));
+	_mm512_storeu_si512(lanes->pattern[KERNEL_EAN_CHECK], check);
+	_mm512_storeu_si512(lanes->pattern[KERNEL_EAN_VALID], _mm512_movm_epi8(valid));
+}
+
+//four records per register: every 128-bit lane is reduced in place, then one
+//blend and a permute gather 16 sums
+KERNEL_AVX512
+static void kernel_check_sums_avx512(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum) {
+	const __m512i weight = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)weights->weight));
+	const __m512i luhn = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)weights->luhn));
+	const __m512i nine = _mm512_set1_epi8(9);
+	const __m512i one = _mm512_set1_epi16(1);
+	const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	__mmask64 doubled;
+	__m512i v, part;
+	__m512i gather = _mm512_setzero_si512();
+	s32 i, j;
+	for (j = 0; j + 16 <= count; j += 16) {
+		for (i = 0; i < 4; i++) {
+			v = _mm512_loadu_si512((const void*)(value + (j + 4 * i) * KERNEL_CHECK_LEN));
+			doubled = _mm512_test_epi8_mask(luhn, luhn);
+			v = _mm512_mask_sub_epi8(v, doubled, _mm512_add_epi8(v, v),
+					_mm512_maskz_mov_epi8(_mm512_cmpgt_epi8_mask(v, _mm512_set1_epi8(4)), nine));
+			part = _mm512_madd_epi16(_mm512_maddubs_epi16(v, weight), one);
+			part = _mm512_add_epi32(part, _mm512_shuffle_epi32(part, _MM_PERM_BADC));
+			part = _mm512_add_epi32(part, _mm512_shuffle_epi32(part, _MM_PERM_CDAB));
+			//dword i of every lane comes from register i
+			gather = _mm512_mask_mov_epi32(gather, (__mmask16)(0x1111 << i), part);
+		}
+		_mm512_storeu_si512((void*)(sum + j), _mm512_permutexvar_epi32(order, gather));
+	}
+	kernel_check_sums_scalar(value + j * KERNEL_CHECK_LEN, count - j, weights, sum + j);
+}
+#endif
+
+//index is CPU_LEVEL_XXX, NULL keeps the kernel of the level below
+static const struct kernel_variant kernel_variants[CPU_LEVEL_NUM] = {
+	{kernel_pack_bits_scalar, kernel_scale_modules_scalar, kernel_check_digits_scalar, kernel_ean13_lanes_scalar,
+		kernel_check_sums_scalar, kernel_transpose64_scalar},
+#ifdef KERNEL_X86
+	{kernel_pack_bits_sse42, NULL, kernel_check_digits_sse42, kernel_ean13_lanes_sse42, kernel_check_sums_sse42,
+		kernel_transpose64_sse42},
+	{kernel_pack_bits_avx2, kernel_scale_modules_bmi2, kernel_check_digits_avx2, kernel_ean13_lanes_avx2,
+		kernel_check_sums_avx2, kernel_transpose64_avx2},
+	{kernel_pack_bits_avx512, NULL, kernel_check_digits_avx512, kernel_ean13_lanes_avx512, kernel_check_sums_avx512,
+		NULL}
+#endif
+};
+
+static s32 kernel_pack_bits_resolve(const s8 *bin, s32 len, u8 *out) {
+	kernel_init(-1);
+	return kernel_pack_bits(bin, len, out);
+}
+
+static s32 kernel_scale_modules_resolve(const u8 *row, s32 bits, s32 scale, u8 *out) {
+	kernel_init(-1);
+	return kernel_scale_modules(row, bits, scale, out);
+}
+
+static s32 kernel_check_digits_resolve(const s8 *buf, s32 len) {
+	kernel_init(-1);
+	return kernel_check_digits(buf, len);
+}
+
+static void kernel_ean13_lanes_resolve(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count) {
+	kernel_init(-1);
+	kernel_ean13_lanes(tables, lanes, count);
+}
+
+static void kernel_check_sums_resolve(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum) {
+	kernel_init(-1);
+	kernel_check_sums(value, count, weights, sum);
+}
+
+static void kernel_transpose64_resolve(const u8 *in, s32 in_stride, u8 *out, s32 out_stride) {
+	kernel_init(-1);
+	kernel_transpose64(in, in_stride, out, out_stride);
+}
+
+//bound on first use
+s32 (*kernel_pack_bits)(const s8 *bin, s32 len, u8 *out) = kernel_pack_bits_resolve;
+s32 (*kernel_scale_modules)(const u8 *row, s32 bits, s32 scale, u8 *out) = kernel_scale_modules_resolve;
+s32 (*kernel_check_digits)(const s8 *buf, s32 len) = kernel_check_digits_resolve;
+void (*kernel_ean13_lanes)(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count) = kernel_ean13_lanes_resolve;
+void (*kernel_check_sums)(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum) = kernel_check_sums_resolve;
+void (*kernel_transpose64)(const u8 *in, s32 in_stride, u8 *out, s32 out_stride) = kernel_transpose64_resolve;
+
+//kernels of level, inheriting from the levels below
+static void kernel_resolve(s32 level, struct kernel_variant *kernels) {
+	s32 i;
+	*kernels = kernel_variants[CPU_LEVEL_SCALAR];
+	for (i = CPU_LEVEL_SCALAR + 1; i <= level; i++) {
+		if (kernel_variants[i].pack_bits != NULL)
+			kernels->pack_bits = kernel_variants[i].pack_bits;
+		if (kernel_variants[i].scale_modules != NULL)
+			kernels->scale_modules = kernel_variants[i].scale_modules;
+		if (kernel_variants[i].check_digits != NULL)
+			kernels->check_digits = kernel_variants[i].check_digits;
+		if (kernel_variants[i].ean13_lanes != NULL)
+			kernels->ean13_lanes = kernel_variants[i].ean13_lanes;
+		if (kernel_variants[i].check_sums != NULL)
+			kernels->check_sums = kernel_variants[i].check_sums;
+		if (kernel_variants[i].transpose64 != NULL)
+			kernels->transpose64 = kernel_variants[i].transpose64;
+	}
+}
+
+/**
+ * @brief bind the kernel function pointers
+ *
+ * @param level: CPU_LEVEL_XXX, -1 or a level above the machine's selects the best one
+ *
+ * @return bound level
+ */
+s32 kernel_init(s32 level) {
+	struct kernel_variant kernels;
+	s32 best = cpu_level();
+#ifndef KERNEL_X86
+	best = CPU_LEVEL_SCALAR;
+#endif
+	if (level < 0 || level > best) {
+		level = best;
+	}
+	kernel_resolve(level, &kernels);
+	__atomic_store_n(&kernel_pack_bits, kernels.pack_bits, __ATOMIC_RELAXED);
+	__atomic_store_n(&kernel_scale_modules, kernels.scale_modules, __ATOMIC_RELAXED);
+	__atomic_store_n(&kernel_check_digits, kernels.check_digits, __ATOMIC_RELAXED);
+	__atomic_store_n(&kernel_ean13_lanes, kernels.ean13_lanes, __ATOMIC_RELAXED);
+	__atomic_store_n(&kernel_check_sums, kernels.check_sums, __ATOMIC_RELAXED);
+	__atomic_store_n(&kernel_transpose64, kernels.transpose64, __ATOMIC_RELAXED);
+	__atomic_store_n(&kernel_bound_level, level, __ATOMIC_RELAXED);
+	return level;
+}
+
+s32 kernel_level(void) {
+	if (__atomic_load_n(&kernel_bound_level, __ATOMIC_RELAXED) < 0) {
+		kernel_init(-1);
+	}
+	return kernel_bound_level;
+}
+
+/**
+ * @brief cross-check every level this machine can run against the scalar kernels
+ *
+ * @return number of mismatches, 0 when all kernels agree
+ */
+s32 kernel_selftest(void) {
+	const struct kernel_variant *ref = &kernel_variants[CPU_LEVEL_SCALAR];
+	struct kernel_variant kernels;
+	s8 bin[KERNEL_TEST_LEN];
+	u8 row[KERNEL_TEST_LEN];
+	u8 expect[KERNEL_TEST_LEN * 8];
+	u8 got[KERNEL_TEST_LEN * 8];
+	struct kernel_ean_tables tables;
+	struct kernel_ean_lanes lanes_expect, lanes_got;
+	struct kernel_check_weights weights;
+	u8 record[KERNEL_LANES * KERNEL_CHECK_LEN];
+	u32 sum_expect[KERNEL_LANES], sum_got[KERNEL_LANES];
+	u8 block[KERNEL_TRANSPOSE_TEST * 64];
+	s32 errors = 0;
+	s32 best = cpu_level();
+	s32 level, round, len, scale, i, j, a, b;
+	u32 seed = 0x2016;
+
+#ifndef KERNEL_X86
+	best = CPU_LEVEL_SCALAR;
+#endif
+	for (level = CPU_LEVEL_SCALAR + 1; level <= best; level++) {
+		kernel_resolve(level, &kernels);
+		for (round = 0; round < KERNEL_TEST_ROUNDS; round++) {
+			for (len = 0; len < KERNEL_TEST_LEN; len++) {
+				//mostly digits, sometimes a character just outside '0'-'9' or above 127
+				for (i = 0; i < len; i++) {
+					seed = seed * 1103515245 + 12345;
+					bin[i] = '0' + ((seed >> 16) % 10);
+					if (((seed >> 8) & 0x3FF) == 0)
+						bin[i] = "/:\x80\xff"[(seed >> 20) & 3];
+				}
+				a = ref->check_digits(bin, len);
+				b = kernels.check_digits(bin, len);
+				if (a != b) {
+					printf("%s %d %s check_digits len:%d %d!=%d\n",__func__,__LINE__,cpu_level_name(level),len,b,a);
+					errors++;
+				}
+
+				for (i = 0; i < len; i++) {
+					seed = seed * 1103515245 + 12345;
+					bin[i] = (seed >> 16) & 1;
+				}
+				memset(expect, 0xA5, sizeof(expect));
+				memset(got, 0xA5, sizeof(got));
+				a = ref->pack_bits(bin, len, expect);
+				b = kernels.pack_bits(bin, len, got);
+				if (a != b || memcmp(expect, got, sizeof(got)) != 0) {
+					printf("%s %d %s pack_bits len:%d\n",__func__,__LINE__,cpu_level_name(level),len);
+					errors++;
+				}
+
+				ref->pack_bits(bin, len, row);
+				for (scale = 1; scale <= 10; scale++) {
+					memset(expect, 0xA5, sizeof(expect));
+					memset(got, 0xA5, sizeof(got));
+					a = ref->scale_modules(row, len, scale, expect);
+					b = kernels.scale_modules(row, len, scale, got);
+					if (a != b || memcmp(expect, got, sizeof(got)) != 0) {
+						printf("%s %d %s scale_modules len:%d scale:%d\n",__func__,__LINE__,cpu_level_name(level),len,scale);
+						errors++;
+					}
+				}
+			}
+
+			//random tables, invalid lanes only have to be flagged
+			for (i = 0; i < 16; i++) {
+				seed = seed * 1103515245 + 12345;
+				tables.left_odd[i] = seed >> 8;
+				tables.left_even[i] = seed >> 16;
+				tables.right[i] = seed >> 24;
+				tables.parity[i] = (seed >> 4) & 0x3F;
+			}
+			for (i = 0; i < 16; i++) {
+				for (j = 0; j < KERNEL_LANES; j++) {
+					seed = seed * 1103515245 + 12345;
+					lanes_expect.digit[i][j] = '0' + ((seed >> 16) % 10);
+					if (((seed >> 8) & 0x7F) == 0)
+						lanes_expect.digit[i][j] = "/:\x80\xff"[(seed >> 20) & 3];
+				}
+			}
+			memcpy(&lanes_got, &lanes_expect, sizeof(lanes_got));
+			ref->ean13_lanes(&tables, &lanes_expect, KERNEL_LANES);
+			kernels.ean13_lanes(&tables, &lanes_got, KERNEL_LANES);
+			for (j = 0; j < KERNEL_LANES; j++) {
+				a = lanes_expect.pattern[KERNEL_EAN_VALID][j];
+				b = lanes_got.pattern[KERNEL_EAN_VALID][j];
+				for (i = 0; a == b && a != 0 && i <= KERNEL_EAN_CHECK; i++) {
+					b = (lanes_expect.pattern[i][j] == lanes_got.pattern[i][j]) ? a : 0;
+				}
+				if (a != b) {
+					printf("%s %d %s ean13_lanes lane:%d\n",__func__,__LINE__,cpu_level_name(level),j);
+					errors++;
+				}
+			}
+
+			//random weights and Luhn positions, KERNEL_LANES records of values in range
+			for (i = 0; i < KERNEL_CHECK_LEN; i++) {
+				seed = seed * 1103515245 + 12345;
+				weights.weight[i] = (seed >> 16) & 0x7F;
+				weights.luhn[i] = ((seed >> 8) & 1) ? 0xFF : 0;
+			}
+			for (i = 0; i < KERNEL_LANES * KERNEL_CHECK_LEN; i++) {
+				seed = seed * 1103515245 + 12345;
+				record[i] = (seed >> 16) % (weights.luhn[i % KERNEL_CHECK_LEN] ? 10 : 100);
+			}
+			for (len = 0; len <= KERNEL_LANES; len += 7) {
+				memset(sum_expect, 0xA5, sizeof(sum_expect));
+				memset(sum_got, 0xA5, sizeof(sum_got));
+				ref->check_sums(record, len, &weights, sum_expect);
+				kernels.check_sums(record, len, &weights, sum_got);
+				if (memcmp(sum_expect, sum_got, sizeof(sum_got)) != 0) {
+					printf("%s %d %s check_sums count:%d\n",__func__,__LINE__,cpu_level_name(level),len);
+					errors++;
+				}
+			}
+
+			//a block inside wider rows, read bottom up like a clockwise rotation
+			for (i = 0; i < (s32)sizeof(block); i++) {
+				seed = seed * 1103515245 + 12345;
+				block[i] = seed >> 16;
+			}
+			memset(expect, 0xA5, sizeof(expect));
+			memset(got, 0xA5, sizeof(got));
+			len = KERNEL_TRANSPOSE_TEST;
+			ref->transpose64(block + 63 * len + 3, -len, expect + 5, len);
+			kernels.transpose64(block + 63 * len + 3, -len, got + 5, len);
+			if (memcmp(expect, got, sizeof(got)) != 0) {
+				printf("%s %d %s transpose64\n",__func__,__LINE__,cpu_level_name(level));
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
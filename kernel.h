@@ -0,0 +1,221 @@
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include <stddef.h>
+#include <string.h>
+#include "platform.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//pack a byte-per-module array into bytes, first module is the MSB, returns bytes
+extern s32 (*kernel_pack_bits)(const s8 *bin, s32 len, u8 *out);
+//repeat every module of a packed row scale times, returns bytes
+extern s32 (*kernel_scale_modules)(const u8 *row, s32 bits, s32 scale, u8 *out);
+//number of leading '0'-'9' characters in buf
+extern s32 (*kernel_check_digits)(const s8 *buf, s32 len);
+
+/*
+ * EAN-13 lane kernel: up to KERNEL_LANES labels encoded side by side,
+ * byte j of every row belongs to label j
+ */
+#define KERNEL_LANES		64
+
+//rows of kernel_ean_lanes.pattern
+#define KERNEL_EAN_CHECK	12	//check digit value
+#define KERNEL_EAN_VALID	13	//0xFF when all 12 characters are digits
+
+//7-bit module patterns indexed by digit
+struct kernel_ean_tables {
+	u8 left_odd[16];
+	u8 left_even[16];
+	u8 right[16];
+	//left-hand parity by first digit, bit 5 belongs to the second digit, 1:odd
+	u8 parity[16];
+};
+
+struct kernel_ean_lanes {
+	//in: characters 0-11, lanes past count must hold digits too
+	u8 digit[16][KERNEL_LANES];
+	//out: patterns of digits 1-11 then of the check digit, KERNEL_EAN_XXX rows
+	u8 pattern[16][KERNEL_LANES];
+};
+
+extern void (*kernel_ean13_lanes)(const struct kernel_ean_tables *tables, struct kernel_ean_lanes *lanes, s32 count);
+
+/*
+ * check digit sums: records of KERNEL_CHECK_LEN values, right aligned and
+ * zero padded, one weighted sum per record
+ */
+#define KERNEL_CHECK_LEN	16
+
+struct kernel_check_weights {
+	//weight of every position, at most 127
+	u8 weight[KERNEL_CHECK_LEN];
+	//0xFF where the value is doubled and its digits added(Luhn) before weighting
+	u8 luhn[KERNEL_CHECK_LEN];
+};
+
+//values are at most 99(9 on Luhn positions), sum[i] belongs to record i
+extern void (*kernel_check_sums)(const u8 *value, s32 count, const struct kernel_check_weights *weights, u32 *sum);
+
+//transpose a 64x64 bit block, rows of 8 bytes with the first dot in the MSB:
+//dot c of input row r becomes dot r of output row c; strides may be negative
+extern void (*kernel_transpose64)(const u8 *in, s32 in_stride, u8 *out, s32 out_stride);
+
+s32 kernel_init(s32 level);
+s32 kernel_level(void);
+s32 kernel_selftest(void);
+
+/*
+ * helpers of the fixed-geometry encoders (EAN/UPC), SSE2 is baseline on x86-64
+ */
+
+//check len(<=16) digits with one compare, digits[16] gets their values, zero padded
+static inline s32 kernel_load_digits(const s8 *input, s32 len, u8 *digits) {
+	s8 buf[16];
+	memset(buf, '0', sizeof(buf));
+	memcpy(buf, input, len);
+#ifdef __SSE2__
+	__m128i value = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)buf), _mm_set1_epi8('0'));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(value, _mm_set1_epi8(9)), value)) != 0xFFFF) {
+		return -1;
+	}
+	_mm_storeu_si128((__m128i*)digits, value);
+#else
+	s32 i;
+	for (i = 0; i < 16; i++) {
+		digits[i] = buf[i] - '0';
+		if (digits[i] > 9) {
+			return -1;
+		}
+	}
+#endif
+	return 0;
+}
+
+//right align len(1-16) digits, record[16] gets their values, zero padded in
+//front; 8 digits and more are put together from two overlapping loads in
+//registers, going through a buffer would stall on store forwarding
+static inline s32 kernel_load_record(const s8 *input, s32 len, u8 *record) {
+	s8 buf[16];
+#ifdef __SSE2__
+	const u64 zeros = 0x3030303030303030ULL;
+	u64 head, tail;
+	__m128i value;
+	if (len >= 8) {
+		memcpy(&head, input, 8);
+		memcpy(&tail, input + len - 8, 8);
+		//little endian: byte 16 - len of the record is the first digit; 16
+		//digits need no padding, and zeros >> 64 would be undefined
+		if (len == 8) {
+			head = zeros;
+		} else if (len < 16) {
+			head = (head << ((16 - len) << 3)) | (zeros >> ((len - 8) << 3));
+		}
+		value = _mm_sub_epi8(_mm_set_epi64x(tail, head), _mm_set1_epi8('0'));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(value, _mm_set1_epi8(9)), value)) != 0xFFFF) {
+			return -1;
+		}
+		_mm_storeu_si128((__m128i*)record, value);
+		return 0;
+	}
+#endif
+	memset(buf, '0', sizeof(buf));
+	memcpy(buf + 16 - len, input, len);
+	return kernel_load_digits(buf, 16, record);
+}
+
+//modulo 10 check digit of digits[16], weight 3 on positions whose (i & 1) == odd
+static inline s32 kernel_mod10(const u8 *digits, s32 odd) {
+	s32 sum;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight = odd ? _mm_set1_epi16(0xFF00) : _mm_set1_epi16(0x00FF);
+	__m128i value = _mm_loadu_si128((const __m128i*)digits);
+	//horizontal sums of all digits and of the weight 3 digits
+	__m128i all = _mm_sad_epu8(value, zero);
+	__m128i three = _mm_sad_epu8(_mm_and_si128(value, weight), zero);
+	all = _mm_add_epi64(all, _mm_slli_epi64(three, 1));
+	sum = _mm_cvtsi128_si32(all) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(all, all));
+#else
+	s32 i;
+	sum = 0;
+	for (i = 0; i < 16; i++) {
+		sum += digits[i] * (((i & 1) == odd) ? 3 : 1);
+	}
+#endif
+	return (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
+}
+
+//store left(left_bits) followed by right(right_bits) MSB first, 1 <= bits <= 64
+static inline s32 kernel_store_row(u8 *out, u64 left, s32 left_bits, u64 right, s32 right_bits) {
+	u64 hi = left << (64 - left_bits);
+	u64 lo = 0;
+	s32 spill = right_bits - (64 - left_bits);
+	s32 bytes = (left_bits + right_bits + 7) >> 3;
+	u64 row[2];
+	if (spill <= 0) {
+		hi |= right << -spill;
+	} else {
+		hi |= right >> spill;
+		lo = right << (64 - spill);
+	}
+	//big endian puts the first module in the MSB of byte 0
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	hi = __builtin_bswap64(hi);
+	lo = __builtin_bswap64(lo);
+#endif
+	row[0] = hi;
+	row[1] = lo;
+	memcpy(out, row, bytes);
+	return left_bits + right_bits;
+}
+
+#ifdef __SSE2__
+#define KERNEL_UNPACK_ROUND(size) do { \
+	for (i = 0; i < 8; i++) { \
+		t[i] = _mm_unpacklo_##size(x[2 * i], x[2 * i + 1]); \
+		t[i + 8] = _mm_unpackhi_##size(x[2 * i], x[2 * i + 1]); \
+	} \
+	memcpy(x, t, sizeof(x)); \
+} while (0)
+#endif
+
+//transpose a 16x16 byte matrix, rows stride bytes apart
+static inline void kernel_transpose16(const u8 *in, s32 in_stride, u8 *out, s32 out_stride) {
+#ifdef __SSE2__
+	//after unpacking 8, 16, 32 and 64 bits row i holds column bitreverse(i)
+	static const u8 order[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+	__m128i x[16], t[16];
+	s32 i;
+	for (i = 0; i < 16; i++) {
+		x[i] = _mm_loadu_si128((const __m128i*)(in + i * in_stride));
+	}
+	KERNEL_UNPACK_ROUND(epi8);
+	KERNEL_UNPACK_ROUND(epi16);
+	KERNEL_UNPACK_ROUND(epi32);
+	KERNEL_UNPACK_ROUND(epi64);
+	for (i = 0; i < 16; i++) {
+		_mm_storeu_si128((__m128i*)(out + order[i] * out_stride), x[i]);
+	}
+#else
+	s32 i, j;
+	for (i = 0; i < 16; i++) {
+		for (j = 0; j < 16; j++) {
+			out[j * out_stride + i] = in[i * in_stride + j];
+		}
+	}
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
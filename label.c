@@ -0,0 +1,307 @@
+/**
+ * @file label.c
+ * @brief label composer, blit packed symbols and bitmaps into one packed label bitmap
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbology.h"
+#include "pack.h"
+#include "trace.h"
+#include "label.h"
+
+//a packed symbol up to this size is encoded on the stack
+#define LABEL_STACK			256
+
+//big endian word k of a packed row of bytes bytes, zero past its end
+static inline u64 label_load(const u8 *row, s32 bytes, s32 k) {
+	u64 word = 0;
+	s32 offset = k << 3;
+	if (offset + 8 <= bytes) {
+		memcpy(&word, row + offset, 8);
+	} else if (offset < bytes) {
+		memcpy(&word, row + offset, bytes - offset);
+	}
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+	return word;
+}
+
+//set dots [lo, hi) of the scratch row
+static inline void label_fill(u64 *word, s32 lo, s32 hi) {
+	s32 first = lo >> 6;
+	s32 last = (hi - 1) >> 6;
+	u64 head = ~0ULL >> (lo & 63);
+	u64 tail = ~0ULL << (63 - ((hi - 1) & 63));
+	s32 k;
+	if (first == last) {
+		word[first] |= head & tail;
+		return;
+	}
+	word[first] |= head;
+	for (k = first + 1; k < last; k++) {
+		word[k] = ~0ULL;
+	}
+	word[last] |= tail;
+}
+
+//cut the scratch row at the label width and put it in memory order, an OR
+//does not care about byte order so every row takes it as is
+static void label_finish(struct label *label) {
+	s32 words = label->stride >> 3;
+	s32 k;
+	if (label->width & 63) {
+		label->scratch[words - 1] &= ~0ULL << (64 - (label->width & 63));
+	}
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (k = 0; k < words; k++) {
+		label->scratch[k] = __builtin_bswap64(label->scratch[k]);
+	}
+#else
+	(void)k;
+#endif
+}
+
+//packed row of bits dots shifted to dot x into the scratch row
+static void label_shift(struct label *label, const u8 *row, s32 bits, s32 x) {
+	u64 *word = label->scratch;
+	s32 words = label->stride >> 3;
+	s32 bytes = pack_len(bits);
+	s32 first = x >> 6;
+	s32 shift = x & 63;
+	s32 k;
+	u64 w;
+
+	memset(word, 0, (words + 1) * sizeof(u64));
+	for (k = 0; k < ((bits + 63) >> 6) && first + k < words; k++) {
+		w = label_load(row, bytes, k);
+		if (k == (bits - 1) >> 6 && (bits & 63)) {
+			w &= ~0ULL << (64 - (bits & 63));
+		}
+		//the scratch row has a spare word for the spill of the last one
+		word[first + k] |= w >> shift;
+		if (shift) {
+			word[first + k + 1] |= w << (64 - shift);
+		}
+	}
+	label_finish(label);
+}
+
+//packed row of bits modules, each scale dots wide, from dot x into the
+//scratch row; bar runs are found a word at a time and filled with masks
+static void label_scale(struct label *label, const u8 *row, s32 bits, s32 scale, s32 x) {
+	s32 words = label->stride >> 3;
+	s32 bytes = pack_len(bits);
+	s32 k, start, ones, lo, hi;
+	u64 w;
+
+	memset(label->scratch, 0, (words + 1) * sizeof(u64));
+	for (k = 0; k < (bits + 63) >> 6; k++) {
+		w = label_load(row, bytes, k);
+		if (k == (bits - 1) >> 6 && (bits & 63)) {
+			w &= ~0ULL << (64 - (bits & 63));
+		}
+		while (w != 0) {
+			start = __builtin_clzll(w);
+			ones = (~(w << start) != 0) ? __builtin_clzll(~(w << start)) : 64 - start;
+			lo = x + ((k << 6) + start) * scale;
+			hi = lo + ones * scale;
+			if (lo >= label->width) {
+				break;
+			}
+			label_fill(label->scratch, lo, (hi < label->width) ? hi : label->width);
+			w = (start + ones < 64) ? (w & (~0ULL >> (start + ones))) : 0;
+		}
+	}
+	label_finish(label);
+}
+
+//OR the scratch row into rows [y, y + rows)
+static void label_or(struct label *label, s32 y, s32 rows) {
+	s32 words = label->stride >> 3;
+	u64 *dst;
+	s32 r, k;
+	if (y + rows > label->height) {
+		rows = label->height - y;
+	}
+	for (r = 0; r < rows; r++) {
+		dst = (u64*)(label->bits + (size_t)(y + r) * label->stride);
+		for (k = 0; k < words; k++) {
+			dst[k] |= label->scratch[k];
+		}
+	}
+}
+
+/**
+ * @brief allocate a cleared label
+ *
+ * @param width: dots per row, such as 384 or 576 for the printhead
+ * @param height: rows
+ *
+ * @return 0, -1 on error
+ */
+s32 label_init(struct label *label, s32 width, s32 height) {
+	if (label == NULL || width <= 0 || height <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(label, 0, sizeof(*label));
+	label->width = width;
+	label->height = height;
+	label->stride = ((width + 63) >> 6) << 3;
+	//rows are whole words, the allocation is word aligned
+	label->bits = (u8*)calloc((size_t)label->stride * height / sizeof(u64), sizeof(u64));
+	label->scratch = (u64*)malloc(label->stride + sizeof(u64));
+	if (label->bits == NULL || label->scratch == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		label_free(label);
+		return -1;
+	}
+	return 0;
+}
+
+void label_free(struct label *label) {
+	if (label == NULL) {
+		return;
+	}
+	free(label->bits);
+	free(label->scratch);
+	label->bits = NULL;
+	label->scratch = NULL;
+}
+
+//blank the label for the next one, the allocation is kept
+void label_clear(struct label *label) {
+	if (label != NULL && label->bits != NULL) {
+		memset(label->bits, 0, (size_t)label->stride * label->height);
+	}
+}
+
+//first dot of column of an n-up layout with columns across the label
+s32 label_column(const struct label *label, s32 columns, s32 column) {
+	if (label == NULL || columns <= 0 || column < 0 || column >= columns) {
+		return 0;
+	}
+	return (s32)((s64)label->width * column / columns);
+}
+
+/**
+ * @brief OR a packed bitmap into the label, such as a rasterised text field
+ *
+ * each bitmap row is shifted to dot x a word at a time; what falls outside
+ * the label is cut
+ *
+ * @param bitmap: packed rows, first dot is the MSB
+ * @param bits: dots per bitmap row
+ * @param rows: bitmap rows
+ * @param stride: bytes per bitmap row, at least pack_len(bits)
+ * @param x: first dot
+ * @param y: first row
+ *
+ * @return 0, -1 on error
+ */
+s32 label_blit(struct label *label, const u8 *bitmap, s32 bits, s32 rows, s32 stride, s32 x, s32 y) {
+	s32 r;
+	if (label == NULL || label->bits == NULL || bitmap == NULL || bits <= 0 || rows < 0 ||
+			stride < pack_len(bits) || x < 0 || y < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (x >= label->width) {
+		return 0;
+	}
+	for (r = 0; r < rows && y + r < label->height; r++) {
+		label_shift(label, bitmap + (size_t)r * stride, bits, x);
+		label_or(label, y + r, 1);
+	}
+	return 0;
+}
+
+/**
+ * @brief OR a packed symbol row into height rows of the label
+ *
+ * the row is shifted(scale 1) or widened(scale > 1) once and OR-ed into
+ * every row it covers
+ *
+ * @param row: packed symbol, such as from symbology_encode_packed()
+ * @param bits: modules of the symbol
+ * @param scale: dots per module
+ * @param x: first dot
+ * @param y: first row
+ * @param height: rows of bars
+ *
+ * @return 0, -1 on error
+ */
+s32 label_blit_row(struct label *label, const u8 *row, s32 bits, s32 scale, s32 x, s32 y, s32 height) {
+	if (label == NULL || label->bits == NULL || row == NULL || bits <= 0 || scale <= 0 ||
+			height < 0 || x < 0 || y < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (x >= label->width || y >= label->height) {
+		return 0;
+	}
+	if (scale == 1) {
+		label_shift(label, row, bits, x);
+	} else {
+		label_scale(label, row, bits, scale, x);
+	}
+	label_or(label, y, height);
+	return 0;
+}
+
+/**
+ * @brief encode input and place the symbol on the label
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ * @param scale: dots per module, see plan_symbology()
+ * @param x: first dot
+ * @param y: first row
+ * @param height: rows of bars
+ *
+ * @return width of the symbol in dots, 0 on error
+ */
+s32 label_place(struct label *label, s32 symbology, const s8 *input, s32 scale, s32 x, s32 y, s32 height) {
+	u8 stack[LABEL_STACK];
+	u8 *packed = stack;
+	s32 size, modules;
+
+	if (label == NULL || input == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	size = pack_len(symbology_max_len(symbology, input));
+	if (size <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	if (size > LABEL_STACK) {
+		packed = (u8*)malloc(size);
+		if (packed == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return 0;
+		}
+	}
+	modules = symbology_encode_packed(symbology, input, packed, size, NULL);
+	if (modules > 0 && label_blit_row(label, packed, modules, scale, x, y, height) < 0) {
+		modules = 0;
+	}
+	if (packed != stack) {
+		free(packed);
+	}
+	return modules * scale;
+}
@@ -0,0 +1,35 @@
+#ifndef __LABEL_H__
+#define __LABEL_H__
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//packed label bitmap, row y starts at bits + y * stride, first dot is the MSB
+struct label {
+	u8 *bits;
+	//dots per row and rows
+	s32 width;
+	s32 height;
+	//bytes per row, a multiple of 8 so every row is whole words
+	s32 stride;
+	//one row of words a blit builds before OR-ing it into its rows
+	u64 *scratch;
+};
+
+s32 label_init(struct label *label, s32 width, s32 height);
+void label_free(struct label *label);
+void label_clear(struct label *label);
+s32 label_column(const struct label *label, s32 columns, s32 column);
+s32 label_blit(struct label *label, const u8 *bitmap, s32 bits, s32 rows, s32 stride, s32 x, s32 y);
+s32 label_blit_row(struct label *label, const u8 *row, s32 bits, s32 scale, s32 x, s32 y, s32 height);
+s32 label_place(struct label *label, s32 symbology, const s8 *input, s32 scale, s32 x, s32 y, s32 height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
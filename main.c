@@ -2,30 +2,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
 
-#include "code128.h"
-#include "code39.h"
-#include "code93.h"
-#include "code11.h"
-#include "msi.h"
-#include "i25.h"
-#include "ean13.h"
-#include "ean8.h"
-#include "upca.h"
-#include "upce.h"
-#include "codabar.h"
-
-#define CODE128	"code128"
-#define CODE39	"code39"
-#define CODE93	"code93"
-#define CODE11	"code11"
-#define MSI		"msi"
-#define I25		"i25"
-#define EAN8	"ean8"
-#define EAN13	"ean13"
-#define UPCA	"upca"
-#define UPCE	"upce"
-#define CODABAR	"codabar"
+#include "symbology.h"
+#include "stats.h"
+#include "cpu.h"
+#include "kernel.h"
+#include "pack.h"
+#include "batch.h"
+#include "serial.h"
+#include "plan.h"
+#include "zpl.h"
+#include "native.h"
+#include "pipeline.h"
+#include "output.h"
+#include "pace.h"
+#include "cache.h"
+#include "service.h"
+#include "pool.h"
+#include "dispatch.h"
+
+#define STATS_FILE_INTERVAL_MS	1000
+
+//--pipe: labels queued ahead of the printer, and the biggest one
+#define PIPE_SLOTS				64
+#define PIPE_SLOT_SIZE			65536
+#define PIPE_SPIN				1000
+//graphics --cache keeps in the printer at most
+#define PIPE_GRAPHICS			256
 
 void print_barcode (char* buffer, int len) {
 	int height,i;
@@ -46,17 +52,269 @@ void print_barcode (char* buffer, int len) {
 	printf( "\n" );
 }
 
-static void bin2hex(s8 *bin_buf, u8* hex_buf, s32 hex_buf_len) {
-	s8 byte;
-	s32 p, pos, bit;
-	for (p=0, pos = 0; pos < hex_buf_len; pos++) {
-		byte = 0;
-		for (bit = 0; bit < 8; bit++) {
-			byte |= (*(bin_buf+(p++)) << (7-bit));
+//one job per line: "CODE_MODE string", one hex row per line out, empty on error
+static s32 encode_batch_file(const s8 *path) {
+	FILE *fp = NULL;
+	s8 **line = NULL;
+	s8 **grow = NULL;
+	const s8 **input = NULL;
+	s32 *symbology = NULL;
+	s32 *bits = NULL;
+	s32 *checksum = NULL;
+	u8 *output = NULL;
+	s8 *data = NULL;
+	size_t line_size = 0;
+	s32 count = 0;
+	s32 capacity = 0;
+	s32 stride = 1;
+	s32 encoded = -1;
+	s32 i, len;
+	u64 stage;
+
+	stage = stats_now();
+	fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+	if (fp == NULL) {
+		printf("%s %d open %s err\n",__func__,__LINE__,path);
+		return -1;
+	}
+	for (;;) {
+		if (count == capacity) {
+			capacity = capacity ? (capacity << 1) : 1024;
+			grow = (s8**)realloc(line, sizeof(*line) * capacity);
+			if (grow == NULL) {
+				printf("%s %d err\n",__func__,__LINE__);
+				goto end;
+			}
+			line = grow;
+		}
+		line[count] = NULL;
+		line_size = 0;
+		len = getline(&line[count], &line_size, fp);
+		if (len < 0) {
+			free(line[count]);
+			break;
+		}
+		while (len > 0 && (line[count][len - 1] == '\n' || line[count][len - 1] == '\r')) {
+			line[count][--len] = '\0';
+		}
+		count++;
+	}
+
+	if (count == 0) {
+		encoded = 0;
+		goto end;
+	}
+	input = (const s8**)malloc(sizeof(*input) * count);
+	symbology = (s32*)malloc(sizeof(*symbology) * count);
+	bits = (s32*)malloc(sizeof(*bits) * count);
+	checksum = (s32*)malloc(sizeof(*checksum) * count);
+	if (input == NULL || symbology == NULL || bits == NULL || checksum == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		goto end;
+	}
+	for (i = 0; i < count; i++) {
+		data = strpbrk(line[i], " \t");
+		symbology[i] = symbology_lookup(line[i]);
+		input[i] = (data != NULL) ? (data + 1) : "";
+		if (symbology[i] > -1 && pack_len(symbology_max_len(symbology[i], input[i])) > stride) {
+			stride = pack_len(symbology_max_len(symbology[i], input[i]));
+		}
+	}
+	output = (u8*)malloc((size_t)stride * count);
+	if (output == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		goto end;
+	}
+	stats_stage(STATS_STAGE_PARSE, stats_now() - stage);
+
+	stage = stats_now();
+	//refused lines are reported on stderr, stdout keeps one row per input line
+	encoded = batch_encode(symbology, input, count, output, stride, bits, checksum, stderr);
+	stats_stage(STATS_STAGE_ENCODE, stats_now() - stage);
+
+	stage = stats_now();
+	for (i = 0; i < count; i++) {
+		pack_write_hex(output + (size_t)i * stride, pack_len(bits[i]), stdout);
+		printf("\n");
+		stats_bytes(symbology[i], pack_len(bits[i]));
+	}
+	stats_stage(STATS_STAGE_WRITE, stats_now() - stage);
+
+end:
+	if (fp != stdin) {
+		fclose(fp);
+	}
+	for (i = 0; i < count; i++) {
+		free(line[i]);
+	}
+	free(line);
+	free(input);
+	free(symbology);
+	free(bits);
+	free(checksum);
+	free(output);
+	return encoded;
+}
+
+//one job per line as --batch, each label goes to device while the next is encoded;
+//paced to printer, NULL for as fast as device takes them; graphics bytes of
+//printer memory hold the bitmaps, 0 sends them inline
+static s32 encode_pipe(const s8 *path, const s8 *device, s32 dialect, s32 height, const struct pace_printer *printer,
+		s64 graphics) {
+	struct pipeline pipeline;
+	struct pace pace;
+	struct cache cache;
+	struct native_field field;
+	FILE *fp = NULL;
+	s8 *line = NULL;
+	s8 *data = NULL;
+	size_t line_size = 0;
+	s32 fd, len;
+	s32 ret = 0;
+
+	memset(&field, 0, sizeof(field));
+	field.height = height;
+	field.module = 2;
+	field.hri = 1;
+	fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+	if (fp == NULL) {
+		printf("%s %d open %s err\n",__func__,__LINE__,path);
+		return -1;
+	}
+	//a FIFO or a file stands in for the printer
+	fd = open(device, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0 || (printer != NULL && pace_init(&pace, printer) < 0) ||
+			(graphics > 0 && cache_init(&cache, dialect, graphics, PIPE_GRAPHICS, NULL) < 0)) {
+		printf("%s %d open %s err\n",__func__,__LINE__,device);
+		if (fd >= 0) {
+			close(fd);
+		}
+		if (fp != stdin) {
+			fclose(fp);
+		}
+		return -1;
+	}
+	if (pipeline_init(&pipeline, fd, 1, PIPE_SLOTS, PIPE_SLOT_SIZE, PIPE_SPIN) < 0) {
+		printf("%s %d open %s err\n",__func__,__LINE__,device);
+		if (graphics > 0) {
+			cache_free(&cache);
+		}
+		close(fd);
+		if (fp != stdin) {
+			fclose(fp);
+		}
+		return -1;
+	}
+	pipeline.pace = (printer != NULL) ? &pace : NULL;
+	pipeline.cache = (graphics > 0) ? &cache : NULL;
+	while ((len = getline(&line, &line_size, fp)) >= 0) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+		data = strpbrk(line, " \t");
+		if (pipeline_encode(&pipeline, 0, dialect, symbology_lookup(line), (data != NULL) ? data + 1 : "",
+				&field) < 0) {
+			ret = -1;
+		}
+	}
+	if (pipeline_stop(&pipeline) < 0) {
+		ret = -1;
+	}
+	printf("labels:%llu bytes:%llu writes:%llu full waits:%llu\n", (unsigned long long)pipeline.records,
+			(unsigned long long)pipeline.written, (unsigned long long)pipeline.writes,
+			(unsigned long long)pipeline.full_waits);
+	if (printer != NULL) {
+		pace_dump(&pace, stdout);
+	}
+	pipeline_free(&pipeline);
+	if (graphics > 0) {
+		printf("graphics hits:%llu misses:%llu evictions:%llu bytes:%llu\n", (unsigned long long)cache.hits,
+				(unsigned long long)cache.misses, (unsigned long long)cache.evictions,
+				(unsigned long long)cache.bytes_sent);
+		cache_free(&cache);
+	}
+	close(fd);
+	free(line);
+	if (fp != stdin) {
+		fclose(fp);
+	}
+	return ret;
+}
+
+//one "text hex" line per label of the run
+static s32 encode_serial(const s8 *kind, const s8 *pattern, const s8 *first, const s8 *last) {
+	struct serial serial;
+	const s8 *text = NULL;
+	const s8 *row = NULL;
+	u8 *hex = NULL;
+	s32 hex_size = 0;
+	s32 row_len;
+
+	if (serial_init(&serial, serial_lookup(kind), pattern, strtoull(first, NULL, 10), strtoull(last, NULL, 10)) < 0) {
+		return -1;
+	}
+	while ((row_len = serial_next(&serial, &text, &row)) > 0) {
+		if (pack_len(row_len) > hex_size) {
+			free(hex);
+			hex_size = pack_len(row_len);
+			hex = (u8*)malloc(hex_size);
+			if (hex == NULL) {
+				printf("%s %d err\n",__func__,__LINE__);
+				break;
+			}
 		}
-		*(hex_buf + pos) = byte & 0xff;
-		//print hex arrays
-		printf("0x%02x,",byte&0xff);
+		pack_bits(row, row_len, hex, hex_size);
+		printf("%s ", text);
+		pack_write_hex(hex, pack_len(row_len), stdout);
+		printf("\n");
+	}
+	free(hex);
+	serial_free(&serial);
+	return 0;
+}
+
+//--serve: the daemon SIGINT/SIGTERM stop
+static struct service service;
+
+static void serve_stop(int sig) {
+	(void)sig;
+	service_stop(&service);
+}
+
+//encode requests from clients on a unix socket until SIGINT/SIGTERM
+static s32 serve(const s8 *path) {
+	s32 ret;
+
+	if (service_init(&service, path) < 0) {
+		return -1;
+	}
+	signal(SIGINT, serve_stop);
+	signal(SIGTERM, serve_stop);
+	signal(SIGPIPE, SIG_IGN);
+	printf("serving on %s\n", path);
+	fflush(stdout);
+	ret = service_run(&service);
+	service_dump(&service, stdout);
+	service_free(&service, path);
+	return ret;
+}
+
+static void usage(const s8 *name) {
+	s32 i;
+	printf("[31mUsage:%s [--stats] [--stats-file PATH] CODE_MODE string\n[0m",name);
+	printf("      %s [--stats] [--stats-file PATH] --batch FILE(- for stdin)\n",name);
+	printf("      %s [--stats] [--stats-file PATH] --serial code128|i25|sscc TEMPLATE FIRST LAST\n",name);
+	printf("      %s [--stats] [--stats-file PATH] --plan HEAD_DOTS auto|CODE_MODE,CODE_MODE... string\n",name);
+	printf("      %s [--zpl HEIGHT] CODE_MODE string(ZPL ^GFA graphic HEIGHT dots high instead of hex)\n",name);
+	printf("      %s [--native escpos|zpl|tspl HEIGHT] CODE_MODE string(printer command instead of hex)\n",name);
+	printf("      %s --pipe DEVICE escpos|zpl|tspl HEIGHT [--pace DPI MM_PER_S] [--cache BYTES] --batch FILE(labels to DEVICE,"
+			" encoded ahead of it; zpl|tspl bitmaps kept in BYTES of printer memory)\n",name);
+	printf("      %s [--stats] --serve SOCKET(encoder daemon on a unix socket)\n",name);
+	printf("      %s --selftest\n",name);
+	printf("eg:%s code93 TEST93\n",name);
+	printf("CODE_MODE:");
+	for (i = 0; i < SYMBOLOGY_NUM; i++) {
+		printf(" %s", symbology_name(i));
 	}
 	printf("\n");
 }
@@ -66,117 +324,232 @@ int main(int argc, char **argv) {
 	s32 bin_len = 0;
 	s32 hex_len = 0;
 	s32 max_len = 0;
+	s32 symbology = -1;
+	s32 checksum = -1;
+	s32 dump_stats = 0;
+	s8 *stats_file = NULL;
+	s8 *batch_file = NULL;
+	s8 **serial = NULL;
+	struct plan plan;
+	s32 head_dots = 0;
+	s32 zpl_height = 0;
+	s32 dialect = -1;
+	struct native_field field;
+	s8 **pipe_args = NULL;
+	struct pace_printer printer;
+	s32 paced = 0;
+	s64 graphics = 0;
+	s8 *serve_path = NULL;
 	s8 *bin = NULL;
+	u8 *hex = NULL;
+	u64 stage;
+	s32 arg;
 
 	struct timeval start;
 	struct timeval end;
 
-	if (argc != 3) {
-		printf("[31mUsage:%s CODE_MODE string\n[0m",argv[0]);
-		printf("eg:%s code93 TEST93\n",argv[0]);
+	for (arg = 1; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+		if (strcmp(argv[arg], "--stats") == 0) {
+			dump_stats = 1;
+		} else if (strcmp(argv[arg], "--stats-file") == 0 && arg + 1 < argc) {
+			stats_file = argv[++arg];
+		} else if (strcmp(argv[arg], "--batch") == 0 && arg + 1 < argc) {
+			batch_file = argv[++arg];
+		} else if (strcmp(argv[arg], "--serial") == 0 && arg + 4 < argc) {
+			//kind, template('#' is the counter), first, last
+			serial = &argv[arg + 1];
+			arg += 4;
+		} else if (strcmp(argv[arg], "--plan") == 0 && arg + 1 < argc) {
+			//CODE_MODE is the list to choose from
+			head_dots = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "--zpl") == 0 && arg + 1 < argc) {
+			zpl_height = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "--native") == 0 && arg + 2 < argc) {
+			dialect = native_lookup(argv[++arg]);
+			memset(&field, 0, sizeof(field));
+			field.height = atoi(argv[++arg]);
+			field.module = 2;
+			field.hri = 1;
+			if (dialect < 0 || field.height <= 0) {
+				usage(argv[0]);
+				exit (0);
+			}
+		} else if (strcmp(argv[arg], "--pipe") == 0 && arg + 3 < argc) {
+			//device, dialect, height
+			pipe_args = &argv[arg + 1];
+			arg += 3;
+		} else if (strcmp(argv[arg], "--pace") == 0 && arg + 2 < argc) {
+			//dpi, print speed in mm/s of the --pipe printer
+			memset(&printer, 0, sizeof(printer));
+			printer.dpi = atoi(argv[++arg]);
+			printer.speed = atoi(argv[++arg]);
+			if (printer.dpi <= 0 || printer.speed <= 0) {
+				usage(argv[0]);
+				exit (0);
+			}
+			paced = 1;
+		} else if (strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc) {
+			//printer memory for the bitmaps of the --pipe printer
+			graphics = atoll(argv[++arg]);
+			if (graphics <= 0) {
+				usage(argv[0]);
+				exit (0);
+			}
+		} else if (strcmp(argv[arg], "--serve") == 0 && arg + 1 < argc) {
+			serve_path = argv[++arg];
+		} else if (strcmp(argv[arg], "--selftest") == 0) {
+			//cross-check the SIMD kernels of this machine against the scalar ones
+			printf("cpu level:%s kernels:%s\n", cpu_level_name(cpu_level()), cpu_level_name(kernel_level()));
+			if (kernel_selftest() != 0) {
+				printf("selftest failed\n");
+				exit (1);
+			}
+			//the output engine into a spool file and a pipe
+			if (output_selftest() != 0) {
+				printf("output selftest failed\n");
+				exit (1);
+			}
+			//labels paced to a printer's speed
+			if (pipeline_selftest() != 0) {
+				printf("pipeline selftest failed\n");
+				exit (1);
+			}
+			//printer resident graphics under a memory budget
+			if (cache_selftest() != 0) {
+				printf("cache selftest failed\n");
+				exit (1);
+			}
+			//an urgent job ahead of a bulk one, deadlines within a class
+			if (dispatch_selftest() != 0) {
+				printf("dispatch selftest failed\n");
+				exit (1);
+			}
+			//a printer failing under a waiting submitter
+			if (pool_selftest() != 0) {
+				printf("pool selftest failed\n");
+				exit (1);
+			}
+			printf("selftest ok\n");
+			exit (0);
+		} else {
+			usage(argv[0]);
+			exit (0);
+		}
+	}
+	if (serve_path != NULL) {
+		if (serve(serve_path) < 0) {
+			exit (1);
+		}
+		if (dump_stats) {
+			stats_dump(stdout);
+		}
+		return 0;
+	}
+	if (argc - arg != ((batch_file != NULL || serial != NULL) ? 0 : 2)) {
+		usage(argv[0]);
 		exit (0);
 	}
+	if (stats_file != NULL && stats_start_file(stats_file, STATS_FILE_INTERVAL_MS) < 0) {
+		printf("%s %d stats file %s not started\n",__func__,__LINE__,stats_file);
+		exit (1);
+	}
+	if (batch_file != NULL || serial != NULL) {
+		if (pipe_args != NULL && batch_file != NULL) {
+			if (native_lookup(pipe_args[1]) < 0 || atoi(pipe_args[2]) <= 0 ||
+					encode_pipe(batch_file, pipe_args[0], native_lookup(pipe_args[1]), atoi(pipe_args[2]),
+					paced ? &printer : NULL, graphics) < 0) {
+				exit (1);
+			}
+		} else if ((batch_file != NULL) ? (encode_batch_file(batch_file) < 0) :
+				(encode_serial(serial[0], serial[1], serial[2], serial[3]) < 0)) {
+			exit (1);
+		}
+		if (stats_file != NULL) {
+			stats_stop_file();
+		}
+		if (dump_stats) {
+			stats_dump(stdout);
+		}
+		return 0;
+	}
 
 	gettimeofday(&start, NULL);
-	if (strncmp(CODE128, argv[1], strlen(CODE128)) == 0) {
-		//get code128 max len
-		max_len = code128_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = code128_encode(argv[2], bin);
-	} else if (strncmp(CODE39, argv[1], strlen(CODE39)) == 0) {
-		//get code39 len
-		max_len = code39_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = code39_encode(argv[2], bin);
-	} else if (strncmp(CODE93, argv[1], strlen(CODE93)) == 0) {
-		//get code93 len
-		max_len = code93_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = code93_encode(argv[2], bin);
-	} else if (strncmp(CODE11, argv[1], strlen(CODE11)) == 0) {
-		//get code11 len
-		max_len = code11_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = code11_encode(argv[2], bin);
-	} else if (strncmp(CODABAR, argv[1], strlen(CODABAR)) == 0) {
-		//get codabar len
-		max_len = codabar_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = codabar_encode(argv[2], bin);
-	} else if (strncmp(MSI, argv[1], strlen(MSI)) == 0) {
-		//get msi len
-		max_len = msi_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = msi_encode(argv[2], bin);
-	} else if (strncmp(I25, argv[1], strlen(I25)) == 0) {
-		//get i25 len
-		max_len = i25_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = i25_encode(argv[2], bin);
-	} else if (strncmp(EAN8, argv[1], strlen(EAN8)) == 0) {
-		//get ean8 len
-		int checksum = -1;
-		max_len = ean8_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = ean8_encode(argv[2], bin, &checksum);
-		printf("checksum:%d\n",checksum);
-	} else if (strncmp(EAN13, argv[1], strlen(EAN13)) == 0) {
-		//get ean13 len
-		int checksum = -1;
-		max_len = ean13_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = ean13_encode(argv[2], bin, &checksum);
-		printf("checksum:%d\n",checksum);
-	} else if (strncmp(UPCA, argv[1], strlen(UPCA)) == 0) {
-		//get upca len
-		int checksum = -1;
-		max_len = upca_max_len(argv[2]);
-		bin = (s8*)malloc(max_len);
-		memset(bin, 0, max_len);
-		bin_len = upca_encode(argv[2], bin, &checksum);
-		printf("checksum:%d\n",checksum);
-	} else if (strncmp(UPCE, argv[1], strlen(UPCE)) == 0) {
-		//get upce len
-		int checksum = -1;
-		max_len = upce_max_len(argv[2]);
+	stage = stats_now();
+	if (head_dots != 0) {
+		if (plan_symbology(argv[arg+1], plan_allowed(argv[arg]), head_dots, &plan) < 0) {
+			exit (1);
+		}
+		printf("plan:%s modules:%d scale:%d dots:%d\n", symbology_name(plan.symbology), plan.modules,
+				plan.scale, plan.dots);
+		symbology = plan.symbology;
+	} else {
+		symbology = symbology_lookup(argv[arg]);
+	}
+	if (symbology > -1) {
+		//get max len of the symbology
+		max_len = symbology_max_len(symbology, argv[arg+1]);
 		bin = (s8*)malloc(max_len);
 		memset(bin, 0, max_len);
-		bin_len = upce_encode(argv[2], bin, &checksum);
-		printf("checksum:%d\n",checksum);
-	}
+		stats_stage(STATS_STAGE_PARSE, stats_now() - stage);
 
+		stage = stats_now();
+		bin_len = symbology_encode(symbology, argv[arg+1], bin, &checksum);
+		stats_stage(STATS_STAGE_ENCODE, stats_now() - stage);
+		if (symbology_has_checksum(symbology)) {
+			printf("checksum:%d\n",checksum);
+		}
+	}
 
 	gettimeofday(&end,NULL);
 	printf("total used(us):%ld\n", 1000000 * ( end.tv_sec - start.tv_sec ) + end.tv_usec -start.tv_usec);
 
+	stage = stats_now();
 	if (bin_len > 0)
 		print_barcode(bin, bin_len);
+	stats_stage(STATS_STAGE_WRITE, stats_now() - stage);
 	
 	
-	hex_len = (bin_len>>3);
-	if ((bin_len%8) > 0) {
-		hex_len++;
-	}
+	hex_len = pack_len(bin_len);
 	printf("binary max_len:%d\n",max_len);
 	printf("hex_len:%d\n",hex_len);
-	u8 hex[512];
-	memset(hex, 0, 512);
 	//convert binary array to hex array for printer
-	bin2hex(bin, hex, hex_len);
+	if (hex_len > 0) {
+		hex = (u8*)malloc(hex_len);
+		stage = stats_now();
+		pack_bits(bin, bin_len, hex, hex_len);
+		stats_stage(STATS_STAGE_PACK, stats_now() - stage);
+		stats_bytes(symbology, hex_len);
+
+		if (dialect > -1) {
+			//the printer draws the symbol, or gets it as a bitmap
+			native_begin(dialect, stdout);
+			native_write(dialect, symbology, argv[arg+1], &field, stdout);
+			native_end(dialect, stdout);
+		} else if (zpl_height > 0) {
+			//one packed row repeated down the symbol
+			printf("^XA");
+			zpl_write_graphic(hex, bin_len, zpl_height, 0, 0, 0, stdout);
+			printf("^XZ");
+		} else {
+			//print hex arrays
+			pack_write_hex(hex, hex_len, stdout);
+		}
+		free(hex);
+		hex = NULL;
+	}
+	printf("\n");
 
 	if (bin != NULL) {
 		free(bin);
 		bin = NULL;
 	}
 
+	if (stats_file != NULL) {
+		stats_stop_file();
+	}
+	if (dump_stats) {
+		stats_dump(stdout);
+	}
+
 	return 0;
 }
@@ -11,18 +11,14 @@
 #include <string.h>
 
 #include "msi.h"
+#include "trace.h"
+#include "check.h"
 
 //https://en.wikipedia.org/wiki/MSI_Barcode
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-//#define MSI_APPEND_BLANK
-
-#ifdef MSI_APPEND_BLANK
-#define MSI_BLANK_LEN		10
+//check characters, CHECK_MSI_XXX, such as make CFLAGS=-DMSI_CHECK=CHECK_MSI_MOD1010
+#ifndef MSI_CHECK
+#define MSI_CHECK			CHECK_MSI_MOD10
 #endif
 
 #define MSI_PATTERN_LEN		12
@@ -52,25 +48,6 @@ static s32 msi_append_blank(s8 *out) {
 }
 #endif
 
-static s32 msi_checksum(const s8 *buf, s32 len) {
-	s32 i;
-	s32 sum = 0;
-	for(i=len-1; i>-1; i--) {
-		if (((len - i) % 2) != 0) {
-			sum = ((*(buf+i)-'0') << 1);
-			if (sum > 9) {
-				sum -= 9; 
-			}
-			sum += sum;
-		} else {
-			sum += (*(buf+i) - '0');
-		}
-	}
-	sum = (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
-
-	return sum;
-}
-
 static s32 msi_append_pattern(s32 index, s8 *out) {
 	s32 i;
 	s32 pattern = msi_pattern[index];
@@ -80,18 +57,10 @@ static s32 msi_append_pattern(s32 index, s8 *out) {
 	} else if (index == MSI_STOP_INDEX) {
 		pattern_len = 4;
 	}
-#ifdef DEBUG
-	printf("index:%d->",index);
-#endif
+	TRACE_SYMBOL("msi", index, pattern);
 	for (i = pattern_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return pattern_len;
 }
 
@@ -99,7 +68,7 @@ static s32 msi_append_pattern(s32 index, s8 *out) {
 s32 msi_max_len(const s8 *input) {
 	s32 len = 0;
 	if (input != NULL) {
-		len = MSI_PATTERN_LEN * (strlen(input) + 1) + 7;
+		len = MSI_PATTERN_LEN * (strlen(input) + CHECK_MAX_LEN) + 7;
 #ifdef MSI_APPEND_BLANK
 		len += (MSI_BLANK_LEN << 1);
 #endif
@@ -107,8 +76,30 @@ s32 msi_max_len(const s8 *input) {
 	return len;
 }
 
+//exact length of the coded data, 0 when input can't be encoded
+s32 msi_width(const s8 *input) {
+	s8 check[CHECK_MAX_LEN + 1];
+	s32 input_len, check_len, len;
+	if (input == NULL) {
+		return 0;
+	}
+	input_len = strlen(input);
+	check_len = check_append(MSI_CHECK, input, input_len, check);
+	if (check_len < 0) {
+		return 0;
+	}
+	//start 3, stop 4
+	len = MSI_PATTERN_LEN * (input_len + check_len) + 7;
+#ifdef MSI_APPEND_BLANK
+	len += (MSI_BLANK_LEN << 1);
+#endif
+	return len;
+}
+
 s32 msi_encode(const s8 *input, s8 *output) {
 
+	s8 check[CHECK_MAX_LEN + 1];
+	s32 check_len = 0;
 	s32 barcode_len = 0;
 	s32 input_len = 0;
 	s32 append_len = 0;
@@ -117,9 +108,11 @@ s32 msi_encode(const s8 *input, s8 *output) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("msi", input);
 
 #ifdef MSI_APPEND_BLANK
 	//append left blank
@@ -128,9 +121,6 @@ s32 msi_encode(const s8 *input, s8 *output) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("start ");
-#endif
 	//append start code
 	append_len = msi_append_pattern(MSI_START_INDEX, output);
 	output += append_len;
@@ -139,11 +129,9 @@ s32 msi_encode(const s8 *input, s8 *output) {
 	//append data code
 	for(i=0; i<input_len; i++) {
 		index = *(input+i) - '0';
-#ifdef DEBUG
-		printf("%d ", index);
-#endif
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			barcode_len = 0;
 			goto end;
 		} else {
@@ -153,18 +141,16 @@ s32 msi_encode(const s8 *input, s8 *output) {
 		}
 	}
 
-#ifdef DEBUG
-	printf("check ");
-#endif
-	//append check(modulo 10)
-	index = msi_checksum(input, input_len);
-	append_len = msi_append_pattern(index, output);
-	output += append_len;
-	barcode_len += append_len;
+	//append check characters
+	check_len = check_append(MSI_CHECK, input, input_len, check);
+	for(i=0; i<check_len; i++) {
+		index = check[i] - '0';
+		TRACE_CHECKSUM("msi", index);
+		append_len = msi_append_pattern(index, output);
+		output += append_len;
+		barcode_len += append_len;
+	}
 
-#ifdef DEBUG
-	printf("stop  ");
-#endif
 	//append stop code
 	append_len = msi_append_pattern(MSI_STOP_INDEX, output);
 	output += append_len;
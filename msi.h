@@ -4,11 +4,26 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+//#define MSI_APPEND_BLANK
+
+#ifdef MSI_APPEND_BLANK
+#define MSI_BLANK_LEN		10
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef MSI_APPEND_BLANK
+#define MSI_QUIET_LEN		(MSI_BLANK_LEN << 1)
+#else
+#define MSI_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 msi_max_len(const s8 *input);
+s32 msi_width(const s8 *input);
 s32 msi_encode(const s8 *input, s8 *output);
 
 #ifdef __cplusplus
@@ -0,0 +1,573 @@
+/**
+ * @file native.c
+ * @brief printer native barcode commands(ESC/POS GS k, ZPL ^BC, TSPL BARCODE), raster for the rest
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbology.h"
+#include "code128.h"
+#include "gs1.h"
+#include "kernel.h"
+#include "pack.h"
+#include "zpl.h"
+#include "cache.h"
+#include "trace.h"
+#include "native.h"
+
+//command bytes around the data at most
+#define NATIVE_HEADER_LEN		96
+//code128 symbols logged on the stack
+#define NATIVE_SYMBOL_STACK		128
+
+//ESC/POS GS k function B takes n data bytes, GS h/GS w limits
+#define ESCPOS_DATA_MAX			255
+#define ESCPOS_HEIGHT_MAX		255
+#define ESCPOS_MODULE_MIN		2
+#define ESCPOS_MODULE_MAX		6
+//ZPL ^BY module width
+#define ZPL_MODULE_MAX			10
+
+static const s8 *const native_names[NATIVE_NUM] = {
+	"escpos",
+	"zpl",
+	"tspl",
+};
+
+//GS k m, 0 goes out as a graphic: ESC/POS has no Code 11 or MSI, and its UPC-E
+//(GS k 66) derives the check digit and parity itself, see native_zpl_format
+static const u8 native_escpos_type[SYMBOLOGY_NUM] = {
+	[SYMBOLOGY_CODE128] = 73,
+	[SYMBOLOGY_CODE39] = 69,
+	[SYMBOLOGY_CODE93] = 72,
+	[SYMBOLOGY_CODABAR] = 71,
+	[SYMBOLOGY_I25] = 70,
+	[SYMBOLOGY_EAN8] = 68,
+	[SYMBOLOGY_EAN13] = 67,
+	[SYMBOLOGY_UPCA] = 65,
+	[SYMBOLOGY_GS1128] = 73,
+};
+
+//ZPL barcode command taking height and the interpretation line flag. ZPL has
+//UPC-E(^B9), Code 11(^B1) and MSI(^BM) too, and TSPL UPCE, 11 and MSI; they go
+//out as a graphic for their check digits: the printer adds its own to Code 11
+//where this library adds none, picks the MSI ones from a fixed set where
+//MSI_CHECK is a build option, and works out the UPC-E one and its parity
+//itself, not necessarily the checksum upce_encode() reports
+static const s8 *const native_zpl_format[SYMBOLOGY_NUM] = {
+	[SYMBOLOGY_CODE128] = "^BCN,%d,%c,N,N,N",
+	[SYMBOLOGY_CODE39] = "^B3N,N,%d,%c,N",
+	[SYMBOLOGY_CODE93] = "^BAN,%d,%c,N,N",
+	[SYMBOLOGY_CODABAR] = "^BKN,N,%d,%c,N",
+	[SYMBOLOGY_I25] = "^B2N,%d,%c,N,N",
+	[SYMBOLOGY_EAN8] = "^B8N,%d,%c,N",
+	[SYMBOLOGY_EAN13] = "^BEN,%d,%c,N",
+	[SYMBOLOGY_UPCA] = "^BUN,%d,%c,N,Y",
+	[SYMBOLOGY_GS1128] = "^BCN,%d,%c,N,N,N",
+};
+
+//TSPL code type, code128 goes out with its code sets("128M"); UPCE, 11 and
+//MSI are left out for their check digits, see native_zpl_format
+static const s8 *const native_tspl_type[SYMBOLOGY_NUM] = {
+	[SYMBOLOGY_CODE128] = "128M",
+	[SYMBOLOGY_CODE39] = "39",
+	[SYMBOLOGY_CODE93] = "93",
+	[SYMBOLOGY_CODABAR] = "CODA",
+	[SYMBOLOGY_I25] = "25",
+	[SYMBOLOGY_EAN8] = "EAN8",
+	[SYMBOLOGY_EAN13] = "EAN13",
+	[SYMBOLOGY_UPCA] = "UPCA",
+	[SYMBOLOGY_GS1128] = "128M",
+};
+
+//how a dialect spells code128 symbols
+struct native_code128 {
+	//start A/B/C and switch to A/B/C
+	const s8 *start[3];
+	const s8 *code[3];
+	const s8 *fnc1;
+	//data character taken as a command, and how to send it as data
+	s8 escape;
+	const s8 *escaped;
+	//characters the dialect can't carry in its data
+	const s8 *refuse;
+	//control characters(code set A) allowed
+	s32 control;
+	//code set C pairs are one byte of value 0-99, not two digits
+	s32 binary_c;
+};
+
+static const struct native_code128 native_code128_table[NATIVE_NUM] = {
+	[NATIVE_ESCPOS] = {{"{A", "{B", "{C"}, {"{A", "{B", "{C"}, "{1", '{', "{{", "", 1, 1},
+	[NATIVE_ZPL] = {{">9", ">:", ">;"}, {">7", ">6", ">5"}, ">8", '>', "><", "^~", 0, 0},
+	[NATIVE_TSPL] = {{"!103", "!104", "!105"}, {"!101", "!100", "!099"}, "!102", 0, NULL, "\"!", 0, 0},
+};
+
+s32 native_lookup(const s8 *name) {
+	s32 i;
+	if (name == NULL) {
+		return -1;
+	}
+	for (i = 0; i < NATIVE_NUM; i++) {
+		if (strcmp(native_names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const s8 *native_name(s32 dialect) {
+	if (dialect < 0 || dialect >= NATIVE_NUM) {
+		return "unknown";
+	}
+	return native_names[dialect];
+}
+
+//command bytes for input at most, whatever the dialect
+s32 native_command_len(const s8 *input) {
+	if (input == NULL) {
+		return 0;
+	}
+	//a GS1 element string doubles at most when parsed, a code128 character
+	//takes a switch and an escape at most
+	return (strlen(input) << 3) + NATIVE_HEADER_LEN;
+}
+
+//does the dialect take every character of data as is
+static s32 native_plain(const struct native_code128 *code, const s8 *data, s32 len) {
+	s32 i;
+	for (i = 0; i < len; i++) {
+		if ((u8)data[i] < 0x20 || (u8)data[i] >= 0x7F || strchr(code->refuse, data[i]) != NULL) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief code128 data in the dialect's code set syntax, the code sets are the
+ * ones code128_encode() chooses
+ *
+ * @param str: code128 input, a parsed element string for GS1-128
+ *
+ * @return length of out, 0 when the dialect can't carry a character, -1 on error
+ */
+static s32 native_code128_data(s32 dialect, const s8 *str, s8 *out, s32 out_size) {
+	const struct native_code128 *code = &native_code128_table[dialect];
+	struct code128_symbol stack[NATIVE_SYMBOL_STACK];
+	struct code128_symbol *symbol = stack;
+	s32 size = (strlen(str) << 1) + 2;
+	s32 num = 0;
+	s32 mode = 0;
+	s32 len = 0;
+	s32 i, n;
+	const s8 *token;
+	s8 c;
+
+	if (size > NATIVE_SYMBOL_STACK) {
+		symbol = (struct code128_symbol*)malloc(size * sizeof(*symbol));
+		if (symbol == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return -1;
+		}
+	}
+	if (code128_symbols(str, symbol, &num, size) <= 0 || num > size) {
+		len = -1;
+		goto end;
+	}
+	for (i = 0; i < num && len >= 0; i++) {
+		token = NULL;
+		if (i == 0) {
+			mode = symbol[i].value - 103;
+			token = code->start[mode];
+		} else if (symbol[i].source < 0) {
+			mode = 101 - symbol[i].value;
+			token = code->code[mode];
+		} else if (symbol[i].value == 102) {
+			token = code->fnc1;
+		}
+		if (token != NULL) {
+			n = strlen(token);
+			if (len + n > out_size) {
+				len = -1;
+				break;
+			}
+			memcpy(out + len, token, n);
+			len += n;
+			continue;
+		}
+		if (len + 2 > out_size) {
+			len = -1;
+			break;
+		}
+		if (mode == 2) {
+			if (code->binary_c) {
+				out[len++] = symbol[i].value;
+			} else {
+				out[len++] = '0' + symbol[i].value / 10;
+				out[len++] = '0' + symbol[i].value % 10;
+			}
+			continue;
+		}
+		c = str[symbol[i].source];
+		//FNC2-4 have no spelling in every dialect
+		if ((u8)c >= 0x80 || (c < 0x20 && !code->control) || strchr(code->refuse, c) != NULL) {
+			len = 0;
+			break;
+		}
+		if (c == code->escape && c != 0) {
+			memcpy(out + len, code->escaped, 2);
+			len += 2;
+		} else {
+			out[len++] = c;
+		}
+	}
+end:
+	if (symbol != stack) {
+		free(symbol);
+	}
+	return len;
+}
+
+//field data of input: code sets for code128, the input itself for the rest
+static s32 native_data(s32 dialect, s32 symbology, const s8 *input, s8 *out, s32 out_size) {
+	s8 *str = NULL;
+	s32 size, len;
+
+	if (symbology == SYMBOLOGY_CODE128) {
+		return native_code128_data(dialect, input, out, out_size);
+	}
+	if (symbology == SYMBOLOGY_GS1128) {
+		size = (strlen(input) << 1) + GS1_FNC1_CODE_LEN + 1;
+		str = (s8*)malloc(size);
+		if (str == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return -1;
+		}
+		len = (gs1_parse(input, str, size) > 0) ? native_code128_data(dialect, str, out, out_size) : -1;
+		free(str);
+		return len;
+	}
+	//the encoder decides what input is valid, the printer gets no other
+	if (symbology_width(symbology, input) <= 0) {
+		return -1;
+	}
+	len = strlen(input);
+	if (len > out_size) {
+		return -1;
+	}
+	if (!native_plain(&native_code128_table[dialect], input, len)) {
+		return 0;
+	}
+	memcpy(out, input, len);
+	return len;
+}
+
+/**
+ * @brief the command that makes the printer draw the symbol itself
+ *
+ * code128 and GS1-128 carry the code sets of code128_encode() as the dialect
+ * spells them({A/{B/{C/{1 for ESC/POS, >9/>:/>;/>8 for ZPL, !103-!105/!102
+ * for TSPL "128M"), so the printer draws the same symbol as the raster would
+ *
+ * @param dialect: NATIVE_XXX
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings, as given to symbology_encode()
+ * @param field: position and size
+ * @param out: command bytes, not '\0' terminated(ESC/POS is binary)
+ * @param out_size: size of out, native_command_len() is enough
+ *
+ * @return length of out, 0 when the dialect can't draw it, -1 on error
+ */
+s32 native_command(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field, s8 *out,
+		s32 out_size) {
+	const s8 *format = NULL;
+	s8 header[NATIVE_HEADER_LEN];
+	s8 *data = NULL;
+	s32 len = 0;
+	s32 n;
+
+	if (dialect < 0 || dialect >= NATIVE_NUM || symbology < 0 || symbology >= SYMBOLOGY_NUM ||
+			input == NULL || field == NULL || out == NULL || field->height <= 0 || field->module <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (*input == '\0') {
+		return 0;
+	}
+	switch (dialect) {
+		case NATIVE_ESCPOS:
+			if (native_escpos_type[symbology] == 0 || field->height > ESCPOS_HEIGHT_MAX ||
+					field->module < ESCPOS_MODULE_MIN || field->module > ESCPOS_MODULE_MAX) {
+				return 0;
+			}
+			//ESC $ x, GS H hri, GS h height, GS w module, GS k m n
+			n = 0;
+			header[n++] = 0x1B; header[n++] = '$';
+			header[n++] = field->x & 0xFF; header[n++] = (field->x >> 8) & 0xFF;
+			header[n++] = 0x1D; header[n++] = 'H'; header[n++] = field->hri ? 2 : 0;
+			header[n++] = 0x1D; header[n++] = 'h'; header[n++] = field->height;
+			header[n++] = 0x1D; header[n++] = 'w'; header[n++] = field->module;
+			header[n++] = 0x1D; header[n++] = 'k'; header[n++] = native_escpos_type[symbology];
+			//n goes between the type and the data
+			if (out_size < n + 1) {
+				return -1;
+			}
+			memcpy(out, header, n);
+			data = out + n + 1;
+			len = native_data(dialect, symbology, input, data, out_size - n - 1);
+			if (len <= 0 || len > ESCPOS_DATA_MAX) {
+				return (len < 0) ? -1 : 0;
+			}
+			out[n] = len;
+			return n + 1 + len;
+		case NATIVE_ZPL:
+			format = native_zpl_format[symbology];
+			if (format == NULL || field->module > ZPL_MODULE_MAX) {
+				return 0;
+			}
+			//start/stop characters of codabar are parameters, not data
+			if (symbology == SYMBOLOGY_CODABAR && strlen(input) < 2) {
+				return 0;
+			}
+			n = snprintf(header, sizeof(header), "^FO%d,%d^BY%d,2", field->x, field->y, field->module);
+			n += snprintf(header + n, sizeof(header) - n, format, field->height, field->hri ? 'Y' : 'N');
+			if (symbology == SYMBOLOGY_CODABAR) {
+				n += snprintf(header + n, sizeof(header) - n, ",%c,%c", input[0], input[strlen(input) - 1]);
+			}
+			n += snprintf(header + n, sizeof(header) - n, "^FD");
+			if (out_size < n + 3) {
+				return -1;
+			}
+			memcpy(out, header, n);
+			data = out + n;
+			len = native_data(dialect, symbology, input, data, out_size - n - 3);
+			if (len <= 0) {
+				return len;
+			}
+			if (symbology == SYMBOLOGY_CODABAR) {
+				len -= 2;
+				memmove(data, data + 1, len);
+			}
+			memcpy(data + len, "^FS", 3);
+			return n + len + 3;
+		case NATIVE_TSPL:
+			if (native_tspl_type[symbology] == NULL) {
+				return 0;
+			}
+			//BARCODE x,y,"type",height,readable,rotation,narrow,wide,"content"
+			n = snprintf(header, sizeof(header), "BARCODE %d,%d,\"%s\",%d,%d,0,%d,%d,\"", field->x, field->y,
+					native_tspl_type[symbology], field->height, field->hri ? 1 : 0, field->module,
+					field->module << 1);
+			if (out_size < n + 3) {
+				return -1;
+			}
+			memcpy(out, header, n);
+			data = out + n;
+			len = native_data(dialect, symbology, input, data, out_size - n - 3);
+			if (len <= 0) {
+				return len;
+			}
+			memcpy(data + len, "\"\r\n", 3);
+			return n + len + 3;
+		default:
+			break;
+	}
+	return 0;
+}
+
+/**
+ * @brief a packed bitmap as a graphic of the dialect: GS v 0, ^GFA or BITMAP
+ *
+ * @param bitmap: packed rows, first dot is the MSB
+ * @param width: dots per row
+ * @param rows: number of rows
+ * @param stride: bytes between rows, 0 repeats one row
+ * @param x: origin, ESC/POS only takes x
+ * @param y: origin
+ *
+ * @return bytes written, -1 on error
+ */
+s32 native_bitmap(s32 dialect, const u8 *bitmap, s32 width, s32 rows, s32 stride, s32 x, s32 y, FILE *fp) {
+	u8 header[12];
+	u8 *inverse = NULL;
+	s32 bytes = pack_len(width);
+	s32 len = -1;
+	s32 r, i;
+
+	if (bitmap == NULL || fp == NULL || bytes <= 0 || rows <= 0 || stride < 0 ||
+			(stride > 0 && stride < bytes)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	switch (dialect) {
+		case NATIVE_ESCPOS:
+			//ESC $ x, GS v 0 normal, bytes per row, rows
+			i = 0;
+			header[i++] = 0x1B; header[i++] = '$';
+			header[i++] = x & 0xFF; header[i++] = (x >> 8) & 0xFF;
+			header[i++] = 0x1D; header[i++] = 'v'; header[i++] = '0'; header[i++] = 0;
+			header[i++] = bytes & 0xFF; header[i++] = (bytes >> 8) & 0xFF;
+			header[i++] = rows & 0xFF; header[i++] = (rows >> 8) & 0xFF;
+			fwrite(header, 1, i, fp);
+			for (r = 0; r < rows; r++) {
+				fwrite(bitmap + (size_t)r * stride, 1, bytes, fp);
+			}
+			len = i + bytes * rows;
+			break;
+		case NATIVE_ZPL:
+			len = zpl_write_graphic(bitmap, width, rows, stride, x, y, fp);
+			break;
+		case NATIVE_TSPL:
+			//BITMAP prints the 0 bits, the padding turns white as well
+			inverse = (u8*)malloc(bytes);
+			if (inverse == NULL) {
+				printf("%s %d err\n",__func__,__LINE__);
+				TRACE_ERROR();
+				break;
+			}
+			len = fprintf(fp, "BITMAP %d,%d,%d,%d,0,", x, y, bytes, rows);
+			for (r = 0; r < rows; r++) {
+				if (r == 0 || stride > 0) {
+					for (i = 0; i < bytes; i++) {
+						inverse[i] = ~bitmap[(size_t)r * stride + i];
+					}
+				}
+				fwrite(inverse, 1, bytes, fp);
+			}
+			fputs("\r\n", fp);
+			len += bytes * rows + 2;
+			free(inverse);
+			break;
+		default:
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			break;
+	}
+	return len;
+}
+
+//the symbol as a bitmap field of the dialect, recalled from the printer when
+//cache holds it; returns bytes written
+static s32 native_raster(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field,
+		struct cache *cache, FILE *fp) {
+	u8 *packed = NULL;
+	u8 *row = NULL;
+	s32 size = pack_len(symbology_max_len(symbology, input));
+	s32 modules;
+	s32 len = -1;
+
+	if (size <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	packed = (u8*)malloc(size);
+	modules = (packed != NULL) ? symbology_encode_packed(symbology, input, packed, size, NULL) : 0;
+	if (modules <= 0) {
+		goto end;
+	}
+	//the scale kernels may store a word past the row
+	row = (u8*)malloc(pack_len(modules * field->module) + sizeof(u64));
+	if (row == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		goto end;
+	}
+	kernel_scale_modules(packed, modules, field->module, row);
+	if (cache != NULL && cache->dialect == dialect) {
+		//downloads and recalls go where the label goes
+		cache->fp = fp;
+		len = cache_place(cache, row, modules * field->module, field->height, 0, field->x, field->y);
+	} else {
+		len = native_bitmap(dialect, row, modules * field->module, field->height, 0, field->x, field->y, fp);
+	}
+end:
+	free(packed);
+	free(row);
+	return len;
+}
+
+/**
+ * @brief write the symbol as a native command, or as a bitmap when the dialect
+ * can't draw it
+ *
+ * @param dialect: NATIVE_XXX
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ * @param field: position and size
+ *
+ * @return bytes written, -1 on error
+ */
+s32 native_write(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field, FILE *fp) {
+	return native_write_cached(dialect, symbology, input, field, NULL, fp);
+}
+
+/**
+ * @brief native_write(), a bitmap is downloaded into the printer once and
+ * recalled by name from then on
+ *
+ * labels written with one cache must reach its printer in the order they were
+ * written, the download comes with the first of them
+ *
+ * @param cache: graphics of the printer of the dialect, see cache_init(); NULL
+ * sends every bitmap inline
+ *
+ * @return bytes written, -1 on error
+ */
+s32 native_write_cached(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field,
+		struct cache *cache, FILE *fp) {
+	s8 *command = NULL;
+	s32 size = native_command_len(input);
+	s32 len;
+
+	if (fp == NULL || size <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	command = (s8*)malloc(size);
+	if (command == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	len = native_command(dialect, symbology, input, field, command, size);
+	if (len > 0) {
+		if (fwrite(command, 1, len, fp) != (size_t)len) {
+			printf("%s %d write err\n",__func__,__LINE__);
+			len = -1;
+		}
+	} else if (len == 0) {
+		len = native_raster(dialect, symbology, input, field, cache, fp);
+	}
+	free(command);
+	return len;
+}
+
+//start of a label: ESC @, ^XA, CLS
+s32 native_begin(s32 dialect, FILE *fp) {
+	static const s8 *const begin[NATIVE_NUM] = {"\x1B@", "^XA", "CLS\r\n"};
+	if (dialect < 0 || dialect >= NATIVE_NUM || fp == NULL) {
+		return -1;
+	}
+	return fputs(begin[dialect], fp) < 0 ? -1 : (s32)strlen(begin[dialect]);
+}
+
+//end of a label, which prints it: LF, ^XZ, PRINT 1
+s32 native_end(s32 dialect, FILE *fp) {
+	static const s8 *const end[NATIVE_NUM] = {"\n", "^XZ\n", "PRINT 1\r\n"};
+	if (dialect < 0 || dialect >= NATIVE_NUM || fp == NULL) {
+		return -1;
+	}
+	return fputs(end[dialect], fp) < 0 ? -1 : (s32)strlen(end[dialect]);
+}
@@ -0,0 +1,52 @@
+#ifndef __NATIVE_H__
+#define __NATIVE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//printer command languages
+enum {
+	NATIVE_ESCPOS = 0,	//ESC/POS receipt printers, GS k
+	NATIVE_ZPL,			//Zebra label printers, ^BC and friends
+	NATIVE_TSPL,		//TSC label printers, BARCODE
+	NATIVE_NUM
+};
+
+//graphics resident in a printer, see cache.h
+struct cache;
+
+//where and how big the printer draws a symbol
+struct native_field {
+	//origin in dots, ESC/POS is line based and only takes x
+	s32 x;
+	s32 y;
+	//bar height in dots
+	s32 height;
+	//dots per narrow module
+	s32 module;
+	//print the human readable line under the bars
+	s32 hri;
+};
+
+s32 native_lookup(const s8 *name);
+const s8 *native_name(s32 dialect);
+s32 native_command_len(const s8 *input);
+s32 native_command(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field, s8 *out,
+		s32 out_size);
+s32 native_bitmap(s32 dialect, const u8 *bitmap, s32 width, s32 rows, s32 stride, s32 x, s32 y, FILE *fp);
+s32 native_write(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field, FILE *fp);
+s32 native_write_cached(s32 dialect, s32 symbology, const s8 *input, const struct native_field *field,
+		struct cache *cache, FILE *fp);
+s32 native_begin(s32 dialect, FILE *fp);
+s32 native_end(s32 dialect, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,613 @@
+/**
+ * @file output.c
+ * @brief output engine: raster writes to many printers and spool files through io_uring, writev() without it
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "stats.h"
+#include "trace.h"
+#include "output.h"
+
+#define OUTPUT_LOAD(p)			__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define OUTPUT_STORE(p, v)		__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+//5.6, headers older than the running kernel may lack it
+#ifndef IORING_FEAT_RW_CUR_POS
+#define IORING_FEAT_RW_CUR_POS	(1U << 3)
+#endif
+
+//no liburing: the three system calls
+static s32 output_uring_setup(u32 entries, struct io_uring_params *params) {
+	return (s32)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static s32 output_uring_enter(s32 fd, u32 submit, u32 min_complete, u32 flags) {
+	return (s32)syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, NULL, 0);
+}
+
+static s32 output_uring_register(s32 fd, u32 opcode, const void *arg, u32 count) {
+	return (s32)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void output_uring_close(struct output *output) {
+	if (output->sqes != NULL) {
+		munmap(output->sqes, output->sqes_size);
+	}
+	if (output->cq_map != NULL && output->cq_map != output->sq_map) {
+		munmap(output->cq_map, output->cq_map_size);
+	}
+	if (output->sq_map != NULL) {
+		munmap(output->sq_map, output->sq_map_size);
+	}
+	if (output->ring_fd >= 0) {
+		close(output->ring_fd);
+	}
+	output->sqes = NULL;
+	output->sq_map = NULL;
+	output->cq_map = NULL;
+	output->ring_fd = -1;
+	output->uring = 0;
+}
+
+//ring of entries submissions, mapped as the kernel laid it out
+static s32 output_uring_open(struct output *output, u32 entries) {
+	struct io_uring_params params;
+	u8 *sq, *cq;
+
+	memset(&params, 0, sizeof(params));
+	output->ring_fd = output_uring_setup(entries, &params);
+	if (output->ring_fd < 0) {
+		return -1;
+	}
+	//writes go at the file position(offset -1), older kernels take -1 as an offset
+	if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+		output_uring_close(output);
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	output->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+	output->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (output->cq_map_size > output->sq_map_size) {
+			output->sq_map_size = output->cq_map_size;
+		}
+		output->cq_map_size = output->sq_map_size;
+	}
+	output->sq_map = mmap(NULL, output->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			output->ring_fd, IORING_OFF_SQ_RING);
+	if (output->sq_map == MAP_FAILED) {
+		output->sq_map = NULL;
+		output_uring_close(output);
+		return -1;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		output->cq_map = output->sq_map;
+	} else {
+		output->cq_map = mmap(NULL, output->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				output->ring_fd, IORING_OFF_CQ_RING);
+		if (output->cq_map == MAP_FAILED) {
+			output->cq_map = NULL;
+			output_uring_close(output);
+			return -1;
+		}
+	}
+	output->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	output->sqes = (struct io_uring_sqe*)mmap(NULL, output->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, output->ring_fd, IORING_OFF_SQES);
+	if (output->sqes == MAP_FAILED) {
+		output->sqes = NULL;
+		output_uring_close(output);
+		return -1;
+	}
+	sq = (u8*)output->sq_map;
+	cq = (u8*)output->cq_map;
+	output->sq_head = (u32*)(sq + params.sq_off.head);
+	output->sq_tail = (u32*)(sq + params.sq_off.tail);
+	output->sq_mask = (u32*)(sq + params.sq_off.ring_mask);
+	output->sq_array = (u32*)(sq + params.sq_off.array);
+	output->cq_head = (u32*)(cq + params.cq_off.head);
+	output->cq_tail = (u32*)(cq + params.cq_off.tail);
+	output->cq_mask = (u32*)(cq + params.cq_off.ring_mask);
+	output->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	output->uring = 1;
+	return 0;
+}
+
+/**
+ * @brief engine for up to targets printers and files
+ *
+ * @param targets: targets at most, each has one batch in flight at most
+ * @param depth: queued writes per target, rounded up to a power of 2
+ * @param flags: OUTPUT_XXX
+ *
+ * @return 0, -1 on error; no io_uring is no error, writev() takes over
+ */
+s32 output_init(struct output *output, s32 targets, s32 depth, s32 flags) {
+	if (output == NULL || targets <= 0 || depth <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(output, 0, sizeof(*output));
+	output->ring_fd = -1;
+	output->capacity = targets;
+	for (output->depth = 1; output->depth < depth; output->depth <<= 1);
+	output->target = (struct output_target*)calloc(targets, sizeof(struct output_target));
+	if (output->target == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (!(flags & OUTPUT_NO_URING) && output_uring_open(output, targets) < 0) {
+		//old kernel, seccomp or io_uring_disabled
+		printf("%s %d io_uring unavailable(%s), writev\n",__func__,__LINE__,strerror(errno));
+	}
+	return 0;
+}
+
+void output_free(struct output *output) {
+	s32 i;
+	if (output == NULL) {
+		return;
+	}
+	output_uring_close(output);
+	for (i = 0; i < output->targets; i++) {
+		free(output->target[i].queue);
+	}
+	free(output->target);
+	free(output->buffer);
+	output->target = NULL;
+	output->buffer = NULL;
+	output->targets = 0;
+	output->buffers = 0;
+}
+
+//a printer, pipe or file; returns its target id, -1 on error
+s32 output_add_target(struct output *output, s32 fd) {
+	struct output_target *target;
+	if (output == NULL || output->target == NULL || fd < 0 || output->targets == output->capacity) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	target = &output->target[output->targets];
+	memset(target, 0, sizeof(*target));
+	target->fd = fd;
+	target->queue = (struct output_request*)malloc(output->depth * sizeof(struct output_request));
+	if (target->queue == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	return output->targets++;
+}
+
+/**
+ * @brief register buffers, such as encoder arenas, writes from inside them go
+ * out as IORING_OP_WRITE_FIXED without the kernel mapping the pages per write
+ *
+ * call it with nothing in flight, it replaces the buffers registered before
+ *
+ * @return 0, -1 on error; failing to pin(RLIMIT_MEMLOCK) only drops the fixed writes
+ */
+s32 output_register(struct output *output, const struct iovec *buffer, s32 count) {
+	if (output == NULL || buffer == NULL || count <= 0 || output->inflight > 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (output->uring && output->buffers > 0) {
+		output_uring_register(output->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+	}
+	free(output->buffer);
+	output->buffers = 0;
+	output->buffer = (struct iovec*)malloc(count * sizeof(struct iovec));
+	if (output->buffer == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memcpy(output->buffer, buffer, count * sizeof(struct iovec));
+	if (output->uring && output_uring_register(output->ring_fd, IORING_REGISTER_BUFFERS, buffer, count) < 0) {
+		printf("%s %d register buffers err:%s\n",__func__,__LINE__,strerror(errno));
+		return 0;
+	}
+	output->buffers = count;
+	return 0;
+}
+
+//registered buffer holding [data, data + len), -1 for none
+static s32 output_buffer(const struct output *output, const u8 *data, s32 len) {
+	const u8 *base;
+	s32 i;
+	for (i = 0; i < output->buffers; i++) {
+		base = (const u8*)output->buffer[i].iov_base;
+		if (data >= base && data + len <= base + output->buffer[i].iov_len) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+//res bytes of the batch in flight written, or -errno
+static void output_complete(struct output *output, struct output_target *target, s32 res) {
+	struct output_request *request;
+	u64 now = stats_now();
+	u64 latency;
+	s32 n = target->busy;
+	s32 remain;
+
+	target->busy = 0;
+	if (res < 0) {
+		//the batch is dropped, the target goes on with the next one
+		target->errors += n;
+		target->error = -res;
+		target->head += n;
+		target->done = 0;
+		return;
+	}
+	for (; n > 0; n--) {
+		request = &target->queue[target->head & (output->depth - 1)];
+		remain = request->len - target->done;
+		if (res < remain) {
+			//short write, the rest goes with the next batch
+			target->done += res;
+			break;
+		}
+		res -= remain;
+		latency = now - request->queued;
+		target->writes++;
+		target->bytes += request->len;
+		target->latency_sum += latency;
+		if (latency > target->latency_max) {
+			target->latency_max = latency;
+		}
+		target->head++;
+		target->done = 0;
+	}
+}
+
+//iovecs of the queued requests of target, returns how many
+static s32 output_batch(struct output *output, struct output_target *target) {
+	struct output_request *request;
+	s32 n;
+	for (n = 0; n < OUTPUT_IOV && target->head + n != target->tail; n++) {
+		request = &target->queue[(target->head + n) & (output->depth - 1)];
+		target->iov[n].iov_base = (void*)(request->data + ((n == 0) ? target->done : 0));
+		target->iov[n].iov_len = request->len - ((n == 0) ? target->done : 0);
+	}
+	return n;
+}
+
+//one batch of target as a submission: WRITE_FIXED for a lone request in a
+//registered buffer, WRITEV otherwise; the file position is used(offset -1)
+static void output_prepare(struct output *output, s32 t, s32 n) {
+	struct output_target *target = &output->target[t];
+	struct output_request *request = &target->queue[target->head & (output->depth - 1)];
+	u32 tail = *output->sq_tail;
+	u32 index = tail & *output->sq_mask;
+	struct io_uring_sqe *sqe = &output->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = target->fd;
+	sqe->off = (u64)-1;
+	sqe->user_data = t;
+	if (n == 1 && request->buffer >= 0) {
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = (u64)(size_t)target->iov[0].iov_base;
+		sqe->len = target->iov[0].iov_len;
+		sqe->buf_index = request->buffer;
+	} else {
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = (u64)(size_t)target->iov;
+		sqe->len = n;
+	}
+	output->sq_array[index] = index;
+	OUTPUT_STORE(output->sq_tail, tail + 1);
+}
+
+//hand the kernel every prepared submission, waiting for min_complete
+//completions; it may take fewer than asked, the rest go on the next round
+static s32 output_uring_flush(struct output *output, u32 min_complete) {
+	u32 pending;
+	s32 res;
+
+	for (;;) {
+		pending = *output->sq_tail - OUTPUT_LOAD(output->sq_head);
+		res = output_uring_enter(output->ring_fd, pending, min_complete,
+				(min_complete > 0) ? IORING_ENTER_GETEVENTS : 0);
+		if (res < 0) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+			return -1;
+		}
+		output->inflight += res;
+		//a short submission returns before waiting
+		if ((u32)res >= pending) {
+			return 0;
+		}
+		if (res == 0) {
+			errno = EBUSY;
+			return -1;
+		}
+	}
+}
+
+/**
+ * @brief start a batch on every idle target with queued writes
+ *
+ * without io_uring the batches are written here with writev()
+ *
+ * @return batches started, -1 on error
+ */
+s32 output_submit(struct output *output) {
+	struct output_target *target;
+	s32 submit = 0;
+	s32 t, n, res;
+
+	if (output == NULL || output->target == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (t = 0; t < output->targets; t++) {
+		target = &output->target[t];
+		if (!output->uring) {
+			while ((n = output_batch(output, target)) > 0) {
+				do {
+					res = writev(target->fd, target->iov, n);
+				} while (res < 0 && errno == EINTR);
+				target->busy = n;
+				output_complete(output, target, (res < 0) ? -errno : res);
+				submit++;
+			}
+			continue;
+		}
+		if (target->busy > 0 || (n = output_batch(output, target)) == 0) {
+			continue;
+		}
+		target->busy = n;
+		output_prepare(output, t, n);
+		submit++;
+	}
+	if (output->uring && submit > 0 && output_uring_flush(output, 0) < 0) {
+		printf("%s %d io_uring_enter err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		return -1;
+	}
+	return submit;
+}
+
+/**
+ * @brief reap completions, waiting for min_complete of them, and start the
+ * next batch of the targets they free
+ *
+ * @return completions, -1 on error
+ */
+s32 output_wait(struct output *output, s32 min_complete) {
+	struct io_uring_cqe *cqe;
+	s32 complete = 0;
+	u32 head, tail, pending;
+
+	if (output == NULL || output->target == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (!output->uring) {
+		return 0;
+	}
+	//submissions the kernel didn't take yet go first
+	pending = *output->sq_tail - OUTPUT_LOAD(output->sq_head);
+	if (min_complete > output->inflight + (s32)pending) {
+		min_complete = output->inflight + pending;
+	}
+	if ((min_complete > 0 || pending > 0) && output_uring_flush(output, min_complete) < 0) {
+		printf("%s %d io_uring_enter err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		return -1;
+	}
+	head = *output->cq_head;
+	tail = OUTPUT_LOAD(output->cq_tail);
+	for (; head != tail; head++) {
+		cqe = &output->cqes[head & *output->cq_mask];
+		if (cqe->user_data < (u64)output->targets) {
+			output_complete(output, &output->target[cqe->user_data], cqe->res);
+		}
+		complete++;
+	}
+	OUTPUT_STORE(output->cq_head, head);
+	output->inflight -= complete;
+	if (complete > 0 && output_submit(output) < 0) {
+		return -1;
+	}
+	return complete;
+}
+
+/**
+ * @brief queue a write, data must stay untouched until it completes
+ *
+ * a full queue first waits for the target to drain some
+ *
+ * @return 0, -1 on error
+ */
+s32 output_write(struct output *output, s32 target, const void *data, s32 len) {
+	struct output_target *t;
+	struct output_request *request;
+
+	if (output == NULL || output->target == NULL || target < 0 || target >= output->targets ||
+			data == NULL || len <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	t = &output->target[target];
+	while (t->tail - t->head == (u32)output->depth) {
+		if (output_submit(output) < 0 || output_wait(output, 1) < 0) {
+			return -1;
+		}
+	}
+	request = &t->queue[t->tail & (output->depth - 1)];
+	request->data = (const u8*)data;
+	request->len = len;
+	request->buffer = output->uring ? output_buffer(output, (const u8*)data, len) : -1;
+	request->queued = stats_now();
+	t->tail++;
+	return 0;
+}
+
+//everything queued written; -1 when a write of any target failed
+s32 output_flush(struct output *output) {
+	s32 t, pending;
+	if (output_submit(output) < 0) {
+		return -1;
+	}
+	for (;;) {
+		pending = 0;
+		for (t = 0; t < output->targets; t++) {
+			pending |= (output->target[t].head != output->target[t].tail);
+		}
+		if (!pending) {
+			break;
+		}
+		if (output->inflight == 0 && output_submit(output) <= 0) {
+			return -1;
+		}
+		if (output_wait(output, 1) < 0) {
+			return -1;
+		}
+	}
+	for (t = 0; t < output->targets; t++) {
+		if (output->target[t].errors > 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//one line per target: completed writes, bytes, errors and latency
+s32 output_dump(const struct output *output, FILE *fp) {
+	const struct output_target *target;
+	s32 t;
+	if (output == NULL || fp == NULL) {
+		return -1;
+	}
+	fprintf(fp, "output engine:%s targets:%d\n", output->uring ? "io_uring" : "writev", output->targets);
+	for (t = 0; t < output->targets; t++) {
+		target = &output->target[t];
+		fprintf(fp, "  target %d fd %d writes:%llu bytes:%llu errors:%llu latency avg(us):%.1f max(us):%.1f",
+				t, target->fd, (unsigned long long)target->writes, (unsigned long long)target->bytes,
+				(unsigned long long)target->errors,
+				target->writes ? (double)target->latency_sum / target->writes / 1000.0 : 0.0,
+				(double)target->latency_max / 1000.0);
+		if (target->error) {
+			fprintf(fp, " last error:%s", strerror(target->error));
+		}
+		fprintf(fp, "\n");
+	}
+	return 0;
+}
+
+//output_selftest(): records of OUTPUT_TEST_RECORDS lengths, some from a registered buffer
+#define OUTPUT_TEST_RECORDS		200
+#define OUTPUT_TEST_LEN			(OUTPUT_TEST_RECORDS * OUTPUT_TEST_RECORDS / 2)
+
+//what came out of fd matches expect; a pipe is read as it comes, a file from its start
+static s32 output_selftest_read(s32 fd, s32 file, const u8 *expect, s32 len, u8 *got) {
+	ssize_t n;
+	s32 done = 0;
+	while (done < len) {
+		n = file ? pread(fd, got + done, len - done, done) : read(fd, got + done, len - done);
+		if (n <= 0) {
+			break;
+		}
+		done += n;
+	}
+	return (done == len && memcmp(expect, got, len) == 0) ? 0 : -1;
+}
+
+/**
+ * @brief the same records through a spool file and a pipe, with io_uring and
+ * with writev(), read back byte for byte
+ *
+ * @return 0 when both targets got every record in order, -1 otherwise
+ */
+s32 output_selftest(void) {
+	struct output output;
+	struct iovec arena;
+	FILE *spool = NULL;
+	u8 *expect = (u8*)malloc(OUTPUT_TEST_LEN);
+	u8 *got = (u8*)malloc(OUTPUT_TEST_LEN);
+	s32 sv[2];
+	s32 flags[2] = {0, OUTPUT_NO_URING};
+	s32 ret = 0;
+	s32 mode, i, off, file, pipe_target;
+
+	if (expect == NULL || got == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		free(expect);
+		free(got);
+		return -1;
+	}
+	for (i = 0; i < OUTPUT_TEST_LEN; i++) {
+		expect[i] = (u8)(i * 7 + (i >> 8));
+	}
+	arena.iov_base = expect;
+	arena.iov_len = OUTPUT_TEST_LEN / 2;
+	for (mode = 0; mode < 2 && ret == 0; mode++) {
+		spool = tmpfile();
+		if (spool == NULL || pipe(sv) < 0) {
+			printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+			if (spool != NULL) {
+				fclose(spool);
+			}
+			ret = -1;
+			break;
+		}
+		if (output_init(&output, 2, 16, flags[mode]) < 0) {
+			fclose(spool);
+			close(sv[0]);
+			close(sv[1]);
+			ret = -1;
+			break;
+		}
+		file = output_add_target(&output, fileno(spool));
+		pipe_target = output_add_target(&output, sv[1]);
+		//the first half of the records are fixed writes under io_uring
+		if (file < 0 || pipe_target < 0 || output_register(&output, &arena, 1) < 0) {
+			ret = -1;
+		}
+		for (i = 1, off = 0; ret == 0 && i < OUTPUT_TEST_RECORDS; off += i++) {
+			if (output_write(&output, file, expect + off, i) < 0 ||
+					output_write(&output, pipe_target, expect + off, i) < 0 ||
+					((i & 7) == 0 && output_submit(&output) < 0)) {
+				ret = -1;
+			}
+		}
+		if (ret == 0 && (output_flush(&output) < 0 ||
+				output_selftest_read(fileno(spool), 1, expect, off, got) < 0 ||
+				output_selftest_read(sv[0], 0, expect, off, got) < 0)) {
+			printf("%s %d %s round trip differs\n",__func__,__LINE__,output.uring ? "io_uring" : "writev");
+			ret = -1;
+		}
+		output_free(&output);
+		fclose(spool);
+		close(sv[0]);
+		close(sv[1]);
+	}
+	free(expect);
+	free(got);
+	return ret;
+}
@@ -0,0 +1,94 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//output_init() flags
+#define OUTPUT_NO_URING		0x1		//writev() even when io_uring is there
+
+//requests of one batch at most
+#define OUTPUT_IOV			64
+
+//one queued write, data must stay put until it completes
+struct output_request {
+	const u8 *data;
+	s32 len;
+	//registered buffer holding data, -1 for none
+	s32 buffer;
+	u64 queued;
+};
+
+//a printer or a spool file, one batch in flight at a time keeps its bytes in order
+struct output_target {
+	s32 fd;
+	struct output_request *queue;
+	u32 head;
+	u32 tail;
+	//requests from head in the batch in flight, 0 for none
+	s32 busy;
+	//bytes of queue[head] already written by a short write
+	s32 done;
+	struct iovec iov[OUTPUT_IOV];
+	//completion report
+	u64 writes;
+	u64 bytes;
+	u64 errors;
+	u64 latency_sum;
+	u64 latency_max;
+	s32 error;
+};
+
+//writes to many targets through io_uring, or writev() without it
+struct output {
+	s32 uring;
+	s32 ring_fd;
+	//queued requests per target, a power of 2
+	s32 depth;
+	struct output_target *target;
+	s32 targets;
+	s32 capacity;
+	//registered buffers, such as encoder arenas
+	struct iovec *buffer;
+	s32 buffers;
+	//io_uring rings
+	void *sq_map;
+	void *cq_map;
+	size_t sq_map_size;
+	size_t cq_map_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	u32 *sq_head;
+	u32 *sq_tail;
+	u32 *sq_mask;
+	u32 *sq_array;
+	u32 *cq_head;
+	u32 *cq_tail;
+	u32 *cq_mask;
+	struct io_uring_cqe *cqes;
+	//batches in flight
+	s32 inflight;
+};
+
+s32 output_init(struct output *output, s32 targets, s32 depth, s32 flags);
+void output_free(struct output *output);
+s32 output_add_target(struct output *output, s32 fd);
+s32 output_register(struct output *output, const struct iovec *buffer, s32 count);
+s32 output_write(struct output *output, s32 target, const void *data, s32 len);
+s32 output_submit(struct output *output);
+s32 output_wait(struct output *output, s32 min_complete);
+s32 output_flush(struct output *output);
+s32 output_dump(const struct output *output, FILE *fp);
+s32 output_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
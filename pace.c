@@ -0,0 +1,170 @@
+/**
+ * @file pace.c
+ * @brief print time of a label from its modules, and output paced to it
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "stats.h"
+#include "trace.h"
+#include "pace.h"
+
+//weight of the newest label in the drain rate
+#define PACE_EWMA			0.25
+#define PACE_MM_PER_INCH	25.4
+
+/**
+ * @brief printed length and time of a symbol, the rest of the label is blank
+ *
+ * @param printer: dpi and speed
+ * @param modules: coded length, what the encoders return
+ * @param scale: dots per module
+ * @param height: bar height in dots
+ * @param rotated: bars along the feed(ladder), the modules set the length;
+ * across it(picket fence) the bar height does
+ * @param estimate: out
+ *
+ * @return 0, -1 on error
+ */
+s32 pace_estimate(const struct pace_printer *printer, s32 modules, s32 scale, s32 height, s32 rotated,
+		struct pace_estimate *estimate) {
+	if (printer == NULL || printer->dpi <= 0 || printer->speed <= 0 || modules < 0 || scale <= 0 ||
+			height < 0 || estimate == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	estimate->dots = rotated ? modules * scale : height;
+	estimate->mm = estimate->dots * PACE_MM_PER_INCH / printer->dpi;
+	//the printer feeds a whole label whatever is on it
+	if (estimate->mm < printer->label_mm) {
+		estimate->mm = printer->label_mm;
+	}
+	estimate->ns = (u64)(estimate->mm * 1e9 / printer->speed);
+	return 0;
+}
+
+s32 pace_init(struct pace *pace, const struct pace_printer *printer) {
+	if (pace == NULL || printer == NULL || printer->dpi <= 0 || printer->speed <= 0 || printer->buffer < 0 ||
+			printer->lead_ms < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(pace, 0, sizeof(*pace));
+	pace->printer = *printer;
+	pace->lead = (u64)(printer->lead_ms > 0 ? printer->lead_ms : PACE_LEAD_MS) * 1000000ULL;
+	pace->tokens = pace->lead;
+	return 0;
+}
+
+//what the printer printed since the last look
+static void pace_refill(struct pace *pace, u64 now) {
+	u64 elapsed;
+	if (!pace->started || now <= pace->last) {
+		return;
+	}
+	elapsed = now - pace->last;
+	pace->last = now;
+	pace->tokens += elapsed;
+	if (pace->tokens > (s64)pace->lead) {
+		//it ran out of labels
+		pace->idle_ns += pace->tokens - pace->lead;
+		pace->tokens = pace->lead;
+	}
+	pace->held -= elapsed * pace->drain;
+	if (pace->held < 0) {
+		pace->held = 0;
+	}
+}
+
+/**
+ * @brief how long to hold a label back so the printer keeps about lead of
+ * print time queued and its buffer doesn't overrun
+ *
+ * @param now: stats_now()
+ * @param bytes: printer command of the label
+ *
+ * @return ns to wait, 0 to send it now
+ */
+u64 pace_delay(struct pace *pace, u64 now, s32 bytes) {
+	u64 delay = 0, fill;
+
+	if (pace == NULL) {
+		return 0;
+	}
+	pace_refill(pace, now);
+	if (pace->tokens < 0) {
+		delay = -pace->tokens;
+	}
+	//an empty buffer takes any label, however big
+	if (pace->printer.buffer > 0 && pace->held > 0 && pace->drain > 0 &&
+			pace->held + bytes > pace->printer.buffer) {
+		fill = (u64)((pace->held + bytes - pace->printer.buffer) / pace->drain);
+		if (fill > delay) {
+			delay = fill;
+		}
+	}
+	return delay;
+}
+
+//the label was sent
+s32 pace_charge(struct pace *pace, u64 now, u64 cost, s32 bytes) {
+	if (pace == NULL || bytes < 0) {
+		return -1;
+	}
+	if (!pace->started) {
+		pace->started = 1;
+		pace->last = now;
+	}
+	pace_refill(pace, now);
+	pace->tokens -= cost;
+	pace->held += bytes;
+	if (cost > 0) {
+		pace->drain = (pace->drain > 0) ? pace->drain + PACE_EWMA * ((double)bytes / cost - pace->drain) :
+				(double)bytes / cost;
+	}
+	pace->labels++;
+	pace->bytes += bytes;
+	pace->print_ns += cost;
+	return 0;
+}
+
+//sleep until a label of cost print time may be sent, then charge it
+s32 pace_wait(struct pace *pace, u64 cost, s32 bytes) {
+	struct timespec ts;
+	u64 now, delay;
+
+	if (pace == NULL) {
+		return -1;
+	}
+	now = stats_now();
+	delay = pace_delay(pace, now, bytes);
+	if (delay > 0) {
+		pace->waits++;
+		pace->wait_ns += delay;
+		ts.tv_sec = delay / 1000000000ULL;
+		ts.tv_nsec = delay % 1000000000ULL;
+		while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+		now = stats_now();
+	}
+	return pace_charge(pace, now, cost, bytes);
+}
+
+s32 pace_dump(const struct pace *pace, FILE *fp) {
+	if (pace == NULL || fp == NULL) {
+		return -1;
+	}
+	fprintf(fp, "pace labels:%llu bytes:%llu print(ms):%llu waits:%llu wait(ms):%llu idle(ms):%llu\n",
+			(unsigned long long)pace->labels, (unsigned long long)pace->bytes,
+			(unsigned long long)(pace->print_ns / 1000000), (unsigned long long)pace->waits,
+			(unsigned long long)(pace->wait_ns / 1000000), (unsigned long long)(pace->idle_ns / 1000000));
+	return 0;
+}
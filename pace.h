@@ -0,0 +1,68 @@
+#ifndef __PACE_H__
+#define __PACE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//what the output is paced to
+struct pace_printer {
+	s32 dpi;
+	//print speed in mm per second
+	s32 speed;
+	//label pitch along the feed, gap included, 0 for continuous media
+	s32 label_mm;
+	//device receive buffer in bytes, 0 for no limit
+	s32 buffer;
+	//print time kept queued in the printer, 0 for PACE_LEAD_MS
+	s32 lead_ms;
+};
+
+//print time kept queued when the printer doesn't say
+#define PACE_LEAD_MS		200
+
+//the printed size and time of one label
+struct pace_estimate {
+	//dots along the feed
+	s32 dots;
+	double mm;
+	u64 ns;
+};
+
+//token buckets over print time and over the printer buffer
+struct pace {
+	struct pace_printer printer;
+	u64 lead;
+	//print time that may still be sent, below 0 until the printer catches up
+	s64 tokens;
+	//bytes the printer is holding, drained at bytes per print ns of the recent labels
+	double held;
+	double drain;
+	u64 last;
+	s32 started;
+	u64 labels;
+	u64 bytes;
+	u64 print_ns;
+	//times output waited and how long, print time the printer sat idle
+	u64 waits;
+	u64 wait_ns;
+	u64 idle_ns;
+};
+
+s32 pace_estimate(const struct pace_printer *printer, s32 modules, s32 scale, s32 height, s32 rotated,
+		struct pace_estimate *estimate);
+s32 pace_init(struct pace *pace, const struct pace_printer *printer);
+u64 pace_delay(struct pace *pace, u64 now, s32 bytes);
+s32 pace_charge(struct pace *pace, u64 now, u64 cost, s32 bytes);
+s32 pace_wait(struct pace *pace, u64 cost, s32 bytes);
+s32 pace_dump(const struct pace *pace, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file pack.c
+ * @brief convert coded data(byte per module) to packed bytes for printer
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "pack.h"
+
+//bytes formatted per pack_write_hex() chunk
+#define PACK_HEX_CHUNK	1024
+
+static const s8 pack_hex_digits[] = "0123456789abcdef";
+
+//bytes needed to pack bits modules
+s32 pack_len(s32 bits) {
+	return (bits > 0) ? ((bits + 7) >> 3) : 0;
+}
+
+/**
+ * @brief pack coded data, first module is the MSB of the first byte
+ *
+ * @param bin: coded data, one module per byte, non-zero is a bar
+ * @param bits: length of coded data
+ * @param out: packed data
+ * @param out_size: size of out, at least pack_len(bits)
+ *
+ * @return length of packed data, -1 on error
+ */
+s32 pack_bits(const s8 *bin, s32 bits, u8 *out, s32 out_size) {
+	if (bin == NULL || out == NULL || bits < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	if (out_size < pack_len(bits)) {
+		printf("%s %d buffer too small\n",__func__,__LINE__);
+		return -1;
+	}
+	return kernel_pack_bits(bin, bits, out);
+}
+
+//text needed by pack_hex(), with the terminating '\0'
+s32 pack_hex_len(s32 bytes) {
+	return bytes * PACK_HEX_CHARS + 1;
+}
+
+/**
+ * @brief format packed data as a C array body: "0xb2,0x59,"
+ *
+ * @param packed: packed data
+ * @param bytes: length of packed data
+ * @param text: output string
+ * @param text_size: size of text, at least pack_hex_len(bytes)
+ *
+ * @return length of text without '\0', -1 on error
+ */
+s32 pack_hex(const u8 *packed, s32 bytes, s8 *text, s32 text_size) {
+	s8 *p = text;
+	s32 i;
+	if (packed == NULL || text == NULL || text_size < pack_hex_len(bytes)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	for (i = 0; i < bytes; i++) {
+		*p++ = '0';
+		*p++ = 'x';
+		*p++ = pack_hex_digits[packed[i] >> 4];
+		*p++ = pack_hex_digits[packed[i] & 0xF];
+		*p++ = ',';
+	}
+	*p = '\0';
+	return p - text;
+}
+
+//format and write in chunks, one fwrite per chunk instead of a printf per byte
+s32 pack_write_hex(const u8 *packed, s32 bytes, FILE *fp) {
+	s8 text[PACK_HEX_CHUNK * PACK_HEX_CHARS + 1];
+	s32 chunk, len;
+	s32 total = 0;
+	if (packed == NULL || fp == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	while (bytes > 0) {
+		chunk = (bytes < PACK_HEX_CHUNK) ? bytes : PACK_HEX_CHUNK;
+		len = pack_hex(packed, chunk, text, sizeof(text));
+		if (fwrite(text, 1, len, fp) != (size_t)len) {
+			printf("%s %d write err\n",__func__,__LINE__);
+			return -1;
+		}
+		packed += chunk;
+		bytes -= chunk;
+		total += len;
+	}
+	return total;
+}
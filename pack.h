@@ -0,0 +1,25 @@
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//"0xNN," per byte
+#define PACK_HEX_CHARS	5
+
+s32 pack_len(s32 bits);
+s32 pack_bits(const s8 *bin, s32 bits, u8 *out, s32 out_size);
+s32 pack_hex_len(s32 bytes);
+s32 pack_hex(const u8 *packed, s32 bytes, s8 *text, s32 text_size);
+s32 pack_write_hex(const u8 *packed, s32 bytes, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
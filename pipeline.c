@@ -0,0 +1,448 @@
+/**
+ * @file pipeline.c
+ * @brief encode threads and a printer writer overlapped through lock-free SPSC rings
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "native.h"
+#include "symbology.h"
+#include "output.h"
+#include "pace.h"
+#include "cache.h"
+#include "stats.h"
+#include "trace.h"
+#include "pipeline.h"
+
+//slots one round of the writer takes at most, one engine batch
+#define PIPELINE_IOV		OUTPUT_IOV
+
+#define PIPELINE_LOAD(v)		__atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define PIPELINE_STORE(v, n)	__atomic_store_n(&(v), (n), __ATOMIC_RELEASE)
+
+static inline void pipeline_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+static s32 pipeline_empty(struct pipeline *pipeline) {
+	s32 i;
+	for (i = 0; i < pipeline->producers; i++) {
+		if (PIPELINE_LOAD(pipeline->ring[i].head) != pipeline->ring[i].tail) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//sleep until a producer commits or the pipeline stops
+static void pipeline_wait_data(struct pipeline *pipeline) {
+	pthread_mutex_lock(&pipeline->lock);
+	__atomic_store_n(&pipeline->writer_sleeping, 1, __ATOMIC_SEQ_CST);
+	//pairs with the fence of a committing producer
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (pipeline_empty(pipeline) && !__atomic_load_n(&pipeline->stop, __ATOMIC_SEQ_CST)) {
+		pthread_cond_wait(&pipeline->data, &pipeline->lock);
+	}
+	__atomic_store_n(&pipeline->writer_sleeping, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+//queue committed slots of every ring as one batch of the output engine, then
+//hand them back once it is written
+static void *pipeline_writer(void *arg) {
+	struct pipeline *pipeline = (struct pipeline*)arg;
+	struct output_target *target = &pipeline->output.target[pipeline->target];
+	struct pipeline_ring *ring;
+	u32 *taken = pipeline->taken;
+	s32 first = 0;
+	s32 idle = 0;
+	s32 n, i, k;
+	u32 head, tail, slot;
+	u64 bytes;
+
+	for (;;) {
+		n = 0;
+		//start at another ring each round so no producer starves
+		for (k = 0; k < pipeline->producers; k++) {
+			i = (first + k) % pipeline->producers;
+			ring = &pipeline->ring[i];
+			head = PIPELINE_LOAD(ring->head);
+			taken[i] = 0;
+			//paced labels go out one at a time, each when the printer is ready for it;
+			//pace is only looked at past a commit, which published it
+			for (tail = ring->tail; tail != head && n < PIPELINE_IOV && (n == 0 || pipeline->pace == NULL); tail++) {
+				slot = tail & (pipeline->slots - 1);
+				if (pipeline->error == 0 && ring->len[slot] > 0 && pipeline->pace != NULL) {
+					pace_wait(pipeline->pace, ring->cost[slot], ring->len[slot]);
+				}
+				//after a failed write the rest is dropped
+				if (pipeline->error == 0 && ring->len[slot] > 0 && output_write(&pipeline->output, pipeline->target,
+						ring->buffer + (size_t)slot * pipeline->slot_size, ring->len[slot]) < 0) {
+					pipeline->error = errno ? errno : EIO;
+				}
+				taken[i]++;
+				n++;
+			}
+		}
+		first = (first + 1) % pipeline->producers;
+		if (n == 0) {
+			if (__atomic_load_n(&pipeline->stop, __ATOMIC_SEQ_CST) && pipeline_empty(pipeline)) {
+				break;
+			}
+			if (idle++ < pipeline->spin) {
+				pipeline_pause();
+			} else {
+				pipeline_wait_data(pipeline);
+				idle = 0;
+			}
+			continue;
+		}
+		idle = 0;
+		if (target->head != target->tail) {
+			bytes = target->bytes;
+			//the slots are handed back only once the engine is done with them
+			if (output_flush(&pipeline->output) < 0) {
+				pipeline->error = target->error ? target->error : errno;
+				printf("%s %d write err:%s\n",__func__,__LINE__,strerror(pipeline->error));
+				TRACE_ERROR();
+			}
+			pipeline->written += target->bytes - bytes;
+			pipeline->writes++;
+		}
+		pipeline->records += n;
+		for (i = 0; i < pipeline->producers; i++) {
+			if (taken[i] > 0) {
+				PIPELINE_STORE(pipeline->ring[i].tail, pipeline->ring[i].tail + taken[i]);
+			}
+		}
+		//pairs with the fence of a producer going to sleep on a full ring
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&pipeline->sleepers, __ATOMIC_RELAXED) > 0) {
+			pthread_mutex_lock(&pipeline->lock);
+			pthread_cond_broadcast(&pipeline->room);
+			pthread_mutex_unlock(&pipeline->lock);
+		}
+	}
+	return NULL;
+}
+
+//a writer still running is stopped first, see pipeline_stop()
+void pipeline_free(struct pipeline *pipeline) {
+	s32 i;
+	if (pipeline == NULL || pipeline->ring == NULL) {
+		return;
+	}
+	pipeline_stop(pipeline);
+	for (i = 0; i < pipeline->producers; i++) {
+		free(pipeline->ring[i].buffer);
+		free(pipeline->ring[i].len);
+		free(pipeline->ring[i].cost);
+	}
+	free(pipeline->ring);
+	free(pipeline->taken);
+	output_free(&pipeline->output);
+	pipeline->ring = NULL;
+	pipeline->taken = NULL;
+	pthread_mutex_destroy(&pipeline->lock);
+	pthread_cond_destroy(&pipeline->room);
+	pthread_cond_destroy(&pipeline->data);
+}
+
+/**
+ * @brief rings for producers encode threads and a writer thread draining them
+ * to fd through the output engine(io_uring, writev without it)
+ *
+ * records of one producer reach fd in order, records of different producers
+ * interleave
+ *
+ * @param fd: the printer, a FIFO or a file stands in for it
+ * @param producers: encode threads, each owns ring pipeline_acquire(producer)
+ * @param slots: slots per ring, rounded up to a power of 2
+ * @param slot_size: bytes of the biggest record
+ * @param spin: polls before a full ring or an idle writer sleeps, 0 sleeps at once
+ *
+ * @return 0, -1 on error
+ */
+s32 pipeline_init(struct pipeline *pipeline, s32 fd, s32 producers, s32 slots, s32 slot_size, s32 spin) {
+	struct iovec *arena = NULL;
+	s32 i;
+
+	if (pipeline == NULL || fd < 0 || producers <= 0 || slots <= 0 || slot_size <= 0 || spin < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(pipeline, 0, sizeof(*pipeline));
+	pipeline->fd = fd;
+	pipeline->producers = producers;
+	pipeline->slot_size = slot_size;
+	pipeline->spin = spin;
+	for (pipeline->slots = 1; pipeline->slots < slots; pipeline->slots <<= 1);
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->room, NULL);
+	pthread_cond_init(&pipeline->data, NULL);
+	//one target, a round of the writer fits its queue
+	if (output_init(&pipeline->output, 1, PIPELINE_IOV, 0) < 0 ||
+			(pipeline->target = output_add_target(&pipeline->output, fd)) < 0) {
+		output_free(&pipeline->output);
+		return -1;
+	}
+
+	pipeline->ring = (struct pipeline_ring*)aligned_alloc(PIPELINE_LINE, producers * sizeof(struct pipeline_ring));
+	if (pipeline->ring == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		output_free(&pipeline->output);
+		return -1;
+	}
+	memset(pipeline->ring, 0, producers * sizeof(struct pipeline_ring));
+	pipeline->taken = (u32*)calloc(producers, sizeof(u32));
+	if (pipeline->taken == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		pipeline_free(pipeline);
+		return -1;
+	}
+	for (i = 0; i < producers; i++) {
+		pipeline->ring[i].buffer = (u8*)malloc((size_t)pipeline->slots * slot_size);
+		pipeline->ring[i].len = (s32*)malloc(pipeline->slots * sizeof(s32));
+		pipeline->ring[i].cost = (u64*)malloc(pipeline->slots * sizeof(u64));
+		if (pipeline->ring[i].buffer == NULL || pipeline->ring[i].len == NULL || pipeline->ring[i].cost == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			pipeline_free(pipeline);
+			return -1;
+		}
+	}
+	//labels go out of the rings without the kernel mapping their pages per write
+	arena = (struct iovec*)malloc(producers * sizeof(struct iovec));
+	for (i = 0; arena != NULL && i < producers; i++) {
+		arena[i].iov_base = pipeline->ring[i].buffer;
+		arena[i].iov_len = (size_t)pipeline->slots * slot_size;
+	}
+	if (arena == NULL || output_register(&pipeline->output, arena, producers) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		free(arena);
+		pipeline_free(pipeline);
+		return -1;
+	}
+	free(arena);
+	if (pthread_create(&pipeline->writer, NULL, pipeline_writer, pipeline) != 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		pipeline_free(pipeline);
+		return -1;
+	}
+	pipeline->running = 1;
+	return 0;
+}
+
+/**
+ * @brief next free slot of the producer's ring, waits while the printer is behind
+ *
+ * @param producer: 0 to producers - 1, one thread each
+ *
+ * @return slot of slot_size bytes, NULL on error
+ */
+u8 *pipeline_acquire(struct pipeline *pipeline, s32 producer) {
+	struct pipeline_ring *ring;
+	s32 idle = 0;
+
+	if (pipeline == NULL || pipeline->ring == NULL || producer < 0 || producer >= pipeline->producers) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return NULL;
+	}
+	ring = &pipeline->ring[producer];
+	if (ring->head - ring->tail_cache == (u32)pipeline->slots) {
+		ring->tail_cache = PIPELINE_LOAD(ring->tail);
+		while (ring->head - ring->tail_cache == (u32)pipeline->slots) {
+			if (idle++ < pipeline->spin) {
+				pipeline_pause();
+			} else {
+				//backpressure: sleep until the writer frees a slot
+				pthread_mutex_lock(&pipeline->lock);
+				pipeline->full_waits++;
+				__atomic_fetch_add(&pipeline->sleepers, 1, __ATOMIC_SEQ_CST);
+				while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == (u32)pipeline->slots) {
+					pthread_cond_wait(&pipeline->room, &pipeline->lock);
+				}
+				__atomic_fetch_sub(&pipeline->sleepers, 1, __ATOMIC_RELAXED);
+				pthread_mutex_unlock(&pipeline->lock);
+				idle = 0;
+			}
+			ring->tail_cache = PIPELINE_LOAD(ring->tail);
+		}
+	}
+	return ring->buffer + (size_t)(ring->head & (pipeline->slots - 1)) * pipeline->slot_size;
+}
+
+//the slot of pipeline_acquire() holds len bytes printing in cost ns
+static s32 pipeline_publish(struct pipeline *pipeline, s32 producer, s32 len, u64 cost) {
+	struct pipeline_ring *ring;
+
+	if (pipeline == NULL || pipeline->ring == NULL || producer < 0 || producer >= pipeline->producers ||
+			len < 0 || len > pipeline->slot_size) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	ring = &pipeline->ring[producer];
+	ring->len[ring->head & (pipeline->slots - 1)] = len;
+	ring->cost[ring->head & (pipeline->slots - 1)] = cost;
+	PIPELINE_STORE(ring->head, ring->head + 1);
+	//pairs with the writer going to sleep on empty rings
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pipeline->writer_sleeping, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&pipeline->lock);
+		pthread_cond_signal(&pipeline->data);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+	return 0;
+}
+
+//publish the slot of pipeline_acquire() holding len bytes, paced as taking no print time
+s32 pipeline_commit(struct pipeline *pipeline, s32 producer, s32 len) {
+	return pipeline_publish(pipeline, producer, len, 0);
+}
+
+/**
+ * @brief encode one label into the producer's ring: the native command of
+ * the dialect, or its bitmap when the dialect can't draw the symbol
+ *
+ * @param dialect: NATIVE_XXX
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ * @param field: position and size
+ *
+ * @return bytes queued, -1 on error(the slot isn't used)
+ */
+s32 pipeline_encode(struct pipeline *pipeline, s32 producer, s32 dialect, s32 symbology, const s8 *input,
+		const struct native_field *field) {
+	struct pace_estimate estimate;
+	FILE *fp = NULL;
+	u8 *slot = pipeline_acquire(pipeline, producer);
+	s32 len = -1;
+	s32 full;
+	u64 cost = 0;
+
+	if (slot == NULL) {
+		return -1;
+	}
+	//the slot is the file, the label is framed as printed on its own
+	fp = fmemopen(slot, pipeline->slot_size, "w");
+	if (fp == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	setvbuf(fp, NULL, _IONBF, 0);
+	if (native_begin(dialect, fp) >= 0 && native_write_cached(dialect, symbology, input, field,
+			(pipeline->producers == 1) ? pipeline->cache : NULL, fp) > 0 &&
+			native_end(dialect, fp) >= 0 && !ferror(fp)) {
+		len = ftell(fp);
+	}
+	full = ferror(fp) || ftell(fp) >= pipeline->slot_size;
+	fclose(fp);
+	if (len <= 0 || len >= pipeline->slot_size) {
+		//a full slot may have lost its tail
+		printf("%s %d encode err:%s\n",__func__,__LINE__,input);
+		if (full && pipeline->cache != NULL && pipeline->producers == 1) {
+			//and with it a graphic the cache counts as downloaded; what the printer
+			//got so far stays under names that won't come again
+			cache_forget(pipeline->cache);
+		}
+		return -1;
+	}
+	//native fields print bars across the feed
+	if (pipeline->pace != NULL && pace_estimate(&pipeline->pace->printer, symbology_width(symbology, input),
+			field->module, field->height, 0, &estimate) == 0) {
+		cost = estimate.ns;
+	}
+	return (pipeline_publish(pipeline, producer, len, cost) < 0) ? -1 : len;
+}
+
+/**
+ * @brief producers are done: the writer drains what is queued and exits
+ *
+ * calling it again only reports the error
+ *
+ * @return 0, -1 when a write failed
+ */
+s32 pipeline_stop(struct pipeline *pipeline) {
+	if (pipeline == NULL || pipeline->ring == NULL) {
+		return -1;
+	}
+	if (pipeline->running) {
+		__atomic_store_n(&pipeline->stop, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_lock(&pipeline->lock);
+		pthread_cond_signal(&pipeline->data);
+		pthread_mutex_unlock(&pipeline->lock);
+		pthread_join(pipeline->writer, NULL);
+		pipeline->running = 0;
+	}
+	return (pipeline->error != 0) ? -1 : 0;
+}
+
+//pipeline_selftest(): 2mm labels at 200mm/s print in 10ms each
+#define PIPELINE_TEST_LABELS	30
+
+/**
+ * @brief labels paced to a printer never leave faster than it prints them:
+ * past the lead it may hold and the label just sent, the run takes their print time
+ *
+ * @return 0 when the pace holds and every byte arrived, -1 otherwise
+ */
+s32 pipeline_selftest(void) {
+	struct pace_printer printer = {203, 200, 2, 0, 20};
+	struct native_field field = {0, 0, 8, 2, 0};
+	struct pipeline pipeline;
+	struct pace pace;
+	FILE *spool = tmpfile();
+	u64 start, elapsed;
+	s32 i, ret = 0;
+
+	if (spool == NULL || pace_init(&pace, &printer) < 0 ||
+			pipeline_init(&pipeline, fileno(spool), 1, 4, 4096, 0) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		if (spool != NULL) {
+			fclose(spool);
+		}
+		return -1;
+	}
+	pipeline.pace = &pace;
+	start = stats_now();
+	for (i = 0; i < PIPELINE_TEST_LABELS; i++) {
+		if (pipeline_encode(&pipeline, 0, NATIVE_ZPL, SYMBOLOGY_CODE128, "PACE0123", &field) < 0) {
+			ret = -1;
+		}
+	}
+	if (pipeline_stop(&pipeline) < 0) {
+		ret = -1;
+	}
+	elapsed = stats_now() - start;
+	fseek(spool, 0, SEEK_END);
+	//ahead of the printer by its lead and the label just sent at most
+	if (ret < 0 || pace.labels != PIPELINE_TEST_LABELS ||
+			elapsed + pace.lead + pace.print_ns / PIPELINE_TEST_LABELS < pace.print_ns ||
+			(u64)ftell(spool) != pipeline.written || pipeline.written != pace.bytes) {
+		printf("%s %d labels:%llu in %llums, print time %llums lead %llums\n",__func__,__LINE__,
+				(unsigned long long)pace.labels, (unsigned long long)(elapsed / 1000000),
+				(unsigned long long)(pace.print_ns / 1000000), (unsigned long long)(pace.lead / 1000000));
+		ret = -1;
+	}
+	pipeline_free(&pipeline);
+	fclose(spool);
+	return ret;
+}
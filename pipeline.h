@@ -0,0 +1,83 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include "platform.h"
+#include "native.h"
+#include "output.h"
+#include "pace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//keeps the producer and the writer side of a ring on their own cache lines
+#define PIPELINE_LINE		64
+
+//single producer single consumer ring of slots, free running u32 indexes
+struct pipeline_ring {
+	//written by the producer, with its last look at tail
+	u32 head __attribute__((aligned(PIPELINE_LINE)));
+	u32 tail_cache;
+	//written by the writer
+	u32 tail __attribute__((aligned(PIPELINE_LINE)));
+	u8 *buffer;
+	s32 *len;
+	//print time of each slot, for pacing
+	u64 *cost;
+};
+
+//encode threads fill rings, one writer thread drains them all to fd
+struct pipeline {
+	s32 fd;
+	s32 producers;
+	//slots per ring, a power of 2, and bytes per slot
+	s32 slots;
+	s32 slot_size;
+	//polls before sleeping when a ring is full or all are empty
+	s32 spin;
+	struct pipeline_ring *ring;
+	//slots the writer took from each ring in its last round
+	u32 *taken;
+	//the writer's engine and fd as its target
+	struct output output;
+	s32 target;
+	//output paced to the printer a label at a time, NULL for as fast as it
+	//takes it; set before the first label is committed
+	struct pace *pace;
+	//graphics of the printer, bitmaps are downloaded once and recalled; NULL
+	//for inline bitmaps, and with more than one producer whose labels interleave
+	struct cache *cache;
+	pthread_t writer;
+	//the writer thread is up, pipeline_stop() joins it
+	s32 running;
+	pthread_mutex_t lock;
+	pthread_cond_t room;
+	pthread_cond_t data;
+	//producers asleep on room, writer asleep on data
+	s32 sleepers;
+	s32 writer_sleeping;
+	s32 stop;
+	//errno of the first failed write, the rest is dropped
+	s32 error;
+	u64 written;
+	u64 records;
+	u64 writes;
+	u64 full_waits;
+};
+
+s32 pipeline_init(struct pipeline *pipeline, s32 fd, s32 producers, s32 slots, s32 slot_size, s32 spin);
+u8 *pipeline_acquire(struct pipeline *pipeline, s32 producer);
+s32 pipeline_commit(struct pipeline *pipeline, s32 producer, s32 len);
+s32 pipeline_encode(struct pipeline *pipeline, s32 producer, s32 dialect, s32 symbology, const s8 *input,
+		const struct native_field *field);
+s32 pipeline_stop(struct pipeline *pipeline);
+void pipeline_free(struct pipeline *pipeline);
+s32 pipeline_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file plan.c
+ * @brief pick the narrowest symbology for the data and the module scale for the printhead
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbology.h"
+#include "trace.h"
+#include "plan.h"
+
+/**
+ * @brief symbologies named by a list
+ *
+ * @param list: "auto" for the ones that carry the input unchanged(PLAN_ALLOW_AUTO),
+ * or CODE_MODEs separated by ',', such as "code128,i25"
+ *
+ * @return PLAN_ALLOW() set, 0 when a name is unknown
+ */
+u32 plan_allowed(const s8 *list) {
+	u32 allowed = 0;
+	s32 symbology;
+	if (list == NULL) {
+		return 0;
+	}
+	if (strcmp(list, "auto") == 0) {
+		return PLAN_ALLOW_AUTO;
+	}
+	while (*list != '\0') {
+		symbology = symbology_lookup(list);
+		if (symbology < 0) {
+			printf("%s %d unknown:%s\n",__func__,__LINE__,list);
+			return 0;
+		}
+		allowed |= PLAN_ALLOW(symbology);
+		list += strlen(symbology_name(symbology));
+		if (*list == ',') {
+			list++;
+		} else if (*list != '\0') {
+			printf("%s %d err:%s\n",__func__,__LINE__,list);
+			return 0;
+		}
+	}
+	return allowed;
+}
+
+/**
+ * @brief choose the symbology with the fewest modules for input
+ *
+ * lengths come from symbology_width(), which runs the encoder rules without
+ * writing modules; they are compared without the blank modules some encoders
+ * include(symbology_quiet()), which fit within head_dots like the bars. Ties
+ * go to the lower SYMBOLOGY_XXX; a refused input only rules its symbology out
+ *
+ * @param input: input strings, as given to symbology_encode()
+ * @param allowed: PLAN_ALLOW() set
+ * @param head_dots: printhead width in dots, such as 384 or 576
+ * @param plan: chosen symbology and scale
+ *
+ * @return 0, -1 when no allowed symbology takes input within head_dots
+ */
+s32 plan_symbology(const s8 *input, u32 allowed, s32 head_dots, struct plan *plan) {
+	s32 symbology, modules, bars;
+	s32 best = -1;
+	s32 best_modules = 0;
+	s32 best_bars = 0;
+
+	if (input == NULL || plan == NULL || head_dots <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (symbology = 0; symbology < SYMBOLOGY_NUM; symbology++) {
+		if (!(allowed & PLAN_ALLOW(symbology))) {
+			continue;
+		}
+		modules = symbology_width(symbology, input);
+		bars = modules - symbology_quiet(symbology);
+		if (modules > 0 && modules <= head_dots && (best < 0 || bars < best_bars)) {
+			best = symbology;
+			best_modules = modules;
+			best_bars = bars;
+		}
+	}
+	if (best < 0) {
+		printf("%s %d no symbology fits %d dots:%s\n",__func__,__LINE__,head_dots,input);
+		return -1;
+	}
+	plan->symbology = best;
+	plan->modules = best_modules;
+	plan->scale = head_dots / best_modules;
+	plan->dots = plan->scale * best_modules;
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef __PLAN_H__
+#define __PLAN_H__
+
+#include <stddef.h>
+#include "platform.h"
+#include "symbology.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//symbologies a plan may choose from
+#define PLAN_ALLOW(symbology)	(1u << (symbology))
+#define PLAN_ALLOW_ALL			((1u << SYMBOLOGY_NUM) - 1)
+//"auto": EAN/UPC and MSI add check or number system digits, the scanned data
+//would differ from the input; they are only planned when named
+#define PLAN_ALLOW_AUTO			(PLAN_ALLOW_ALL & ~(PLAN_ALLOW(SYMBOLOGY_EAN8) | PLAN_ALLOW(SYMBOLOGY_EAN13) | \
+		PLAN_ALLOW(SYMBOLOGY_UPCA) | PLAN_ALLOW(SYMBOLOGY_UPCE) | PLAN_ALLOW(SYMBOLOGY_MSI)))
+
+struct plan {
+	s32 symbology;
+	//length of the coded data, symbology_encode() modules
+	s32 modules;
+	//dots per module, the largest that fits the printhead
+	s32 scale;
+	//printed width, modules * scale
+	s32 dots;
+};
+
+u32 plan_allowed(const s8 *list);
+s32 plan_symbology(const s8 *input, u32 allowed, s32 head_dots, struct plan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
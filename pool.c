@@ -0,0 +1,693 @@
+/**
+ * @file pool.c
+ * @brief fan labels out to a pool of printers: a queue per printer, idle printers steal
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "native.h"
+#include "symbology.h"
+#include "stats.h"
+#include "output.h"
+#include "pace.h"
+#include "trace.h"
+#include "pool.h"
+
+//drain rate of a printer nothing is known about, bytes per second
+#define POOL_RATE_DEFAULT		(1024.0 * 1024.0)
+//bytes per label before any was written
+#define POOL_JOB_BYTES			512.0
+//weight of the newest label in the estimates
+#define POOL_EWMA				0.25
+//busy time a drain rate sample spans at least, bursts of the printer buffer average out
+#define POOL_RATE_WINDOW		(100 * 1000000ULL)
+//how often completions are looked at while a printer waits for work
+#define POOL_POLL_NS			1000000ULL
+
+static inline s32 pool_pending(const struct pool_device *device) {
+	return (s32)(device->tail - device->head);
+}
+
+//seconds the queue of device takes to drain, failed devices never drain
+static double pool_drain_time(const struct pool *pool, const struct pool_device *device, s32 extra) {
+	if (device->failed) {
+		return 1e30;
+	}
+	return (pool_pending(device) + device->busy + extra) * pool->job_bytes / device->rate;
+}
+
+//the label as the device's dialect into its buffer, in one pass: a second
+//one would find a graphic of the first as resident in the printer
+static s32 pool_encode(struct pool_device *device, const struct pool_job *job) {
+	FILE *fp = NULL;
+	s8 *text = NULL;
+	size_t size = 0;
+	s32 len = -1;
+
+	fp = open_memstream(&text, &size);
+	if (fp == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (native_begin(device->dialect, fp) >= 0 &&
+			native_write_cached(device->dialect, job->symbology, job->input, &device->field, device->cache,
+			fp) > 0 &&
+			native_end(device->dialect, fp) >= 0 && fflush(fp) == 0) {
+		len = (s32)size;
+	}
+	fclose(fp);
+	if (len <= 0) {
+		free(text);
+		return -1;
+	}
+	//the last label was written, its buffer is free
+	free(device->buffer);
+	device->buffer = (u8*)text;
+	return len;
+}
+
+//next job of device: its own oldest, else the newest of the device that
+//would take longest to drain its queue; called locked
+static s32 pool_take(struct pool *pool, struct pool_device *device, struct pool_job *job) {
+	struct pool_device *victim = NULL;
+	double time, longest = 0;
+	s32 i;
+
+	if (pool_pending(device) > 0) {
+		*job = device->queue[device->head++ & (pool->depth - 1)];
+		return 1;
+	}
+	for (i = 0; i < pool->devices; i++) {
+		if (&pool->device[i] == device || pool_pending(&pool->device[i]) == 0) {
+			continue;
+		}
+		time = pool_drain_time(pool, &pool->device[i], 0);
+		if (victim == NULL || time > longest) {
+			victim = &pool->device[i];
+			longest = time;
+		}
+	}
+	if (victim == NULL) {
+		return 0;
+	}
+	*job = victim->queue[--victim->tail & (pool->depth - 1)];
+	device->stolen++;
+	return 1;
+}
+
+static s32 pool_drained(const struct pool *pool) {
+	s32 i;
+	for (i = 0; i < pool->devices; i++) {
+		if (pool->device[i].busy || pool_pending(&pool->device[i]) > 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//the label of device left the engine: count it, or take the printer out
+//after a failed write; called locked
+static void pool_complete(struct pool *pool, struct pool_device *device, s32 failed) {
+	device->busy = 0;
+	if (failed) {
+		//the job goes back for the other printers, this one is out
+		if (pool->diag != NULL) {
+			fprintf(pool->diag, "%s %d device fd %d write err:%s\n",__func__,__LINE__,device->fd,
+					strerror(pool->output.target[device->target].error));
+		}
+		device->failed = 1;
+		device->errors++;
+		device->queue[--device->head & (pool->depth - 1)] = device->job;
+		//submitters waiting for room in its queue look elsewhere, or give up
+		pthread_cond_broadcast(&pool->room);
+		pthread_cond_broadcast(&pool->idle);
+		return;
+	}
+	device->jobs++;
+	device->bytes += device->len;
+	pool->job_bytes += POOL_EWMA * (device->len - pool->job_bytes);
+	free(device->job.input);
+}
+
+//an idle printer takes its next label, the bytes of its last one count
+//toward the drain rate while it never ran dry; called locked
+static s32 pool_next(struct pool *pool, struct pool_device *device) {
+	u64 now;
+
+	if (!pool_take(pool, device, &device->job)) {
+		device->window_start = 0;
+		return 0;
+	}
+	now = stats_now();
+	if (device->window_start == 0) {
+		device->window_start = now;
+		device->window_bytes = 0;
+	} else {
+		device->window_bytes += device->len;
+		if (now - device->window_start >= POOL_RATE_WINDOW) {
+			device->rate += POOL_EWMA * (device->window_bytes * 1e9 / (now - device->window_start) - device->rate);
+			device->window_start = now;
+			device->window_bytes = 0;
+		}
+	}
+	device->busy = 1;
+	device->len = 0;
+	pthread_cond_broadcast(&pool->room);
+	return 1;
+}
+
+//queue the encoded label of device, or hold it back until its printer is ready for it
+static s32 pool_send(struct pool *pool, struct pool_device *device, u64 now) {
+	u64 delay;
+
+	if (device->pace != NULL) {
+		delay = pace_delay(device->pace, now, device->len);
+		if (delay > 0) {
+			if (device->due == 0) {
+				device->pace->waits++;
+				device->pace->wait_ns += delay;
+			}
+			device->due = now + delay;
+			return 0;
+		}
+		pace_charge(device->pace, now, device->cost, device->len);
+	}
+	device->due = 0;
+	return output_write(&pool->output, device->target, device->buffer, device->len);
+}
+
+//the label of device encoded just in time, with its print time when paced
+static s32 pool_prepare(struct pool_device *device) {
+	struct pace_estimate estimate;
+
+	device->len = pool_encode(device, &device->job);
+	device->cost = 0;
+	//native fields print bars across the feed
+	if (device->len > 0 && device->pace != NULL && pace_estimate(&device->pace->printer,
+			symbology_width(device->job.symbology, device->job.input), device->field.module,
+			device->field.height, 0, &estimate) == 0) {
+		device->cost = estimate.ns;
+	}
+	return device->len;
+}
+
+/**
+ * @brief every printer driven through one output engine: an idle printer takes
+ * a label, it is encoded just in time and queued as the printer's write, held
+ * back first while a paced printer is ahead; completions free the printer for
+ * the next one
+ *
+ * without io_uring the engine writes with writev() in output_submit(), one
+ * printer at a time
+ */
+static void *pool_engine(void *arg) {
+	struct pool *pool = (struct pool*)arg;
+	struct pool_device *device;
+	struct output_target *target;
+	struct timespec ts;
+	u64 now, next, delay;
+	s32 busy, spare, held, done, ret, i;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		for (i = 0; i < pool->devices; i++) {
+			device = &pool->device[i];
+			if (device->failed || device->busy || !pool_next(pool, device)) {
+				continue;
+			}
+			pthread_mutex_unlock(&pool->lock);
+			ret = (pool_prepare(device) > 0) ? pool_send(pool, device, stats_now()) : 0;
+			pthread_mutex_lock(&pool->lock);
+			if (ret < 0) {
+				pool_complete(pool, device, 1);
+			} else if (device->len <= 0) {
+				//a bad label, not a bad printer
+				device->busy = 0;
+				device->errors++;
+				device->window_start = 0;
+				free(device->job.input);
+			}
+		}
+		now = stats_now();
+		next = ~0ULL;
+		for (i = 0, busy = 0, spare = 0, held = 0; i < pool->devices; i++) {
+			device = &pool->device[i];
+			//a held label goes once its printer caught up
+			if (device->busy && device->due != 0 && device->due <= now && pool_send(pool, device, now) < 0) {
+				pool_complete(pool, device, 1);
+			}
+			if (device->busy && device->due != 0) {
+				held++;
+				next = (device->due < next) ? device->due : next;
+			}
+			busy += device->busy;
+			spare += !device->busy && !device->failed;
+		}
+		if (busy == 0) {
+			if (pool_drained(pool)) {
+				pthread_cond_broadcast(&pool->idle);
+			}
+			if (pool->stop) {
+				break;
+			}
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		ret = output_submit(&pool->output);
+		//every printer left is writing, nothing can start before one is done
+		if (ret >= 0) {
+			ret = output_wait(&pool->output, (spare || held) ? 0 : 1);
+		}
+		pthread_mutex_lock(&pool->lock);
+		for (i = 0, done = 0; i < pool->devices; i++) {
+			device = &pool->device[i];
+			target = &pool->output.target[device->target];
+			if (device->busy && device->due == 0 && (ret < 0 || target->head == target->tail)) {
+				pool_complete(pool, device, ret < 0 || target->errors > 0);
+				done++;
+			}
+		}
+		if (done > 0 && pool_drained(pool)) {
+			pthread_cond_broadcast(&pool->idle);
+		}
+		if (done > 0 || (!spare && !held)) {
+			continue;
+		}
+		//new labels and completions are looked at in turn, held labels when due
+		now = stats_now();
+		delay = (spare || busy > held) ? POOL_POLL_NS : ~0ULL;
+		if (held) {
+			delay = (next <= now) ? 0 : (next - now < delay) ? next - now : delay;
+		}
+		if (delay > 0) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += delay / 1000000000ULL;
+			ts.tv_nsec += delay % 1000000000ULL;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&pool->work, &pool->lock, &ts);
+		}
+	}
+	pthread_cond_broadcast(&pool->idle);
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/**
+ * @brief pool of up to devices printers
+ *
+ * @param depth: jobs queued per printer, rounded up to a power of 2
+ *
+ * @return 0, -1 on error
+ */
+s32 pool_init(struct pool *pool, s32 devices, s32 depth) {
+	if (pool == NULL || devices <= 0 || depth <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(pool, 0, sizeof(*pool));
+	pool->capacity = devices;
+	for (pool->depth = 1; pool->depth < depth; pool->depth <<= 1);
+	pool->job_bytes = POOL_JOB_BYTES;
+	pool->diag = stdout;
+	pool->device = (struct pool_device*)calloc(devices, sizeof(struct pool_device));
+	if (pool->device == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->room, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	return 0;
+}
+
+/**
+ * @brief a printer of the pool, before pool_start()
+ *
+ * @param fd: the printer, a rate limited pipe stands in for it
+ * @param dialect: NATIVE_XXX, labels are encoded for it when it takes them
+ * @param field: position and size of the symbol
+ * @param rate: bytes per second expected, 0 when unknown; labels refine it
+ *
+ * @return device id, -1 on error
+ */
+s32 pool_add_device(struct pool *pool, s32 fd, s32 dialect, const struct native_field *field, double rate) {
+	struct pool_device *device;
+	if (pool == NULL || pool->device == NULL || pool->started || pool->devices == pool->capacity || fd < 0 ||
+			dialect < 0 || dialect >= NATIVE_NUM || field == NULL || rate < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	device = &pool->device[pool->devices];
+	memset(device, 0, sizeof(*device));
+	device->fd = fd;
+	device->dialect = dialect;
+	device->field = *field;
+	device->rate = (rate > 0) ? rate : POOL_RATE_DEFAULT;
+	device->pool = pool;
+	device->queue = (struct pool_job*)malloc(pool->depth * sizeof(struct pool_job));
+	if (device->queue == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	return pool->devices++;
+}
+
+//the engine thread, with every printer added as a target of its output engine
+s32 pool_start(struct pool *pool) {
+	s32 i;
+	if (pool == NULL || pool->devices == 0 || pool->started) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	//one label in flight per printer
+	if (output_init(&pool->output, pool->devices, 1, 0) < 0) {
+		return -1;
+	}
+	for (i = 0; i < pool->devices; i++) {
+		pool->device[i].target = output_add_target(&pool->output, pool->device[i].fd);
+		if (pool->device[i].target < 0) {
+			output_free(&pool->output);
+			return -1;
+		}
+	}
+	if (pthread_create(&pool->thread, NULL, pool_engine, pool) != 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		output_free(&pool->output);
+		return -1;
+	}
+	pool->started = 1;
+	return 0;
+}
+
+/**
+ * @brief queue a label on the printer expected to finish it first, waits
+ * while every queue is full
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings, copied
+ *
+ * @return device it was queued on, -1 on error or when every printer failed
+ */
+s32 pool_submit(struct pool *pool, s32 symbology, const s8 *input) {
+	struct pool_device *device = NULL;
+	struct pool_job job;
+	double time, best = 0;
+	s32 i;
+
+	if (pool == NULL || pool->device == NULL || input == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	job.symbology = symbology;
+	job.input = strdup(input);
+	if (job.input == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		device = NULL;
+		for (i = 0; i < pool->devices; i++) {
+			//the job in hand keeps its slot, a failed write puts it back
+			if (pool->device[i].failed || pool_pending(&pool->device[i]) + pool->device[i].busy >= pool->depth) {
+				continue;
+			}
+			time = pool_drain_time(pool, &pool->device[i], 1);
+			if (device == NULL || time < best) {
+				device = &pool->device[i];
+				best = time;
+			}
+		}
+		if (device != NULL) {
+			break;
+		}
+		for (i = 0; i < pool->devices && pool->device[i].failed; i++);
+		if (i == pool->devices) {
+			pthread_mutex_unlock(&pool->lock);
+			free(job.input);
+			if (pool->diag != NULL) {
+				fprintf(pool->diag, "%s %d no printer left\n",__func__,__LINE__);
+			}
+			return -1;
+		}
+		pthread_cond_wait(&pool->room, &pool->lock);
+	}
+	device->queue[device->tail++ & (pool->depth - 1)] = job;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	return device - pool->device;
+}
+
+/**
+ * @brief wait until every queued label is written, then stop the threads
+ *
+ * @return 0, -1 when labels were dropped because every printer failed
+ */
+s32 pool_finish(struct pool *pool) {
+	struct pool_job job;
+	s32 i, alive;
+
+	if (pool == NULL || pool->device == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		for (i = 0, alive = 0; i < pool->devices; i++) {
+			alive += !pool->device[i].failed;
+		}
+		if (pool_drained(pool) || alive == 0) {
+			break;
+		}
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	}
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_cond_broadcast(&pool->room);
+	pthread_mutex_unlock(&pool->lock);
+	if (pool->started) {
+		pthread_join(pool->thread, NULL);
+		output_free(&pool->output);
+		pool->started = 0;
+	}
+	//what the failed printers held when no one was left to steal it
+	for (i = 0; i < pool->devices; i++) {
+		while (pool_pending(&pool->device[i]) > 0) {
+			job = pool->device[i].queue[pool->device[i].head++ & (pool->depth - 1)];
+			free(job.input);
+			pool->dropped++;
+		}
+	}
+	return (pool->dropped > 0) ? -1 : 0;
+}
+
+void pool_free(struct pool *pool) {
+	s32 i;
+	if (pool == NULL || pool->device == NULL) {
+		return;
+	}
+	if (pool->started) {
+		pool_finish(pool);
+	}
+	for (i = 0; i < pool->devices; i++) {
+		free(pool->device[i].queue);
+		free(pool->device[i].buffer);
+	}
+	free(pool->device);
+	pool->device = NULL;
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->room);
+	pthread_cond_destroy(&pool->idle);
+}
+
+//one line per printer: labels, bytes, stolen labels and the drain rate
+s32 pool_dump(const struct pool *pool, FILE *fp) {
+	const struct pool_device *device;
+	s32 i;
+	if (pool == NULL || fp == NULL) {
+		return -1;
+	}
+	for (i = 0; i < pool->devices; i++) {
+		device = &pool->device[i];
+		fprintf(fp, "device %d fd %d %s jobs:%llu bytes:%llu stolen:%llu errors:%llu rate(KB/s):%.1f%s\n", i,
+				device->fd, native_name(device->dialect), (unsigned long long)device->jobs,
+				(unsigned long long)device->bytes, (unsigned long long)device->stolen,
+				(unsigned long long)device->errors, device->rate / 1024.0, device->failed ? " failed" : "");
+	}
+	if (pool->dropped > 0) {
+		fprintf(fp, "dropped:%llu\n", (unsigned long long)pool->dropped);
+	}
+	return 0;
+}
+
+//pool_selftest(): the printer goes away while a submitter waits for room
+struct pool_selftest_arg {
+	s32 fd;
+	volatile s32 done;
+};
+
+static void *pool_selftest_unplug(void *arg) {
+	struct pool_selftest_arg *test = (struct pool_selftest_arg*)arg;
+	s32 i;
+
+	usleep(100000);
+	close(test->fd);
+	for (i = 0; i < 50 && !test->done; i++) {
+		usleep(100000);
+	}
+	if (!test->done) {
+		printf("%s %d pool_submit still waiting 5s after the printer failed\n",__func__,__LINE__);
+		fflush(stdout);
+		_exit(1);
+	}
+	return NULL;
+}
+
+//a printer that fails with a full queue and a submitter waiting for room:
+//the submitter has to give up and the queued labels count as dropped
+static s32 pool_selftest_failed(void) {
+	struct native_field field = {0, 0, 50, 2, 0};
+	struct pool_selftest_arg test;
+	struct pool pool;
+	pthread_t unplug;
+	void (*sigpipe)(int);
+	s32 sv[2], i, ret = 0;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		return -1;
+	}
+	sigpipe = signal(SIGPIPE, SIG_IGN);
+	if (pool_init(&pool, 1, 2) < 0 || pool_add_device(&pool, sv[0], NATIVE_ZPL, &field, 0) < 0 ||
+			pool_start(&pool) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		signal(SIGPIPE, sigpipe);
+		return -1;
+	}
+	//the unplug is the test, its write error and the given up submit are expected
+	pool.diag = NULL;
+	test.fd = sv[1];
+	test.done = 0;
+	pthread_create(&unplug, NULL, pool_selftest_unplug, &test);
+	//nobody reads: the socket fills, then the queue, then this waits for room
+	for (i = 0; pool_submit(&pool, SYMBOLOGY_CODE128, "POOL0123456789") >= 0; i++);
+	test.done = 1;
+	pthread_join(unplug, NULL);
+	if (!pool.device[0].failed || pool_finish(&pool) == 0) {
+		printf("%s %d failed:%d dropped:%llu\n",__func__,__LINE__,pool.device[0].failed,
+				(unsigned long long)pool.dropped);
+		ret = -1;
+	}
+	pool_free(&pool);
+	close(sv[0]);
+	signal(SIGPIPE, sigpipe);
+	return ret;
+}
+
+//pool_selftest_paced(): 2mm labels at 200mm/s print in 10ms each
+#define POOL_TEST_LABELS		30
+
+//two paced printers on spool files, each never ahead of its print time by
+//more than its lead and the label just sent
+static s32 pool_selftest_paced(void) {
+	struct pace_printer printer = {203, 200, 2, 0, 20};
+	struct native_field field = {0, 0, 8, 2, 0};
+	struct pace pace[2];
+	struct pool pool;
+	FILE *spool[2];
+	u64 start, elapsed, labels = 0;
+	s32 i, ret = 0;
+
+	spool[0] = tmpfile();
+	spool[1] = tmpfile();
+	if (spool[0] == NULL || spool[1] == NULL || pool_init(&pool, 2, 4) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		ret = -1;
+		goto end;
+	}
+	for (i = 0; i < 2; i++) {
+		if (pace_init(&pace[i], &printer) < 0 ||
+				pool_add_device(&pool, fileno(spool[i]), NATIVE_ZPL, &field, 0) < 0) {
+			ret = -1;
+		} else {
+			pool.device[i].pace = &pace[i];
+		}
+	}
+	if (ret < 0 || pool_start(&pool) < 0) {
+		pool_free(&pool);
+		ret = -1;
+		goto end;
+	}
+	start = stats_now();
+	for (i = 0; i < POOL_TEST_LABELS; i++) {
+		if (pool_submit(&pool, SYMBOLOGY_CODE128, "PACE0123") < 0) {
+			ret = -1;
+		}
+	}
+	if (pool_finish(&pool) < 0) {
+		ret = -1;
+	}
+	elapsed = stats_now() - start;
+	for (i = 0; i < 2; i++) {
+		fseek(spool[i], 0, SEEK_END);
+		labels += pace[i].labels;
+		if (pace[i].labels > 0 && elapsed + pace[i].lead + pace[i].print_ns / pace[i].labels < pace[i].print_ns) {
+			printf("%s %d device %d labels:%llu in %llums, print time %llums\n",__func__,__LINE__,i,
+					(unsigned long long)pace[i].labels, (unsigned long long)(elapsed / 1000000),
+					(unsigned long long)(pace[i].print_ns / 1000000));
+			ret = -1;
+		}
+		if ((u64)ftell(spool[i]) != pool.device[i].bytes || pool.device[i].bytes != pace[i].bytes) {
+			printf("%s %d device %d bytes:%llu paced:%llu\n",__func__,__LINE__,i,
+					(unsigned long long)pool.device[i].bytes, (unsigned long long)pace[i].bytes);
+			ret = -1;
+		}
+	}
+	if (labels != POOL_TEST_LABELS) {
+		printf("%s %d labels:%llu\n",__func__,__LINE__,(unsigned long long)labels);
+		ret = -1;
+	}
+	pool_free(&pool);
+end:
+	for (i = 0; i < 2; i++) {
+		if (spool[i] != NULL) {
+			fclose(spool[i]);
+		}
+	}
+	return ret;
+}
+
+/**
+ * @brief a printer failing under a waiting submitter, and paced printers
+ * keeping to their print time
+ *
+ * @return 0 when the pool behaves, -1 otherwise
+ */
+s32 pool_selftest(void) {
+	return (pool_selftest_failed() < 0 || pool_selftest_paced() < 0) ? -1 : 0;
+}
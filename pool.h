@@ -0,0 +1,98 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "platform.h"
+#include "native.h"
+#include "output.h"
+#include "pace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//a label waiting for a printer, encoded only when a printer takes it
+struct pool_job {
+	s32 symbology;
+	s8 *input;
+};
+
+//one printer of the pool with its own queue, a target of the pool's output engine
+struct pool_device {
+	s32 fd;
+	s32 target;
+	s32 dialect;
+	struct native_field field;
+	//queue, the owner takes from head, thieves from tail
+	struct pool_job *queue;
+	u32 head;
+	u32 tail;
+	//job is being encoded or written, len bytes of it
+	s32 busy;
+	struct pool_job job;
+	s32 len;
+	//labels paced to this printer, NULL for as fast as it takes them; set
+	//before pool_start()
+	struct pace *pace;
+	//graphics of this printer, bitmaps are downloaded once and recalled; NULL
+	//for inline bitmaps; set before pool_start()
+	struct cache *cache;
+	//print time of the label in hand, and when it may be written, 0 once queued
+	u64 cost;
+	u64 due;
+	//a write failed(paper out, unplugged), the rest of its queue is stolen
+	s32 failed;
+	//drain rate estimate in bytes per second, from the bytes of the labels
+	//taken back to back since window_start, 0 while the printer sits idle
+	double rate;
+	u64 window_start;
+	u64 window_bytes;
+	//the label in hand as the dialect's command, NULL before the first
+	u8 *buffer;
+	struct pool *pool;
+	u64 jobs;
+	u64 bytes;
+	u64 stolen;
+	u64 errors;
+};
+
+//printers that can all take any job of the pool
+struct pool {
+	struct pool_device *device;
+	s32 devices;
+	s32 capacity;
+	//jobs per device queue, a power of 2
+	s32 depth;
+	pthread_mutex_t lock;
+	//work for an idle device, room in a queue, all drained
+	pthread_cond_t work;
+	pthread_cond_t room;
+	pthread_cond_t idle;
+	//one thread encodes for every printer and drives their writes
+	struct output output;
+	pthread_t thread;
+	s32 started;
+	s32 stop;
+	//failed printers and given up submits, NULL for none
+	FILE *diag;
+	//bytes per label estimate, for the queue time of a device
+	double job_bytes;
+	u64 dropped;
+};
+
+s32 pool_init(struct pool *pool, s32 devices, s32 depth);
+s32 pool_add_device(struct pool *pool, s32 fd, s32 dialect, const struct native_field *field, double rate);
+s32 pool_start(struct pool *pool);
+s32 pool_submit(struct pool *pool, s32 symbology, const s8 *input);
+s32 pool_finish(struct pool *pool);
+void pool_free(struct pool *pool);
+s32 pool_dump(const struct pool *pool, FILE *fp);
+s32 pool_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
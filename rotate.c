@@ -0,0 +1,141 @@
+/**
+ * @file rotate.c
+ * @brief 90 degree rotation of packed rows and bitmaps for ladder orientation
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "pack.h"
+#include "trace.h"
+#include "rotate.h"
+
+//dots of a transpose block side
+#define ROTATE_BLOCK		64
+#define ROTATE_BLOCK_BYTES	(ROTATE_BLOCK >> 3)
+
+//edge block: the rows and dots that exist go through a zeroed block
+static void rotate_edge(const u8 *in, s32 in_stride, s32 rows, s32 dots, u8 *out, s32 out_stride, s32 out_dots) {
+	u8 block[ROTATE_BLOCK * ROTATE_BLOCK_BYTES];
+	u8 turned[ROTATE_BLOCK * ROTATE_BLOCK_BYTES];
+	s32 bytes = pack_len(dots);
+	s32 k;
+
+	memset(block, 0, sizeof(block));
+	for (k = 0; k < rows; k++) {
+		memcpy(block + k * ROTATE_BLOCK_BYTES, in + k * in_stride, bytes);
+		if (dots & 7) {
+			block[k * ROTATE_BLOCK_BYTES + bytes - 1] &= 0xFF << (8 - (dots & 7));
+		}
+	}
+	kernel_transpose64(block, ROTATE_BLOCK_BYTES, turned, ROTATE_BLOCK_BYTES);
+	for (k = 0; k < dots; k++) {
+		memcpy(out + k * out_stride, turned + k * ROTATE_BLOCK_BYTES, pack_len(out_dots));
+	}
+}
+
+/**
+ * @brief rotate a packed bitmap 90 degrees clockwise
+ *
+ * 64x64 blocks are read bottom up(negative stride) and transposed by the
+ * kernel of this machine, edge blocks go through a zeroed block
+ *
+ * @param in: packed rows, first dot is the MSB
+ * @param width: dots per input row
+ * @param height: input rows
+ * @param in_stride: bytes per input row, at least pack_len(width)
+ * @param out: width rows of height dots, the top one is the left input column
+ * @param out_stride: bytes per output row, at least pack_len(height)
+ *
+ * @return output rows, -1 on error
+ */
+s32 rotate_bitmap(const u8 *in, s32 width, s32 height, s32 in_stride, u8 *out, s32 out_stride) {
+	const u8 *src = NULL;
+	u8 *dst = NULL;
+	s32 r, c, rows, dots;
+
+	if (in == NULL || out == NULL || width <= 0 || height <= 0 || in_stride < pack_len(width) ||
+			out_stride < pack_len(height)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	//output dot r of row c is input dot c of row height - 1 - r
+	for (r = 0; r < height; r += ROTATE_BLOCK) {
+		rows = (height - r < ROTATE_BLOCK) ? (height - r) : ROTATE_BLOCK;
+		src = in + (size_t)(height - 1 - r) * in_stride;
+		for (c = 0; c < width; c += ROTATE_BLOCK) {
+			dots = (width - c < ROTATE_BLOCK) ? (width - c) : ROTATE_BLOCK;
+			dst = out + (size_t)c * out_stride + (r >> 3);
+			if (rows == ROTATE_BLOCK && dots == ROTATE_BLOCK) {
+				kernel_transpose64(src + (c >> 3), -in_stride, dst, out_stride);
+			} else {
+				rotate_edge(src + (c >> 3), -in_stride, rows, dots, dst, out_stride, rows);
+			}
+		}
+	}
+	return width;
+}
+
+/**
+ * @brief rotate a packed symbol row of height rows 90 degrees clockwise
+ *
+ * every input column is one module, so every output row is all bar or all
+ * space: the transpose of a block of equal rows, filled without one
+ *
+ * @param row: packed symbol, such as from symbology_encode_packed()
+ * @param bits: modules of the symbol
+ * @param scale: output rows per module
+ * @param height: bar length in dots
+ * @param out: bits * scale rows of height dots, the first module on top
+ * @param out_stride: bytes per output row, at least pack_len(height)
+ *
+ * @return output rows, -1 on error
+ */
+s32 rotate_row(const u8 *row, s32 bits, s32 scale, s32 height, u8 *out, s32 out_stride) {
+	s32 bytes = pack_len(height);
+	u8 tail = (height & 7) ? (0xFF << (8 - (height & 7))) : 0xFF;
+	s32 i, k;
+	u8 *dst = out;
+
+	if (row == NULL || out == NULL || bits <= 0 || scale <= 0 || height <= 0 || out_stride < bytes) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (i = 0; i < bits; i++) {
+		for (k = 0; k < scale; k++, dst += out_stride) {
+			if (row[i >> 3] & (0x80 >> (i & 7))) {
+				memset(dst, 0xFF, bytes - 1);
+				dst[bytes - 1] = tail;
+			} else {
+				memset(dst, 0, bytes);
+			}
+		}
+	}
+	return bits * scale;
+}
+
+/**
+ * @brief rotate a composed label 90 degrees clockwise
+ *
+ * @param label: picket fence label
+ * @param rotated: label_init() with width label->height and height label->width
+ *
+ * @return 0, -1 on error
+ */
+s32 rotate_label(const struct label *label, struct label *rotated) {
+	if (label == NULL || rotated == NULL || label->bits == NULL || rotated->bits == NULL ||
+			rotated->width != label->height || rotated->height != label->width) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	return (rotate_bitmap(label->bits, label->width, label->height, label->stride, rotated->bits,
+			rotated->stride) < 0) ? -1 : 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __ROTATE_H__
+#define __ROTATE_H__
+
+#include <stddef.h>
+#include "platform.h"
+#include "label.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+s32 rotate_bitmap(const u8 *in, s32 width, s32 height, s32 in_stride, u8 *out, s32 out_stride);
+s32 rotate_row(const u8 *row, s32 bits, s32 scale, s32 height, u8 *out, s32 out_stride);
+s32 rotate_label(const struct label *label, struct label *rotated);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
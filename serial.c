@@ -0,0 +1,365 @@
+/**
+ * @file serial.c
+ * @brief serial number runs, the next label is patched from the previous one
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "code128.h"
+#include "i25.h"
+#include "symbology.h"
+#include "stats.h"
+#include "trace.h"
+#include "serial.h"
+
+//SSCC: GS1-128 with AI (00), 17 data digits and a mod 10 check digit
+#define SERIAL_SSCC_PREFIX		"[FNC1]00"
+#define SERIAL_SSCC_PREFIX_LEN	8
+#define SERIAL_SSCC_DATA_LEN	17
+
+//counter digits that fit in u64
+#define SERIAL_WIDTH_MAX		19
+
+static const s8 *serial_names[SERIAL_NUM] = {"code128", "i25", "sscc"};
+
+#define SERIAL_IS_DIGIT(c)		((c) >= '0' && (c) <= '9')
+
+s32 serial_lookup(const s8 *name) {
+	s32 i;
+	if (name == NULL) {
+		return -1;
+	}
+	for (i = 0; i < SERIAL_NUM; i++) {
+		if (strcmp(serial_names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static s32 serial_symbology(const struct serial *serial) {
+	return (serial->kind == SERIAL_I25) ? SYMBOLOGY_I25 : SYMBOLOGY_CODE128;
+}
+
+//weight of the code128 symbol index in the checksum, the start code counts once
+static inline s32 serial_weight(s32 index) {
+	return index ? index : 1;
+}
+
+//GS1 mod 10, weight 3 on the data digits at an even distance from the check digit
+static inline s32 serial_sscc_weight(const struct serial *serial, s32 pos) {
+	return ((serial->check - pos) & 1) ? 3 : 1;
+}
+
+static void serial_set_counter(struct serial *serial, u64 value) {
+	s32 i;
+	for (i = serial->field + serial->width - 1; i >= serial->field; i--) {
+		serial->text[i] = '0' + (value % 10);
+		value /= 10;
+	}
+}
+
+static void serial_sscc_check(struct serial *serial) {
+	s32 i;
+	serial->mod10 = 0;
+	for (i = serial->check - SERIAL_SSCC_DATA_LEN; i < serial->check; i++) {
+		serial->mod10 += (serial->text[i] - '0') * serial_sscc_weight(serial, i);
+	}
+	serial->mod10 %= 10;
+	serial->text[serial->check] = '0' + (10 - serial->mod10) % 10;
+}
+
+//encode text from scratch and rebuild the symbol map
+static s32 serial_full(struct serial *serial) {
+	struct code128_symbol *symbol;
+	s32 i, j;
+
+	for (i = 0; i < serial->text_len; i++) {
+		serial->symbol_of[i] = -1;
+	}
+	if (serial->kind == SERIAL_I25) {
+		serial->row_len = i25_encode(serial->text, serial->row);
+		for (i = 0; i < serial->text_len; i++) {
+			serial->symbol_of[i] = i >> 1;
+		}
+	} else {
+		serial->row_len = code128_encode_symbols(serial->text, serial->row,
+				serial->symbol, &serial->symbol_num, serial->symbol_size);
+		if (serial->symbol_num > serial->symbol_size) {
+			serial->row_len = 0;
+		}
+		serial->weighted = 0;
+		for (i = 0; i < serial->symbol_num && serial->row_len > 0; i++) {
+			symbol = &serial->symbol[i];
+			serial->weighted += symbol->value * serial_weight(i);
+			//only digits encoded without anything in between can be patched
+			for (j = 0; symbol->source >= 0 && j < symbol->chars; j++) {
+				if (!SERIAL_IS_DIGIT(serial->text[symbol->source + j])) {
+					break;
+				}
+			}
+			if (symbol->source >= 0 && j == symbol->chars) {
+				for (j = 0; j < symbol->chars; j++) {
+					serial->symbol_of[symbol->source + j] = i;
+				}
+			}
+		}
+	}
+	serial->full++;
+	return serial->row_len;
+}
+
+//re-encode the symbol holding text offset pos, -1 when it can not be patched
+static s32 serial_patch_at(struct serial *serial, s32 pos, s32 *done) {
+	struct code128_symbol *symbol;
+	s32 index = serial->symbol_of[pos];
+	s32 value;
+
+	if (index < 0) {
+		return -1;
+	}
+	if (index == *done) {
+		return 0;
+	}
+	*done = index;
+	if (serial->kind == SERIAL_I25) {
+		return i25_pair_pattern(serial->text + (index << 1), serial->row + i25_pair_offset(index)) ? 0 : -1;
+	}
+
+	//code set C holds a digit pair, A and B one digit at ' ' + value
+	symbol = &serial->symbol[index];
+	if (symbol->chars == 2) {
+		value = (serial->text[symbol->source] - '0') * 10 + (serial->text[symbol->source + 1] - '0');
+	} else {
+		value = serial->text[symbol->source] - ' ';
+	}
+	serial->weighted += (value - symbol->value) * serial_weight(index);
+	symbol->value = value;
+	TRACE_SYMBOL("serial", index, value);
+	return code128_symbol_pattern(value, serial->row + code128_symbol_offset(index)) ? 0 : -1;
+}
+
+/**
+ * @brief count up and patch the changed symbols and the check character
+ *
+ * counter digits stay digits, so the code set layout never changes; anything
+ * the symbol map can not patch falls back to a full encode
+ */
+static s32 serial_increment(struct serial *serial) {
+	s32 end = serial->field + serial->width;
+	s32 pos = end - 1;
+	s32 done = -1;
+	s32 delta = 0;
+	s32 i;
+
+	//carry
+	while (pos >= serial->field && serial->text[pos] == '9') {
+		serial->text[pos] = '0';
+		if (serial->check >= 0) {
+			delta -= 9 * serial_sscc_weight(serial, pos);
+		}
+		pos--;
+	}
+	if (pos < serial->field) {
+		printf("%s %d counter overflow\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	serial->text[pos]++;
+	if (serial->check >= 0) {
+		delta += serial_sscc_weight(serial, pos);
+		serial->mod10 = ((serial->mod10 + delta) % 10 + 10) % 10;
+		serial->text[serial->check] = '0' + (10 - serial->mod10) % 10;
+	}
+
+	for (i = pos; i < end; i++) {
+		if (serial_patch_at(serial, i, &done) < 0) {
+			return serial_full(serial);
+		}
+	}
+	if (serial->check >= 0 && serial_patch_at(serial, serial->check, &done) < 0) {
+		return serial_full(serial);
+	}
+	if (serial->kind != SERIAL_I25) {
+		TRACE_CHECKSUM("serial", serial->weighted % 103);
+		code128_symbol_pattern(serial->weighted % 103, serial->row + code128_symbol_offset(serial->symbol_num));
+	}
+	serial->patched++;
+	return serial->row_len;
+}
+
+/**
+ * @brief start a serial number run
+ *
+ * @param serial: run state, release with serial_free()
+ * @param kind: SERIAL_XXX
+ * @param pattern: label template, the run of '#' is the counter;
+ *                 SSCC takes the 17 data digits without AI and check digit
+ * @param first: first counter value
+ * @param last: last counter value, must fit the counter width
+ *
+ * @return 0 on success, -1 on error
+ */
+s32 serial_init(struct serial *serial, s32 kind, const s8 *pattern, u64 first, u64 last) {
+	const s8 *field = NULL;
+	u64 limit = 1;
+	s32 pattern_len = 0;
+	s32 row_size = 0;
+	s32 offset = 0;
+	s32 i;
+
+	if (serial == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(serial, 0, sizeof(*serial));
+	serial->check = -1;
+	if (kind < 0 || kind >= SERIAL_NUM || pattern == NULL || first > last) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	pattern_len = strlen(pattern);
+	field = strchr(pattern, SERIAL_COUNTER_CHAR);
+	if (field == NULL) {
+		printf("%s %d no counter in template\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (i = field - pattern; pattern[i] == SERIAL_COUNTER_CHAR; i++) {
+		serial->width++;
+	}
+	if (strchr(pattern + i, SERIAL_COUNTER_CHAR) != NULL || serial->width > SERIAL_WIDTH_MAX) {
+		printf("%s %d counter err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (i = 0; i < serial->width && limit <= last; i++) {
+		limit *= 10;
+	}
+	if (limit <= last) {
+		printf("%s %d last:%llu does not fit %d digits\n",__func__,__LINE__,(unsigned long long)last,serial->width);
+		TRACE_ERROR();
+		return -1;
+	}
+	//i25 and SSCC are digits only
+	for (i = 0; kind != SERIAL_CODE128 && i < pattern_len; i++) {
+		if (!SERIAL_IS_DIGIT(pattern[i]) && pattern[i] != SERIAL_COUNTER_CHAR) {
+			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return -1;
+		}
+	}
+	if ((kind == SERIAL_I25 && (pattern_len % 2) != 0) ||
+			(kind == SERIAL_SSCC && pattern_len != SERIAL_SSCC_DATA_LEN)) {
+		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+
+	serial->kind = kind;
+	serial->next = first;
+	serial->last = last;
+	if (kind == SERIAL_SSCC) {
+		offset = SERIAL_SSCC_PREFIX_LEN;
+		serial->check = offset + SERIAL_SSCC_DATA_LEN;
+	}
+	serial->text_len = offset + pattern_len + (serial->check >= 0);
+	serial->field = offset + (field - pattern);
+	serial->text = (s8*)malloc(serial->text_len + 1);
+	serial->symbol_of = (s32*)malloc(sizeof(s32) * serial->text_len);
+	if (serial->text == NULL || serial->symbol_of == NULL) {
+		goto err;
+	}
+	memcpy(serial->text, SERIAL_SSCC_PREFIX, offset);
+	memcpy(serial->text + offset, pattern, pattern_len);
+	if (serial->check >= 0) {
+		serial->text[serial->check] = '0';
+	}
+	serial->text[serial->text_len] = '\0';
+	serial_set_counter(serial, first);
+
+	if (kind == SERIAL_I25) {
+		row_size = i25_max_len(serial->text);
+	} else {
+		row_size = code128_max_len(serial->text);
+		serial->symbol_size = (serial->text_len << 1) + 2;
+		serial->symbol = (struct code128_symbol*)malloc(sizeof(*serial->symbol) * serial->symbol_size);
+		if (serial->symbol == NULL) {
+			goto err;
+		}
+	}
+	serial->row = (s8*)malloc(row_size);
+	if (serial->row == NULL) {
+		goto err;
+	}
+	return 0;
+
+err:
+	printf("%s %d err\n",__func__,__LINE__);
+	TRACE_ERROR();
+	serial_free(serial);
+	return -1;
+}
+
+/**
+ * @brief produce the next label of the run
+ *
+ * @param serial: run state
+ * @param text: label text, may be NULL
+ * @param row: coded data,format is binary array, valid until the next call, may be NULL
+ *
+ * @return length of coded data, 0 at the end of the run or on error
+ */
+s32 serial_next(struct serial *serial, const s8 **text, const s8 **row) {
+	s32 row_len = 0;
+
+	if (serial == NULL || serial->text == NULL || serial->next > serial->last) {
+		return 0;
+	}
+	if (serial->full + serial->patched == 0) {
+		if (serial->check >= 0) {
+			serial_sscc_check(serial);
+		}
+		row_len = serial_full(serial);
+	} else {
+		row_len = serial_increment(serial);
+	}
+	if (row_len <= 0) {
+		stats_error(serial_symbology(serial), STATS_ERR_OTHER);
+		serial->next = serial->last + 1;
+		serial->row_len = 0;
+		return 0;
+	}
+	stats_label(serial_symbology(serial), row_len);
+	//last < 10^SERIAL_WIDTH_MAX, no overflow
+	serial->next++;
+
+	if (text != NULL) {
+		*text = serial->text;
+	}
+	if (row != NULL) {
+		*row = serial->row;
+	}
+	return row_len;
+}
+
+void serial_free(struct serial *serial) {
+	if (serial == NULL) {
+		return;
+	}
+	free(serial->text);
+	free(serial->row);
+	free(serial->symbol);
+	free(serial->symbol_of);
+	serial->text = NULL;
+	serial->row = NULL;
+	serial->symbol = NULL;
+	serial->symbol_of = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+#include <stddef.h>
+#include "platform.h"
+#include "code128.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//serial number layouts
+enum {
+	SERIAL_CODE128 = 0,	//code128 template
+	SERIAL_I25,			//i25 template, digits only
+	SERIAL_SSCC,		//17 digit template, encoded as GS1-128 (00) + check digit
+	SERIAL_NUM
+};
+
+//the counter is the run of '#' in the template, zero padded to its width
+#define SERIAL_COUNTER_CHAR		'#'
+
+struct serial {
+	s32 kind;
+	u64 next;
+	u64 last;
+	//label text, the counter digits are at field
+	s8 *text;
+	s32 text_len;
+	s32 field;
+	s32 width;
+	//SSCC check digit offset in text and mod 10 sum of the data digits
+	s32 check;
+	s32 mod10;
+	//coded data of the current label
+	s8 *row;
+	s32 row_len;
+	//code128: symbol log, weighted sum without the check character
+	struct code128_symbol *symbol;
+	s32 symbol_num;
+	s32 symbol_size;
+	s32 weighted;
+	//text offset to symbol(code128) or digit pair(i25), -1 forces a full encode
+	s32 *symbol_of;
+	//labels produced by a full encode and by patching
+	u64 full;
+	u64 patched;
+};
+
+s32 serial_lookup(const s8 *name);
+s32 serial_init(struct serial *serial, s32 kind, const s8 *pattern, u64 first, u64 last);
+s32 serial_next(struct serial *serial, const s8 **text, const s8 **row);
+void serial_free(struct serial *serial);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
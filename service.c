@@ -0,0 +1,1204 @@
+/**
+ * @file service.c
+ * @brief encoder daemon on a unix domain socket, and its client side
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+
+#include "symbology.h"
+#include "pack.h"
+#include "batch.h"
+#include "native.h"
+#include "trace.h"
+#include "service.h"
+
+#define SERVICE_EVENTS			64
+#define SERVICE_BACKLOG			64
+#define SERVICE_BUFFER_SIZE		16384
+#define SERVICE_BATCH_SIZE		64
+//a buffer never grows past this, the request is refused instead
+#define SERVICE_SIZE_MAX		(1 << 30)
+//raster bytes a printer command may take, bars as a bitmap when the dialect can't draw them
+#define SERVICE_RASTER_MAX		(SERVICE_BUFFER_SIZE * 64)
+//polls of the ring before a client sleeps on the reply eventfd
+#define SERVICE_SHM_SPIN		2000
+
+//what an epoll data.ptr of a connection or a ring points at
+enum {
+	SERVICE_KIND_CONN = 0,
+	SERVICE_KIND_RING
+};
+
+//service end of a shared memory ring, negotiated on conn
+struct service_ring {
+	s32 kind;
+	struct service_conn *conn;
+	s32 request_fd;
+	s32 reply_fd;
+	u8 *map;
+	size_t size;
+	struct service_shm_header *header;
+	//geometry as it was set up, the client may scribble over the header copy
+	u32 slots;
+	u32 slot_size;
+	u32 input_max;
+	u32 reply_offset;
+	//slots collected into the batch and slots replied to
+	u32 head;
+	u32 done;
+};
+
+struct service_conn {
+	s32 kind;
+	s32 fd;
+	//received bytes, the first parsed of them belong to the batch
+	u8 *in;
+	s32 in_len;
+	s32 in_size;
+	s32 parsed;
+	//replies not written yet, from out_off
+	u8 *out;
+	s32 out_off;
+	s32 out_len;
+	s32 out_size;
+	//waiting for EPOLLOUT
+	s32 blocked;
+	//the client shut its end: what it sent is served, then the connection closes
+	s32 eof;
+	s32 closed;
+	struct service_ring *ring;
+	struct service_conn *next;
+};
+
+//a request of the batch, its input is text + offset
+struct service_item {
+	struct service_conn *conn;
+	//the ring slot it came in, NULL for the socket
+	struct service_ring *ring;
+	u32 slot;
+	struct service_request request;
+	s32 offset;
+	//index in the packed batch, -1 for none
+	s32 packed;
+};
+
+//room for len more bytes at *buffer + used, -1 past SERVICE_SIZE_MAX
+static s32 service_reserve(u8 **buffer, s32 *size, s32 used, s32 len) {
+	u8 *grow;
+	s64 new_size = (*size > 0) ? *size : SERVICE_BUFFER_SIZE;
+
+	if (used < 0 || len < 0) {
+		return -1;
+	}
+	while (new_size - used < len) {
+		if (new_size >= SERVICE_SIZE_MAX) {
+			return -1;
+		}
+		new_size <<= 1;
+	}
+	if (new_size == *size) {
+		return 0;
+	}
+	grow = (u8*)realloc(*buffer, new_size);
+	if (grow == NULL) {
+		return -1;
+	}
+	*buffer = grow;
+	*size = new_size;
+	return 0;
+}
+
+static inline u8 *service_slot(u8 *map, u32 slots, u32 slot_size, u32 slot) {
+	return map + sizeof(struct service_shm_header) + (size_t)(slot & (slots - 1)) * slot_size;
+}
+
+static s32 service_read_full(s32 fd, void *data, s32 len) {
+	u8 *p = (u8*)data;
+	ssize_t n;
+	while (len > 0) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static s32 service_write_full(s32 fd, const struct iovec *iov, s32 count) {
+	struct iovec local[2];
+	ssize_t n;
+	s32 i;
+
+	memcpy(local, iov, count * sizeof(struct iovec));
+	for (i = 0; i < count; ) {
+		n = writev(fd, &local[i], count - i);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		for (; i < count && (size_t)n >= local[i].iov_len; i++) {
+			n -= local[i].iov_len;
+		}
+		if (i < count) {
+			local[i].iov_base = (u8*)local[i].iov_base + n;
+			local[i].iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief listen on path, an old socket file there is replaced
+ *
+ * @return 0, -1 on error
+ */
+s32 service_init(struct service *service, const s8 *path) {
+	struct sockaddr_un addr;
+	struct epoll_event event;
+
+	if (service == NULL || path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(service, 0, sizeof(*service));
+	service->epoll_fd = -1;
+	service->wake_fd = -1;
+	service->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (service->listen_fd < 0) {
+		printf("%s %d socket err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(service->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+			listen(service->listen_fd, SERVICE_BACKLOG) < 0) {
+		printf("%s %d %s err:%s\n",__func__,__LINE__,path,strerror(errno));
+		TRACE_ERROR();
+		goto err;
+	}
+	service->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	service->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (service->epoll_fd < 0 || service->wake_fd < 0) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		goto err;
+	}
+	//connections carry their service_conn, these two their fd field
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = &service->listen_fd;
+	if (epoll_ctl(service->epoll_fd, EPOLL_CTL_ADD, service->listen_fd, &event) < 0) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		goto err;
+	}
+	event.data.ptr = &service->wake_fd;
+	if (epoll_ctl(service->epoll_fd, EPOLL_CTL_ADD, service->wake_fd, &event) < 0) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		goto err;
+	}
+	return 0;
+err:
+	close(service->listen_fd);
+	if (service->epoll_fd >= 0) {
+		close(service->epoll_fd);
+	}
+	if (service->wake_fd >= 0) {
+		close(service->wake_fd);
+	}
+	service->listen_fd = -1;
+	return -1;
+}
+
+static void service_accept(struct service *service) {
+	struct service_conn *conn;
+	struct epoll_event event;
+	s32 fd;
+
+	while ((fd = accept(service->listen_fd, NULL, NULL)) >= 0) {
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		conn = (struct service_conn*)calloc(1, sizeof(struct service_conn));
+		if (conn == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			close(fd);
+			continue;
+		}
+		conn->kind = SERVICE_KIND_CONN;
+		conn->fd = fd;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.ptr = conn;
+		if (epoll_ctl(service->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+			printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+			TRACE_ERROR();
+			close(fd);
+			free(conn);
+			continue;
+		}
+		conn->next = service->conn;
+		service->conn = conn;
+		service->connections++;
+	}
+}
+
+//the events conn waits for
+static void service_watch(struct service *service, struct service_conn *conn) {
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = (conn->eof ? 0 : (EPOLLIN | EPOLLRDHUP)) | (conn->blocked ? EPOLLOUT : 0);
+	event.data.ptr = conn;
+	epoll_ctl(service->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+//everything the socket has, until it would block
+static void service_receive(struct service *service, struct service_conn *conn) {
+	ssize_t n;
+	if (conn->eof) {
+		return;
+	}
+	for (;;) {
+		if (service_reserve(&conn->in, &conn->in_size, conn->in_len, SERVICE_BUFFER_SIZE / 2) < 0) {
+			conn->closed = 1;
+			return;
+		}
+		n = read(conn->fd, conn->in + conn->in_len, conn->in_size - conn->in_len);
+		if (n > 0) {
+			conn->in_len += n;
+			service->bytes_in += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n == 0) {
+			//no more requests, the ones read are still answered
+			conn->eof = 1;
+			service_watch(service, conn);
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			conn->closed = 1;
+		}
+		return;
+	}
+}
+
+//writes what it can, EPOLLOUT only while the socket is full
+static void service_flush(struct service *service, struct service_conn *conn) {
+	ssize_t n;
+	s32 blocked = 0;
+
+	while (conn->out_off < conn->out_len) {
+		n = write(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off);
+		if (n > 0) {
+			conn->out_off += n;
+			service->bytes_out += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			blocked = 1;
+		} else {
+			conn->closed = 1;
+		}
+		break;
+	}
+	if (conn->out_off == conn->out_len) {
+		conn->out_off = 0;
+		conn->out_len = 0;
+	}
+	if (blocked != conn->blocked && !conn->closed) {
+		conn->blocked = blocked;
+		service_watch(service, conn);
+	}
+}
+
+static s32 service_reply(struct service_conn *conn, u32 id, s32 status, s32 modules, s32 checksum,
+		const u8 *data, s32 len) {
+	struct service_reply reply;
+
+	if (service_reserve(&conn->out, &conn->out_size, conn->out_len, sizeof(reply) + len) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		conn->closed = 1;
+		return -1;
+	}
+	reply.id = id;
+	reply.status = status;
+	reply.modules = modules;
+	reply.checksum = checksum;
+	reply.len = len;
+	memcpy(conn->out + conn->out_len, &reply, sizeof(reply));
+	if (len > 0) {
+		memcpy(conn->out + conn->out_len + sizeof(reply), data, len);
+	}
+	conn->out_len += sizeof(reply) + len;
+	return 0;
+}
+
+//a request into the batch, its input copied NUL terminated to text
+static s32 service_add(struct service *service, struct service_conn *conn, struct service_ring *ring, u32 slot,
+		const struct service_request *request, const u8 *input) {
+	struct service_item *item;
+	s32 text_len = 0;
+
+	if (service->items > 0) {
+		item = &service->item[service->items - 1];
+		text_len = item->offset + item->request.len + 1;
+	}
+	if (service->items == service->batch_size) {
+		item = (struct service_item*)realloc(service->item,
+				(service->batch_size ? service->batch_size * 2 : SERVICE_BATCH_SIZE) * sizeof(*item));
+		if (item == NULL) {
+			return -1;
+		}
+		service->item = item;
+		service->batch_size = service->batch_size ? service->batch_size * 2 : SERVICE_BATCH_SIZE;
+	}
+	if (service_reserve((u8**)&service->text, &service->text_size, text_len, request->len + 1) < 0) {
+		return -1;
+	}
+	item = &service->item[service->items++];
+	item->conn = conn;
+	item->ring = ring;
+	item->slot = slot;
+	item->request = *request;
+	item->offset = text_len;
+	item->packed = -1;
+	memcpy(service->text + text_len, input, request->len);
+	service->text[text_len + request->len] = 0;
+	return 0;
+}
+
+//every complete frame of conn into the batch
+static s32 service_collect(struct service *service, struct service_conn *conn) {
+	struct service_request request;
+
+	while (conn->in_len - conn->parsed >= (s32)sizeof(request)) {
+		memcpy(&request, conn->in + conn->parsed, sizeof(request));
+		if (request.len > SERVICE_INPUT_MAX || request.op >= SERVICE_OP_NUM) {
+			printf("%s %d fd %d bad frame\n",__func__,__LINE__,conn->fd);
+			conn->closed = 1;
+			return -1;
+		}
+		if (conn->in_len - conn->parsed < (s32)(sizeof(request) + request.len)) {
+			break;
+		}
+		if (service_add(service, conn, NULL, 0, &request, conn->in + conn->parsed + sizeof(request)) < 0) {
+			return -1;
+		}
+		conn->parsed += sizeof(request) + request.len;
+	}
+	return 0;
+}
+
+//the slots the client published since the last look into the batch; the
+//client shares the memory, so only copies of what it wrote are trusted
+static s32 service_collect_ring(struct service *service, struct service_ring *ring) {
+	struct service_shm_header *header = ring->header;
+	struct service_request request;
+	u8 *slot;
+	u32 head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+	if (head - ring->done > ring->slots) {
+		printf("%s %d fd %d bad ring head\n",__func__,__LINE__,ring->conn->fd);
+		ring->conn->closed = 1;
+		return -1;
+	}
+	for (; ring->head != head; ring->head++) {
+		slot = service_slot(ring->map, ring->slots, ring->slot_size, ring->head);
+		memcpy(&request, slot, sizeof(request));
+		//refused by service_batch(), a ring can't be moved again
+		if (request.len > ring->input_max || request.op == SERVICE_OP_SHM) {
+			request.len = 0;
+			request.op = SERVICE_OP_NUM;
+		}
+		if (service_add(service, ring->conn, ring, ring->head, &request, slot + sizeof(request)) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//printer command of one label into output, or into service->buffer which grows
+//until it fits when output is NULL
+static s32 service_native(struct service *service, const struct service_item *item, u8 *output,
+		s32 output_size) {
+	struct native_field field;
+	FILE *fp;
+	s32 modules, len;
+
+	memset(&field, 0, sizeof(field));
+	field.height = item->request.height;
+	field.module = item->request.module;
+	field.hri = item->request.hri;
+	if (item->request.dialect >= NATIVE_NUM || field.height <= 0 || field.module <= 0) {
+		return -1;
+	}
+	//what a raster fallback would take, a symbol too big for any printer is refused up front
+	modules = symbology_width(item->request.symbology, service->text + item->offset);
+	if (modules <= 0 || ((u64)modules * field.module + 7) / 8 * field.height > SERVICE_RASTER_MAX) {
+		return -1;
+	}
+	for (;;) {
+		fp = (output != NULL) ? fmemopen(output, output_size, "w") :
+				fmemopen(service->buffer, service->buffer_size, "w");
+		if (fp == NULL) {
+			return -1;
+		}
+		setvbuf(fp, NULL, _IONBF, 0);
+		len = -1;
+		if (native_begin(item->request.dialect, fp) >= 0 &&
+				native_write(item->request.dialect, item->request.symbology, service->text + item->offset,
+						&field, fp) > 0 &&
+				native_end(item->request.dialect, fp) >= 0) {
+			len = ftell(fp);
+		} else if (!ferror(fp)) {
+			fclose(fp);
+			return -1;
+		}
+		fclose(fp);
+		if (output != NULL) {
+			return (len >= 0 && len < output_size) ? len : -1;
+		}
+		if (len >= 0 && len < service->buffer_size) {
+			return len;
+		}
+		if (service_reserve(&service->buffer, &service->buffer_size, service->buffer_size, 1) < 0) {
+			return -1;
+		}
+	}
+}
+
+//the reply of a ring request, encoded straight into its slot
+static void service_ring_reply(struct service *service, const struct service_item *item) {
+	const struct service_ring *ring = item->ring;
+	struct service_reply reply;
+	u8 *slot = service_slot(ring->map, ring->slots, ring->slot_size, item->slot);
+	u8 *output = slot + ring->reply_offset + sizeof(reply);
+	s32 output_size = ring->slot_size - ring->reply_offset - sizeof(reply);
+	const s8 *input = service->text + item->offset;
+	s32 len = -1;
+
+	reply.id = item->request.id;
+	reply.modules = 0;
+	reply.checksum = -1;
+	if (item->request.op == SERVICE_OP_PACKED && item->request.symbology < SYMBOLOGY_NUM &&
+			pack_len(symbology_max_len(item->request.symbology, input)) <= output_size) {
+		reply.modules = symbology_encode_packed(item->request.symbology, input, output, output_size,
+				&reply.checksum);
+		len = (reply.modules > 0) ? pack_len(reply.modules) : -1;
+	} else if (item->request.op == SERVICE_OP_NATIVE) {
+		len = service_native(service, item, output, output_size);
+		reply.modules = (len > 0) ? symbology_width(item->request.symbology, input) : 0;
+	}
+	reply.status = (len > 0) ? 0 : -1;
+	reply.len = (len > 0) ? len : 0;
+	memcpy(slot + ring->reply_offset, &reply, sizeof(reply));
+	service->ring_requests++;
+}
+
+//replies of the collected slots are in place, tell the client
+static void service_ring_publish(struct service_ring *ring) {
+	u64 one = 1;
+	if (ring->done == ring->head) {
+		return;
+	}
+	ring->done = ring->head;
+	__atomic_store_n(&ring->header->done, ring->done, __ATOMIC_RELEASE);
+	//pairs with the client setting waiting before its last look at done
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->header->waiting, __ATOMIC_RELAXED)) {
+		if (write(ring->reply_fd, &one, sizeof(one)) < 0) {
+			return;
+		}
+	}
+}
+
+static void service_ring_free(struct service *service, struct service_ring *ring) {
+	if (ring == NULL) {
+		return;
+	}
+	if (ring->request_fd >= 0) {
+		epoll_ctl(service->epoll_fd, EPOLL_CTL_DEL, ring->request_fd, NULL);
+		close(ring->request_fd);
+	}
+	if (ring->reply_fd >= 0) {
+		close(ring->reply_fd);
+	}
+	if (ring->map != NULL && ring->map != MAP_FAILED) {
+		munmap(ring->map, ring->size);
+	}
+	free(ring);
+}
+
+/**
+ * @brief SERVICE_OP_SHM: set up a ring for conn and pass the memfd and the
+ * request and reply eventfds along with the reply; the reply is a plain
+ * status -1 when it can't be done, the client keeps to the socket then
+ */
+static void service_ring_accept(struct service *service, const struct service_item *item) {
+	struct service_conn *conn = item->conn;
+	struct service_ring *ring = NULL;
+	struct service_shm_header *header;
+	struct service_reply reply;
+	struct epoll_event event;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	s32 fds[3];
+	u8 control[CMSG_SPACE(sizeof(fds))];
+	s32 memfd = -1;
+
+	//the reply has to be the next bytes on the socket
+	if (conn->ring != NULL || conn->out_len > conn->out_off) {
+		goto refuse;
+	}
+	ring = (struct service_ring*)calloc(1, sizeof(struct service_ring));
+	if (ring == NULL) {
+		goto refuse;
+	}
+	ring->kind = SERVICE_KIND_RING;
+	ring->conn = conn;
+	ring->reply_fd = -1;
+	ring->size = sizeof(struct service_shm_header) + (size_t)SERVICE_SHM_SLOTS * SERVICE_SHM_SLOT_SIZE;
+	memfd = syscall(SYS_memfd_create, "barcode-ring", MFD_CLOEXEC);
+	ring->request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	//the client blocks reading it, and the file flags are shared
+	ring->reply_fd = eventfd(0, EFD_CLOEXEC);
+	if (memfd < 0 || ring->request_fd < 0 || ring->reply_fd < 0 || ftruncate(memfd, ring->size) < 0) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		goto refuse;
+	}
+	ring->map = (u8*)mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (ring->map == MAP_FAILED) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		goto refuse;
+	}
+	ring->slots = SERVICE_SHM_SLOTS;
+	ring->slot_size = SERVICE_SHM_SLOT_SIZE;
+	ring->input_max = SERVICE_SHM_INPUT_MAX;
+	ring->reply_offset = (sizeof(struct service_request) + SERVICE_SHM_INPUT_MAX + 7) & ~7;
+	//what the client reads, the service goes by the copies above
+	header = ring->header = (struct service_shm_header*)ring->map;
+	header->magic = SERVICE_SHM_MAGIC;
+	header->slots = ring->slots;
+	header->slot_size = ring->slot_size;
+	header->input_max = ring->input_max;
+	header->reply_offset = ring->reply_offset;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = ring;
+	if (epoll_ctl(service->epoll_fd, EPOLL_CTL_ADD, ring->request_fd, &event) < 0) {
+		printf("%s %d err:%s\n",__func__,__LINE__,strerror(errno));
+		goto refuse;
+	}
+
+	memset(&reply, 0, sizeof(reply));
+	reply.id = item->request.id;
+	reply.checksum = -1;
+	iov.iov_base = &reply;
+	iov.iov_len = sizeof(reply);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	fds[0] = memfd;
+	fds[1] = ring->request_fd;
+	fds[2] = ring->reply_fd;
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	//nothing is queued on the socket, so the few bytes go at once
+	if (sendmsg(conn->fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(reply)) {
+		printf("%s %d fd %d sendmsg err:%s\n",__func__,__LINE__,conn->fd,strerror(errno));
+		conn->closed = 1;
+		close(memfd);
+		service_ring_free(service, ring);
+		return;
+	}
+	close(memfd);
+	service->bytes_out += sizeof(reply);
+	conn->ring = ring;
+	service->rings++;
+	return;
+refuse:
+	if (memfd >= 0) {
+		close(memfd);
+	}
+	service_ring_free(service, ring);
+	service_reply(conn, item->request.id, -1, 0, -1, NULL, 0);
+}
+
+/**
+ * @brief encode the batch and queue the replies: packed rows of all
+ * connections go through batch_encode() together, printer commands one by one;
+ * ring requests are encoded straight into their slots
+ */
+static void service_batch(struct service *service) {
+	struct service_item *item;
+	s32 packed = 0, stride = 1, len, i;
+
+	if (service->items == 0) {
+		return;
+	}
+	service->batches++;
+	service->requests += service->items;
+	if ((u64)service->items > service->batch_max) {
+		service->batch_max = service->items;
+	}
+	for (i = 0; i < service->items; i++) {
+		item = &service->item[i];
+		if (item->ring != NULL || item->request.op != SERVICE_OP_PACKED ||
+				item->request.symbology >= SYMBOLOGY_NUM) {
+			continue;
+		}
+		len = pack_len(symbology_max_len(item->request.symbology, service->text + item->offset));
+		if (len <= 0) {
+			continue;
+		}
+		stride = (len > stride) ? len : stride;
+		item->packed = packed++;
+	}
+	if (packed > 0 && service->input_size < packed) {
+		free(service->input);
+		free(service->symbology);
+		free(service->bits);
+		free(service->checksum);
+		service->input = (const s8**)malloc(packed * sizeof(*service->input));
+		service->symbology = (s32*)malloc(packed * sizeof(s32));
+		service->bits = (s32*)malloc(packed * sizeof(s32));
+		service->checksum = (s32*)malloc(packed * sizeof(s32));
+		service->input_size = packed;
+	}
+	if (packed > 0 && (service->input == NULL || service->symbology == NULL || service->bits == NULL ||
+			service->checksum == NULL ||
+			service_reserve(&service->rows, &service->rows_size, 0, packed * stride) < 0)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		service->input_size = 0;
+		packed = 0;
+	}
+	for (i = 0; i < service->items; i++) {
+		item = &service->item[i];
+		if (item->packed < 0) {
+			continue;
+		}
+		if (packed == 0) {
+			item->packed = -1;
+			continue;
+		}
+		service->input[item->packed] = service->text + item->offset;
+		service->symbology[item->packed] = item->request.symbology;
+	}
+	if (packed > 0) {
+		memset(service->rows, 0, packed * stride);
+		batch_encode(service->symbology, service->input, packed, service->rows, stride, service->bits,
+				service->checksum, stdout);
+	}
+
+	for (i = 0; i < service->items; i++) {
+		item = &service->item[i];
+		if (item->conn->closed) {
+			continue;
+		}
+		if (item->ring != NULL) {
+			service_ring_reply(service, item);
+		} else if (item->request.op == SERVICE_OP_SHM) {
+			service_ring_accept(service, item);
+		} else if (item->packed >= 0 && service->bits[item->packed] > 0) {
+			service_reply(item->conn, item->request.id, 0, service->bits[item->packed],
+					service->checksum[item->packed], service->rows + item->packed * stride,
+					pack_len(service->bits[item->packed]));
+		} else if (item->request.op == SERVICE_OP_NATIVE &&
+				(len = service_native(service, item, NULL, 0)) > 0) {
+			service_reply(item->conn, item->request.id, 0,
+					symbology_width(item->request.symbology, service->text + item->offset), -1,
+					service->buffer, len);
+		} else {
+			service_reply(item->conn, item->request.id, -1, 0, -1, NULL, 0);
+		}
+	}
+	service->items = 0;
+}
+
+static void service_close(struct service *service, struct service_conn *conn) {
+	struct service_conn **link;
+	for (link = &service->conn; *link != NULL; link = &(*link)->next) {
+		if (*link == conn) {
+			*link = conn->next;
+			break;
+		}
+	}
+	service_ring_free(service, conn->ring);
+	epoll_ctl(service->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	free(conn->in);
+	free(conn->out);
+	free(conn);
+}
+
+/**
+ * @brief serve until service_stop(): each wakeup reads every ready socket,
+ * encodes all complete requests as one batch and writes the replies back
+ *
+ * @return 0, -1 on error
+ */
+s32 service_run(struct service *service) {
+	struct epoll_event events[SERVICE_EVENTS];
+	struct service_conn *conn, *next;
+	u64 wake;
+	s32 n, i, fd;
+
+	if (service == NULL || service->listen_fd < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	if (service->buffer == NULL &&
+			service_reserve(&service->buffer, &service->buffer_size, 0, SERVICE_BUFFER_SIZE) < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	while (!service->stop) {
+		n = epoll_wait(service->epoll_fd, events, SERVICE_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			printf("%s %d epoll err:%s\n",__func__,__LINE__,strerror(errno));
+			TRACE_ERROR();
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (events[i].data.ptr == &service->listen_fd) {
+				service_accept(service);
+				continue;
+			}
+			if (events[i].data.ptr == &service->wake_fd ||
+					*(s32*)events[i].data.ptr == SERVICE_KIND_RING) {
+				//the counter only wakes the loop up, every ring is looked at below
+				fd = (events[i].data.ptr == &service->wake_fd) ? service->wake_fd :
+						((struct service_ring*)events[i].data.ptr)->request_fd;
+				if (read(fd, &wake, sizeof(wake)) < 0) {
+					continue;
+				}
+				continue;
+			}
+			conn = (struct service_conn*)events[i].data.ptr;
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+				service_receive(service, conn);
+			}
+			if (events[i].events & EPOLLOUT) {
+				service_flush(service, conn);
+			}
+		}
+		//what came in since the last wakeup, from every connection, is one batch
+		for (conn = service->conn; conn != NULL; conn = conn->next) {
+			if (!conn->closed && conn->in_len - conn->parsed > 0) {
+				service_collect(service, conn);
+			}
+			if (!conn->closed && conn->ring != NULL) {
+				service_collect_ring(service, conn->ring);
+			}
+		}
+		service_batch(service);
+		for (conn = service->conn; conn != NULL; conn = next) {
+			next = conn->next;
+			if (!conn->closed && conn->ring != NULL) {
+				service_ring_publish(conn->ring);
+			}
+			if (conn->parsed > 0) {
+				memmove(conn->in, conn->in + conn->parsed, conn->in_len - conn->parsed);
+				conn->in_len -= conn->parsed;
+				conn->parsed = 0;
+			}
+			if (!conn->closed && conn->out_len > conn->out_off && !conn->blocked) {
+				service_flush(service, conn);
+			}
+			//a partial frame left at end of input is dropped
+			if (conn->eof && conn->out_len == conn->out_off) {
+				conn->closed = 1;
+			}
+			if (conn->closed) {
+				service_close(service, conn);
+			}
+		}
+	}
+	return 0;
+}
+
+//from any thread or a signal handler
+void service_stop(struct service *service) {
+	u64 one = 1;
+	if (service == NULL) {
+		return;
+	}
+	service->stop = 1;
+	if (write(service->wake_fd, &one, sizeof(one)) < 0) {
+		return;
+	}
+}
+
+//closes every connection, path is unlinked when given
+void service_free(struct service *service, const s8 *path) {
+	if (service == NULL || service->listen_fd < 0) {
+		return;
+	}
+	while (service->conn != NULL) {
+		service_close(service, service->conn);
+	}
+	close(service->listen_fd);
+	close(service->epoll_fd);
+	close(service->wake_fd);
+	service->listen_fd = -1;
+	if (path != NULL) {
+		unlink(path);
+	}
+	free(service->item);
+	free(service->input);
+	free(service->symbology);
+	free(service->bits);
+	free(service->checksum);
+	free(service->rows);
+	free(service->text);
+	free(service->buffer);
+}
+
+s32 service_dump(const struct service *service, FILE *fp) {
+	if (service == NULL || fp == NULL) {
+		return -1;
+	}
+	fprintf(fp, "service connections:%llu requests:%llu batches:%llu batch(avg):%.1f batch(max):%llu "
+			"in:%llu out:%llu rings:%llu ring requests:%llu\n", (unsigned long long)service->connections,
+			(unsigned long long)service->requests, (unsigned long long)service->batches,
+			service->batches ? (double)service->requests / service->batches : 0.0,
+			(unsigned long long)service->batch_max, (unsigned long long)service->bytes_in,
+			(unsigned long long)service->bytes_out, (unsigned long long)service->rings,
+			(unsigned long long)service->ring_requests);
+	return 0;
+}
+
+//client side, blocking
+
+s32 service_connect(const s8 *path) {
+	struct sockaddr_un addr;
+	s32 fd;
+
+	if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		printf("%s %d socket err:%s\n",__func__,__LINE__,strerror(errno));
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		printf("%s %d %s err:%s\n",__func__,__LINE__,path,strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief queue a request, replies may be read later with service_recv()
+ *
+ * @param request: len is set from input
+ *
+ * @return 0, -1 on error
+ */
+s32 service_send(s32 fd, const struct service_request *request, const s8 *input) {
+	struct service_request header;
+	struct iovec iov[2];
+
+	if (request == NULL || input == NULL || strlen(input) > SERVICE_INPUT_MAX) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	header = *request;
+	header.len = strlen(input);
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void*)input;
+	iov[1].iov_len = header.len;
+	return service_write_full(fd, iov, 2);
+}
+
+/**
+ * @brief the next reply, its bytes into output
+ *
+ * @return reply bytes, -1 on error or when they don't fit output_size(they
+ *         are read and dropped)
+ */
+s32 service_recv(s32 fd, struct service_reply *reply, u8 *output, s32 output_size) {
+	u8 drop[256];
+	u32 left;
+	s32 n;
+
+	if (reply == NULL || service_read_full(fd, reply, sizeof(*reply)) < 0) {
+		return -1;
+	}
+	if (output != NULL && reply->len <= (u32)output_size) {
+		return (service_read_full(fd, output, reply->len) < 0) ? -1 : (s32)reply->len;
+	}
+	for (left = reply->len; left > 0; left -= n) {
+		n = (left < sizeof(drop)) ? left : sizeof(drop);
+		if (service_read_full(fd, drop, n) < 0) {
+			return -1;
+		}
+	}
+	printf("%s %d id %u reply of %u bytes dropped\n",__func__,__LINE__,reply->id,reply->len);
+	return -1;
+}
+
+//one request and its reply
+s32 service_call(s32 fd, const struct service_request *request, const s8 *input, struct service_reply *reply,
+		u8 *output, s32 output_size) {
+	if (service_send(fd, request, input) < 0) {
+		return -1;
+	}
+	return service_recv(fd, reply, output, output_size);
+}
+
+/**
+ * @brief move the requests of a fresh connection to a shared memory ring;
+ * nothing may be in flight on fd, which stays open for the service to see
+ * the client go
+ *
+ * @return 0, -1 when the service or the kernel can't, keep to fd then
+ */
+s32 service_shm_open(struct service_shm *shm, s32 fd) {
+	struct service_request request;
+	struct service_reply reply;
+	struct service_shm_header *header;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct stat st;
+	s32 fds[3] = {-1, -1, -1};
+	u8 control[CMSG_SPACE(sizeof(fds))];
+	ssize_t n;
+	s32 i;
+
+	if (shm == NULL || fd < 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	memset(shm, 0, sizeof(*shm));
+	shm->fd = fd;
+	shm->request_fd = -1;
+	shm->reply_fd = -1;
+	memset(&request, 0, sizeof(request));
+	request.op = SERVICE_OP_SHM;
+	if (service_send(fd, &request, "") < 0) {
+		return -1;
+	}
+	iov.iov_base = &reply;
+	iov.iov_len = sizeof(reply);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	do {
+		n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0 || (n < (ssize_t)sizeof(reply) &&
+			service_read_full(fd, (u8*)&reply + n, sizeof(reply) - n) < 0)) {
+		return -1;
+	}
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+				cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+		}
+	}
+	if (reply.status != 0 || fds[0] < 0 || fstat(fds[0], &st) < 0 ||
+			(size_t)st.st_size < sizeof(struct service_shm_header)) {
+		goto err;
+	}
+	shm->size = st.st_size;
+	shm->map = (u8*)mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+	if (shm->map == MAP_FAILED) {
+		shm->map = NULL;
+		goto err;
+	}
+	close(fds[0]);
+	fds[0] = -1;
+	header = shm->header = (struct service_shm_header*)shm->map;
+	if (header->magic != SERVICE_SHM_MAGIC || header->slots == 0 || (header->slots & (header->slots - 1)) != 0 ||
+			sizeof(*header) + (size_t)header->slots * header->slot_size > shm->size ||
+			header->reply_offset < sizeof(request) + header->input_max ||
+			header->reply_offset + sizeof(reply) > header->slot_size) {
+		printf("%s %d bad ring\n",__func__,__LINE__);
+		goto err;
+	}
+	shm->request_fd = fds[1];
+	shm->reply_fd = fds[2];
+	shm->head = header->head;
+	shm->tail = header->done;
+	return 0;
+err:
+	for (i = 0; i < 3; i++) {
+		if (fds[i] >= 0) {
+			close(fds[i]);
+		}
+	}
+	if (shm->map != NULL) {
+		munmap(shm->map, shm->size);
+	}
+	shm->map = NULL;
+	shm->header = NULL;
+	return -1;
+}
+
+//the socket it was opened on stays with the caller
+void service_shm_close(struct service_shm *shm) {
+	if (shm == NULL || shm->map == NULL) {
+		return;
+	}
+	munmap(shm->map, shm->size);
+	close(shm->request_fd);
+	close(shm->reply_fd);
+	shm->map = NULL;
+	shm->header = NULL;
+}
+
+/**
+ * @brief write a request into the next free slot and tell the service
+ *
+ * @return 0, -1 on error or when every slot is taken(read replies first)
+ */
+s32 service_shm_send(struct service_shm *shm, const struct service_request *request, const s8 *input) {
+	struct service_request header;
+	u64 one = 1;
+	u8 *slot;
+
+	if (shm == NULL || shm->header == NULL || request == NULL || input == NULL ||
+			strlen(input) > shm->header->input_max || shm->head - shm->tail >= shm->header->slots) {
+		return -1;
+	}
+	header = *request;
+	header.len = strlen(input);
+	slot = service_slot(shm->map, shm->header->slots, shm->header->slot_size, shm->head);
+	memcpy(slot, &header, sizeof(header));
+	memcpy(slot + sizeof(header), input, header.len);
+	__atomic_store_n(&shm->header->head, ++shm->head, __ATOMIC_RELEASE);
+	return (write(shm->request_fd, &one, sizeof(one)) < 0) ? -1 : 0;
+}
+
+/**
+ * @brief the next reply, read where the encoder wrote it; the slot is given
+ * back by the next service_shm_recv() call
+ *
+ * @param output: out, reply bytes in the ring
+ *
+ * @return reply bytes, -1 on error, when nothing was sent or the service went away
+ */
+s32 service_shm_recv(struct service_shm *shm, struct service_reply *reply, const u8 **output) {
+	struct service_shm_header *header;
+	struct pollfd pfd[2];
+	u64 count;
+	u8 *slot;
+	s32 spin = 0;
+
+	if (shm == NULL || shm->header == NULL || reply == NULL || output == NULL) {
+		return -1;
+	}
+	header = shm->header;
+	if (shm->held) {
+		shm->tail++;
+		shm->held = 0;
+	}
+	if (shm->tail == shm->head) {
+		return -1;
+	}
+	while (__atomic_load_n(&header->done, __ATOMIC_ACQUIRE) == shm->tail) {
+		if (spin++ < SERVICE_SHM_SPIN) {
+			continue;
+		}
+		__atomic_store_n(&header->waiting, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&header->done, __ATOMIC_SEQ_CST) == shm->tail) {
+			//the socket hangs up when the service goes
+			pfd[0].fd = shm->reply_fd;
+			pfd[0].events = POLLIN;
+			pfd[1].fd = shm->fd;
+			pfd[1].events = 0;
+			if (poll(pfd, 2, -1) < 0 && errno != EINTR) {
+				__atomic_store_n(&header->waiting, 0, __ATOMIC_RELAXED);
+				return -1;
+			}
+			if ((pfd[0].revents & POLLIN) && read(shm->reply_fd, &count, sizeof(count)) < 0) {
+				count = 0;
+			}
+			if ((pfd[1].revents & (POLLHUP | POLLERR)) &&
+					__atomic_load_n(&header->done, __ATOMIC_ACQUIRE) == shm->tail) {
+				__atomic_store_n(&header->waiting, 0, __ATOMIC_RELAXED);
+				return -1;
+			}
+		}
+		__atomic_store_n(&header->waiting, 0, __ATOMIC_RELAXED);
+	}
+	slot = service_slot(shm->map, header->slots, header->slot_size, shm->tail);
+	memcpy(reply, slot + header->reply_offset, sizeof(*reply));
+	if (reply->len > header->slot_size - header->reply_offset - sizeof(*reply)) {
+		return -1;
+	}
+	*output = slot + header->reply_offset + sizeof(*reply);
+	shm->held = 1;
+	return reply->len;
+}
+
+//one request and its reply over the ring
+s32 service_shm_call(struct service_shm *shm, const struct service_request *request, const s8 *input,
+		struct service_reply *reply, const u8 **output) {
+	if (service_shm_send(shm, request, input) < 0) {
+		return -1;
+	}
+	return service_shm_recv(shm, reply, output);
+}
@@ -0,0 +1,148 @@
+#ifndef __SERVICE_H__
+#define __SERVICE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//what a request asks for
+enum {
+	SERVICE_OP_PACKED = 0,	//packed row of modules, pack_bits() layout
+	SERVICE_OP_NATIVE,		//printer command of a whole label, native_begin() to native_end()
+	SERVICE_OP_SHM,			//move the connection to a shared memory ring, service_shm_open()
+	SERVICE_OP_NUM
+};
+
+//input bytes of a request at most, a longer one closes the connection
+#define SERVICE_INPUT_MAX		4096
+
+//request frame, followed by len input bytes without a NUL; host byte order,
+//the socket never leaves the machine
+struct service_request {
+	//echoed in the reply, requests may be pipelined
+	u32 id;
+	u16 op;
+	u16 symbology;
+	//SERVICE_OP_NATIVE: NATIVE_XXX and the native_field
+	u16 dialect;
+	u16 height;
+	u16 module;
+	u16 hri;
+	u32 len;
+};
+
+//reply frame, followed by len output bytes; replies of a connection come in request order
+struct service_reply {
+	u32 id;
+	//0, -1 when the input was refused
+	s32 status;
+	//coded length in modules, check digit or -1
+	s32 modules;
+	s32 checksum;
+	u32 len;
+};
+
+//shared memory ring: a header, then slots; a slot holds a request and its input,
+//then the reply the encoder writes in place, which the client reads in place
+#define SERVICE_SHM_MAGIC		0x314d4853
+#define SERVICE_SHM_SLOTS		64
+#define SERVICE_SHM_SLOT_SIZE	16384
+#define SERVICE_SHM_INPUT_MAX	256
+#define SERVICE_SHM_LINE		64
+
+struct service_shm_header {
+	u32 magic;
+	u32 slots;
+	u32 slot_size;
+	//input bytes at most, the reply starts at reply_offset of the slot
+	u32 input_max;
+	u32 reply_offset;
+	//requests the client published, it sleeps on the reply eventfd while waiting is set
+	u32 head __attribute__((aligned(SERVICE_SHM_LINE)));
+	u32 waiting;
+	//requests the service replied to
+	u32 done __attribute__((aligned(SERVICE_SHM_LINE)));
+};
+
+//client end of a ring
+struct service_shm {
+	s32 fd;
+	s32 request_fd;
+	s32 reply_fd;
+	u8 *map;
+	size_t size;
+	struct service_shm_header *header;
+	//next slot to fill, next reply to read
+	u32 head;
+	u32 tail;
+	//the reply service_shm_recv() handed out, released by the next call
+	s32 held;
+};
+
+struct service_conn;
+struct service_item;
+
+//encoder daemon: one epoll loop, the requests of every wakeup encoded as one batch
+struct service {
+	s32 listen_fd;
+	s32 epoll_fd;
+	//written by service_stop()
+	s32 wake_fd;
+	volatile s32 stop;
+	struct service_conn *conn;
+	//requests of the batch being encoded
+	struct service_item *item;
+	s32 items;
+	s32 batch_size;
+	//their inputs, NUL terminated
+	s8 *text;
+	s32 text_size;
+	//batch_encode() arguments for the packed ones
+	const s8 **input;
+	s32 *symbology;
+	s32 *bits;
+	s32 *checksum;
+	s32 input_size;
+	u8 *rows;
+	s32 rows_size;
+	//printer command scratch
+	u8 *buffer;
+	s32 buffer_size;
+	u64 connections;
+	u64 requests;
+	u64 batches;
+	u64 batch_max;
+	u64 bytes_in;
+	u64 bytes_out;
+	u64 rings;
+	u64 ring_requests;
+};
+
+s32 service_init(struct service *service, const s8 *path);
+s32 service_run(struct service *service);
+void service_stop(struct service *service);
+void service_free(struct service *service, const s8 *path);
+s32 service_dump(const struct service *service, FILE *fp);
+
+s32 service_connect(const s8 *path);
+s32 service_send(s32 fd, const struct service_request *request, const s8 *input);
+s32 service_recv(s32 fd, struct service_reply *reply, u8 *output, s32 output_size);
+s32 service_call(s32 fd, const struct service_request *request, const s8 *input, struct service_reply *reply,
+		u8 *output, s32 output_size);
+
+s32 service_shm_open(struct service_shm *shm, s32 fd);
+void service_shm_close(struct service_shm *shm);
+s32 service_shm_send(struct service_shm *shm, const struct service_request *request, const s8 *input);
+s32 service_shm_recv(struct service_shm *shm, struct service_reply *reply, const u8 **output);
+s32 service_shm_call(struct service_shm *shm, const struct service_request *request, const s8 *input,
+		struct service_reply *reply, const u8 **output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,483 @@
+/**
+ * @file stats.c
+ * @brief runtime statistics: per-symbology counters and latency histograms
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "symbology.h"
+#include "stats.h"
+
+//counters are written only by the owning thread and summed on demand,
+//so recording a label costs a few plain stores and no lock or atomic rmw.
+
+//log-linear (HDR style) histogram: 8 sub-buckets per power of two,
+//~12% relative precision from 1ns up to 2^44ns
+#define STATS_HIST_SUB_BITS		3
+#define STATS_HIST_SUB			(1 << STATS_HIST_SUB_BITS)
+#define STATS_HIST_BUCKETS		(STATS_HIST_SUB * 42)
+
+//time one label out of 2^STATS_SAMPLE_SHIFT, counters are always exact
+#define STATS_SAMPLE_SHIFT		4
+
+#define STATS_TMP_SUFFIX		".tmp"
+
+//single writer: relaxed load + store, readers may see a slightly old value
+#define STATS_ADD(c, v) \
+	__atomic_store_n(&(c), __atomic_load_n(&(c), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+#define STATS_GET(c) __atomic_load_n(&(c), __ATOMIC_RELAXED)
+
+struct stats_hist {
+	u64 count;
+	u64 sum;
+	u64 max;
+	u64 bucket[STATS_HIST_BUCKETS];
+};
+
+struct stats_local {
+	struct stats_local *next;
+	s32 busy;
+	u64 labels[SYMBOLOGY_NUM];
+	u64 modules[SYMBOLOGY_NUM];
+	u64 bytes[SYMBOLOGY_NUM];
+	u64 errors[SYMBOLOGY_NUM][STATS_ERR_NUM];
+	struct stats_hist encode[SYMBOLOGY_NUM];
+	struct stats_hist stage[STATS_STAGE_NUM];
+};
+
+static const s8 *stats_stage_name[STATS_STAGE_NUM] = {
+	"parse",
+	"encode",
+	"pack",
+	"write"
+};
+
+static const s8 *stats_error_name[STATS_ERR_NUM] = {
+	"input",
+	"length",
+	"charset",
+	"memory",
+	"io",
+	"other"
+};
+
+static const double stats_quantile[] = {0.5, 0.9, 0.99, 0.999};
+
+static s32 stats_enabled = 1;
+static s32 stats_sample_mask = (1 << STATS_SAMPLE_SHIFT) - 1;
+static __thread u32 stats_sample_count = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_local *stats_list = NULL;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static __thread struct stats_local *stats_self = NULL;
+
+//periodic metrics file
+static pthread_t stats_file_thread;
+static pthread_cond_t stats_file_cond = PTHREAD_COND_INITIALIZER;
+static s8 *stats_file_path = NULL;
+static s32 stats_file_interval = 0;
+static s32 stats_file_running = 0;
+
+//thread exit: keep the counters but let the next thread reuse the block
+static void stats_release(void *arg) {
+	struct stats_local *local = (struct stats_local*)arg;
+	pthread_mutex_lock(&stats_lock);
+	local->busy = 0;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_key_init(void) {
+	pthread_key_create(&stats_key, stats_release);
+}
+
+static struct stats_local *stats_get_local(void) {
+	struct stats_local *local = stats_self;
+	if (local != NULL) {
+		return local;
+	}
+	pthread_once(&stats_once, stats_key_init);
+	pthread_mutex_lock(&stats_lock);
+	for (local = stats_list; local != NULL; local = local->next) {
+		if (!local->busy) {
+			break;
+		}
+	}
+	if (local == NULL) {
+		local = (struct stats_local*)calloc(1, sizeof(*local));
+		if (local == NULL) {
+			pthread_mutex_unlock(&stats_lock);
+			return NULL;
+		}
+		local->next = stats_list;
+		stats_list = local;
+	}
+	local->busy = 1;
+	pthread_mutex_unlock(&stats_lock);
+	pthread_setspecific(stats_key, local);
+	stats_self = local;
+	return local;
+}
+
+static inline s32 stats_bucket(u64 value) {
+	s32 msb, index;
+	if (value < STATS_HIST_SUB) {
+		return value;
+	}
+	msb = 63 - __builtin_clzl(value);
+	index = ((msb - STATS_HIST_SUB_BITS + 1) << STATS_HIST_SUB_BITS)
+		+ ((value >> (msb - STATS_HIST_SUB_BITS)) & (STATS_HIST_SUB - 1));
+	return (index < STATS_HIST_BUCKETS) ? index : (STATS_HIST_BUCKETS - 1);
+}
+
+//highest value that falls into bucket
+static u64 stats_bucket_upper(s32 index) {
+	s32 group = index >> STATS_HIST_SUB_BITS;
+	u64 sub = index & (STATS_HIST_SUB - 1);
+	if (group == 0) {
+		return sub;
+	}
+	return ((STATS_HIST_SUB + sub + 1) << (group - 1)) - 1;
+}
+
+static inline void stats_hist_record(struct stats_hist *hist, u64 value) {
+	STATS_ADD(hist->count, 1);
+	STATS_ADD(hist->sum, value);
+	STATS_ADD(hist->bucket[stats_bucket(value)], 1);
+	if (value > STATS_GET(hist->max)) {
+		__atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+static void stats_hist_merge(struct stats_hist *to, struct stats_hist *from) {
+	s32 i;
+	to->count += STATS_GET(from->count);
+	to->sum += STATS_GET(from->sum);
+	if (STATS_GET(from->max) > to->max) {
+		to->max = STATS_GET(from->max);
+	}
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		to->bucket[i] += STATS_GET(from->bucket[i]);
+	}
+}
+
+static u64 stats_hist_quantile(const struct stats_hist *hist, double quantile) {
+	u64 rank = (u64)(quantile * hist->count);
+	u64 seen = 0;
+	u64 value;
+	s32 i;
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen > rank) {
+			value = stats_bucket_upper(i);
+			return (value < hist->max) ? value : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+//sum every thread's counters into total
+static void stats_collect(struct stats_local *total) {
+	struct stats_local *local;
+	s32 i, j;
+	memset(total, 0, sizeof(*total));
+	pthread_mutex_lock(&stats_lock);
+	for (local = stats_list; local != NULL; local = local->next) {
+		for (i = 0; i < SYMBOLOGY_NUM; i++) {
+			total->labels[i] += STATS_GET(local->labels[i]);
+			total->modules[i] += STATS_GET(local->modules[i]);
+			total->bytes[i] += STATS_GET(local->bytes[i]);
+			for (j = 0; j < STATS_ERR_NUM; j++) {
+				total->errors[i][j] += STATS_GET(local->errors[i][j]);
+			}
+			stats_hist_merge(&total->encode[i], &local->encode[i]);
+		}
+		for (i = 0; i < STATS_STAGE_NUM; i++) {
+			stats_hist_merge(&total->stage[i], &local->stage[i]);
+		}
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_dump_hist(FILE *fp, const s8 *metric, const s8 *label,
+		const s8 *value, const struct stats_hist *hist) {
+	u32 i;
+	if (hist->count == 0) {
+		return;
+	}
+	for (i = 0; i < sizeof(stats_quantile)/sizeof(stats_quantile[0]); i++) {
+		fprintf(fp, "%s{%s=\"%s\",quantile=\"%g\"} %lu\n", metric, label, value,
+				stats_quantile[i], stats_hist_quantile(hist, stats_quantile[i]));
+	}
+	fprintf(fp, "%s_max{%s=\"%s\"} %lu\n", metric, label, value, hist->max);
+	fprintf(fp, "%s_sum{%s=\"%s\"} %lu\n", metric, label, value, hist->sum);
+	fprintf(fp, "%s_count{%s=\"%s\"} %lu\n", metric, label, value, hist->count);
+}
+
+u64 stats_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void stats_enable(s32 enable) {
+	__atomic_store_n(&stats_enabled, enable, __ATOMIC_RELAXED);
+}
+
+//sample 1 of 2^shift labels for latency, 0 times every label
+void stats_set_sample(s32 shift) {
+	if (shift < 0 || shift > 16) {
+		return;
+	}
+	__atomic_store_n(&stats_sample_mask, (1 << shift) - 1, __ATOMIC_RELAXED);
+}
+
+//should the caller time this label, the first label of a thread is always timed
+s32 stats_sample(void) {
+	if (!__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	return (stats_sample_count++ & __atomic_load_n(&stats_sample_mask, __ATOMIC_RELAXED)) == 0;
+}
+
+/**
+ * @brief count one encoded label
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param modules: length of coded data
+ */
+void stats_label(s32 symbology, s32 modules) {
+	struct stats_local *local;
+	if (!__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED) ||
+			symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return;
+	}
+	local = stats_get_local();
+	if (local == NULL) {
+		return;
+	}
+	STATS_ADD(local->labels[symbology], 1);
+	STATS_ADD(local->modules[symbology], modules);
+}
+
+void stats_latency(s32 symbology, u64 ns) {
+	struct stats_local *local;
+	if (!__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED) ||
+			symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return;
+	}
+	local = stats_get_local();
+	if (local == NULL) {
+		return;
+	}
+	stats_hist_record(&local->encode[symbology], ns);
+}
+
+void stats_bytes(s32 symbology, s32 bytes) {
+	struct stats_local *local;
+	if (!__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED) ||
+			symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return;
+	}
+	local = stats_get_local();
+	if (local == NULL) {
+		return;
+	}
+	STATS_ADD(local->bytes[symbology], bytes);
+}
+
+void stats_error(s32 symbology, s32 reason) {
+	struct stats_local *local;
+	if (!__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED) ||
+			symbology < 0 || symbology >= SYMBOLOGY_NUM ||
+			reason < 0 || reason >= STATS_ERR_NUM) {
+		return;
+	}
+	local = stats_get_local();
+	if (local == NULL) {
+		return;
+	}
+	STATS_ADD(local->errors[symbology][reason], 1);
+}
+
+void stats_stage(s32 stage, u64 ns) {
+	struct stats_local *local;
+	if (!__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED) ||
+			stage < 0 || stage >= STATS_STAGE_NUM) {
+		return;
+	}
+	local = stats_get_local();
+	if (local == NULL) {
+		return;
+	}
+	stats_hist_record(&local->stage[stage], ns);
+}
+
+/**
+ * @brief write all counters in text metrics format
+ *
+ * @param fp: output stream
+ *
+ * @return 0 on success, -1 on error
+ */
+s32 stats_dump(FILE *fp) {
+	struct stats_local *total = NULL;
+	s32 i, j;
+
+	if (fp == NULL) {
+		return -1;
+	}
+	total = (struct stats_local*)malloc(sizeof(*total));
+	if (total == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	stats_collect(total);
+
+	for (i = 0; i < SYMBOLOGY_NUM; i++) {
+		fprintf(fp, "barcode_labels_total{symbology=\"%s\"} %lu\n", symbology_name(i), total->labels[i]);
+		fprintf(fp, "barcode_modules_total{symbology=\"%s\"} %lu\n", symbology_name(i), total->modules[i]);
+		fprintf(fp, "barcode_bytes_total{symbology=\"%s\"} %lu\n", symbology_name(i), total->bytes[i]);
+		for (j = 0; j < STATS_ERR_NUM; j++) {
+			if (total->errors[i][j] == 0) {
+				continue;
+			}
+			fprintf(fp, "barcode_errors_total{symbology=\"%s\",reason=\"%s\"} %lu\n",
+					symbology_name(i), stats_error_name[j], total->errors[i][j]);
+		}
+	}
+	for (i = 0; i < SYMBOLOGY_NUM; i++) {
+		stats_dump_hist(fp, "barcode_encode_ns", "symbology", symbology_name(i), &total->encode[i]);
+	}
+	for (i = 0; i < STATS_STAGE_NUM; i++) {
+		stats_dump_hist(fp, "barcode_stage_ns", "stage", stats_stage_name[i], &total->stage[i]);
+	}
+
+	free(total);
+	return ferror(fp) ? -1 : 0;
+}
+
+//write to path.tmp then rename, readers never see a partial file
+s32 stats_write_file(const s8 *path) {
+	s8 *tmp = NULL;
+	FILE *fp = NULL;
+	s32 ret = -1;
+
+	if (path == NULL) {
+		return -1;
+	}
+	tmp = (s8*)malloc(strlen(path) + sizeof(STATS_TMP_SUFFIX));
+	if (tmp == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	sprintf(tmp, "%s%s", path, STATS_TMP_SUFFIX);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		printf("%s %d open %s err\n",__func__,__LINE__,tmp);
+		goto end;
+	}
+	ret = stats_dump(fp);
+	if (fclose(fp) != 0) {
+		ret = -1;
+	}
+	if (ret == 0 && rename(tmp, path) != 0) {
+		printf("%s %d rename %s err\n",__func__,__LINE__,path);
+		ret = -1;
+	}
+end:
+	free(tmp);
+	return ret;
+}
+
+static void *stats_file_loop(void *arg) {
+	struct timespec ts;
+	(void)arg;
+	pthread_mutex_lock(&stats_lock);
+	while (stats_file_running) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += stats_file_interval / 1000;
+		ts.tv_nsec += (stats_file_interval % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		while (stats_file_running &&
+				pthread_cond_timedwait(&stats_file_cond, &stats_lock, &ts) != ETIMEDOUT);
+		if (!stats_file_running) {
+			break;
+		}
+		//stats_dump takes the lock itself
+		pthread_mutex_unlock(&stats_lock);
+		stats_write_file(stats_file_path);
+		pthread_mutex_lock(&stats_lock);
+	}
+	pthread_mutex_unlock(&stats_lock);
+	return NULL;
+}
+
+/**
+ * @brief refresh a metrics file every interval_ms in a background thread
+ *
+ * @param path: metrics file
+ * @param interval_ms: refresh interval
+ *
+ * @return 0 on success, -1 on error
+ */
+s32 stats_start_file(const s8 *path, s32 interval_ms) {
+	s8 *copy = NULL;
+	if (path == NULL || interval_ms <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	copy = strdup(path);
+	if (copy == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return -1;
+	}
+	//tested and set under the lock, a second start sees the first one
+	pthread_mutex_lock(&stats_lock);
+	if (stats_file_running) {
+		pthread_mutex_unlock(&stats_lock);
+		printf("%s %d err\n",__func__,__LINE__);
+		free(copy);
+		return -1;
+	}
+	stats_file_path = copy;
+	stats_file_interval = interval_ms;
+	stats_file_running = 1;
+	if (pthread_create(&stats_file_thread, NULL, stats_file_loop, NULL) != 0) {
+		stats_file_running = 0;
+		stats_file_path = NULL;
+		pthread_mutex_unlock(&stats_lock);
+		printf("%s %d err\n",__func__,__LINE__);
+		free(copy);
+		return -1;
+	}
+	pthread_mutex_unlock(&stats_lock);
+	return 0;
+}
+
+//stop the refresh thread, the file is written one last time
+void stats_stop_file(void) {
+	pthread_mutex_lock(&stats_lock);
+	if (!stats_file_running) {
+		pthread_mutex_unlock(&stats_lock);
+		return;
+	}
+	stats_file_running = 0;
+	pthread_cond_signal(&stats_file_cond);
+	pthread_mutex_unlock(&stats_lock);
+	pthread_join(stats_file_thread, NULL);
+	stats_write_file(stats_file_path);
+	free(stats_file_path);
+	stats_file_path = NULL;
+}
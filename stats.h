@@ -0,0 +1,51 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//pipeline stages timed by stats_stage()
+enum {
+	STATS_STAGE_PARSE = 0,
+	STATS_STAGE_ENCODE,
+	STATS_STAGE_PACK,
+	STATS_STAGE_WRITE,
+	STATS_STAGE_NUM
+};
+
+//error reasons counted by stats_error()
+enum {
+	STATS_ERR_INPUT = 0,	//NULL or empty input
+	STATS_ERR_LENGTH,		//length not allowed by the symbology
+	STATS_ERR_CHARSET,		//character not in the symbology set
+	STATS_ERR_MEMORY,		//allocation failed
+	STATS_ERR_IO,			//output write failed
+	STATS_ERR_OTHER,
+	STATS_ERR_NUM
+};
+
+u64 stats_now(void);
+void stats_enable(s32 enable);
+void stats_set_sample(s32 shift);
+s32 stats_sample(void);
+void stats_label(s32 symbology, s32 modules);
+void stats_latency(s32 symbology, u64 ns);
+void stats_bytes(s32 symbology, s32 bytes);
+void stats_error(s32 symbology, s32 reason);
+void stats_stage(s32 stage, u64 ns);
+
+s32 stats_dump(FILE *fp);
+s32 stats_write_file(const s8 *path);
+s32 stats_start_file(const s8 *path, s32 interval_ms);
+void stats_stop_file(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
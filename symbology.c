@@ -0,0 +1,362 @@
+/**
+ * @file symbology.c
+ * @brief symbology table, dispatch encoders by name or id
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "code128.h"
+#include "code39.h"
+#include "code93.h"
+#include "code11.h"
+#include "msi.h"
+#include "i25.h"
+#include "ean13.h"
+#include "ean8.h"
+#include "upca.h"
+#include "upce.h"
+#include "codabar.h"
+#include "gs1.h"
+#include "stats.h"
+#include "pack.h"
+#include "symbology.h"
+
+#define SYMBOLOGY_DIGITS	"0123456789"
+
+struct symbology {
+	const s8 *name;
+	s32 (*max_len)(const s8 *input);
+	//exact length without encoding, 0 when refused; NULL: max_len is exact
+	//for input passing charset and len
+	s32 (*width)(const s8 *input);
+	s32 (*encode)(const s8 *input, s8 *output);
+	s32 (*encode_check)(const s8 *input, s8 *output, s32 *checksum);
+	//fixed geometry kernel writing packed rows, NULL packs the coded data
+	s32 (*encode_packed)(const s8 *input, u8 *output, s32 *checksum);
+	//lane kernel encoding a whole batch, NULL encodes one by one
+	s32 (*encode_batch)(const s8 *const *input, s32 count, u8 *output, s32 stride, s32 *checksum);
+	//only used to classify errors, NULL accepts any character
+	const s8 *charset;
+	//allowed input lengths, 0 means any length
+	s32 len[2];
+	s32 even;
+	//blank modules the coded data includes, XXX_QUIET_LEN
+	s32 quiet;
+};
+
+//same order as SYMBOLOGY_XXX
+static const struct symbology symbology_table[SYMBOLOGY_NUM] = {
+	{"code128", code128_max_len, code128_width, code128_encode, NULL, NULL, NULL, NULL, {0, 0}, 0, CODE128_QUIET_LEN},
+	{"code39", code39_max_len, NULL, code39_encode, NULL, NULL, NULL, "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. $/+%", {0, 0}, 0, CODE39_QUIET_LEN},
+	{"code93", code93_max_len, NULL, code93_encode, NULL, NULL, NULL, "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. $/+%", {0, 0}, 0, CODE93_QUIET_LEN},
+	{"code11", code11_max_len, code11_width, code11_encode, NULL, NULL, NULL, "0123456789-", {0, 0}, 0, CODE11_QUIET_LEN},
+	{"codabar", codabar_max_len, codabar_width, codabar_encode, NULL, NULL, NULL, "0123456789-$:/.+ABCD", {0, 0}, 0, CODABAR_QUIET_LEN},
+	{"msi", msi_max_len, msi_width, msi_encode, NULL, NULL, NULL, SYMBOLOGY_DIGITS, {0, 0}, 0, MSI_QUIET_LEN},
+	{"i25", i25_max_len, NULL, i25_encode, NULL, NULL, NULL, SYMBOLOGY_DIGITS, {0, 0}, 1, I25_QUIET_LEN},
+	{"ean8", ean8_max_len, NULL, NULL, ean8_encode, ean8_encode_packed, NULL, SYMBOLOGY_DIGITS, {7, 0}, 0, EAN8_QUIET_LEN},
+	{"ean13", ean13_max_len, NULL, NULL, ean13_encode, ean13_encode_packed, ean13_encode_batch, SYMBOLOGY_DIGITS, {12, 0}, 0, EAN13_QUIET_LEN},
+	{"upca", upca_max_len, NULL, NULL, upca_encode, upca_encode_packed, ean13_encode_upca_batch, SYMBOLOGY_DIGITS, {11, 0}, 0, UPCA_QUIET_LEN},
+	{"upce", upce_max_len, upce_width, NULL, upce_encode, upce_encode_packed, NULL, SYMBOLOGY_DIGITS, {6, 11}, 0, UPCE_QUIET_LEN},
+	{"gs1128", gs1_max_len, gs1_width, gs1_encode, NULL, NULL, NULL, NULL, {0, 0}, 0, CODE128_QUIET_LEN}
+};
+
+//guess why an encoder refused the input, only called on the error path
+static s32 symbology_error_reason(const struct symbology *sym, const s8 *input) {
+	s32 len;
+	if (input == NULL || *input == '\0') {
+		return STATS_ERR_INPUT;
+	}
+	len = strlen(input);
+	if ((sym->len[0] && len != sym->len[0] && len != sym->len[1]) ||
+			(sym->even && (len % 2) != 0)) {
+		return STATS_ERR_LENGTH;
+	}
+	if (sym->charset != NULL && (s32)strspn(input, sym->charset) != len) {
+		return STATS_ERR_CHARSET;
+	}
+	return STATS_ERR_OTHER;
+}
+
+/**
+ * @brief find symbology by name, name may be followed by other characters
+ *
+ * @param name: symbology name, such as "code128"
+ *
+ * @return symbology id, -1 if unknown
+ */
+s32 symbology_lookup(const s8 *name) {
+	s32 i;
+	if (name == NULL) {
+		return -1;
+	}
+	for (i = 0; i < SYMBOLOGY_NUM; i++) {
+		if (strncmp(symbology_table[i].name, name, strlen(symbology_table[i].name)) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const s8 *symbology_name(s32 symbology) {
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return "unknown";
+	}
+	return symbology_table[symbology].name;
+}
+
+//EAN/UPC encoders report their check digit
+s32 symbology_has_checksum(s32 symbology) {
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return 0;
+	}
+	return symbology_table[symbology].encode_check != NULL;
+}
+
+//blank modules around the bars, in every length the encoders return
+s32 symbology_quiet(s32 symbology) {
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return 0;
+	}
+	return symbology_table[symbology].quiet;
+}
+
+s32 symbology_max_len(s32 symbology, const s8 *input) {
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		return 0;
+	}
+	return symbology_table[symbology].max_len(input);
+}
+
+/**
+ * @brief exact length of the coded data without encoding
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ *
+ * @return length symbology_encode() would return, 0 when input is refused(empty
+ *         input included, a symbol without data is never planned)
+ */
+s32 symbology_width(s32 symbology, const s8 *input) {
+	const struct symbology *sym = NULL;
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM || input == NULL) {
+		return 0;
+	}
+	sym = &symbology_table[symbology];
+	if (sym->width != NULL) {
+		return sym->width(input);
+	}
+	//nothing left for the encoder to refuse
+	if (symbology_error_reason(sym, input) != STATS_ERR_OTHER) {
+		return 0;
+	}
+	return sym->max_len(input);
+}
+
+/**
+ * @brief whether the encoder takes input, found without encoding and without
+ * printing; a refused input is counted in runtime statistics as
+ * symbology_encode() would count it
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ *
+ * @return symbology_width(), 0 when input is refused
+ */
+s32 symbology_check(s32 symbology, const s8 *input) {
+	const struct symbology *sym = NULL;
+	s32 width;
+
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM || input == NULL) {
+		return 0;
+	}
+	sym = &symbology_table[symbology];
+	if (*input == '\0') {
+		//never planned, but some encoders draw a symbol without data
+		width = (sym->width != NULL) ? sym->width(input) : (sym->len[0] ? 0 : sym->max_len(input));
+	} else {
+		width = symbology_width(symbology, input);
+	}
+	if (width <= 0) {
+		stats_error(symbology, symbology_error_reason(sym, input));
+	}
+	return width;
+}
+
+/**
+ * @brief encode input by symbology, counted in runtime statistics
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ * @param output: coded data,format is binary array, at least symbology_max_len()
+ * @param checksum: check digit for EAN/UPC, may be NULL
+ *
+ * @return length of coded data, 0 on error
+ */
+s32 symbology_encode(s32 symbology, const s8 *input, s8 *output, s32 *checksum) {
+	const struct symbology *sym = NULL;
+	s32 barcode_len = 0;
+	s32 check = -1;
+	u64 start = 0;
+	s32 timed;
+
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return 0;
+	}
+	sym = &symbology_table[symbology];
+
+	timed = stats_sample();
+	if (timed) {
+		start = stats_now();
+	}
+	if (sym->encode_check != NULL) {
+		barcode_len = sym->encode_check(input, output, &check);
+	} else {
+		barcode_len = sym->encode(input, output);
+	}
+	if (checksum != NULL) {
+		*checksum = check;
+	}
+
+	if (barcode_len > 0) {
+		if (timed) {
+			stats_latency(symbology, stats_now() - start);
+		}
+		stats_label(symbology, barcode_len);
+	} else {
+		stats_error(symbology, symbology_error_reason(sym, input));
+	}
+	return barcode_len;
+}
+
+/**
+ * @brief encode input by symbology into packed data, counted in runtime statistics
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: input strings
+ * @param output: packed data, first module is the MSB
+ * @param output_size: size of output, at least pack_len(symbology_max_len())
+ * @param checksum: check digit for EAN/UPC, may be NULL
+ *
+ * @return length of coded data(modules), 0 on error
+ */
+s32 symbology_encode_packed(s32 symbology, const s8 *input, u8 *output, s32 output_size, s32 *checksum) {
+	const struct symbology *sym = NULL;
+	s8 *bin = NULL;
+	s32 barcode_len = 0;
+	s32 max_len = 0;
+	s32 check = -1;
+	u64 start = 0;
+	s32 timed;
+
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM || output == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return 0;
+	}
+	sym = &symbology_table[symbology];
+	max_len = sym->max_len(input);
+	if (output_size < pack_len(max_len)) {
+		printf("%s %d buffer too small\n",__func__,__LINE__);
+		stats_error(symbology, STATS_ERR_MEMORY);
+		return 0;
+	}
+
+	timed = stats_sample();
+	if (timed) {
+		start = stats_now();
+	}
+	if (sym->encode_packed != NULL) {
+		barcode_len = sym->encode_packed(input, output, &check);
+	} else {
+		bin = (s8*)malloc(max_len);
+		if (bin == NULL) {
+			printf("%s %d err\n",__func__,__LINE__);
+			stats_error(symbology, STATS_ERR_MEMORY);
+			return 0;
+		}
+		barcode_len = (sym->encode_check != NULL) ? sym->encode_check(input, bin, &check) : sym->encode(input, bin);
+		if (barcode_len > 0) {
+			pack_bits(bin, barcode_len, output, output_size);
+		}
+		free(bin);
+	}
+	if (checksum != NULL) {
+		*checksum = check;
+	}
+
+	if (barcode_len > 0) {
+		if (timed) {
+			stats_latency(symbology, stats_now() - start);
+		}
+		stats_label(symbology, barcode_len);
+	} else {
+		stats_error(symbology, symbology_error_reason(sym, input));
+	}
+	return barcode_len;
+}
+
+/**
+ * @brief encode a batch of one symbology into packed rows, counted in runtime statistics
+ *
+ * symbologies with a lane kernel encode the batch side by side, the others one by one
+ *
+ * @param symbology: SYMBOLOGY_XXX
+ * @param input: count input strings
+ * @param count: number of inputs
+ * @param output: count packed rows, stride bytes apart
+ * @param stride: bytes per row, a row that does not fit is an error
+ * @param bits: count lengths of coded data(modules), 0 on error
+ * @param checksum: count check digits, -1 when there is none
+ *
+ * @return number of inputs encoded
+ */
+s32 symbology_encode_batch(s32 symbology, const s8 *const *input, s32 count, u8 *output, s32 stride,
+		s32 *bits, s32 *checksum) {
+	const struct symbology *sym = NULL;
+	s32 encoded = 0;
+	u64 start = 0;
+	s32 timed;
+	s32 i;
+
+	if (symbology < 0 || symbology >= SYMBOLOGY_NUM || input == NULL || output == NULL ||
+			bits == NULL || checksum == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		return 0;
+	}
+	sym = &symbology_table[symbology];
+
+	if (sym->encode_batch == NULL || count <= 0 || stride < pack_len(sym->max_len(""))) {
+		for (i = 0; i < count; i++) {
+			checksum[i] = -1;
+			bits[i] = symbology_encode_packed(symbology, input[i], output + (size_t)i * stride, stride, &checksum[i]);
+			encoded += (bits[i] > 0);
+		}
+		return encoded;
+	}
+
+	//latency of a lane batch is recorded once, amortised over its labels
+	timed = stats_sample();
+	if (timed) {
+		start = stats_now();
+	}
+	sym->encode_batch(input, count, output, stride, checksum);
+	for (i = 0; i < count; i++) {
+		if (checksum[i] < 0) {
+			bits[i] = 0;
+			stats_error(symbology, symbology_error_reason(sym, input[i]));
+			continue;
+		}
+		bits[i] = sym->max_len(input[i]);
+		stats_label(symbology, bits[i]);
+		encoded++;
+	}
+	if (timed && encoded > 0) {
+		stats_latency(symbology, (stats_now() - start) / encoded);
+	}
+	return encoded;
+}
@@ -0,0 +1,44 @@
+#ifndef __SYMBOLOGY_H__
+#define __SYMBOLOGY_H__
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//symbology id, also the index of per-symbology counters
+enum {
+	SYMBOLOGY_CODE128 = 0,
+	SYMBOLOGY_CODE39,
+	SYMBOLOGY_CODE93,
+	SYMBOLOGY_CODE11,
+	SYMBOLOGY_CODABAR,
+	SYMBOLOGY_MSI,
+	SYMBOLOGY_I25,
+	SYMBOLOGY_EAN8,
+	SYMBOLOGY_EAN13,
+	SYMBOLOGY_UPCA,
+	SYMBOLOGY_UPCE,
+	SYMBOLOGY_GS1128,	//GS1 element string "(AI)data..." as code128
+	SYMBOLOGY_NUM
+};
+
+s32 symbology_lookup(const s8 *name);
+const s8 *symbology_name(s32 symbology);
+s32 symbology_has_checksum(s32 symbology);
+s32 symbology_quiet(s32 symbology);
+s32 symbology_max_len(s32 symbology, const s8 *input);
+s32 symbology_width(s32 symbology, const s8 *input);
+s32 symbology_check(s32 symbology, const s8 *input);
+s32 symbology_encode(s32 symbology, const s8 *input, s8 *output, s32 *checksum);
+s32 symbology_encode_packed(s32 symbology, const s8 *input, u8 *output, s32 output_size, s32 *checksum);
+s32 symbology_encode_batch(s32 symbology, const s8 *const *input, s32 count, u8 *output, s32 stride,
+		s32 *bits, s32 *checksum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
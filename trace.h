@@ -0,0 +1,51 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "platform.h"
+
+//trace points of the encoders, selected at build time:
+//  default      - no code at all
+//  TRACE_USDT   - USDT probes (provider "barcode") for bpftrace/systemtap,
+//                 a nop per probe when nobody is attached
+//  TRACE_PRINTF - print to stderr, replaces the old "#define DEBUG"
+//
+//  bpftrace -e 'usdt:./barcode:barcode:code_set { printf("%d->%d\n", arg0, arg1); }'
+//
+//probes:
+//  symbol_start(const char *symbology, const char *input)
+//  symbol(const char *symbology, int index, int pattern)
+//  code_set(int prev, int next, int index)   prev 0 is the start code
+//  checksum(const char *symbology, int value)
+//  error(const char *func, int line)
+
+#if defined(TRACE_USDT)
+
+#include <sys/sdt.h>
+
+#define TRACE_SYMBOL_START(sym, input)	DTRACE_PROBE2(barcode, symbol_start, sym, input)
+#define TRACE_SYMBOL(sym, index, pattern)	DTRACE_PROBE3(barcode, symbol, sym, index, pattern)
+#define TRACE_CODE_SET(prev, next, index)	DTRACE_PROBE3(barcode, code_set, prev, next, index)
+#define TRACE_CHECKSUM(sym, value)		DTRACE_PROBE2(barcode, checksum, sym, value)
+#define TRACE_ERROR()					DTRACE_PROBE2(barcode, error, __func__, __LINE__)
+
+#elif defined(TRACE_PRINTF)
+
+#include <stdio.h>
+
+#define TRACE_SYMBOL_START(sym, input)	fprintf(stderr, "%s start:%s\n", (sym), (input))
+#define TRACE_SYMBOL(sym, index, pattern)	fprintf(stderr, "%s index:%d pattern:%x\n", (sym), (index), (pattern))
+#define TRACE_CODE_SET(prev, next, index)	fprintf(stderr, "code set %d to %d idx:%d\n", (prev), (next), (index))
+#define TRACE_CHECKSUM(sym, value)		fprintf(stderr, "%s check:%d\n", (sym), (value))
+#define TRACE_ERROR()					fprintf(stderr, "%s %d trace err\n", __func__, __LINE__)
+
+#else
+
+#define TRACE_SYMBOL_START(sym, input)	do {} while (0)
+#define TRACE_SYMBOL(sym, index, pattern)	do {} while (0)
+#define TRACE_CODE_SET(prev, next, index)	do {} while (0)
+#define TRACE_CHECKSUM(sym, value)		do {} while (0)
+#define TRACE_ERROR()					do {} while (0)
+
+#endif
+
+#endif
@@ -11,22 +11,12 @@
 #include <string.h>
 
 #include "upca.h"
+#include "trace.h"
+#include "check.h"
+#include "kernel.h"
 
 //https://en.wikipedia.org/wiki/Universal_Product_Code
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-#define UPCA_APPEND_BLANK
-
-//add left/right blank to display human readable string(first digit, check digit)
-#ifdef UPCA_APPEND_BLANK
-#define UPCA_BLANK_LEN				8
-#endif
-
-
 #define UPCA_INPUT_LEN				11
 #define UPCA_PATTERN_LEN			7
 //start/stop
@@ -81,21 +71,14 @@ static s32 upca_append_marker(s32 index, s8 *out) {
 	s32 marker = upca_marker_pattern[index];
 	s32 marker_len = index ? UPCA_CENTER_PATTERN_LEN : UPCA_MARKER_PATTERN_LEN;
 	for (i = marker_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(marker & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (marker & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return marker_len;
 }
 
 static s32 upca_append_data(const s8 *input, s8 *out, s32 *checksum) {
 	s32 i,j;
 	s32 sum = 0;
-	s32 weight = 0;
 	s32 index = 0;
 	s32 append_len = 0;
 	s32 total_len = 0;
@@ -105,30 +88,18 @@ static s32 upca_append_data(const s8 *input, s8 *out, s32 *checksum) {
 		index = *(input+i) - '0';
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto err;
 		}
-#ifdef DEBUG
-		printf("%c index:%d->", *(input+i), index);
-#endif
-		weight = ((i%2) == 0) ? 3 : 1;
-		sum += index * weight;
 		pattern = upca_left_pattern[index];
+		TRACE_SYMBOL("upca", index, pattern);
 		for (j = UPCA_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-			printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 			*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 		}
 		total_len += UPCA_PATTERN_LEN;
-#ifdef DEBUG
-		printf("\n");
-#endif
 	}
 
 	//append center marker
-#ifdef DEBUG
-	printf("center->");
-#endif
 	append_len = upca_append_marker(UPCA_CENTER_MARKER_INDEX, out);
 	total_len += append_len;
 	out += append_len;
@@ -138,41 +109,25 @@ static s32 upca_append_data(const s8 *input, s8 *out, s32 *checksum) {
 		index = *(input+i) - '0';
 		if (index < 0 || index > 9) {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto err;
 		}
-#ifdef DEBUG
-		printf("%c index:%d->", *(input+i), index);
-#endif
 		pattern = upca_right_pattern[index];
-		weight = ((i%2) == 0) ? 3 : 1;
-		sum += index * weight;
+		TRACE_SYMBOL("upca", index, pattern);
 		for (j = UPCA_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-			printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 			*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 		}
-#ifdef DEBUG
-		printf("\n");
-#endif
 		total_len += UPCA_PATTERN_LEN;
 	}
 	//append checksum(modulo 10)
-	sum = (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
+	sum = check_mod10(input, UPCA_INPUT_LEN);
 	*checksum = sum;
-#ifdef DEBUG
-	printf("check:%d->",sum);
-#endif
+	TRACE_CHECKSUM("upca", sum);
 	pattern = upca_right_pattern[sum];
+	TRACE_SYMBOL("upca", sum, pattern);
 	for (j = UPCA_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-		printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 		*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	total_len += UPCA_PATTERN_LEN;
 
 	return total_len;
@@ -200,11 +155,14 @@ s32 upca_encode(const s8 *input, s8 *output, s32 *checksum) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("upca", input);
 	if (input_len != UPCA_INPUT_LEN) {
 		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 
@@ -215,9 +173,6 @@ s32 upca_encode(const s8 *input, s8 *output, s32 *checksum) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("start->");
-#endif
 	//append start code
 	append_len = upca_append_marker(UPCA_MARKER_INDEX, output);
 	output += append_len;
@@ -227,14 +182,12 @@ s32 upca_encode(const s8 *input, s8 *output, s32 *checksum) {
 	append_len = upca_append_data(input, output, checksum);
 	if (append_len < 0) {
 		printf("%s %d end\n",__func__,__LINE__);
+		barcode_len = 0;
 		goto end;
 	}
 	output += append_len;
 	barcode_len += append_len;
 
-#ifdef DEBUG
-	printf("stop->");
-#endif
 	//append stop code
 	append_len = upca_append_marker(UPCA_MARKER_INDEX, output);
 	output += append_len;
@@ -250,3 +203,62 @@ s32 upca_encode(const s8 *input, s8 *output, s32 *checksum) {
 end:
 	return barcode_len;
 }
+
+#ifdef UPCA_APPEND_BLANK
+#define UPCA_ROW_BLANK_LEN		UPCA_BLANK_LEN
+#else
+#define UPCA_ROW_BLANK_LEN		0
+#endif
+//row = blank + start + 6 left + center | 6 right + stop + blank
+#define UPCA_ROW_LEFT_LEN		(UPCA_ROW_BLANK_LEN + UPCA_MARKER_PATTERN_LEN + 6 * UPCA_PATTERN_LEN + UPCA_CENTER_PATTERN_LEN)
+#define UPCA_ROW_RIGHT_LEN		(6 * UPCA_PATTERN_LEN + UPCA_MARKER_PATTERN_LEN + UPCA_ROW_BLANK_LEN)
+
+/**
+ * @brief encode input by upca straight into a packed row
+ *
+ * @param input: 11 digits
+ * @param output: packed data, first module is the MSB, at least (upca_max_len() + 7) / 8 bytes
+ * @param checksum: check digit
+ *
+ * @return length of coded data(modules), 0 on error
+ */
+s32 upca_encode_packed(const s8 *input, u8 *output, s32 *checksum) {
+	u8 digits[16];
+	u64 left, right;
+	s32 check;
+
+	if (input == NULL || output == NULL || checksum == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	if (strlen(input) != UPCA_INPUT_LEN || kernel_load_digits(input, UPCA_INPUT_LEN, digits) < 0) {
+		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	TRACE_SYMBOL_START("upca", input);
+	check = kernel_mod10(digits, 0);
+	*checksum = check;
+	TRACE_CHECKSUM("upca", check);
+
+	left = upca_marker_pattern[UPCA_MARKER_INDEX];
+	left = (left << UPCA_PATTERN_LEN) | upca_left_pattern[digits[0]];
+	left = (left << UPCA_PATTERN_LEN) | upca_left_pattern[digits[1]];
+	left = (left << UPCA_PATTERN_LEN) | upca_left_pattern[digits[2]];
+	left = (left << UPCA_PATTERN_LEN) | upca_left_pattern[digits[3]];
+	left = (left << UPCA_PATTERN_LEN) | upca_left_pattern[digits[4]];
+	left = (left << UPCA_PATTERN_LEN) | upca_left_pattern[digits[5]];
+	left = (left << UPCA_CENTER_PATTERN_LEN) | upca_marker_pattern[UPCA_CENTER_MARKER_INDEX];
+
+	right = upca_right_pattern[digits[6]];
+	right = (right << UPCA_PATTERN_LEN) | upca_right_pattern[digits[7]];
+	right = (right << UPCA_PATTERN_LEN) | upca_right_pattern[digits[8]];
+	right = (right << UPCA_PATTERN_LEN) | upca_right_pattern[digits[9]];
+	right = (right << UPCA_PATTERN_LEN) | upca_right_pattern[digits[10]];
+	right = (right << UPCA_PATTERN_LEN) | upca_right_pattern[check];
+	right = (right << UPCA_MARKER_PATTERN_LEN) | upca_marker_pattern[UPCA_MARKER_INDEX];
+	right <<= UPCA_ROW_BLANK_LEN;
+
+	return kernel_store_row(output, left, UPCA_ROW_LEFT_LEN, right, UPCA_ROW_RIGHT_LEN);
+}
@@ -4,12 +4,28 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+#define UPCA_APPEND_BLANK
+
+//add left/right blank to display human readable string(first digit, check digit)
+#ifdef UPCA_APPEND_BLANK
+#define UPCA_BLANK_LEN				8
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef UPCA_APPEND_BLANK
+#define UPCA_QUIET_LEN		(UPCA_BLANK_LEN << 1)
+#else
+#define UPCA_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 upca_max_len(const s8 *input);
 s32 upca_encode(const s8 *input, s8 *output, s32 *checksum);
+s32 upca_encode_packed(const s8 *input, u8 *output, s32 *checksum);
 
 #ifdef __cplusplus
 }
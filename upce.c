@@ -11,22 +11,13 @@
 #include <string.h>
 
 #include "upce.h"
+#include "trace.h"
+#include "check.h"
+#include "kernel.h"
+#include "gtin.h"
 
 //https://en.wikipedia.org/wiki/International_Article_Number
 
-#if 0
-#define DEBUG
-#endif
-
-//add left/right blank for barcode
-#define UPCE_APPEND_BLANK
-
-//add left blank to display human readable string(first digit)
-#ifdef UPCE_APPEND_BLANK
-#define UPCE_BLANK_LEN				8
-#endif
-
-
 #define UPCA_INPUT_LEN				11
 #define UPCE_INPUT_LEN				6
 #define UPCE_PATTERN_LEN			7
@@ -111,14 +102,8 @@ static s32 upce_append_marker(s32 index, s8 *out) {
 	s32 marker = upce_marker_pattern[index];
 	s32 marker_len = index ? UPCE_STOP_PATTERN_LEN : UPCE_START_PATTERN_LEN;
 	for (i = marker_len; i > 0; i--) {
-#ifdef DEBUG
-		printf("%d",(marker & (1 << (i-1))) ? 1 : 0);
-#endif
 		*out++ = (marker & (1 << (i-1))) ? 1 : 0;
 	}
-#ifdef DEBUG
-	printf("\n");
-#endif
 	return marker_len;
 }
 
@@ -129,220 +114,38 @@ static s32 upce_append_data(s8 start_code, const s8 *input, s8 *out, const s32 c
 	s32 pattern;
 
 	s32 parity = (start_code == '0') ? upce_system_0_parity_table[checksum] : upce_system_1_parity_table[checksum];
-#ifdef DEBUG
-	printf("parity:");
-	for (j = UPCE_INPUT_LEN; j > 0; j--) {
-		printf("%c",(parity & (1 << (j-1))) ? 'O' : 'E');
-	}
-	printf("\n");
-#endif
 
 	for(i=0; i<UPCE_INPUT_LEN; i++) {
 		index = *(input + i) - '0';
 		pattern = (parity & (1 << (UPCE_INPUT_LEN-i-1))) ? upce_left_odd_pattern[index] : upce_left_even_pattern[index];
-#ifdef DEBUG
-		printf("%d->", index);
-#endif
+		TRACE_SYMBOL("upce", index, pattern);
 		for (j = UPCE_PATTERN_LEN; j > 0; j--) {
-#ifdef DEBUG
-			printf("%d",(pattern & (1 << (j-1))) ? 1 : 0);
-#endif
 			*out++ = (pattern & (1 << (j-1))) ? 1 : 0;
 		}
-#ifdef DEBUG
-		printf("\n");
-#endif
 	}
 	return UPCE_INPUT_LEN * UPCE_PATTERN_LEN;
 }
 
-//convert UPC-A 11 digits to UPC-E 6 digits
-static s32 upce_convert_from_upca(const s8 *from, s8 *to) {
-	s32 i;
-	s8 ends[3] = {0};
-	s8 product_code[5] = {0};
-	//get last three digits
-	for(i=5; i>2; i--) {
-		ends[i-3] = *(from + i);
-	}
-	//get product code
-	for(i=6; i>11; i++) {
-		product_code[i] = *(from + i);
-	}
-	//refer to:http://www.barcodeisland.com/upce.phtml#Conversion
-	if (ends[2] == '0' && ends[1] == '0' && ends[0] < '3') {
-		//check product code
-		if (atoi(product_code) > 999) {
-			printf("%s %d err:can't converted to UPC-E\n",__func__,__LINE__);
-			goto err;
-		}
-		//take first 2 digits
-		*to++ = *(from + 1);
-		*to++ = *(from + 2);
-		//take latest 3 digits
-		*to++ = *(from + 8);
-		*to++ = *(from + 9);
-		*to++ = *(from + 10);
-		//take end
-		*to = ends[0];
-	} else if (ends[2] == '0' && ends[1] == '0' && ends[0] > '2') {
-		//check product code
-		if (atoi(product_code) > 99) {
-			printf("%s %d err:can't converted to UPC-E\n",__func__,__LINE__);
-			goto err;
-		}
-		//take first 3 digits
-		*to++ = *(from + 1);
-		*to++ = *(from + 2);
-		*to++ = *(from + 3);
-		//take latest 2 digits
-		*to++ = *(from + 9);
-		*to++ = *(from + 10);
-		//end is '3'
-		*to = '3';
-	} else if (ends[2] == '0') {
-		//check product code
-		if (atoi(product_code) > 9) {
-			printf("%s %d err:can't converted to UPC-E\n",__func__,__LINE__);
-			goto err;
-		}
-		//take first 4 digits
-		for(i=1; i<5; i++) {
-			*to++ = *(from + i);
-		}
-		//take end digits
-		*to++ = *(from + 10);
-		//end is '4'
-		*to = '4';
-	} else {
-		//check product code
-		if (atoi(product_code) > 9 || atoi(product_code) < 5) {
-			printf("%s %d err:can't converted to UPC-E\n",__func__,__LINE__);
-			goto err;
-		}
-		//take manufacturer code
-		for(i=1; i<6; i++) {
-			*to++ = *(from + i);
-		}
-		//take end digits
-		*to++ = *(from + 10);
-	}
-
-	return 0;
-err:
-	return -1;
-}
-
-//convert UPC-E 6 digits to UPC-A 11 digits
-static s32 upce_convert_to_upca(const s8 *from, s8 *to) {
-	s8 end = *(from + UPCE_INPUT_LEN - 1);
-	s32 i;
-
-	//always start with '0'
-	*to++ = '0';
-
-	switch(end) {
-		case '0':
-		case '1':
-		case '2':
-			//take first 2 digits
-			*to++ = *from;
-			*to++ = *(from + 1);
-			//take the last ditit
-			*to++ = end;
-			//take four 0 digits
-			for(i=0; i<4; i++) {
-				*to++ = '0';
-			}
-			//take 3 through 5
-			for(i=2; i<5; i++) {
-				*to++ = *(from + i);
-			}
-			break;
-
-		case '3':
-			//take first 3 digits
-			for(i=0; i<3; i++) {
-				*to++ = *(from + i);
-			}
-			//take five 0 digits
-			for(i=0; i<5; i++) {
-				*to++ = '0';
-			}
-			//take 4 through 5
-			*to++ = *(from + 3);
-			*to++ = *(from + 4);
-			break;
-
-		case '4':
-			//take first 4 digits
-			for(i=0; i<4; i++) {
-				*to++ = *(from + i);
-			}
-			//take five 0 digits
-			for(i=0; i<5; i++) {
-				*to++ = '0';
-			}
-			//take 5th digit
-			*to++ = *(from + 4);
-			break;
-
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			//take first 5 digits
-			for(i=0; i<5; i++) {
-				*to++ = *(from + i);
-			}
-			//take four 0 digits
-			for(i=0; i<4; i++) {
-				*to++ = '0';
-			}
-			//take last digit
-			*to = end;
-			break;
-	}
-	return 0;
-}
-
 static s32 upce_checksum(const s8 *input, s32 len) {
-	s32 i;
 	s32 sum = 0;
-	s32 weight = 0;
-	s32 index = 0;
 	s8 str[UPCA_INPUT_LEN] = {0};
 
 	if (len == UPCE_INPUT_LEN) {
 		//convert UPC-E to UPC-A 11 digits then compute checksum
-		upce_convert_to_upca(input, str);
-	} else {
-		memcpy(str, input, len);
-	}
-	for(i=0; i<UPCA_INPUT_LEN; i++) {
-		index = str[i] - '0';
-		if (index < 0 || index > 9) {
+		if (gtin_upce_to_upca(input, '0', str) < 0) {
 			printf("%s %d input err\n",__func__,__LINE__);
-			goto err;
+			TRACE_ERROR();
+			return -1;
 		}
-		weight = ((i%2) == 0) ? 3 : 1;
-		sum += index * weight;
+	} else {
+		memcpy(str, input, len);
 	}
-	sum = (sum % 10 != 0) ? (10 - (sum % 10)) : 0;
-#ifdef DEBUG
-	if (len == UPCE_INPUT_LEN) {
-		printf("UPCE->UPCA: ");
-		for(i=0;i<UPCA_INPUT_LEN;i++) {
-			printf("%c",str[i]);
-		}
-		printf("%d",sum);
-		printf("\n");
+	sum = check_mod10(str, UPCA_INPUT_LEN);
+	if (sum < 0) {
+		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
 	}
-#endif
 	return sum;
-err:
-	return -1;
 }
 
 //len = start + data + stop
@@ -357,6 +160,25 @@ s32 upce_max_len(const s8 *input) {
 	return len;
 }
 
+//length of the coded data, 0 when input has no UPC-E form
+s32 upce_width(const s8 *input) {
+	s8 str[UPCE_INPUT_LEN];
+	s8 upca[UPCA_INPUT_LEN];
+	s32 input_len;
+	if (input == NULL) {
+		return 0;
+	}
+	input_len = strlen(input);
+	if (input_len == UPCA_INPUT_LEN) {
+		if (gtin_upca_to_upce(input, str) < 0) {
+			return 0;
+		}
+	} else if (input_len != UPCE_INPUT_LEN || gtin_upce_to_upca(input, '0', upca) < 0) {
+		return 0;
+	}
+	return upce_max_len(input);
+}
+
 //input: 11 digits(must start with 0 or 1 to be converted UPC-E), 6 digits
 s32 upce_encode(const s8 *input, s8 *output, s32 *checksum) {
 	s32 barcode_len = 0;
@@ -367,41 +189,33 @@ s32 upce_encode(const s8 *input, s8 *output, s32 *checksum) {
 
 	if (input == NULL || output == NULL) {
 		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	input_len = strlen(input);
+	TRACE_SYMBOL_START("upce", input);
 	if (input_len != UPCE_INPUT_LEN && input_len != UPCA_INPUT_LEN) {
 		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
 		goto end;
 	}
 	if (input_len == UPCA_INPUT_LEN) {
 		//check start for upc-a
 		if (*input != '0' && *input != '1') {
 			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto end;
 		}
 		//convert upc-a to upc-e
-		if (upce_convert_from_upca(input, str) < 0) {
-			printf("%s %d input err\n",__func__,__LINE__);
+		if (gtin_upca_to_upce(input, str) < 0) {
+			printf("%s %d err:can't converted to UPC-E\n",__func__,__LINE__);
+			TRACE_ERROR();
 			goto end;
 		}
 		start_code = *input;
-#ifdef DEBUG
-		printf("UPCA->UPCE:");
-#endif
 	} else {
-#ifdef DEBUG
-		printf("UPCE:");
-#endif
 		memcpy(str, input, UPCE_INPUT_LEN);
 	}
-#ifdef DEBUG
-	int i;
-	for(i=0;i<UPCE_INPUT_LEN;i++) {
-		printf("%c",str[i]);
-	}
-	printf("\n");
-#endif
 #ifdef UPCE_APPEND_BLANK
 	//append left blank
 	append_len = upce_append_blank(output);
@@ -409,9 +223,6 @@ s32 upce_encode(const s8 *input, s8 *output, s32 *checksum) {
 	barcode_len += append_len;
 #endif
 
-#ifdef DEBUG
-	printf("start->");
-#endif
 	//append start code
 	append_len = upce_append_marker(UPCE_START_INDEX, output);
 	output += append_len;
@@ -419,6 +230,11 @@ s32 upce_encode(const s8 *input, s8 *output, s32 *checksum) {
 
 	//compute check digit by input string
 	*checksum = upce_checksum(input, input_len);
+	TRACE_CHECKSUM("upce", *checksum);
+	if (*checksum < 0) {
+		barcode_len = 0;
+		goto end;
+	}
 
 	//append data code and checksum
 	append_len = upce_append_data(start_code, str, output, *checksum);
@@ -429,9 +245,6 @@ s32 upce_encode(const s8 *input, s8 *output, s32 *checksum) {
 	output += append_len;
 	barcode_len += append_len;
 
-#ifdef DEBUG
-	printf("stop->");
-#endif
 	//append stop code
 	append_len = upce_append_marker(UPCE_STOP_INDEX, output);
 	output += append_len;
@@ -447,3 +260,81 @@ s32 upce_encode(const s8 *input, s8 *output, s32 *checksum) {
 end:
 	return barcode_len;
 }
+
+#ifdef UPCE_APPEND_BLANK
+#define UPCE_ROW_BLANK_LEN		UPCE_BLANK_LEN
+#else
+#define UPCE_ROW_BLANK_LEN		0
+#endif
+//row = blank + start + 6 digits | stop + blank
+#define UPCE_ROW_LEFT_LEN		(UPCE_ROW_BLANK_LEN + UPCE_START_PATTERN_LEN + UPCE_INPUT_LEN * UPCE_PATTERN_LEN)
+#define UPCE_ROW_RIGHT_LEN		(UPCE_STOP_PATTERN_LEN + UPCE_ROW_BLANK_LEN)
+
+//[parity][digit], parity 1:odd 0:even
+static const s32 *const upce_left_pattern[] = {
+	upce_left_even_pattern,
+	upce_left_odd_pattern
+};
+
+#define UPCE_LEFT(parity, bit, digit) \
+	upce_left_pattern[((parity) >> (bit)) & 1][(digit) - '0']
+
+/**
+ * @brief encode input by upce straight into a packed row
+ *
+ * @param input: 11 digits(must start with 0 or 1 to be converted UPC-E), 6 digits
+ * @param output: packed data, first module is the MSB, at least (upce_max_len() + 7) / 8 bytes
+ * @param checksum: check digit
+ *
+ * @return length of coded data(modules), 0 on error
+ */
+s32 upce_encode_packed(const s8 *input, u8 *output, s32 *checksum) {
+	s8 upca[UPCA_INPUT_LEN] = {0};
+	s8 str[UPCE_INPUT_LEN] = {0};
+	u8 digits[16] = {0};
+	u64 left, right;
+	s32 input_len, parity, check;
+	s8 start_code = '0';
+
+	if (input == NULL || output == NULL || checksum == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	input_len = strlen(input);
+	if (input_len == UPCA_INPUT_LEN) {
+		if ((*input != '0' && *input != '1') || kernel_load_digits(input, UPCA_INPUT_LEN, digits) < 0 ||
+				gtin_upca_to_upce(input, str) < 0) {
+			printf("%s %d input err\n",__func__,__LINE__);
+			TRACE_ERROR();
+			return 0;
+		}
+		start_code = *input;
+	} else if (input_len == UPCE_INPUT_LEN && gtin_upce_to_upca(input, '0', upca) == 0) {
+		memcpy(str, input, UPCE_INPUT_LEN);
+		kernel_load_digits(upca, UPCA_INPUT_LEN, digits);
+	} else {
+		printf("%s %d input err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return 0;
+	}
+	TRACE_SYMBOL_START("upce", input);
+	//check digit of the UPC-A form selects the parity
+	check = kernel_mod10(digits, 0);
+	*checksum = check;
+	TRACE_CHECKSUM("upce", check);
+	parity = (start_code == '0') ? upce_system_0_parity_table[check] : upce_system_1_parity_table[check];
+
+	left = upce_marker_pattern[UPCE_START_INDEX];
+	left = (left << UPCE_PATTERN_LEN) | UPCE_LEFT(parity, 5, str[0]);
+	left = (left << UPCE_PATTERN_LEN) | UPCE_LEFT(parity, 4, str[1]);
+	left = (left << UPCE_PATTERN_LEN) | UPCE_LEFT(parity, 3, str[2]);
+	left = (left << UPCE_PATTERN_LEN) | UPCE_LEFT(parity, 2, str[3]);
+	left = (left << UPCE_PATTERN_LEN) | UPCE_LEFT(parity, 1, str[4]);
+	left = (left << UPCE_PATTERN_LEN) | UPCE_LEFT(parity, 0, str[5]);
+
+	right = upce_marker_pattern[UPCE_STOP_INDEX];
+	right <<= UPCE_ROW_BLANK_LEN;
+
+	return kernel_store_row(output, left, UPCE_ROW_LEFT_LEN, right, UPCE_ROW_RIGHT_LEN);
+}
@@ -4,12 +4,29 @@
 #include <stddef.h>
 #include "platform.h"
 
+//add left/right blank for barcode
+#define UPCE_APPEND_BLANK
+
+//add left blank to display human readable string(first digit)
+#ifdef UPCE_APPEND_BLANK
+#define UPCE_BLANK_LEN				8
+#endif
+
+//blank modules around the coded data, both sides
+#ifdef UPCE_APPEND_BLANK
+#define UPCE_QUIET_LEN		(UPCE_BLANK_LEN << 1)
+#else
+#define UPCE_QUIET_LEN		0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 s32 upce_max_len(const s8 *input);
+s32 upce_width(const s8 *input);
 s32 upce_encode(const s8 *input, s8 *output, s32 *checksum);
+s32 upce_encode_packed(const s8 *input, u8 *output, s32 *checksum);
 
 #ifdef __cplusplus
 }
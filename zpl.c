@@ -0,0 +1,194 @@
+/**
+ * @file zpl.c
+ * @brief ZPL ^GFA graphic fields with the alternative compression scheme(ACS)
+ * @author Hansen.Z(hansen@pay-device.com)
+ * @version 1.0
+ * @date 2016-09-03
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pack.h"
+#include "trace.h"
+#include "zpl.h"
+
+//ACS: a hex digit may follow a repeat count, G-Y count 1-19 and g-z count
+//20-400; ',' ends a row with 0s, '!' ends a row with 1s, ':' repeats the
+//previous row
+#define ZPL_COUNT_UNIT		20
+#define ZPL_COUNT_MAX		400
+#define ZPL_FILL_ZERO		','
+#define ZPL_FILL_ONE		'!'
+#define ZPL_REPEAT_ROW		':'
+
+//"^FO" and "^GFA" parameters at most
+#define ZPL_HEADER_LEN		64
+
+static const s8 zpl_hex_digits[] = "0123456789ABCDEF";
+
+static inline s32 zpl_nibble(const u8 *row, s32 i) {
+	return (i & 1) ? (row[i >> 1] & 0xF) : (row[i >> 1] >> 4);
+}
+
+//repeat count letters of n, returns their length
+static s32 zpl_put_count(s32 n, s8 *out) {
+	s32 len = 0;
+	while (n >= ZPL_COUNT_MAX) {
+		out[len++] = 'z';
+		n -= ZPL_COUNT_MAX;
+	}
+	if (n >= ZPL_COUNT_UNIT) {
+		out[len++] = 'g' + n / ZPL_COUNT_UNIT - 1;
+		n %= ZPL_COUNT_UNIT;
+	}
+	if (n > 0) {
+		out[len++] = 'G' + n - 1;
+	}
+	return len;
+}
+
+//one row of nibbles, runs whose count is shorter than the run are counted
+static s32 zpl_compress_row(const u8 *row, s32 nibbles, s8 *out) {
+	s8 count[8];
+	s32 len = 0;
+	s32 end = nibbles;
+	s32 i, run, n, v;
+	s8 fill = 0;
+
+	//a tail of 0s or 1s is one character
+	v = zpl_nibble(row, nibbles - 1);
+	if (v == 0 || v == 0xF) {
+		while (end > 0 && zpl_nibble(row, end - 1) == v) {
+			end--;
+		}
+		if (nibbles - end > 1) {
+			fill = (v == 0) ? ZPL_FILL_ZERO : ZPL_FILL_ONE;
+		} else {
+			end = nibbles;
+		}
+	}
+	for (i = 0; i < end; i += run) {
+		v = zpl_nibble(row, i);
+		for (run = 1; i + run < end && zpl_nibble(row, i + run) == v; run++);
+		n = zpl_put_count(run, count);
+		if (n + 1 < run) {
+			memcpy(out + len, count, n);
+			len += n;
+			out[len++] = zpl_hex_digits[v];
+		} else {
+			memset(out + len, zpl_hex_digits[v], run);
+			len += run;
+		}
+	}
+	if (fill) {
+		out[len++] = fill;
+	}
+	return len;
+}
+
+//ACS data of rows at most, never more than plain hex
+s32 zpl_compress_len(s32 bytes_per_row, s32 rows) {
+	if (bytes_per_row <= 0 || rows <= 0) {
+		return 0;
+	}
+	return bytes_per_row * rows * 2 + 1;
+}
+
+/**
+ * @brief compress packed rows to ^GFA/~DG data
+ *
+ * @param bitmap: packed rows, first dot is the MSB
+ * @param bytes_per_row: bytes of a row sent to the printer
+ * @param rows: number of rows
+ * @param stride: bytes between rows, 0 repeats one row(a picket fence symbol)
+ * @param out: ACS data, '\0' terminated
+ * @param out_size: size of out, at least zpl_compress_len()
+ *
+ * @return length of out, -1 on error
+ */
+s32 zpl_compress(const u8 *bitmap, s32 bytes_per_row, s32 rows, s32 stride, s8 *out, s32 out_size) {
+	const u8 *row = bitmap;
+	const u8 *prev = NULL;
+	s32 len = 0;
+	s32 r;
+
+	if (bitmap == NULL || out == NULL || bytes_per_row <= 0 || rows <= 0 || stride < 0 ||
+			(stride > 0 && stride < bytes_per_row) || out_size < zpl_compress_len(bytes_per_row, rows)) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	for (r = 0; r < rows; r++, row += stride) {
+		if (prev != NULL && (prev == row || memcmp(prev, row, bytes_per_row) == 0)) {
+			out[len++] = ZPL_REPEAT_ROW;
+		} else {
+			len += zpl_compress_row(row, bytes_per_row << 1, out + len);
+		}
+		prev = row;
+	}
+	out[len] = '\0';
+	return len;
+}
+
+/**
+ * @brief write a graphic field: ^FOx,y^GFA,total,total,bytes_per_row,data^FS
+ *
+ * @param bitmap: packed rows, first dot is the MSB
+ * @param width: dots per row
+ * @param rows: number of rows
+ * @param stride: bytes between rows, 0 repeats one row, such as the packed
+ *		output of symbology_encode_packed() for a symbol rows high
+ * @param x: field origin
+ * @param y: field origin
+ *
+ * @return bytes written, -1 on error
+ */
+s32 zpl_write_graphic(const u8 *bitmap, s32 width, s32 rows, s32 stride, s32 x, s32 y, FILE *fp) {
+	s8 *text = NULL;
+	s32 bytes = pack_len(width);
+	s32 size = zpl_compress_len(bytes, rows) + ZPL_HEADER_LEN;
+	s32 len, data;
+
+	if (bitmap == NULL || fp == NULL || bytes <= 0 || rows <= 0) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	text = (s8*)malloc(size);
+	if (text == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	len = snprintf(text, ZPL_HEADER_LEN, "^FO%d,%d^GFA,%d,%d,%d,", x, y, bytes * rows, bytes * rows, bytes);
+	data = zpl_compress(bitmap, bytes, rows, stride, text + len, size - len);
+	if (data < 0) {
+		free(text);
+		return -1;
+	}
+	len += data;
+	memcpy(text + len, "^FS", 3);
+	len += 3;
+	if (fwrite(text, 1, len, fp) != (size_t)len) {
+		printf("%s %d write err\n",__func__,__LINE__);
+		len = -1;
+	}
+	free(text);
+	return len;
+}
+
+//a whole composed label as one format: ^XA graphic ^XZ
+s32 zpl_write_label(const struct label *label, FILE *fp) {
+	s32 len;
+	if (label == NULL || label->bits == NULL || fp == NULL) {
+		printf("%s %d err\n",__func__,__LINE__);
+		TRACE_ERROR();
+		return -1;
+	}
+	fputs("^XA", fp);
+	len = zpl_write_graphic(label->bits, label->width, label->height, label->stride, 0, 0, fp);
+	fputs("^XZ\n", fp);
+	return (len < 0) ? -1 : len + 7;
+}
@@ -0,0 +1,22 @@
+#ifndef __ZPL_H__
+#define __ZPL_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+#include "label.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+s32 zpl_compress_len(s32 bytes_per_row, s32 rows);
+s32 zpl_compress(const u8 *bitmap, s32 bytes_per_row, s32 rows, s32 stride, s8 *out, s32 out_size);
+s32 zpl_write_graphic(const u8 *bitmap, s32 width, s32 rows, s32 stride, s32 x, s32 y, FILE *fp);
+s32 zpl_write_label(const struct label *label, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif